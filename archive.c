@@ -0,0 +1,534 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 Eddie Hillenbrand
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+/* FON files inside zip archives and gzip files. Opening an archive
+ * maps it and reads the zip's central directory, or the gzip header,
+ * into a list of entries; nothing is decompressed until an entry's
+ * font is asked for. Stored entries are parsed where they lie in the
+ * mapping, deflated ones are inflated into a buffer the font takes.
+ * Deflate needs zlib, found with pkg-config at build time. Without it
+ * deflated entries fail to load with WinFont_ErrArchive. */
+
+#include <winfont.h>
+#include "winfont_private.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#ifdef WINFONT_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#define MAX_THREADS 64
+#define MAX_ENTRY   (64 << 20)  /* largest entry inflated */
+
+#define ZIP_LOCAL   0x04034b50
+#define ZIP_CENTRAL 0x02014b50
+#define ZIP_END     0x06054b50
+
+#define METHOD_STORED   0
+#define METHOD_DEFLATE  8
+
+enum {
+    ENTRY_NEW,
+    ENTRY_LOADING,
+    ENTRY_DONE,
+};
+
+struct entry {
+    char *name;
+    size_t off;                 /* of the entry's data in the archive */
+    size_t csize, usize;
+    uint32_t crc;
+    int method;                 /* -1 if encrypted */
+    int state;
+    WinFont *font;
+    WinFont_Error err;
+};
+
+struct WinFontArchive {
+    const uint8_t *base;
+    size_t len;
+    void *map;
+    size_t maplen;
+    int flags;
+    struct entry *entries;
+    int nentries;
+    pthread_mutex_t lock;
+    pthread_cond_t loaded;
+};
+
+static unsigned
+get16(const uint8_t *p)
+{
+    return p[0] | p[1] << 8;
+}
+
+static uint32_t
+get32(const uint8_t *p)
+{
+    return get16(p) | (uint32_t)get16(p + 2) << 16;
+}
+
+static int
+is_fon(const uint8_t *name, size_t n)
+{
+    return n > 4 &&
+        strncasecmp((const char *)name + n - 4, ".fon", 4) == 0;
+}
+
+static struct entry *
+add_entry(WinFontArchive *ar, const void *name, size_t namelen)
+{
+    struct entry *e = &ar->entries[ar->nentries];
+
+    memset(e, 0, sizeof(*e));
+    e->name = malloc(namelen + 1);
+    if (!e->name) {
+        winfont_set_error(WinFont_ErrNoMem);
+        return NULL;
+    }
+    memcpy(e->name, name, namelen);
+    e->name[namelen] = '\0';
+    ar->nentries++;
+
+    return e;
+}
+
+/* Every .fon in the central directory, which the end record at the
+ * back of the archive points to. */
+static int
+zip_read(WinFontArchive *ar)
+{
+    const uint8_t *base = ar->base, *p, *end, *eocd = NULL;
+    size_t len = ar->len, loff, doff, nlen, skip;
+    struct entry *e;
+    int n, flags;
+
+    /* The end record is 22 bytes and a comment of up to 64K. */
+    for (size_t back = 22; back <= len && back <= 22 + 0xffff; back++) {
+        if (get32(base + len - back) == ZIP_END) {
+            eocd = base + len - back;
+            break;
+        }
+    }
+    if (!eocd) {
+        WF_FAIL(WinFont_ErrArchive, "no zip end of central directory");
+        return -1;
+    }
+
+    n = get16(eocd + 10);
+    if (n == 0xffff || get32(eocd + 16) == 0xffffffff) {
+        WF_FAIL(WinFont_ErrArchive, "zip64 archives are not supported");
+        return -1;
+    }
+    if (get32(eocd + 16) > len || get32(eocd + 12) > len -
+            get32(eocd + 16)) {
+        WF_FAIL(WinFont_ErrArchive, "zip central directory runs past the "
+            "end");
+        return -1;
+    }
+    p = base + get32(eocd + 16);
+    end = p + get32(eocd + 12);
+
+    ar->entries = calloc(n ? n : 1, sizeof(struct entry));
+    if (!ar->entries) {
+        winfont_set_error(WinFont_ErrNoMem);
+        return -1;
+    }
+
+    for (int i = 0; i < n; i++, p += skip) {
+        if (end - p < 46 || get32(p) != ZIP_CENTRAL) {
+            WF_FAIL(WinFont_ErrArchive, "bad zip central directory entry "
+                "%d", i);
+            return -1;
+        }
+        nlen = get16(p + 28);
+        skip = 46 + nlen + get16(p + 30) + get16(p + 32);
+        if ((size_t)(end - p) < skip) {
+            WF_FAIL(WinFont_ErrArchive, "bad zip central directory entry "
+                "%d", i);
+            return -1;
+        }
+        if (!is_fon(p + 46, nlen))
+            continue;
+
+        /* The data follows the local header, whose extra field need
+         * not match the central one. */
+        loff = get32(p + 42);
+        if (loff > len || len - loff < 30 ||
+            get32(base + loff) != ZIP_LOCAL) {
+            WF_FAIL(WinFont_ErrArchive, "%.*s: bad zip local header",
+                (int)nlen, p + 46);
+            return -1;
+        }
+        doff = loff + 30 + get16(base + loff + 26) +
+            get16(base + loff + 28);
+        if (doff > len || get32(p + 20) > len - doff) {
+            WF_FAIL(WinFont_ErrArchive, "%.*s: runs past the end",
+                (int)nlen, p + 46);
+            return -1;
+        }
+
+        e = add_entry(ar, p + 46, nlen);
+        if (!e)
+            return -1;
+        flags = get16(p + 8);
+        e->method = flags & 1 ? -1 : (int)get16(p + 10);
+        e->crc = get32(p + 16);
+        e->csize = get32(p + 20);
+        e->usize = get32(p + 24);
+        e->off = doff;
+    }
+
+    return 0;
+}
+
+/* A gzip file is one entry, named by the header or else by the file. */
+static int
+gzip_read(WinFontArchive *ar, const char *path)
+{
+    const uint8_t *base = ar->base;
+    size_t len = ar->len, p = 10, namelen = 0;
+    const char *name = NULL, *slash;
+    struct entry *e;
+    int flg;
+
+    if (len < 18 || base[2] != METHOD_DEFLATE) {
+        WF_FAIL(WinFont_ErrArchive, "bad gzip header");
+        return -1;
+    }
+
+    flg = base[3];
+    if ((flg & 4) && p + 2 <= len)      /* FEXTRA */
+        p += 2 + get16(base + p);
+    if (flg & 8) {                      /* FNAME */
+        name = (const char *)base + p;
+        while (p < len && base[p])
+            p++;
+        namelen = (const char *)base + p - name;
+        p++;
+    }
+    if (flg & 16) {                     /* FCOMMENT */
+        while (p < len && base[p])
+            p++;
+        p++;
+    }
+    if (flg & 2)                        /* FHCRC */
+        p += 2;
+    if (p > len - 8) {
+        WF_FAIL(WinFont_ErrArchive, "gzip header runs past the end");
+        return -1;
+    }
+
+    if (!name && path) {
+        slash = strrchr(path, '/');
+        name = slash ? slash + 1 : path;
+        namelen = strlen(name);
+        if (namelen > 3 && !strcasecmp(name + namelen - 3, ".gz"))
+            namelen -= 3;
+    }
+
+    ar->entries = calloc(1, sizeof(struct entry));
+    if (!ar->entries) {
+        winfont_set_error(WinFont_ErrNoMem);
+        return -1;
+    }
+    e = add_entry(ar, name ? name : "", namelen);
+    if (!e)
+        return -1;
+    e->method = METHOD_DEFLATE;
+    e->off = p;
+    e->csize = len - 8 - p;
+    e->crc = get32(base + len - 8);
+    e->usize = get32(base + len - 4);
+
+    return 0;
+}
+
+static WinFontArchive *
+archive_build(const uint8_t *base, size_t len, int flags, const char *path)
+{
+    WinFontArchive *ar;
+    int ret;
+
+    ar = calloc(1, sizeof(WinFontArchive));
+    if (!ar) {
+        winfont_set_error(WinFont_ErrNoMem);
+        return NULL;
+    }
+    if (pthread_mutex_init(&ar->lock, NULL)) {
+        free(ar);
+        winfont_set_error(WinFont_ErrNoMem);
+        return NULL;
+    }
+    if (pthread_cond_init(&ar->loaded, NULL)) {
+        pthread_mutex_destroy(&ar->lock);
+        free(ar);
+        winfont_set_error(WinFont_ErrNoMem);
+        return NULL;
+    }
+    ar->base = base;
+    ar->len = len;
+    ar->flags = flags;
+
+    if (len >= 2 && base[0] == 0x1f && base[1] == 0x8b)
+        ret = gzip_read(ar, path);
+    else
+        ret = zip_read(ar);
+    if (ret == -1) {
+        winfont_archive_free(ar);
+        return NULL;
+    }
+
+    return ar;
+}
+
+WinFontArchive *
+winfont_archive_read_memory(const void *buf, size_t len, int flags)
+{
+    if (!buf) {
+        winfont_set_error(WinFont_ErrArg);
+        return NULL;
+    }
+
+    return archive_build(buf, len, flags, NULL);
+}
+
+WinFontArchive *
+winfont_archive_open(const char *path, int flags)
+{
+    WinFontArchive *ar;
+    void *map;
+    size_t len;
+
+    map = winfont_map_path(path, &len);
+    if (!map)
+        return NULL;
+
+    ar = archive_build(map, len, flags, path);
+    if (!ar) {
+        munmap(map, len);
+        return NULL;
+    }
+
+    ar->map = map;
+    ar->maplen = len;
+
+    return ar;
+}
+
+int
+winfont_archive_count(const WinFontArchive *ar)
+{
+    return ar ? ar->nentries : -1;
+}
+
+const char *
+winfont_archive_name(const WinFontArchive *ar, int i)
+{
+    if (!ar || i < 0 || i >= ar->nentries)
+        return NULL;
+
+    return ar->entries[i].name;
+}
+
+/* Decompress and parse one entry, with no lock held. */
+static WinFont *
+entry_load(WinFontArchive *ar, struct entry *e)
+{
+    const uint8_t *data = ar->base + e->off;
+    uint8_t *buf;
+#ifdef WINFONT_HAVE_ZLIB
+    z_stream zs;
+    int ret;
+#endif
+
+    switch (e->method) {
+    case METHOD_STORED:
+        if (e->csize != e->usize) {
+            WF_FAIL(WinFont_ErrArchive, "%s: bad stored size", e->name);
+            return NULL;
+        }
+#ifdef WINFONT_HAVE_ZLIB
+        if (crc32(0, data, e->usize) != e->crc) {
+            WF_FAIL(WinFont_ErrArchive, "%s: CRC mismatch", e->name);
+            return NULL;
+        }
+#endif
+        /* The font may point into the archive, which outlives it. */
+        return winfont_read_memory_flags(data, e->usize, ar->flags);
+    case METHOD_DEFLATE:
+        break;
+    case -1:
+        WF_FAIL(WinFont_ErrArchive, "%s: encrypted", e->name);
+        return NULL;
+    default:
+        WF_FAIL(WinFont_ErrArchive, "%s: compression method %d", e->name,
+            e->method);
+        return NULL;
+    }
+
+#ifdef WINFONT_HAVE_ZLIB
+    if (e->usize > MAX_ENTRY) {
+        WF_FAIL(WinFont_ErrArchive, "%s: %zu bytes is too big", e->name,
+            e->usize);
+        return NULL;
+    }
+    buf = malloc(e->usize ? e->usize : 1);
+    if (!buf) {
+        winfont_set_error(WinFont_ErrNoMem);
+        return NULL;
+    }
+
+    memset(&zs, 0, sizeof(zs));
+    if (inflateInit2(&zs, -MAX_WBITS) != Z_OK) {
+        free(buf);
+        winfont_set_error(WinFont_ErrNoMem);
+        return NULL;
+    }
+    zs.next_in = (Bytef *)data;
+    zs.avail_in = e->csize;
+    zs.next_out = buf;
+    zs.avail_out = e->usize;
+    ret = inflate(&zs, Z_FINISH);
+    inflateEnd(&zs);
+
+    if (ret != Z_STREAM_END || zs.total_out != e->usize) {
+        WF_FAIL(WinFont_ErrArchive, "%s: bad deflate data", e->name);
+        free(buf);
+        return NULL;
+    }
+    if (crc32(0, buf, e->usize) != e->crc) {
+        WF_FAIL(WinFont_ErrArchive, "%s: CRC mismatch", e->name);
+        free(buf);
+        return NULL;
+    }
+
+    return winfont_read_buffer(buf, e->usize, ar->flags);
+#else
+    (void)buf;
+    WF_FAIL(WinFont_ErrArchive, "%s: deflate needs zlib", e->name);
+    return NULL;
+#endif
+}
+
+/* The first thread to ask for an entry loads it outside the lock;
+ * any others asking meanwhile wait for it. */
+WinFont *
+winfont_archive_font(WinFontArchive *ar, int i)
+{
+    struct entry *e;
+    WinFont *wf;
+    WinFont_Error err;
+
+    if (!ar || i < 0 || i >= ar->nentries) {
+        winfont_set_error(WinFont_ErrArg);
+        return NULL;
+    }
+    e = &ar->entries[i];
+
+    if (__atomic_load_n(&e->state, __ATOMIC_ACQUIRE) != ENTRY_DONE) {
+        pthread_mutex_lock(&ar->lock);
+        while (e->state == ENTRY_LOADING)
+            pthread_cond_wait(&ar->loaded, &ar->lock);
+        if (e->state == ENTRY_NEW) {
+            e->state = ENTRY_LOADING;
+            pthread_mutex_unlock(&ar->lock);
+
+            wf = entry_load(ar, e);
+            err = wf ? WinFont_ErrNone : winfont_last_error();
+
+            pthread_mutex_lock(&ar->lock);
+            e->font = wf;
+            e->err = err;
+            __atomic_store_n(&e->state, ENTRY_DONE, __ATOMIC_RELEASE);
+            pthread_cond_broadcast(&ar->loaded);
+        }
+        pthread_mutex_unlock(&ar->lock);
+    }
+
+    if (!e->font)
+        winfont_set_error(e->err);
+    return e->font;
+}
+
+struct load_job {
+    WinFontArchive *ar;
+    int next;
+};
+
+static void *
+load_worker(void *arg)
+{
+    struct load_job *job = arg;
+    int i;
+
+    while ((i = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED)) <
+            job->ar->nentries)
+        winfont_archive_font(job->ar, i);
+
+    return NULL;
+}
+
+int
+winfont_archive_load(WinFontArchive *ar, int nthreads)
+{
+    pthread_t threads[MAX_THREADS];
+    struct load_job job = { ar, 0 };
+    int started = 0, loaded = 0;
+
+    if (!ar) {
+        winfont_set_error(WinFont_ErrArg);
+        return -1;
+    }
+
+    if (nthreads <= 0)
+        nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+    if (nthreads > ar->nentries)
+        nthreads = ar->nentries;
+    if (nthreads > MAX_THREADS)
+        nthreads = MAX_THREADS;
+
+    for (int i = 1; i < nthreads; i++) {
+        if (pthread_create(&threads[started], NULL, load_worker, &job))
+            break;
+        started++;
+    }
+    load_worker(&job);
+    for (int i = 0; i < started; i++)
+        pthread_join(threads[i], NULL);
+
+    for (int i = 0; i < ar->nentries; i++)
+        if (ar->entries[i].font)
+            loaded++;
+
+    return loaded;
+}
+
+void
+winfont_archive_free(WinFontArchive *ar)
+{
+    if (!ar)
+        return;
+
+    for (int i = 0; i < ar->nentries; i++) {
+        winfont_free(ar->entries[i].font);
+        free(ar->entries[i].name);
+    }
+    free(ar->entries);
+    if (ar->map)
+        munmap(ar->map, ar->maplen);
+    pthread_cond_destroy(&ar->loaded);
+    pthread_mutex_destroy(&ar->lock);
+    free(ar);
+}
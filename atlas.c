@@ -0,0 +1,270 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 Eddie Hillenbrand
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+/* Texture atlases. Fixed pitch fonts are laid out on a grid of equal
+ * cells. Proportional glyphs all share the font height, so packing
+ * them is a one dimensional problem: glyphs go widest first onto the
+ * first shelf (row) with room left, which wastes very little at the
+ * end of each shelf. */
+
+#include <winfont.h>
+#include "winfont_private.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define ATLAS_OWNS_PIXELS 0x0001
+
+static int
+atlas_bpp(WinFont_AtlasFormat format)
+{
+    return format == WinFont_AtlasRGBA8888 ? 4 : 1;
+}
+
+static int
+font_is_fixed(WinFont *wf)
+{
+    for (int g = 1; g < wf->nglyphs; g++)
+        if (wf->widths[g] != wf->widths[0])
+            return 0;
+    return 1;
+}
+
+/* Roughly square unless the caller gave a width. */
+static int
+atlas_max_width(WinFont *wf, int maxwidth, int pad)
+{
+    size_t area = 0;
+    int side = 0, widest = 0;
+
+    for (int g = 0; g < wf->nglyphs; g++) {
+        area += (size_t)(wf->widths[g] + pad) * (wf->height + pad);
+        if (wf->widths[g] > widest)
+            widest = wf->widths[g];
+    }
+
+    if (maxwidth <= 0)
+        while ((size_t)side * side < area)
+            side++;
+    else
+        side = maxwidth;
+
+    if (side < widest + 2 * pad)
+        side = widest + 2 * pad;
+
+    return side;
+}
+
+/* Stable insertion sort, widest first. A font has at most 257
+ * glyphs. */
+static void
+sort_by_width(int *order, int n, const uint16_t *widths)
+{
+    for (int i = 1; i < n; i++) {
+        int g = order[i], j = i;
+        while (j > 0 && widths[order[j - 1]] < widths[g]) {
+            order[j] = order[j - 1];
+            j--;
+        }
+        order[j] = g;
+    }
+}
+
+static int
+atlas_layout(WinFont *wf, int maxwidth, int pad, WinFont_AtlasRect *rects,
+    int *aw, int *ah)
+{
+    int h = wf->height, n = wf->nglyphs;
+    int cols, cellw, nshelves = 0, width = 0;
+    int *order, *used;
+
+    maxwidth = atlas_max_width(wf, maxwidth, pad);
+
+    if (font_is_fixed(wf)) {
+        cellw = wf->widths[0] + pad;
+        cols = (maxwidth - pad) / (cellw ? cellw : 1);
+        if (cols < 1)
+            cols = 1;
+        if (cols > n)
+            cols = n;
+        for (int g = 0; g < n; g++) {
+            rects[g].x = pad + (g % cols) * cellw;
+            rects[g].y = pad + (g / cols) * (h + pad);
+            rects[g].w = wf->widths[0];
+            rects[g].h = h;
+        }
+        *aw = pad + cols * cellw;
+        *ah = pad + (n + cols - 1) / cols * (h + pad);
+        return 0;
+    }
+
+    order = malloc(n * sizeof(int));
+    used = malloc(n * sizeof(int));
+    if (!order || !used) {
+        free(order);
+        free(used);
+        return -1;
+    }
+
+    for (int g = 0; g < n; g++)
+        order[g] = g;
+    sort_by_width(order, n, wf->widths);
+
+    for (int i = 0; i < n; i++) {
+        int g = order[i], gw = wf->widths[g], s;
+
+        rects[g].w = gw;
+        rects[g].h = h;
+        if (gw == 0) {
+            rects[g].x = rects[g].y = 0;
+            continue;
+        }
+
+        for (s = 0; s < nshelves; s++)
+            if (used[s] + gw + pad <= maxwidth)
+                break;
+        if (s == nshelves)
+            used[nshelves++] = pad;
+
+        rects[g].x = used[s];
+        rects[g].y = pad + s * (h + pad);
+        used[s] += gw + pad;
+        if (used[s] > width)
+            width = used[s];
+    }
+
+    *aw = width ? width : 1;
+    *ah = pad + nshelves * (h + pad);
+
+    free(order);
+    free(used);
+    return 0;
+}
+
+size_t
+winfont_atlas_required_size(WinFont *wf, WinFont_AtlasFormat format,
+    int maxwidth, int padding)
+{
+    WinFont_AtlasRect *rects;
+    int aw, ah;
+
+    if (!wf || padding < 0)
+        return 0;
+
+    rects = malloc(wf->nglyphs * sizeof(WinFont_AtlasRect));
+    if (!rects)
+        return 0;
+
+    if (atlas_layout(wf, maxwidth, padding, rects, &aw, &ah) == -1) {
+        free(rects);
+        return 0;
+    }
+
+    free(rects);
+    return (size_t)aw * ah * atlas_bpp(format);
+}
+
+WinFont_Atlas *
+winfont_build_atlas(WinFont *wf, WinFont_AtlasFormat format,
+    int maxwidth, int padding, uint8_t *pixels, size_t sz)
+{
+    WinFont_Atlas *atlas;
+    WinFont_AtlasRect *rc;
+    const uint8_t *rows;
+    uint8_t *scratch = NULL, *dst;
+    size_t need;
+    int bpp = atlas_bpp(format), rowbytes;
+    WinFont_Error err = WinFont_ErrNoMem;
+
+    if (!wf || padding < 0) {
+        winfont_set_error(WinFont_ErrArg);
+        return NULL;
+    }
+
+    atlas = calloc(1, sizeof(WinFont_Atlas));
+    if (!atlas) {
+        winfont_set_error(WinFont_ErrNoMem);
+        return NULL;
+    }
+
+    atlas->format = format;
+    atlas->nglyphs = wf->nglyphs;
+    atlas->rects = malloc(wf->nglyphs * sizeof(WinFont_AtlasRect));
+    scratch = malloc((size_t)wf->wbytes * wf->height + 1);
+    if (!atlas->rects || !scratch)
+        goto fail;
+
+    if (atlas_layout(wf, maxwidth, padding, atlas->rects,
+            &atlas->width, &atlas->height) == -1)
+        goto fail;
+    atlas->stride = atlas->width * bpp;
+
+    need = (size_t)atlas->stride * atlas->height;
+    if (pixels) {
+        if (sz < need) {
+            err = WinFont_ErrArg;
+            goto fail;
+        }
+        atlas->pixels = pixels;
+    } else {
+        atlas->pixels = malloc(need);
+        if (!atlas->pixels)
+            goto fail;
+        atlas->_flags |= ATLAS_OWNS_PIXELS;
+    }
+    memset(atlas->pixels, 0, need);
+
+    for (int g = 0; g < wf->nglyphs; g++) {
+        rc = &atlas->rects[g];
+        rc->u0 = (float)rc->x / atlas->width;
+        rc->v0 = (float)rc->y / atlas->height;
+        rc->u1 = (float)(rc->x + rc->w) / atlas->width;
+        rc->v1 = (float)(rc->y + rc->h) / atlas->height;
+        if (rc->w == 0)
+            continue;
+
+        rows = winfont_glyph_get(wf, g, WinFont_LayoutRowMSB, scratch,
+            (size_t)wf->wbytes * wf->height + 1);
+        if (!rows) {
+            err = winfont_last_error();
+            goto fail;
+        }
+
+        rowbytes = (rc->w + 7) / 8;
+        dst = atlas->pixels + (size_t)rc->y * atlas->stride + rc->x * bpp;
+        for (int r = 0; r < rc->h; r++) {
+            if (format == WinFont_AtlasRGBA8888)
+                winfont_expand_bits32(dst, rows, rc->w, 0xFFFFFFFF, 0);
+            else
+                winfont_expand_bits(dst, rows, rc->w);
+            rows += rowbytes;
+            dst += atlas->stride;
+        }
+    }
+
+    free(scratch);
+    return atlas;
+
+fail:
+    free(scratch);
+    winfont_atlas_free(atlas);
+    winfont_set_error(err);
+    return NULL;
+}
+
+void
+winfont_atlas_free(WinFont_Atlas *atlas)
+{
+    if (!atlas)
+        return;
+
+    if (atlas->_flags & ATLAS_OWNS_PIXELS)
+        free(atlas->pixels);
+    free(atlas->rects);
+    free(atlas);
+}
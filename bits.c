@@ -0,0 +1,699 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 Eddie Hillenbrand
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+/* Bulk bitmap kernels. Each kernel has a portable scalar version and,
+ * on x86, SSE2/AVX2 versions picked at run time. */
+
+#include <winfont.h>
+#include "winfont_private.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define WF_X86 1
+#include <immintrin.h>
+#define TARGET(isa) __attribute__((target(isa)))
+#endif
+
+int
+winfont_cpu_isa(void)
+{
+#ifdef WF_X86
+    if (__builtin_cpu_supports("avx2"))
+        return WF_ISA_AVX2;
+    if (__builtin_cpu_supports("sse2"))
+        return WF_ISA_SSE2;
+#endif
+    return WF_ISA_SCALAR;
+}
+
+/* Column to row transposition
+ *
+ * A FNT glyph is wbytes byte columns of h bytes each. Row r of the
+ * decoded glyph is byte r of every column, so decoding a glyph is an
+ * interleave of wbytes byte streams. One byte wide glyphs are already
+ * in row order. */
+
+static void
+transpose_scalar(uint8_t *dst, const uint8_t *src,
+    int wbytes, int h, int nglyphs)
+{
+    for (int c = 0; c < nglyphs; c++) {
+        for (int col = 0; col < wbytes; col++) {
+            for (int r = 0; r < h; r++)
+                dst[r * wbytes + col] = src[r];
+            src += h;
+        }
+        dst += wbytes * h;
+    }
+}
+
+#ifdef WF_X86
+
+TARGET("sse2") static void
+transpose2_sse2(uint8_t *dst, const uint8_t *src, int h, int nglyphs)
+{
+    const uint8_t *c0, *c1;
+    __m128i a, b;
+    int r;
+
+    for (int c = 0; c < nglyphs; c++) {
+        c0 = src;
+        c1 = src + h;
+        for (r = 0; r + 16 <= h; r += 16) {
+            a = _mm_loadu_si128((const __m128i *)(c0 + r));
+            b = _mm_loadu_si128((const __m128i *)(c1 + r));
+            _mm_storeu_si128((__m128i *)(dst + 2 * r),
+                _mm_unpacklo_epi8(a, b));
+            _mm_storeu_si128((__m128i *)(dst + 2 * r + 16),
+                _mm_unpackhi_epi8(a, b));
+        }
+        if (r + 8 <= h) {
+            a = _mm_loadl_epi64((const __m128i *)(c0 + r));
+            b = _mm_loadl_epi64((const __m128i *)(c1 + r));
+            _mm_storeu_si128((__m128i *)(dst + 2 * r),
+                _mm_unpacklo_epi8(a, b));
+            r += 8;
+        }
+        for (; r < h; r++) {
+            dst[2 * r] = c0[r];
+            dst[2 * r + 1] = c1[r];
+        }
+        src += 2 * h;
+        dst += 2 * h;
+    }
+}
+
+TARGET("sse2") static void
+transpose4_sse2(uint8_t *dst, const uint8_t *src, int h, int nglyphs)
+{
+    const uint8_t *c0, *c1, *c2, *c3;
+    __m128i a, b, c, d, ab, cd;
+    int r;
+
+    for (int g = 0; g < nglyphs; g++) {
+        c0 = src;
+        c1 = src + h;
+        c2 = src + 2 * h;
+        c3 = src + 3 * h;
+        for (r = 0; r + 16 <= h; r += 16) {
+            a = _mm_loadu_si128((const __m128i *)(c0 + r));
+            b = _mm_loadu_si128((const __m128i *)(c1 + r));
+            c = _mm_loadu_si128((const __m128i *)(c2 + r));
+            d = _mm_loadu_si128((const __m128i *)(c3 + r));
+            ab = _mm_unpacklo_epi8(a, b);
+            cd = _mm_unpacklo_epi8(c, d);
+            _mm_storeu_si128((__m128i *)(dst + 4 * r),
+                _mm_unpacklo_epi16(ab, cd));
+            _mm_storeu_si128((__m128i *)(dst + 4 * r + 16),
+                _mm_unpackhi_epi16(ab, cd));
+            ab = _mm_unpackhi_epi8(a, b);
+            cd = _mm_unpackhi_epi8(c, d);
+            _mm_storeu_si128((__m128i *)(dst + 4 * r + 32),
+                _mm_unpacklo_epi16(ab, cd));
+            _mm_storeu_si128((__m128i *)(dst + 4 * r + 48),
+                _mm_unpackhi_epi16(ab, cd));
+        }
+        for (; r < h; r++) {
+            dst[4 * r] = c0[r];
+            dst[4 * r + 1] = c1[r];
+            dst[4 * r + 2] = c2[r];
+            dst[4 * r + 3] = c3[r];
+        }
+        src += 4 * h;
+        dst += 4 * h;
+    }
+}
+
+/* The AVX2 unpacks work within 128-bit lanes, so the two halves are
+ * put back in order with a cross-lane permute. Glyphs shorter than 32
+ * rows gain nothing here and use the SSE2 kernel. */
+TARGET("avx2") static void
+transpose2_avx2(uint8_t *dst, const uint8_t *src, int h, int nglyphs)
+{
+    const uint8_t *c0, *c1;
+    __m256i a, b, lo, hi;
+    int r;
+
+    if (h < 32) {
+        transpose2_sse2(dst, src, h, nglyphs);
+        return;
+    }
+
+    for (int c = 0; c < nglyphs; c++) {
+        c0 = src;
+        c1 = src + h;
+        for (r = 0; r + 32 <= h; r += 32) {
+            a = _mm256_loadu_si256((const __m256i *)(c0 + r));
+            b = _mm256_loadu_si256((const __m256i *)(c1 + r));
+            lo = _mm256_unpacklo_epi8(a, b);
+            hi = _mm256_unpackhi_epi8(a, b);
+            _mm256_storeu_si256((__m256i *)(dst + 2 * r),
+                _mm256_permute2x128_si256(lo, hi, 0x20));
+            _mm256_storeu_si256((__m256i *)(dst + 2 * r + 32),
+                _mm256_permute2x128_si256(lo, hi, 0x31));
+        }
+        for (; r < h; r++) {
+            dst[2 * r] = c0[r];
+            dst[2 * r + 1] = c1[r];
+        }
+        src += 2 * h;
+        dst += 2 * h;
+    }
+}
+
+/* Bit expansion
+ *
+ * Each source byte is broadcast to 8 lanes, masked with the lane's bit
+ * and compared against the mask, giving 0xFF for set bits. */
+
+TARGET("sse2") static size_t
+expand_sse2(uint8_t *dst, const uint8_t *src, size_t npixels)
+{
+    const __m128i mask = _mm_set_epi8(
+        0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, (char)0x80,
+        0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, (char)0x80);
+    __m128i v;
+    size_t i;
+
+    for (i = 0; i + 16 <= npixels; i += 16) {
+        v = _mm_cvtsi32_si128(src[0] | src[1] << 8);
+        v = _mm_unpacklo_epi8(v, v);
+        v = _mm_unpacklo_epi16(v, v);
+        v = _mm_unpacklo_epi32(v, v);
+        v = _mm_cmpeq_epi8(_mm_and_si128(v, mask), mask);
+        _mm_storeu_si128((__m128i *)dst, v);
+        src += 2;
+        dst += 16;
+    }
+
+    return i;
+}
+
+TARGET("avx2") static size_t
+expand_avx2(uint8_t *dst, const uint8_t *src, size_t npixels)
+{
+    const __m256i mask = _mm256_set1_epi64x(0x0102040810204080LL);
+    const __m256i spread = _mm256_setr_epi8(
+        0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1,
+        2, 2, 2, 2, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3);
+    __m256i v;
+    uint32_t bits;
+    size_t i;
+
+    for (i = 0; i + 32 <= npixels; i += 32) {
+        memcpy(&bits, src, sizeof(bits));
+        v = _mm256_shuffle_epi8(_mm256_set1_epi32(bits), spread);
+        v = _mm256_cmpeq_epi8(_mm256_and_si256(v, mask), mask);
+        _mm256_storeu_si256((__m256i *)dst, v);
+        src += 4;
+        dst += 32;
+    }
+
+    return i + expand_sse2(dst, src, npixels - i);
+}
+
+/* The same for 32-bit pixels, selecting fg or bg per lane. */
+
+TARGET("sse2") static size_t
+expand32_sse2(uint8_t *dst, const uint8_t *src, size_t npixels,
+    uint32_t fg, uint32_t bg)
+{
+    const __m128i lo = _mm_set_epi32(0x10, 0x20, 0x40, 0x80);
+    const __m128i hi = _mm_set_epi32(0x01, 0x02, 0x04, 0x08);
+    const __m128i vfg = _mm_set1_epi32(fg);
+    const __m128i vbg = _mm_set1_epi32(bg);
+    __m128i v, m;
+    size_t i;
+
+    for (i = 0; i + 8 <= npixels; i += 8) {
+        v = _mm_set1_epi32(*src++);
+        m = _mm_cmpeq_epi32(_mm_and_si128(v, lo), lo);
+        _mm_storeu_si128((__m128i *)dst, _mm_or_si128(
+            _mm_and_si128(m, vfg), _mm_andnot_si128(m, vbg)));
+        m = _mm_cmpeq_epi32(_mm_and_si128(v, hi), hi);
+        _mm_storeu_si128((__m128i *)(dst + 16), _mm_or_si128(
+            _mm_and_si128(m, vfg), _mm_andnot_si128(m, vbg)));
+        dst += 32;
+    }
+
+    return i;
+}
+
+TARGET("avx2") static size_t
+expand32_avx2(uint8_t *dst, const uint8_t *src, size_t npixels,
+    uint32_t fg, uint32_t bg)
+{
+    const __m256i mask = _mm256_setr_epi32(
+        0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01);
+    const __m256i vfg = _mm256_set1_epi32(fg);
+    const __m256i vbg = _mm256_set1_epi32(bg);
+    __m256i v, m;
+    size_t i;
+
+    for (i = 0; i + 8 <= npixels; i += 8) {
+        v = _mm256_set1_epi32(*src++);
+        m = _mm256_cmpeq_epi32(_mm256_and_si256(v, mask), mask);
+        _mm256_storeu_si256((__m256i *)dst,
+            _mm256_blendv_epi8(vbg, vfg, m));
+        dst += 32;
+    }
+
+    return i;
+}
+
+/* Horizontal scaling of rows of bits
+ *
+ * 16 source pixels are expanded to bytes, each group of output bytes
+ * is gathered with a byte shuffle that repeats every pixel s times,
+ * and movemask packs them back into bits. The shuffle also reverses
+ * each run of 8 bytes, because movemask puts byte 0 in bit 0 and the
+ * glyph wants the leftmost pixel in bit 7. pshufb is SSSE3, which
+ * every AVX2 CPU has. Returns the number of pixels done in each row. */
+
+TARGET("avx2") static int
+scale_rows_avx2(uint8_t *dst, int dststride, const uint8_t *src,
+    int w, int h, int s)
+{
+    const __m128i mask = _mm_set_epi8(
+        0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, (char)0x80,
+        0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, (char)0x80);
+    int rowbytes = (w + 7) / 8, n = w / 16, bits;
+    __m128i idx[8], v;
+    uint8_t lanes[16], *d;
+    const uint8_t *p;
+
+    if (s > 8 || n == 0)
+        return 0;
+
+    for (int k = 0; k < s; k++) {
+        for (int j = 0; j < 16; j++)
+            lanes[j] = (k * 16 + (j & ~7) + (7 - (j & 7))) / s;
+        idx[k] = _mm_loadu_si128((const __m128i *)lanes);
+    }
+
+    for (int r = 0; r < h; r++) {
+        p = src + r * rowbytes;
+        d = dst + r * dststride;
+        for (int i = 0; i < n; i++, p += 2) {
+            v = _mm_cvtsi32_si128(p[0] | p[1] << 8);
+            v = _mm_unpacklo_epi8(v, v);
+            v = _mm_unpacklo_epi16(v, v);
+            v = _mm_unpacklo_epi32(v, v);
+            v = _mm_cmpeq_epi8(_mm_and_si128(v, mask), mask);
+            for (int k = 0; k < s; k++, d += 2) {
+                bits = _mm_movemask_epi8(_mm_shuffle_epi8(v, idx[k]));
+                d[0] = bits & 0xFF;
+                d[1] = bits >> 8;
+            }
+        }
+    }
+
+    return n * 16;
+}
+
+#endif /* WF_X86 */
+
+void
+winfont_expand_bits_isa(int isa, uint8_t *dst, const uint8_t *src,
+    size_t npixels)
+{
+    size_t done = 0;
+
+#ifdef WF_X86
+    if (isa >= WF_ISA_AVX2)
+        done = expand_avx2(dst, src, npixels);
+    else if (isa >= WF_ISA_SSE2)
+        done = expand_sse2(dst, src, npixels);
+#endif
+
+    for (size_t i = done; i < npixels; i++)
+        dst[i] = (src[i / 8] >> (7 - i % 8)) & 1 ? 0xFF : 0;
+}
+
+void
+winfont_expand_bits(uint8_t *dst, const uint8_t *src, size_t npixels)
+{
+    winfont_expand_bits_isa(winfont_cpu_isa(), dst, src, npixels);
+}
+
+void
+winfont_expand_bits32_isa(int isa, uint8_t *dst, const uint8_t *src,
+    size_t npixels, uint32_t fg, uint32_t bg)
+{
+    size_t done = 0;
+
+#ifdef WF_X86
+    if (isa >= WF_ISA_AVX2)
+        done = expand32_avx2(dst, src, npixels, fg, bg);
+    else if (isa >= WF_ISA_SSE2)
+        done = expand32_sse2(dst, src, npixels, fg, bg);
+#endif
+
+    for (size_t i = done; i < npixels; i++) {
+        uint32_t px = (src[i / 8] >> (7 - i % 8)) & 1 ? fg : bg;
+        memcpy(dst + 4 * i, &px, sizeof(px));
+    }
+}
+
+void
+winfont_expand_bits32(uint8_t *dst, const uint8_t *src, size_t npixels,
+    uint32_t fg, uint32_t bg)
+{
+    winfont_expand_bits32_isa(winfont_cpu_isa(), dst, src, npixels,
+        fg, bg);
+}
+
+/* Pixels from..w of one row, s bits each, through an accumulator. */
+static void
+scale_row_scalar(uint8_t *dst, const uint8_t *src, int from, int w, int s)
+{
+    uint32_t acc = 0, ones = (1u << s) - 1;
+    int nbits = 0;
+
+    for (int i = from; i < w; i++) {
+        acc = acc << s | ((src[i / 8] >> (7 - i % 8)) & 1 ? ones : 0);
+        nbits += s;
+        while (nbits >= 8) {
+            nbits -= 8;
+            *dst++ = acc >> nbits;
+        }
+    }
+    if (nbits)
+        *dst = acc << (8 - nbits);
+}
+
+void
+winfont_scale_rows_isa(int isa, uint8_t *dst, int dststride,
+    const uint8_t *src, int w, int h, int s)
+{
+    int rowbytes = (w + 7) / 8, done = 0;
+
+#ifdef WF_X86
+    if (isa >= WF_ISA_AVX2)
+        done = scale_rows_avx2(dst, dststride, src, w, h, s);
+#endif
+
+    /* done is a multiple of 16, so the rest starts on a byte. */
+    if (done < w)
+        for (int r = 0; r < h; r++)
+            scale_row_scalar(dst + r * dststride + done * s / 8,
+                src + r * rowbytes, done, w, s);
+}
+
+void
+winfont_scale_rows(uint8_t *dst, int dststride, const uint8_t *src,
+    int w, int h, int s)
+{
+    winfont_scale_rows_isa(winfont_cpu_isa(), dst, dststride, src, w, h, s);
+}
+
+void
+winfont_transpose_bitmap_isa(int isa, uint8_t *dst, const uint8_t *src,
+    int wbytes, int h, int nglyphs)
+{
+    if (wbytes == 1) {
+        memcpy(dst, src, (size_t)h * nglyphs);
+        return;
+    }
+
+#ifdef WF_X86
+    if (isa >= WF_ISA_AVX2 && wbytes == 2) {
+        transpose2_avx2(dst, src, h, nglyphs);
+        return;
+    }
+    if (isa >= WF_ISA_SSE2 && wbytes == 2) {
+        transpose2_sse2(dst, src, h, nglyphs);
+        return;
+    }
+    if (isa >= WF_ISA_SSE2 && wbytes == 4) {
+        transpose4_sse2(dst, src, h, nglyphs);
+        return;
+    }
+#endif
+
+    transpose_scalar(dst, src, wbytes, h, nglyphs);
+}
+
+void
+winfont_transpose_bitmap(uint8_t *dst, const uint8_t *src,
+    int wbytes, int h, int nglyphs)
+{
+    winfont_transpose_bitmap_isa(winfont_cpu_isa(), dst, src,
+        wbytes, h, nglyphs);
+}
+
+/* ASCII to glyph indices
+ *
+ * Most text is ASCII, and in most fonts a run of the ASCII codes are
+ * glyphs ch - first. A kernel converts the bytes of src up to the
+ * first one outside lo..hi, a whole vector at a time; lo and hi are
+ * at most 0x7E so the bounds fit a signed byte compare. The vector
+ * holding that byte is stored whole, so dst past the run, up to n,
+ * is overwritten. */
+
+static size_t
+ascii_scalar(uint16_t *dst, const uint8_t *src, size_t n, int lo, int hi,
+    int first)
+{
+    size_t i;
+
+    for (i = 0; i < n && src[i] >= lo && src[i] <= hi; i++)
+        dst[i] = src[i] - first;
+
+    return i;
+}
+
+#ifdef WF_X86
+
+TARGET("sse2") static size_t
+ascii_sse2(uint16_t *dst, const uint8_t *src, size_t n, int lo, int hi,
+    int first)
+{
+    __m128i below = _mm_set1_epi8(lo - 1), above = _mm_set1_epi8(hi + 1);
+    __m128i base = _mm_set1_epi16(first), zero = _mm_setzero_si128();
+    __m128i b, in;
+    unsigned mask;
+    size_t i;
+
+    for (i = 0; i + 16 <= n; i += 16) {
+        b = _mm_loadu_si128((const __m128i *)(src + i));
+        in = _mm_and_si128(_mm_cmpgt_epi8(b, below),
+            _mm_cmplt_epi8(b, above));
+        mask = _mm_movemask_epi8(in);
+        _mm_storeu_si128((__m128i *)(dst + i),
+            _mm_sub_epi16(_mm_unpacklo_epi8(b, zero), base));
+        _mm_storeu_si128((__m128i *)(dst + i + 8),
+            _mm_sub_epi16(_mm_unpackhi_epi8(b, zero), base));
+        if (mask != 0xFFFF)
+            return i + __builtin_ctz(~mask);
+    }
+
+    return i;
+}
+
+TARGET("avx2") static size_t
+ascii_avx2(uint16_t *dst, const uint8_t *src, size_t n, int lo, int hi,
+    int first)
+{
+    __m256i below = _mm256_set1_epi8(lo - 1);
+    __m256i above = _mm256_set1_epi8(hi + 1);
+    __m256i base = _mm256_set1_epi16(first);
+    __m256i b, in;
+    uint32_t mask;
+    size_t i;
+
+    for (i = 0; i + 32 <= n; i += 32) {
+        b = _mm256_loadu_si256((const __m256i *)(src + i));
+        in = _mm256_and_si256(_mm256_cmpgt_epi8(b, below),
+            _mm256_cmpgt_epi8(above, b));
+        mask = _mm256_movemask_epi8(in);
+        _mm256_storeu_si256((__m256i *)(dst + i), _mm256_sub_epi16(
+            _mm256_cvtepu8_epi16(_mm256_castsi256_si128(b)), base));
+        _mm256_storeu_si256((__m256i *)(dst + i + 16), _mm256_sub_epi16(
+            _mm256_cvtepu8_epi16(_mm256_extracti128_si256(b, 1)), base));
+        if (mask != 0xFFFFFFFF)
+            return i + __builtin_ctz(~mask);
+    }
+
+    return i;
+}
+
+#endif /* WF_X86 */
+
+size_t
+winfont_ascii_glyphs_isa(int isa, uint16_t *dst, const uint8_t *src,
+    size_t n, int lo, int hi, int first)
+{
+    size_t done = 0;
+
+    if (lo > hi)
+        return 0;
+
+#ifdef WF_X86
+    if (isa >= WF_ISA_AVX2)
+        done = ascii_avx2(dst, src, n, lo, hi, first);
+    else if (isa >= WF_ISA_SSE2)
+        done = ascii_sse2(dst, src, n, lo, hi, first);
+#endif
+
+    /* The scalar loop takes the bytes after the last whole vector, and
+     * stops at once if a kernel stopped short of them. */
+    return done + ascii_scalar(dst + done, src + done, n - done, lo, hi,
+        first);
+}
+
+size_t
+winfont_ascii_glyphs(uint16_t *dst, const uint8_t *src, size_t n,
+    int lo, int hi, int first)
+{
+    return winfont_ascii_glyphs_isa(winfont_cpu_isa(), dst, src, n,
+        lo, hi, first);
+}
+
+/* Emboldening
+ *
+ * A bold pixel also sets the one to its right. Rows of the same byte
+ * width as before have a clear last pixel, so a bitmap of them is one
+ * bit stream and no pixel spreads into the next row. One byte rows of
+ * eight pixels grow to two bytes, which are built as 16-bit words. */
+
+#ifdef WF_X86
+
+TARGET("sse2") static size_t
+bold_sse2(uint8_t *dst, const uint8_t *src, size_t n)
+{
+    const __m128i lo7 = _mm_set1_epi8(0x7F), hi1 = _mm_set1_epi8((char)0x80);
+    __m128i a, p;
+    size_t i;
+
+    /* From byte 1, so the byte before is always there to load. */
+    for (i = 1; i + 16 <= n; i += 16) {
+        a = _mm_loadu_si128((const __m128i *)(src + i));
+        p = _mm_loadu_si128((const __m128i *)(src + i - 1));
+        a = _mm_or_si128(a, _mm_and_si128(_mm_srli_epi16(a, 1), lo7));
+        a = _mm_or_si128(a, _mm_and_si128(_mm_slli_epi16(p, 7), hi1));
+        _mm_storeu_si128((__m128i *)(dst + i), a);
+    }
+
+    return i;
+}
+
+TARGET("avx2") static size_t
+bold_avx2(uint8_t *dst, const uint8_t *src, size_t n)
+{
+    const __m256i lo7 = _mm256_set1_epi8(0x7F);
+    const __m256i hi1 = _mm256_set1_epi8((char)0x80);
+    __m256i a, p;
+    size_t i;
+
+    for (i = 1; i + 32 <= n; i += 32) {
+        a = _mm256_loadu_si256((const __m256i *)(src + i));
+        p = _mm256_loadu_si256((const __m256i *)(src + i - 1));
+        a = _mm256_or_si256(a,
+            _mm256_and_si256(_mm256_srli_epi16(a, 1), lo7));
+        a = _mm256_or_si256(a,
+            _mm256_and_si256(_mm256_slli_epi16(p, 7), hi1));
+        _mm256_storeu_si256((__m256i *)(dst + i), a);
+    }
+
+    return i;
+}
+
+/* Byte b becomes the word (b | b >> 1) | b << 15, which is stored
+ * little endian as the two bytes of the wider row. */
+TARGET("sse2") static size_t
+bold_bytes_sse2(uint8_t *dst, const uint8_t *src, size_t n)
+{
+    const __m128i zero = _mm_setzero_si128();
+    __m128i b, lo, hi;
+    size_t i;
+
+    for (i = 0; i + 16 <= n; i += 16) {
+        b = _mm_loadu_si128((const __m128i *)(src + i));
+        lo = _mm_unpacklo_epi8(b, zero);
+        hi = _mm_unpackhi_epi8(b, zero);
+        lo = _mm_or_si128(_mm_or_si128(lo, _mm_srli_epi16(lo, 1)),
+            _mm_slli_epi16(lo, 15));
+        hi = _mm_or_si128(_mm_or_si128(hi, _mm_srli_epi16(hi, 1)),
+            _mm_slli_epi16(hi, 15));
+        _mm_storeu_si128((__m128i *)(dst + 2 * i), lo);
+        _mm_storeu_si128((__m128i *)(dst + 2 * i + 16), hi);
+    }
+
+    return i;
+}
+
+TARGET("avx2") static size_t
+bold_bytes_avx2(uint8_t *dst, const uint8_t *src, size_t n)
+{
+    __m256i w;
+    size_t i;
+
+    for (i = 0; i + 16 <= n; i += 16) {
+        w = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(src + i)));
+        w = _mm256_or_si256(_mm256_or_si256(w, _mm256_srli_epi16(w, 1)),
+            _mm256_slli_epi16(w, 15));
+        _mm256_storeu_si256((__m256i *)(dst + 2 * i), w);
+    }
+
+    return i;
+}
+
+#endif /* WF_X86 */
+
+void
+winfont_bold_bits_isa(int isa, uint8_t *dst, const uint8_t *src, size_t n)
+{
+    size_t done = 1;
+
+    if (n == 0)
+        return;
+
+    dst[0] = src[0] | src[0] >> 1;
+#ifdef WF_X86
+    if (isa >= WF_ISA_AVX2)
+        done = bold_avx2(dst, src, n);
+    else if (isa >= WF_ISA_SSE2)
+        done = bold_sse2(dst, src, n);
+#endif
+
+    for (size_t i = done; i < n; i++)
+        dst[i] = src[i] | src[i] >> 1 | (uint8_t)(src[i - 1] << 7);
+}
+
+void
+winfont_bold_bits(uint8_t *dst, const uint8_t *src, size_t n)
+{
+    winfont_bold_bits_isa(winfont_cpu_isa(), dst, src, n);
+}
+
+void
+winfont_bold_bytes_isa(int isa, uint8_t *dst, const uint8_t *src, size_t n)
+{
+    size_t done = 0;
+
+#ifdef WF_X86
+    if (isa >= WF_ISA_AVX2)
+        done = bold_bytes_avx2(dst, src, n);
+    else if (isa >= WF_ISA_SSE2)
+        done = bold_bytes_sse2(dst, src, n);
+#endif
+
+    for (size_t i = done; i < n; i++) {
+        dst[2 * i] = src[i] | src[i] >> 1;
+        dst[2 * i + 1] = (uint8_t)(src[i] << 7);
+    }
+}
+
+void
+winfont_bold_bytes(uint8_t *dst, const uint8_t *src, size_t n)
+{
+    winfont_bold_bytes_isa(winfont_cpu_isa(), dst, src, n);
+}
@@ -0,0 +1,482 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 Eddie Hillenbrand
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+/* Bulk file reads for the batch and index paths. A file is read in
+ * rounds: the first HEAD_SIZE bytes, which hold the MZ and NE headers,
+ * the resource table and, in most files, the FNT headers, and then
+ * whatever winfont_mem_extent says the headers, or the first font's
+ * char table and bits, still need. Usually that is two reads a file.
+ *
+ * On Linux each thread takes its files a chunk at a time and drives
+ * the whole chunk through an io_uring, so the opens, the header reads,
+ * the follow-up reads and the closes of up to CHUNK files are in
+ * flight together and each round costs one system call for all of
+ * them. The ring is set up with raw system calls, so there is no
+ * liburing dependency. Where io_uring is missing, too old or not
+ * allowed, or with -DWINFONT_NO_URING, each file is read with open and
+ * pread instead. */
+
+#include <winfont.h>
+#include "winfont_private.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#if defined(__linux__) && !defined(WINFONT_NO_URING) && \
+    defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define WF_HAVE_URING 1
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+#endif
+
+#define MAX_THREADS 64
+#define HEAD_SIZE   4096
+#define MAX_FILE    (64 << 20)  /* bytes read of any one file */
+#define CHUNK       64          /* files in flight per ring */
+
+struct bulk {
+    char *const *paths;
+    int npaths;
+    int header_only;
+    int backend;
+    int chunk;
+    int next;
+    winfont_bulk_fn fn;
+    void *ctx;
+};
+
+struct bulk_file {
+    int fd;
+    uint8_t *buf;
+    size_t len;                 /* bytes read */
+    size_t want;                /* bytes asked for by the last read */
+    WinFont_Error err;
+};
+
+static void
+bulk_start(struct bulk_file *f)
+{
+    f->fd = -1;
+    f->len = 0;
+    f->want = HEAD_SIZE;
+    f->buf = malloc(HEAD_SIZE);
+    f->err = f->buf ? WinFont_ErrNone : WinFont_ErrNoMem;
+}
+
+/* Account for a read of f that returned res and size the next one.
+ * Returns how many bytes to read at f->len, or 0 when f is read. */
+static size_t
+bulk_next(struct bulk *b, struct bulk_file *f, int i, ssize_t res,
+    int errnum)
+{
+    uint8_t *grown;
+    size_t need;
+
+    if (res < 0) {
+        WF_LOG(WinFont_LogError, "%s: %s", b->paths[i], strerror(errnum));
+        f->err = WinFont_ErrIO;
+        return 0;
+    }
+
+    f->len += res;
+    if ((size_t)res < f->want)
+        return 0;               /* end of file */
+
+    need = winfont_mem_extent(f->buf, f->len, b->header_only);
+    if (need == 0 || need == SIZE_MAX)
+        need = 2 * f->len;      /* no telling yet, read on */
+    if (need > MAX_FILE)
+        need = MAX_FILE;
+    if (need <= f->len)
+        return 0;
+
+    grown = realloc(f->buf, need);
+    if (!grown) {
+        f->err = WinFont_ErrNoMem;
+        return 0;
+    }
+    f->buf = grown;
+    f->want = need - f->len;
+
+    return f->want;
+}
+
+static void
+bulk_finish(struct bulk *b, struct bulk_file *f, int i)
+{
+    if (f->err) {
+        free(f->buf);
+        b->fn(b->ctx, i, NULL, 0, f->err);
+    } else {
+        b->fn(b->ctx, i, f->buf, f->len, WinFont_ErrNone);
+    }
+    f->buf = NULL;
+}
+
+static void
+bulk_pread(struct bulk *b, int i)
+{
+    struct bulk_file f;
+    ssize_t res;
+    size_t n;
+
+    bulk_start(&f);
+    if (!f.err) {
+        f.fd = open(b->paths[i], O_RDONLY | O_CLOEXEC);
+        if (f.fd == -1) {
+            WF_LOG(WinFont_LogError, "%s: %s", b->paths[i],
+                strerror(errno));
+            f.err = WinFont_ErrIO;
+        }
+    }
+
+    if (f.fd != -1) {
+        n = f.want;
+        do {
+            do
+                res = pread(f.fd, f.buf + f.len, n, f.len);
+            while (res == -1 && errno == EINTR);
+        } while ((n = bulk_next(b, &f, i, res, errno)));
+        close(f.fd);
+    }
+
+    bulk_finish(b, &f, i);
+}
+
+#ifdef WF_HAVE_URING
+
+/* What a completion was for, in the low bits of its user_data. The
+ * file's index in the chunk is in the rest. */
+enum {
+    OP_OPEN,
+    OP_READ,
+    OP_CLOSE,
+};
+
+struct ring {
+    int fd;
+    void *rings;
+    size_t ringslen;
+    struct io_uring_sqe *sqes;
+    size_t sqeslen;
+    unsigned *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_cqe *cqes;
+    unsigned pending;           /* queued but not submitted */
+};
+
+static void
+ring_free(struct ring *r)
+{
+    munmap(r->sqes, r->sqeslen);
+    munmap(r->rings, r->ringslen);
+    close(r->fd);
+}
+
+/* Set up a ring of entries slots, or return -1 if the kernel can't.
+ * OPENAT, READ and CLOSE came in 5.6, along with
+ * IORING_FEAT_RW_CUR_POS, which is how they are detected here. */
+static int
+ring_init(struct ring *r, unsigned entries)
+{
+    struct io_uring_params p;
+    uint8_t *base;
+    size_t sqlen, cqlen;
+
+    memset(&p, 0, sizeof(p));
+    r->fd = syscall(__NR_io_uring_setup, entries, &p);
+    if (r->fd < 0)
+        return -1;
+
+    if (!(p.features & IORING_FEAT_SINGLE_MMAP) ||
+        !(p.features & IORING_FEAT_RW_CUR_POS)) {
+        close(r->fd);
+        return -1;
+    }
+
+    sqlen = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    cqlen = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    r->ringslen = sqlen > cqlen ? sqlen : cqlen;
+    r->rings = mmap(NULL, r->ringslen, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+    if (r->rings == MAP_FAILED) {
+        close(r->fd);
+        return -1;
+    }
+
+    r->sqeslen = p.sq_entries * sizeof(struct io_uring_sqe);
+    r->sqes = mmap(NULL, r->sqeslen, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+    if (r->sqes == MAP_FAILED) {
+        munmap(r->rings, r->ringslen);
+        close(r->fd);
+        return -1;
+    }
+
+    base = r->rings;
+    r->sq_tail = (unsigned *)(base + p.sq_off.tail);
+    r->sq_mask = (unsigned *)(base + p.sq_off.ring_mask);
+    r->sq_array = (unsigned *)(base + p.sq_off.array);
+    r->cq_head = (unsigned *)(base + p.cq_off.head);
+    r->cq_tail = (unsigned *)(base + p.cq_off.tail);
+    r->cq_mask = (unsigned *)(base + p.cq_off.ring_mask);
+    r->cqes = (struct io_uring_cqe *)(base + p.cq_off.cqes);
+    r->pending = 0;
+
+    return 0;
+}
+
+/* Queue one request. The caller keeps no more requests in flight than
+ * the ring has slots. */
+static void
+ring_push(struct ring *r, int opcode, int fd, const void *addr,
+    unsigned len, uint64_t off, uint64_t data)
+{
+    struct io_uring_sqe *sqe;
+    unsigned tail, idx;
+
+    tail = *r->sq_tail;
+    idx = tail & *r->sq_mask;
+    sqe = &r->sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = opcode;
+    sqe->fd = fd;
+    sqe->addr = (uintptr_t)addr;
+    sqe->len = len;
+    sqe->off = off;
+    sqe->user_data = data;
+    if (opcode == IORING_OP_OPENAT)
+        sqe->open_flags = O_RDONLY | O_CLOEXEC;
+    r->sq_array[idx] = idx;
+
+    __atomic_store_n(r->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    r->pending++;
+}
+
+/* Submit what is queued and wait for at least one completion. */
+static int
+ring_enter(struct ring *r)
+{
+    int ret;
+
+    do
+        ret = syscall(__NR_io_uring_enter, r->fd, r->pending, 1,
+            IORING_ENTER_GETEVENTS, NULL, 0);
+    while (ret == -1 && (errno == EINTR || errno == EAGAIN ||
+        errno == EBUSY));
+    if (ret < 0)
+        return -1;
+
+    r->pending -= ret;
+    return 0;
+}
+
+static void
+ring_read(struct ring *r, struct bulk_file *f, int k, size_t n)
+{
+    ring_push(r, IORING_OP_READ, f->fd, f->buf + f->len, n, f->len,
+        (uint64_t)k << 2 | OP_READ);
+}
+
+/* Read n files from first on through r. Every file has at most one
+ * request in flight, so n <= CHUNK keeps to the ring's slots. */
+static void
+bulk_uring_chunk(struct bulk *b, struct ring *r, int first, int n)
+{
+    struct bulk_file files[CHUNK], *f;
+    struct io_uring_cqe *cqe;
+    unsigned head, tail;
+    int left = 0, k, res;
+    size_t want;
+
+    for (k = 0; k < n; k++) {
+        f = &files[k];
+        bulk_start(f);
+        if (f->err) {
+            bulk_finish(b, f, first + k);
+            continue;
+        }
+        ring_push(r, IORING_OP_OPENAT, AT_FDCWD, b->paths[first + k], 0,
+            0, (uint64_t)k << 2 | OP_OPEN);
+        left++;
+    }
+
+    while (left > 0) {
+        if (ring_enter(r) == -1) {
+            /* Only bad arguments get here. What is in flight may still
+             * land in the buffers, so they are left allocated. */
+            WF_LOG(WinFont_LogError, "io_uring_enter: %s",
+                strerror(errno));
+            for (k = 0; k < n; k++)
+                if (files[k].buf)
+                    b->fn(b->ctx, first + k, NULL, 0, WinFont_ErrIO);
+            return;
+        }
+
+        head = *r->cq_head;
+        tail = __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE);
+        for (; head != tail; head++) {
+            cqe = &r->cqes[head & *r->cq_mask];
+            k = cqe->user_data >> 2;
+            res = cqe->res;
+            f = &files[k];
+
+            switch (cqe->user_data & 3) {
+            case OP_OPEN:
+                if (res < 0) {
+                    WF_LOG(WinFont_LogError, "%s: %s",
+                        b->paths[first + k], strerror(-res));
+                    f->err = WinFont_ErrIO;
+                    bulk_finish(b, f, first + k);
+                    left--;
+                    break;
+                }
+                f->fd = res;
+                ring_read(r, f, k, f->want);
+                break;
+            case OP_READ:
+                want = bulk_next(b, f, first + k, res, -res);
+                if (want)
+                    ring_read(r, f, k, want);
+                else
+                    ring_push(r, IORING_OP_CLOSE, f->fd, NULL, 0, 0,
+                        (uint64_t)k << 2 | OP_CLOSE);
+                break;
+            case OP_CLOSE:
+                bulk_finish(b, f, first + k);
+                left--;
+                break;
+            }
+        }
+        __atomic_store_n(r->cq_head, head, __ATOMIC_RELEASE);
+    }
+}
+
+#else
+
+struct ring {
+    int fd;
+};
+
+static int
+ring_init(struct ring *r, unsigned entries)
+{
+    (void)r;
+    (void)entries;
+    return -1;
+}
+
+static void
+ring_free(struct ring *r)
+{
+    (void)r;
+}
+
+static void
+bulk_uring_chunk(struct bulk *b, struct ring *r, int first, int n)
+{
+    (void)r;
+    for (int k = 0; k < n; k++)
+        bulk_pread(b, first + k);
+}
+
+#endif
+
+/* Take chunks of files until there are none left. r is the thread's
+ * ring, or NULL to pread. */
+static void
+bulk_run(struct bulk *b, struct ring *r)
+{
+    int i, n;
+
+    while ((i = __atomic_fetch_add(&b->next, b->chunk,
+            __ATOMIC_RELAXED)) < b->npaths) {
+        n = b->npaths - i < b->chunk ? b->npaths - i : b->chunk;
+        if (r) {
+            bulk_uring_chunk(b, r, i, n);
+        } else {
+            for (int k = 0; k < n; k++)
+                bulk_pread(b, i + k);
+        }
+    }
+}
+
+static void *
+bulk_worker(void *arg)
+{
+    struct bulk *b = arg;
+    struct ring r;
+
+    if (b->backend == WF_IO_URING && ring_init(&r, CHUNK) == 0) {
+        bulk_run(b, &r);
+        ring_free(&r);
+    } else {
+        bulk_run(b, NULL);
+    }
+
+    return NULL;
+}
+
+int
+winfont_bulk_read(char *const *paths, int npaths, int header_only,
+    int backend, int nthreads, winfont_bulk_fn fn, void *ctx)
+{
+    pthread_t threads[MAX_THREADS];
+    struct bulk b;
+    struct ring r;
+    int started = 0, have_ring = 0;
+
+    if (backend != WF_IO_PREAD) {
+        have_ring = ring_init(&r, CHUNK) == 0;
+        backend = have_ring ? WF_IO_URING : WF_IO_PREAD;
+    }
+
+    if (nthreads <= 0)
+        nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+    if (nthreads > npaths)
+        nthreads = npaths;
+    if (nthreads > MAX_THREADS)
+        nthreads = MAX_THREADS;
+
+    b.paths = paths;
+    b.npaths = npaths;
+    b.header_only = header_only;
+    b.backend = backend;
+    b.next = 0;
+    b.fn = fn;
+    b.ctx = ctx;
+    /* Big enough chunks to fill a ring, small enough to give every
+     * thread some. */
+    b.chunk = nthreads > 0 ? (npaths + nthreads - 1) / nthreads : 1;
+    if (b.chunk > CHUNK)
+        b.chunk = CHUNK;
+    if (backend == WF_IO_PREAD || b.chunk < 1)
+        b.chunk = 1;
+
+    for (int i = 1; i < nthreads; i++) {
+        if (pthread_create(&threads[started], NULL, bulk_worker, &b))
+            break;
+        started++;
+    }
+    /* The calling thread works too, with the ring it probed with. */
+    bulk_run(&b, have_ring ? &r : NULL);
+    for (int i = 0; i < started; i++)
+        pthread_join(threads[i], NULL);
+
+    if (have_ring)
+        ring_free(&r);
+
+    return backend;
+}
@@ -0,0 +1,339 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 Eddie Hillenbrand
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+/* Precompiled font caches. A cache file holds a font exactly as it
+ * sits in memory after loading, so opening one is a mmap and a few
+ * pointer fixups:
+ *
+ *     header      struct cache_header
+ *     info        the FNT header and v3 fields, copied
+ *     facename    null-terminated
+ *     widths      uint16_t per glyph
+ *     offsets     uint32_t per glyph
+ *     bitmap      row major, 64 byte aligned
+ *
+ * Sections are 16 byte aligned and the file is padded to 64 bytes.
+ * Numbers are in host byte order, which the byte order tag records;
+ * a cache from a machine of the other order is treated as stale. */
+
+#include <winfont.h>
+#include "winfont_private.h"
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define CACHE_MAGIC     "WFCACHE"
+#define CACHE_VERSION   2
+#define CACHE_BYTEORDER 0x01020304
+
+struct cache_header {
+    char magic[8];
+    uint32_t byteorder;
+    uint32_t version;
+    uint64_t length;            /* whole file */
+    uint64_t checksum;          /* of everything after the header */
+    uint64_t src_size;
+    int64_t src_mtime;
+    int32_t nglyphs;
+    int32_t width;
+    int32_t height;
+    int32_t charset;
+    uint32_t info_off;
+    uint32_t info_size;
+    uint32_t name_off;
+    uint32_t widths_off;
+    uint32_t offsets_off;
+    uint32_t bitmap_off;
+    uint32_t bitmap_size;
+    uint32_t reserved;
+};
+
+#ifdef __APPLE__
+#define MTIME_NSEC(st) ((st)->st_mtimespec.tv_nsec)
+#else
+#define MTIME_NSEC(st) ((st)->st_mtim.tv_nsec)
+#endif
+
+/* Modification time in nanoseconds */
+#define MTIME(st) ((int64_t)(st)->st_mtime * 1000000000 + MTIME_NSEC(st))
+
+#define ALIGN(n, a) (((n) + (a) - 1) & ~(size_t)((a) - 1))
+
+/* FNV-1a over 64 bit words; len is a multiple of 8. */
+static uint64_t
+cache_checksum(const uint8_t *p, size_t len)
+{
+    uint64_t h = 0xcbf29ce484222325ULL, w;
+
+    for (size_t i = 0; i < len; i += 8) {
+        memcpy(&w, p + i, 8);
+        h = (h ^ w) * 0x100000001b3ULL;
+    }
+
+    return h;
+}
+
+int
+winfont_save_cache(WinFont *wf, const char *source_path,
+    const char *cache_path)
+{
+    struct cache_header hd;
+    struct stat st;
+    uint8_t *blob = NULL, *bitmap;
+    const uint8_t *rows;
+    uint16_t *widths;
+    uint32_t *offsets;
+    size_t len, off, namelen, rowbytes, sz;
+    char *tmp = NULL;
+    int fd = -1, ret = -1;
+    WinFont_Error err = WinFont_ErrIO;
+
+    if (!wf || !cache_path) {
+        winfont_set_error(WinFont_ErrArg);
+        return -1;
+    }
+
+    memset(&hd, 0, sizeof(hd));
+    if (source_path) {
+        if (stat(source_path, &st) == -1) {
+            winfont_set_error(WinFont_ErrIO);
+            return -1;
+        }
+        hd.src_size = st.st_size;
+        hd.src_mtime = MTIME(&st);
+    }
+
+    namelen = strlen(wf->facename ? wf->facename : "") + 1;
+    off = sizeof(hd);
+    hd.info_off = off;
+    hd.info_size = winfont_info_size();
+    off = ALIGN(off + hd.info_size, 16);
+    hd.name_off = off;
+    off = ALIGN(off + namelen, 16);
+    hd.widths_off = off;
+    off = ALIGN(off + wf->nglyphs * sizeof(uint16_t), 16);
+    hd.offsets_off = off;
+    off = ALIGN(off + wf->nglyphs * sizeof(uint32_t), 64);
+    hd.bitmap_off = off;
+    for (int g = 0; g < wf->nglyphs; g++)
+        off += (size_t)(wf->widths[g] + 7) / 8 * wf->height;
+    if (off > UINT32_MAX) {
+        winfont_set_error(WinFont_ErrNoMem);
+        return -1;
+    }
+    hd.bitmap_size = off - hd.bitmap_off;
+    len = ALIGN(off, 64);
+
+    blob = calloc(1, len);
+    if (!blob) {
+        winfont_set_error(WinFont_ErrNoMem);
+        return -1;
+    }
+
+    memcpy(blob + hd.info_off, wf->_fn_info, hd.info_size);
+    memcpy(blob + hd.name_off, wf->facename ? wf->facename : "", namelen);
+    widths = (uint16_t *)(blob + hd.widths_off);
+    offsets = (uint32_t *)(blob + hd.offsets_off);
+    bitmap = blob + hd.bitmap_off;
+    off = 0;
+    for (int g = 0; g < wf->nglyphs; g++) {
+        rowbytes = (wf->widths[g] + 7) / 8;
+        sz = rowbytes * wf->height;
+        widths[g] = wf->widths[g];
+        offsets[g] = off;
+        if (!sz)
+            continue;
+        /* Glyphs the font already holds come back as a pointer into
+         * it and are copied, the rest are decoded in place. */
+        rows = winfont_glyph_get(wf, g, WinFont_LayoutRowMSB,
+            bitmap + off, sz);
+        if (!rows) {
+            err = winfont_last_error();
+            goto cleanup;
+        }
+        if (rows != bitmap + off)
+            memcpy(bitmap + off, rows, sz);
+        off += sz;
+    }
+
+    memcpy(hd.magic, CACHE_MAGIC, sizeof(hd.magic));
+    hd.byteorder = CACHE_BYTEORDER;
+    hd.version = CACHE_VERSION;
+    hd.length = len;
+    hd.nglyphs = wf->nglyphs;
+    hd.width = wf->width;
+    hd.height = wf->height;
+    hd.charset = wf->charset;
+    hd.checksum = cache_checksum(blob + sizeof(hd), len - sizeof(hd));
+    memcpy(blob, &hd, sizeof(hd));
+
+    /* Write a temporary file and rename it, so a reader never maps a
+     * half written cache. */
+    tmp = malloc(strlen(cache_path) + 32);
+    if (!tmp) {
+        err = WinFont_ErrNoMem;
+        goto cleanup;
+    }
+    sprintf(tmp, "%s.%ld.tmp", cache_path, (long)getpid());
+    fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1)
+        goto cleanup;
+    for (off = 0; off < len; ) {
+        ssize_t n = write(fd, blob + off, len - off);
+        if (n <= 0)
+            goto cleanup;
+        off += n;
+    }
+    if (close(fd) == -1) {
+        fd = -1;
+        goto cleanup;
+    }
+    fd = -1;
+    if (rename(tmp, cache_path) == -1)
+        goto cleanup;
+    ret = 0;
+
+cleanup:
+    if (fd != -1)
+        close(fd);
+    if (ret == -1 && tmp)
+        unlink(tmp);
+    if (ret == -1)
+        winfont_set_error(err);
+    free(tmp);
+    free(blob);
+    return ret;
+}
+
+/* The font in a mapped cache, or NULL if it is not a valid cache or
+ * does not match st. */
+static WinFont *
+cache_map_font(uint8_t *map, size_t len, const struct stat *st)
+{
+    struct cache_header hd;
+    WinFont *wf;
+    size_t need;
+
+    if (len < sizeof(hd))
+        return NULL;
+    memcpy(&hd, map, sizeof(hd));
+
+    if (memcmp(hd.magic, CACHE_MAGIC, sizeof(hd.magic)) ||
+        hd.byteorder != CACHE_BYTEORDER || hd.version != CACHE_VERSION ||
+        hd.length != len || hd.info_size != winfont_info_size() ||
+        hd.nglyphs < 1 || hd.height < 1)
+        return NULL;
+
+    if (st && (hd.src_size != (uint64_t)st->st_size ||
+            hd.src_mtime != MTIME(st)))
+        return NULL;
+
+    if (hd.info_off + (size_t)hd.info_size > len ||
+        hd.name_off >= len || !memchr(map + hd.name_off, 0,
+            len - hd.name_off) ||
+        hd.widths_off % 2 || hd.offsets_off % 4 ||
+        hd.widths_off + hd.nglyphs * sizeof(uint16_t) > len ||
+        hd.offsets_off + hd.nglyphs * sizeof(uint32_t) > len ||
+        hd.bitmap_off + (size_t)hd.bitmap_size > len)
+        return NULL;
+
+    if (cache_checksum(map + sizeof(hd), len - sizeof(hd)) != hd.checksum)
+        return NULL;
+
+    wf = winfont_arena_new(NULL, 0, 0, 0, 0);
+    if (!wf)
+        return NULL;
+
+    wf->facename = (char *)map + hd.name_off;
+    wf->_fn_info = (WinFont_Info *)(map + hd.info_off);
+    wf->widths = (uint16_t *)(map + hd.widths_off);
+    wf->offsets = (uint32_t *)(map + hd.offsets_off);
+    wf->bitmap = map + hd.bitmap_off;
+    wf->_bmbytes = hd.bitmap_size;
+    wf->nglyphs = hd.nglyphs;
+    wf->width = hd.width;
+    wf->height = hd.height;
+    wf->wbytes = (hd.width + 7) / 8;
+    wf->charset = hd.charset;
+
+    for (int g = 0; g < wf->nglyphs; g++) {
+        need = (size_t)(wf->widths[g] + 7) / 8 * wf->height;
+        if (wf->offsets[g] + need > hd.bitmap_size) {
+            winfont_free(wf);
+            return NULL;
+        }
+    }
+
+    wf->width = winfont_cell_width(wf->widths, wf->nglyphs, wf->width);
+    wf->wbytes = (wf->width + 7) / 8;
+    wf->_map = map;
+    wf->_maplen = len;
+
+    return wf;
+}
+
+WinFont *
+winfont_load_cache(const char *cache_path, const char *source_path)
+{
+    struct stat st, cst;
+    WinFont *wf = NULL;
+    WinFont_Error err = WinFont_ErrIO;
+    void *map;
+    int fd;
+
+    if (!cache_path) {
+        winfont_set_error(WinFont_ErrArg);
+        return NULL;
+    }
+    if (source_path && stat(source_path, &st) == -1) {
+        winfont_set_error(WinFont_ErrIO);
+        return NULL;
+    }
+
+    fd = open(cache_path, O_RDONLY);
+    if (fd != -1) {
+        if (fstat(fd, &cst) == 0 && cst.st_size > 0) {
+            err = WinFont_ErrFormat;
+            map = mmap(NULL, cst.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (map != MAP_FAILED) {
+                wf = cache_map_font(map, cst.st_size,
+                    source_path ? &st : NULL);
+                if (!wf)
+                    munmap(map, cst.st_size);
+            } else {
+                err = WinFont_ErrIO;
+            }
+        }
+        close(fd);
+    }
+
+    if (wf)
+        return wf;
+    if (!source_path) {
+        winfont_set_error(err);
+        return NULL;
+    }
+
+    /* Missing, damaged or stale: load the source and rebuild. A cache
+     * that cannot be written is not an error, so it leaves the last
+     * error alone. */
+    wf = winfont_open_mmap(source_path);
+    if (wf) {
+        err = winfont_last_error();
+        winfont_save_cache(wf, source_path, cache_path);
+        winfont_set_error(err);
+    }
+
+    return wf;
+}
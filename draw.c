@@ -0,0 +1,429 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 Eddie Hillenbrand
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+/* Software text rendering into caller owned framebuffers.
+ *
+ * Glyph rows are expanded a group of pixels at a time through tables
+ * of pixel masks: one 64-bit mask covers 8 pixels at 8bpp, 4 at 16bpp
+ * and 2 at 32bpp. With the mask m, an opaque group is fg & m | bg & ~m
+ * and a transparent one dst & ~m | fg & m, so there is no per pixel
+ * branch. Pixels are stored little endian, like the FON data. */
+
+#include <winfont.h>
+#include "winfont_private.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define INLINE static inline __attribute__((always_inline))
+
+/* 8 pixels of 8 bits for every byte of glyph bits. Pixel 0 is the MSB
+ * of the glyph byte and the lowest byte of the mask. */
+#define M8(b) ( \
+    ((b) & 0x80 ? 0xFFULL : 0) | \
+    ((b) & 0x40 ? 0xFF00ULL : 0) | \
+    ((b) & 0x20 ? 0xFF0000ULL : 0) | \
+    ((b) & 0x10 ? 0xFF000000ULL : 0) | \
+    ((b) & 0x08 ? 0xFF00000000ULL : 0) | \
+    ((b) & 0x04 ? 0xFF0000000000ULL : 0) | \
+    ((b) & 0x02 ? 0xFF000000000000ULL : 0) | \
+    ((b) & 0x01 ? 0xFF00000000000000ULL : 0))
+#define M8_4(b)   M8(b), M8((b) + 1), M8((b) + 2), M8((b) + 3)
+#define M8_16(b)  M8_4(b), M8_4((b) + 4), M8_4((b) + 8), M8_4((b) + 12)
+#define M8_64(b)  M8_16(b), M8_16((b) + 16), M8_16((b) + 32), \
+    M8_16((b) + 48)
+
+static const uint64_t mask8[256] = {
+    M8_64(0), M8_64(64), M8_64(128), M8_64(192),
+};
+
+/* 4 pixels of 16 bits for every nibble. */
+#define M16(n) ( \
+    ((n) & 0x8 ? 0xFFFFULL : 0) | \
+    ((n) & 0x4 ? 0xFFFF0000ULL : 0) | \
+    ((n) & 0x2 ? 0xFFFF00000000ULL : 0) | \
+    ((n) & 0x1 ? 0xFFFF000000000000ULL : 0))
+
+static const uint64_t mask16[16] = {
+    M16(0), M16(1), M16(2), M16(3), M16(4), M16(5), M16(6), M16(7),
+    M16(8), M16(9), M16(10), M16(11), M16(12), M16(13), M16(14), M16(15),
+};
+
+/* 2 pixels of 32 bits for every 2 bits. */
+static const uint64_t mask32[4] = {
+    0, 0xFFFFFFFF00000000ULL, 0x00000000FFFFFFFFULL, ~0ULL,
+};
+
+INLINE uint64_t
+load64(const uint8_t *p)
+{
+    uint64_t v;
+
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+INLINE void
+store64(uint8_t *p, uint64_t v)
+{
+    memcpy(p, &v, sizeof(v));
+}
+
+INLINE uint64_t
+blend(uint64_t m, uint64_t fg, uint64_t bg, const uint8_t *dst, int opaque)
+{
+    if (opaque)
+        return (fg & m) | (bg & ~m);
+    return (load64(dst) & ~m) | (fg & m);
+}
+
+/* Broadcast a pixel value across 64 bits. */
+static uint64_t
+splat(uint32_t v, int bpp)
+{
+    switch (bpp) {
+    case 1:
+        return (v & 0xFF) * 0x0101010101010101ULL;
+    case 2:
+        return (v & 0xFFFF) * 0x0001000100010001ULL;
+    default:
+        return (uint64_t)v << 32 | v;
+    }
+}
+
+static void
+put_pixel(uint8_t *p, int bpp, uint32_t v)
+{
+    uint16_t v16 = v;
+    uint8_t v8 = v;
+
+    switch (bpp) {
+    case 1:
+        *p = v8;
+        break;
+    case 2:
+        memcpy(p, &v16, 2);
+        break;
+    default:
+        memcpy(p, &v, 4);
+        break;
+    }
+}
+
+/* The leftover pixels of a row, and clipped glyphs. */
+static void
+blit_pixels(uint8_t *dst, const uint8_t *src, int x0, int n, int bpp,
+    uint32_t fg, uint32_t bg, int opaque)
+{
+    for (int x = x0; x < x0 + n; x++, dst += bpp) {
+        if ((src[x / 8] >> (7 - x % 8)) & 1)
+            put_pixel(dst, bpp, fg);
+        else if (opaque)
+            put_pixel(dst, bpp, bg);
+    }
+}
+
+/* Eight pixels of b through the tables. */
+INLINE void
+blit_byte(uint8_t *d, uint8_t b, int bpp, uint64_t fg, uint64_t bg,
+    int opaque)
+{
+    switch (bpp) {
+    case 1:
+        store64(d, blend(mask8[b], fg, bg, d, opaque));
+        break;
+    case 2:
+        store64(d, blend(mask16[b >> 4], fg, bg, d, opaque));
+        store64(d + 8, blend(mask16[b & 0xF], fg, bg, d + 8, opaque));
+        break;
+    default:
+        store64(d, blend(mask32[b >> 6], fg, bg, d, opaque));
+        store64(d + 8, blend(mask32[(b >> 4) & 3], fg, bg, d + 8, opaque));
+        store64(d + 16, blend(mask32[(b >> 2) & 3], fg, bg, d + 16,
+            opaque));
+        store64(d + 24, blend(mask32[b & 3], fg, bg, d + 24, opaque));
+        break;
+    }
+}
+
+/* One unclipped glyph, full whole bytes and tail more pixels wide.
+ * Inlined into blit_glyph once for each pixel size and again for rows
+ * of one and two whole bytes, with and without a tail, so the common
+ * widths and their bold copies get constant loop bounds. The tail of
+ * a row at least 8 wide is drawn as the 8 pixels that end at its right
+ * edge, which draws some pixels twice but the same both times. */
+INLINE void
+blit_rows(uint8_t *dst, int stride, const uint8_t *src, int full, int tail,
+    int h, int bpp, uint64_t fg, uint64_t bg, uint32_t fg1, uint32_t bg1,
+    int opaque)
+{
+    int rowbytes = full + (tail > 0);
+    uint8_t *d;
+
+    for (int r = 0; r < h; r++, src += rowbytes, dst += stride) {
+        d = dst;
+        for (int i = 0; i < full; i++, d += 8 * bpp)
+            blit_byte(d, src[i], bpp, fg, bg, opaque);
+        if (tail && full)
+            blit_byte(d - (8 - tail) * bpp,
+                (uint8_t)((src[full - 1] << 8 | src[full]) >> (8 - tail)),
+                bpp, fg, bg, opaque);
+        else if (tail)
+            blit_pixels(d, src, 0, tail, bpp, fg1, bg1, opaque);
+    }
+}
+
+#define BLIT_ROWS(full, tail, bpp, op) \
+    blit_rows(dst, stride, src, full, tail, h, bpp, fg, bg, fg1, bg1, op)
+
+#define BLIT_WIDTHS(bpp, op) \
+    switch (w) { \
+    case 8: BLIT_ROWS(1, 0, bpp, op); break; \
+    case 16: BLIT_ROWS(2, 0, bpp, op); break; \
+    default: \
+        if (w / 8 == 1) \
+            BLIT_ROWS(1, w % 8, bpp, op); \
+        else if (w / 8 == 2) \
+            BLIT_ROWS(2, w % 8, bpp, op); \
+        else \
+            BLIT_ROWS(w / 8, w % 8, bpp, op); \
+        break; \
+    }
+
+static void
+blit_glyph(uint8_t *dst, int stride, const uint8_t *src, int w, int h,
+    int bpp, uint32_t fg1, uint32_t bg1, int opaque)
+{
+    uint64_t fg = splat(fg1, bpp), bg = splat(bg1, bpp);
+
+    if (opaque) {
+        switch (bpp) {
+        case 1: BLIT_WIDTHS(1, 1) break;
+        case 2: BLIT_WIDTHS(2, 1) break;
+        default: BLIT_WIDTHS(4, 1) break;
+        }
+    } else {
+        switch (bpp) {
+        case 1: BLIT_WIDTHS(1, 0) break;
+        case 2: BLIT_WIDTHS(2, 0) break;
+        default: BLIT_WIDTHS(4, 0) break;
+        }
+    }
+}
+
+/* Glyph rows, in scratch if the font is lazy and the glyph is being
+ * decoded by another thread. The first try fails for such a glyph
+ * without it being an error, so it leaves the last error as it was. */
+static const uint8_t *
+glyph_rows(WinFont *wf, int g, uint8_t **scratch, size_t *scratchsz)
+{
+    size_t need = winfont_glyph_required_size(wf, g);
+    WinFont_Error err = winfont_last_error();
+    const uint8_t *rows;
+
+    rows = winfont_glyph_get(wf, g, WinFont_LayoutRowMSB, NULL, 0);
+    if (rows)
+        return rows;
+    winfont_set_error(err);
+
+    if (*scratchsz < need) {
+        free(*scratch);
+        *scratch = malloc(need);
+        *scratchsz = *scratch ? need : 0;
+        if (!*scratch)
+            return NULL;
+    }
+
+    return winfont_glyph_get(wf, g, WinFont_LayoutRowMSB, *scratch,
+        *scratchsz);
+}
+
+static void
+draw_glyph(const WinFont_Framebuffer *fb, int x, int y,
+    const uint8_t *rows, int w, int h, uint32_t fg, uint32_t bg, int mode)
+{
+    int bpp = fb->format, rowbytes = (w + 7) / 8;
+    int opaque = mode == WinFont_DrawOpaque;
+    int x0 = 0, y0 = 0, x1 = w, y1 = h;
+    uint8_t *dst;
+
+    if (x >= fb->width || y >= fb->height || x + w <= 0 || y + h <= 0)
+        return;
+
+    if (x >= 0 && y >= 0 && x + w <= fb->width && y + h <= fb->height) {
+        dst = fb->pixels + (size_t)y * fb->stride + (size_t)x * bpp;
+        blit_glyph(dst, fb->stride, rows, w, h, bpp, fg, bg, opaque);
+        return;
+    }
+
+    if (x < 0)
+        x0 = -x;
+    if (y < 0)
+        y0 = -y;
+    if (x + w > fb->width)
+        x1 = fb->width - x;
+    if (y + h > fb->height)
+        y1 = fb->height - y;
+
+    for (int r = y0; r < y1; r++) {
+        dst = fb->pixels + (size_t)(y + r) * fb->stride +
+            (size_t)(x + x0) * bpp;
+        blit_pixels(dst, rows + r * rowbytes, x0, x1 - x0, bpp,
+            fg, bg, opaque);
+    }
+}
+
+static int
+fb_is_valid(const WinFont_Framebuffer *fb)
+{
+    return fb && fb->pixels && (fb->format == WinFont_Pixel8 ||
+        fb->format == WinFont_Pixel16 || fb->format == WinFont_Pixel32);
+}
+
+int
+winfont_draw_glyph(WinFont *wf, const WinFont_Framebuffer *fb,
+    int x, int y, int g, uint32_t fg, uint32_t bg, int mode)
+{
+    uint8_t *scratch = NULL;
+    size_t scratchsz = 0;
+    const uint8_t *rows;
+
+    if (!wf || !fb_is_valid(fb) || g < 0 || g >= wf->nglyphs)
+        return x;
+
+    rows = glyph_rows(wf, g, &scratch, &scratchsz);
+    if (rows)
+        draw_glyph(fb, x, y, rows, wf->widths[g], wf->height,
+            fg, bg, mode);
+    free(scratch);
+
+    return x + wf->widths[g];
+}
+
+int
+winfont_draw_string(WinFont *wf, const WinFont_Framebuffer *fb,
+    int x, int y, uint32_t fg, uint32_t bg, int mode,
+    const char *text, size_t len)
+{
+    uint8_t *scratch = NULL;
+    size_t scratchsz = 0;
+    const uint8_t *rows;
+    int g, a, c;
+
+    if (!wf || !fb_is_valid(fb) || !text)
+        return x;
+
+    winfont_spacing(wf, &a, &c);
+    for (size_t i = 0; i < len && x < fb->width; i++) {
+        g = winfont_glyph_index(wf, (uint8_t)text[i]);
+        x += a;
+        if (x + wf->widths[g] > 0) {
+            rows = glyph_rows(wf, g, &scratch, &scratchsz);
+            if (rows)
+                draw_glyph(fb, x, y, rows, wf->widths[g], wf->height,
+                    fg, bg, mode);
+        }
+        x += wf->widths[g] + c;
+    }
+
+    free(scratch);
+    return x;
+}
+
+/* Scale glyph g of wf by s into *out, growing it as needed. */
+static const uint8_t *
+scaled_rows(WinFont *wf, int g, int s, uint8_t **scratch,
+    size_t *scratchsz, uint8_t **out, size_t *outsz)
+{
+    int w = wf->widths[g], h = wf->height;
+    size_t need = (size_t)(w * s + 7) / 8 * h * s;
+    const uint8_t *rows;
+
+    rows = glyph_rows(wf, g, scratch, scratchsz);
+    if (!rows)
+        return NULL;
+
+    if (*outsz < need) {
+        free(*out);
+        *out = malloc(need);
+        *outsz = *out ? need : 0;
+        if (!*out)
+            return NULL;
+    }
+
+    winfont_scale_glyph(*out, rows, w, h, s);
+    return *out;
+}
+
+int
+winfont_draw_glyph_scaled(WinFont *wf, const WinFont_Framebuffer *fb,
+    int x, int y, int g, int factor, uint32_t fg, uint32_t bg, int mode)
+{
+    uint8_t *scratch = NULL, *out = NULL;
+    size_t scratchsz = 0, outsz = 0;
+    const uint8_t *rows;
+    WinFont *sf;
+
+    if (!wf || !fb_is_valid(fb) || g < 0 || g >= wf->nglyphs ||
+        factor < 1 || factor > WINFONT_MAX_SCALE)
+        return x;
+
+    if (factor == 1)
+        return winfont_draw_glyph(wf, fb, x, y, g, fg, bg, mode);
+    if ((sf = winfont_cached_scale(wf, factor)))
+        return winfont_draw_glyph(sf, fb, x, y, g, fg, bg, mode);
+
+    rows = scaled_rows(wf, g, factor, &scratch, &scratchsz, &out, &outsz);
+    if (rows)
+        draw_glyph(fb, x, y, rows, wf->widths[g] * factor,
+            wf->height * factor, fg, bg, mode);
+    free(scratch);
+    free(out);
+
+    return x + wf->widths[g] * factor;
+}
+
+int
+winfont_draw_string_scaled(WinFont *wf, const WinFont_Framebuffer *fb,
+    int x, int y, int factor, uint32_t fg, uint32_t bg, int mode,
+    const char *text, size_t len)
+{
+    uint8_t *scratch = NULL, *out = NULL;
+    size_t scratchsz = 0, outsz = 0;
+    const uint8_t *rows;
+    WinFont *sf;
+    int g, w, a, c;
+
+    if (!wf || !fb_is_valid(fb) || !text ||
+        factor < 1 || factor > WINFONT_MAX_SCALE)
+        return x;
+
+    if (factor == 1)
+        return winfont_draw_string(wf, fb, x, y, fg, bg, mode, text, len);
+    if ((sf = winfont_cached_scale(wf, factor)))
+        return winfont_draw_string(sf, fb, x, y, fg, bg, mode, text, len);
+
+    winfont_spacing(wf, &a, &c);
+    for (size_t i = 0; i < len && x < fb->width; i++) {
+        g = winfont_glyph_index(wf, (uint8_t)text[i]);
+        w = wf->widths[g] * factor;
+        x += a * factor;
+        if (x + w > 0) {
+            rows = scaled_rows(wf, g, factor, &scratch, &scratchsz,
+                &out, &outsz);
+            if (rows)
+                draw_glyph(fb, x, y, rows, w, wf->height * factor,
+                    fg, bg, mode);
+        }
+        x += w + c * factor;
+    }
+
+    free(scratch);
+    free(out);
+    return x;
+}
@@ -0,0 +1,82 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 Eddie Hillenbrand
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+/* Error codes and diagnostics. The last error is kept per thread.
+ * Messages go to the callback set with winfont_set_log, and are only
+ * formatted when it wants their level. */
+
+#include <winfont.h>
+#include "winfont_private.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+
+static __thread WinFont_Error last_error;
+
+static WinFont_LogFunc log_fn;
+static void *log_ctx;
+int winfont_log_level;
+
+static const char *error_strings[] = {
+    [WinFont_ErrNone] = "no error",
+    [WinFont_ErrIO] = "read error",
+    [WinFont_ErrNoMem] = "out of memory",
+    [WinFont_ErrFormat] = "not a FON file or damaged",
+    [WinFont_ErrNoFont] = "no FNT resources",
+    [WinFont_ErrVector] = "vector font",
+    [WinFont_ErrVersion] = "unsupported FNT version",
+    [WinFont_ErrCharTable] = "glyph outside the font",
+    [WinFont_ErrArg] = "invalid argument",
+    [WinFont_ErrArchive] = "damaged or unsupported archive",
+};
+
+WinFont_Error
+winfont_last_error(void)
+{
+    return last_error;
+}
+
+const char *
+winfont_strerror(WinFont_Error err)
+{
+    if (err < 0 || err >= (int)(sizeof(error_strings) /
+            sizeof(error_strings[0])))
+        return "unknown error";
+
+    return error_strings[err];
+}
+
+void
+winfont_set_error(WinFont_Error err)
+{
+    last_error = err;
+}
+
+void
+winfont_set_log(WinFont_LogFunc fn, int level, void *ctx)
+{
+    log_fn = fn;
+    log_ctx = ctx;
+    __atomic_store_n(&winfont_log_level, fn ? level : 0, __ATOMIC_RELEASE);
+}
+
+void
+winfont_log(int level, const char *fmt, ...)
+{
+    char msg[256];
+    va_list ap;
+
+    if (!log_fn)
+        return;
+
+    va_start(ap, fmt);
+    vsnprintf(msg, sizeof(msg), fmt, ap);
+    va_end(ap);
+
+    log_fn(level, msg, log_ctx);
+}
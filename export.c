@@ -0,0 +1,783 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 Eddie Hillenbrand
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+/* Writers for the Linux console's PSF2 and X11's BDF and PCF. Glyph
+ * rows go from the decoded bitmap into each format with only their
+ * pad bits cleared, since all three store rows of MSB first bits
+ * padded to a byte. A PSF2 font is written with one writev of its
+ * header, glyphs and Unicode table; the glyphs of a fixed pitch font
+ * whose rows have no pad bits are written straight from its bitmap.
+ *
+ * Glyphs are encoded by Unicode code point when the font's charset
+ * maps every character it has, and by character code otherwise. A
+ * glyph whose code point an earlier glyph already has, and the glyph
+ * past dfLastChar, get no code. */
+
+#include <winfont.h>
+#include "winfont_private.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#define ROWBYTES(w) (((w) + 7) / 8)
+
+#define PSF2_MAGIC      0x864AB572
+#define PSF2_HAS_UNICODE_TABLE 0x01
+#define PSF2_SEPARATOR  0xFF
+
+#define PCF_PROPERTIES      (1 << 0)
+#define PCF_ACCELERATORS    (1 << 1)
+#define PCF_METRICS         (1 << 2)
+#define PCF_BITMAPS         (1 << 3)
+#define PCF_BDF_ENCODINGS   (1 << 5)
+#define PCF_BDF_ACCELERATORS (1 << 8)
+
+/* Big endian bytes and MSB first bits, glyph rows padded to a byte. */
+#define PCF_FORMAT          0x0C
+
+#define PCF_NTABLES 6
+#define MAX_PROPS   20
+
+struct face {
+    WinFont_FontInfo info;
+    int ascent, descent;
+    int a, c;                   /* v3 spacing */
+    int unicode;                /* codes are code points */
+    int32_t *codes;             /* of each glyph, or -1 */
+    int32_t defcode;
+    int resx, resy;
+    char family[64];
+    char xlfd[256];
+};
+
+struct prop {
+    const char *name;
+    const char *str;            /* or NULL for an integer */
+    int32_t value;
+};
+
+static int
+face_init(WinFont *wf, struct face *f)
+{
+    int first, last, ch, unicode = 1, n;
+    const char *name = wf->facename ? wf->facename : "";
+
+    if (winfont_get_info(wf, &f->info) == -1)
+        return -1;
+
+    f->ascent = f->info.ascent < wf->height ? f->info.ascent : wf->height;
+    f->descent = wf->height - f->ascent;
+    winfont_spacing(wf, &f->a, &f->c);
+    f->resx = f->info.horizres > 0 ? f->info.horizres : 96;
+    f->resy = f->info.vertres > 0 ? f->info.vertres : 96;
+
+    f->codes = malloc((wf->nglyphs ? wf->nglyphs : 1) * sizeof(int32_t));
+    if (!f->codes) {
+        winfont_set_error(WinFont_ErrNoMem);
+        return -1;
+    }
+
+    first = f->info.firstchar;
+    last = f->info.lastchar;
+    for (ch = first; ch <= last && unicode; ch++)
+        unicode = winfont_charset_unicode(f->info.charset, ch) >= 0;
+    f->unicode = unicode;
+
+    for (int g = 0; g < wf->nglyphs; g++) {
+        ch = first + g;
+        f->codes[g] = -1;
+        if (ch > last)
+            continue;
+        f->codes[g] = unicode ?
+            winfont_charset_unicode(f->info.charset, ch) : ch;
+        for (int k = 0; k < g; k++)
+            if (f->codes[k] == f->codes[g])
+                f->codes[g] = -1;
+    }
+    f->defcode = -1;
+    if (f->info.defaultchar < wf->nglyphs)
+        f->defcode = f->codes[f->info.defaultchar];
+
+    /* XLFD fields can't hold a dash, and BDF strings a quote. */
+    n = snprintf(f->family, sizeof(f->family), "%s", name);
+    for (int i = 0; i < n && i < (int)sizeof(f->family); i++)
+        if (f->family[i] == '-' || f->family[i] == '"')
+            f->family[i] = ' ';
+    for (char *p = f->info.copyright; *p; p++)
+        if (*p == '"')
+            *p = '\'';
+
+    snprintf(f->xlfd, sizeof(f->xlfd),
+        "-FON-%s-%s-%s-Normal--%d-%d-%d-%d-%c-%d-%s-%s",
+        f->family, f->info.weight >= 600 ? "Bold" : "Medium",
+        f->info.italic ? "I" : "R", wf->height, f->info.points * 10,
+        f->resx, f->resy, f->info.pixwidth ? 'C' : 'P',
+        f->info.avgwidth * 10, f->unicode ? "ISO10646" : "FontSpecific",
+        f->unicode ? "1" : "0");
+
+    return 0;
+}
+
+static int
+face_props(WinFont *wf, const struct face *f, struct prop *p)
+{
+    int n = 0;
+
+#define STR(k, v) p[n++] = (struct prop){ k, v, 0 }
+#define INT(k, v) p[n++] = (struct prop){ k, NULL, v }
+    STR("FONT", f->xlfd);
+    STR("FOUNDRY", "FON");
+    STR("FAMILY_NAME", f->family);
+    STR("WEIGHT_NAME", f->info.weight >= 600 ? "Bold" : "Medium");
+    STR("SLANT", f->info.italic ? "I" : "R");
+    STR("SETWIDTH_NAME", "Normal");
+    INT("PIXEL_SIZE", wf->height);
+    INT("POINT_SIZE", f->info.points * 10);
+    INT("RESOLUTION_X", f->resx);
+    INT("RESOLUTION_Y", f->resy);
+    STR("SPACING", f->info.pixwidth ? "C" : "P");
+    INT("AVERAGE_WIDTH", f->info.avgwidth * 10);
+    STR("CHARSET_REGISTRY", f->unicode ? "ISO10646" : "FontSpecific");
+    STR("CHARSET_ENCODING", f->unicode ? "1" : "0");
+    INT("FONT_ASCENT", f->ascent);
+    INT("FONT_DESCENT", f->descent);
+    if (f->defcode >= 0)
+        INT("DEFAULT_CHAR", f->defcode);
+    if (f->info.copyright[0])
+        STR("COPYRIGHT", f->info.copyright);
+#undef STR
+#undef INT
+
+    return n;
+}
+
+/* Glyph g's rows into dst, rowbytes apart, with the pad bits cleared.
+ * buf holds a lazy glyph being decoded by another thread. */
+static int
+glyph_copy(WinFont *wf, int g, uint8_t *dst, int rowbytes, uint8_t *buf,
+    size_t bufsz)
+{
+    int w = wf->widths[g], rb = ROWBYTES(w);
+    uint8_t mask = w % 8 ? (uint8_t)(0xFF00 >> (w % 8)) : 0xFF;
+    const uint8_t *rows;
+
+    rows = winfont_glyph_get(wf, g, WinFont_LayoutRowMSB, buf, bufsz);
+    if (!rows)
+        return -1;
+
+    for (int r = 0; r < wf->height; r++, rows += rb, dst += rowbytes) {
+        memcpy(dst, rows, rb);
+        memset(dst + rb, 0, rowbytes - rb);
+        if (rb)
+            dst[rb - 1] &= mask;
+    }
+
+    return 0;
+}
+
+static size_t
+glyph_buf_size(WinFont *wf)
+{
+    size_t sz = 1, need;
+
+    for (int g = 0; g < wf->nglyphs; g++) {
+        need = winfont_glyph_required_size(wf, g);
+        if (need > sz)
+            sz = need;
+    }
+
+    return sz;
+}
+
+static void
+put32le(uint8_t *p, uint32_t v)
+{
+    p[0] = v;
+    p[1] = v >> 8;
+    p[2] = v >> 16;
+    p[3] = v >> 24;
+}
+
+static int
+utf8_encode(uint8_t *p, uint32_t cp)
+{
+    if (cp < 0x80) {
+        p[0] = cp;
+        return 1;
+    }
+    if (cp < 0x800) {
+        p[0] = 0xC0 | cp >> 6;
+        p[1] = 0x80 | (cp & 0x3F);
+        return 2;
+    }
+    if (cp < 0x10000) {
+        p[0] = 0xE0 | cp >> 12;
+        p[1] = 0x80 | ((cp >> 6) & 0x3F);
+        p[2] = 0x80 | (cp & 0x3F);
+        return 3;
+    }
+    p[0] = 0xF0 | cp >> 18;
+    p[1] = 0x80 | ((cp >> 12) & 0x3F);
+    p[2] = 0x80 | ((cp >> 6) & 0x3F);
+    p[3] = 0x80 | (cp & 0x3F);
+    return 4;
+}
+
+/* The whole of iov, through short writes and signals. */
+static int
+writev_all(int fd, struct iovec *iov, int n)
+{
+    ssize_t k;
+
+    while (n > 0) {
+        k = writev(fd, iov, n);
+        if (k == -1 && errno == EINTR)
+            continue;
+        if (k <= 0)
+            return -1;
+        for (; n > 0 && (size_t)k >= iov->iov_len; iov++, n--)
+            k -= iov->iov_len;
+        if (n > 0) {
+            iov->iov_base = (uint8_t *)iov->iov_base + k;
+            iov->iov_len -= k;
+        }
+    }
+
+    return 0;
+}
+
+/* Rows of every glyph one after another, all wf->width wide, with no
+ * pad bits to clear. */
+static int
+bitmap_is_psf(WinFont *wf)
+{
+    size_t pos = 0, size = (size_t)ROWBYTES(wf->width) * wf->height;
+
+    if (!wf->bitmap || wf->_lazy || wf->_shared || wf->width % 8)
+        return 0;
+    for (int g = 0; g < wf->nglyphs; g++, pos += size)
+        if (wf->widths[g] != wf->width || wf->offsets[g] != pos)
+            return 0;
+
+    return 1;
+}
+
+int
+winfont_write_psf2(WinFont *wf, int fd)
+{
+    uint8_t hdr[32], *glyphs = NULL, *table = NULL, *buf = NULL;
+    size_t charsize, tlen = 0, bufsz;
+    struct iovec iov[3];
+    struct face f;
+    int ret = -1, rowbytes, niov = 2;
+
+    if (!wf || fd < 0) {
+        winfont_set_error(WinFont_ErrArg);
+        return -1;
+    }
+    if (face_init(wf, &f) == -1)
+        return -1;
+
+    rowbytes = ROWBYTES(wf->width);
+    charsize = (size_t)rowbytes * wf->height;
+
+    if (bitmap_is_psf(wf)) {
+        iov[1].iov_base = wf->bitmap;
+    } else {
+        bufsz = glyph_buf_size(wf);
+        glyphs = malloc(charsize * wf->nglyphs + 1);
+        buf = malloc(bufsz);
+        if (!glyphs || !buf)
+            goto nomem;
+        for (int g = 0; g < wf->nglyphs; g++) {
+            if (glyph_copy(wf, g, glyphs + charsize * g, rowbytes, buf,
+                    bufsz) == -1)
+                goto nomem;
+        }
+        iov[1].iov_base = glyphs;
+    }
+    iov[1].iov_len = charsize * wf->nglyphs;
+
+    /* Each glyph's code point, if it has one, then a separator. */
+    if (f.unicode) {
+        table = malloc(5 * (size_t)wf->nglyphs + 1);
+        if (!table)
+            goto nomem;
+        for (int g = 0; g < wf->nglyphs; g++) {
+            if (f.codes[g] >= 0)
+                tlen += utf8_encode(table + tlen, f.codes[g]);
+            table[tlen++] = PSF2_SEPARATOR;
+        }
+        iov[2].iov_base = table;
+        iov[2].iov_len = tlen;
+        niov = 3;
+    }
+
+    put32le(hdr, PSF2_MAGIC);
+    put32le(hdr + 4, 0);
+    put32le(hdr + 8, sizeof(hdr));
+    put32le(hdr + 12, f.unicode ? PSF2_HAS_UNICODE_TABLE : 0);
+    put32le(hdr + 16, wf->nglyphs);
+    put32le(hdr + 20, charsize);
+    put32le(hdr + 24, wf->height);
+    put32le(hdr + 28, wf->width);
+    iov[0].iov_base = hdr;
+    iov[0].iov_len = sizeof(hdr);
+
+    if (writev_all(fd, iov, niov) == -1)
+        winfont_set_error(WinFont_ErrIO);
+    else
+        ret = 0;
+    goto done;
+
+nomem:
+    winfont_set_error(WinFont_ErrNoMem);
+done:
+    free(f.codes);
+    free(glyphs);
+    free(table);
+    free(buf);
+    return ret;
+}
+
+/* BDF */
+
+int
+winfont_write_bdf(WinFont *wf, FILE *out)
+{
+    static const char hex[] = "0123456789ABCDEF";
+    struct prop props[MAX_PROPS];
+    uint8_t *rows = NULL, *buf = NULL;
+    char *line = NULL;
+    size_t bufsz;
+    struct face f;
+    int64_t swidth;
+    int nprops, w, rb, dwidth, ret = -1;
+
+    if (!wf || !out) {
+        winfont_set_error(WinFont_ErrArg);
+        return -1;
+    }
+    if (face_init(wf, &f) == -1)
+        return -1;
+
+    bufsz = glyph_buf_size(wf);
+    rb = ROWBYTES(wf->width);
+    rows = malloc((size_t)rb * wf->height + 1);
+    buf = malloc(bufsz);
+    line = malloc(2 * (size_t)rb + 2);
+    if (!rows || !buf || !line) {
+        winfont_set_error(WinFont_ErrNoMem);
+        goto done;
+    }
+
+    fprintf(out, "STARTFONT 2.1\nFONT %s\n", f.xlfd);
+    fprintf(out, "SIZE %d %d %d\n", f.info.points, f.resx, f.resy);
+    fprintf(out, "FONTBOUNDINGBOX %d %d %d %d\n", wf->width, wf->height,
+        f.a, -f.descent);
+
+    /* FONT is its own line in BDF. */
+    nprops = face_props(wf, &f, props) - 1;
+    fprintf(out, "STARTPROPERTIES %d\n", nprops);
+    for (int i = 1; i <= nprops; i++) {
+        if (props[i].str)
+            fprintf(out, "%s \"%s\"\n", props[i].name, props[i].str);
+        else
+            fprintf(out, "%s %d\n", props[i].name, props[i].value);
+    }
+    fprintf(out, "ENDPROPERTIES\nCHARS %d\n", wf->nglyphs);
+
+    for (int g = 0; g < wf->nglyphs; g++) {
+        w = wf->widths[g];
+        rb = ROWBYTES(w);
+        if (glyph_copy(wf, g, rows, rb, buf, bufsz) == -1) {
+            winfont_set_error(WinFont_ErrNoMem);
+            goto done;
+        }
+
+        if (f.codes[g] < 0)
+            fprintf(out, "STARTCHAR glyph%d\nENCODING -1\n", g);
+        else if (f.unicode)
+            fprintf(out, "STARTCHAR uni%04X\nENCODING %d\n", f.codes[g],
+                f.codes[g]);
+        else
+            fprintf(out, "STARTCHAR char%d\nENCODING %d\n", f.codes[g],
+                f.codes[g]);
+
+        dwidth = f.a + w + f.c;
+        /* A and C space come from the file and may be large. */
+        swidth = f.info.points > 0 ?
+            (int64_t)dwidth * 72000 / ((int64_t)f.info.points * f.resx) :
+            (int64_t)dwidth * 1000 / (wf->height ? wf->height : 1);
+        if (swidth > INT32_MAX)
+            swidth = INT32_MAX;
+        fprintf(out, "SWIDTH %d 0\nDWIDTH %d 0\nBBX %d %d %d %d\nBITMAP\n",
+            (int)swidth, dwidth, w, wf->height, f.a, -f.descent);
+
+        for (int r = 0; r < wf->height; r++) {
+            for (int i = 0; i < rb; i++) {
+                line[2 * i] = hex[rows[r * rb + i] >> 4];
+                line[2 * i + 1] = hex[rows[r * rb + i] & 0xF];
+            }
+            line[2 * rb] = '\n';
+            fwrite(line, 1, 2 * rb + 1, out);
+        }
+        fputs("ENDCHAR\n", out);
+    }
+    fputs("ENDFONT\n", out);
+
+    if (ferror(out))
+        winfont_set_error(WinFont_ErrIO);
+    else
+        ret = 0;
+
+done:
+    free(f.codes);
+    free(rows);
+    free(buf);
+    free(line);
+    return ret;
+}
+
+/* PCF, built in memory and written with one fwrite. */
+
+struct pcf {
+    uint8_t *p;
+    size_t len, cap;
+    int failed;
+};
+
+static uint8_t *
+pcf_grow(struct pcf *pc, size_t n)
+{
+    size_t cap = pc->cap ? pc->cap : 4096;
+    uint8_t *p;
+
+    if (pc->failed)
+        return NULL;
+    while (cap < pc->len + n)
+        cap *= 2;
+    if (cap != pc->cap) {
+        p = realloc(pc->p, cap);
+        if (!p) {
+            pc->failed = 1;
+            return NULL;
+        }
+        pc->p = p;
+        pc->cap = cap;
+    }
+
+    p = pc->p + pc->len;
+    pc->len += n;
+    return p;
+}
+
+static void
+pcf_bytes(struct pcf *pc, const void *src, size_t n)
+{
+    uint8_t *p = pcf_grow(pc, n);
+
+    if (p)
+        memcpy(p, src, n);
+}
+
+static void
+pcf8(struct pcf *pc, int v)
+{
+    uint8_t b = v;
+
+    pcf_bytes(pc, &b, 1);
+}
+
+static void
+pcf16(struct pcf *pc, int v)
+{
+    uint8_t b[2] = { (uint8_t)(v >> 8), (uint8_t)v };
+
+    pcf_bytes(pc, b, 2);
+}
+
+static void
+pcf32(struct pcf *pc, uint32_t v)
+{
+    uint8_t b[4] = { v >> 24, v >> 16, v >> 8, v };
+
+    pcf_bytes(pc, b, 4);
+}
+
+static void
+pcf_align(struct pcf *pc)
+{
+    while (pc->len % 4)
+        pcf8(pc, 0);
+}
+
+/* The table format word is little endian whatever the format says. */
+static void
+pcf_format(struct pcf *pc)
+{
+    uint8_t b[4];
+
+    put32le(b, PCF_FORMAT);
+    pcf_bytes(pc, b, 4);
+}
+
+/* lsb, rsb, width, ascent, descent, attributes */
+static void
+glyph_metrics(WinFont *wf, const struct face *f, int g, int m[6])
+{
+    m[0] = f->a;
+    m[1] = f->a + wf->widths[g];
+    m[2] = f->a + wf->widths[g] + f->c;
+    m[3] = f->ascent;
+    m[4] = f->descent;
+    m[5] = 0;
+}
+
+static void
+pcf_metrics(struct pcf *pc, const int m[6])
+{
+    for (int i = 0; i < 6; i++)
+        pcf16(pc, m[i]);
+}
+
+static void
+pcf_properties(struct pcf *pc, WinFont *wf, const struct face *f)
+{
+    struct prop props[MAX_PROPS];
+    int n = face_props(wf, f, props);
+    uint32_t off = 0;
+
+    pcf_format(pc);
+    pcf32(pc, n);
+    for (int i = 0; i < n; i++) {
+        pcf32(pc, off);
+        off += strlen(props[i].name) + 1;
+        pcf8(pc, props[i].str != NULL);
+        if (props[i].str) {
+            pcf32(pc, off);
+            off += strlen(props[i].str) + 1;
+        } else {
+            pcf32(pc, props[i].value);
+        }
+    }
+    if (n & 3)
+        for (int i = 0; i < 4 - (n & 3); i++)
+            pcf8(pc, 0);
+    pcf32(pc, off);
+    for (int i = 0; i < n; i++) {
+        pcf_bytes(pc, props[i].name, strlen(props[i].name) + 1);
+        if (props[i].str)
+            pcf_bytes(pc, props[i].str, strlen(props[i].str) + 1);
+    }
+}
+
+static void
+pcf_accelerators(struct pcf *pc, WinFont *wf, const struct face *f)
+{
+    int fixed = f->info.pixwidth != 0, m[6], lo[6], hi[6];
+
+    for (int g = 0; g < wf->nglyphs; g++) {
+        glyph_metrics(wf, f, g, m);
+        for (int i = 0; i < 6; i++) {
+            lo[i] = g == 0 || m[i] < lo[i] ? m[i] : lo[i];
+            hi[i] = g == 0 || m[i] > hi[i] ? m[i] : hi[i];
+        }
+    }
+    if (wf->nglyphs == 0) {
+        memset(lo, 0, sizeof(lo));
+        memset(hi, 0, sizeof(hi));
+    }
+
+    pcf_format(pc);
+    pcf8(pc, 1);                /* noOverlap */
+    pcf8(pc, fixed);            /* constantMetrics */
+    pcf8(pc, fixed && f->a == 0 && f->c == 0);  /* terminalFont */
+    pcf8(pc, fixed);            /* constantWidth */
+    pcf8(pc, 1);                /* inkInside */
+    pcf8(pc, 0);                /* inkMetrics */
+    pcf8(pc, 0);                /* drawDirection, left to right */
+    pcf8(pc, 0);
+    pcf32(pc, f->ascent);
+    pcf32(pc, f->descent);
+    pcf32(pc, 0);               /* maxOverlap */
+    pcf_metrics(pc, lo);
+    pcf_metrics(pc, hi);
+}
+
+static void
+pcf_glyph_metrics(struct pcf *pc, WinFont *wf, const struct face *f)
+{
+    int m[6];
+
+    pcf_format(pc);
+    pcf32(pc, wf->nglyphs);
+    for (int g = 0; g < wf->nglyphs; g++) {
+        glyph_metrics(wf, f, g, m);
+        pcf_metrics(pc, m);
+    }
+}
+
+static int
+pcf_bitmaps(struct pcf *pc, WinFont *wf)
+{
+    size_t sizes[4] = { 0 }, off = 0, bufsz = glyph_buf_size(wf);
+    uint8_t *buf, *dst;
+    int rb;
+
+    buf = malloc(bufsz);
+    if (!buf) {
+        pc->failed = 1;
+        return -1;
+    }
+
+    pcf_format(pc);
+    pcf32(pc, wf->nglyphs);
+    for (int g = 0; g < wf->nglyphs; g++) {
+        rb = ROWBYTES(wf->widths[g]);
+        pcf32(pc, off);
+        off += (size_t)rb * wf->height;
+        for (int i = 0; i < 4; i++)
+            sizes[i] += (size_t)((rb + (1 << i) - 1) & ~((1 << i) - 1)) *
+                wf->height;
+    }
+    for (int i = 0; i < 4; i++)
+        pcf32(pc, sizes[i]);
+
+    for (int g = 0; g < wf->nglyphs; g++) {
+        rb = ROWBYTES(wf->widths[g]);
+        dst = pcf_grow(pc, (size_t)rb * wf->height);
+        if (!dst || glyph_copy(wf, g, dst, rb, buf, bufsz) == -1) {
+            pc->failed = 1;
+            break;
+        }
+    }
+
+    free(buf);
+    return pc->failed ? -1 : 0;
+}
+
+/* Codes as byte1 << 8 | byte2, a row of columns for each byte1. */
+static void
+pcf_encodings(struct pcf *pc, WinFont *wf, const struct face *f)
+{
+    int mincol = 0xFF, maxcol = 0, minrow = 0xFF, maxrow = 0, ncols;
+    size_t n, at;
+    uint16_t *idx;
+
+    for (int g = 0; g < wf->nglyphs; g++) {
+        if (f->codes[g] < 0 || f->codes[g] > 0xFFFF)
+            continue;
+        mincol = (f->codes[g] & 0xFF) < mincol ? f->codes[g] & 0xFF : mincol;
+        maxcol = (f->codes[g] & 0xFF) > maxcol ? f->codes[g] & 0xFF : maxcol;
+        minrow = (f->codes[g] >> 8) < minrow ? f->codes[g] >> 8 : minrow;
+        maxrow = (f->codes[g] >> 8) > maxrow ? f->codes[g] >> 8 : maxrow;
+    }
+    if (mincol > maxcol)
+        mincol = maxcol = minrow = maxrow = 0;
+
+    ncols = maxcol - mincol + 1;
+    n = (size_t)ncols * (maxrow - minrow + 1);
+    idx = malloc(n * sizeof(uint16_t));
+    if (!idx) {
+        pc->failed = 1;
+        return;
+    }
+    memset(idx, 0xFF, n * sizeof(uint16_t));
+    for (int g = 0; g < wf->nglyphs; g++) {
+        if (f->codes[g] < 0 || f->codes[g] > 0xFFFF)
+            continue;
+        at = (size_t)((f->codes[g] >> 8) - minrow) * ncols +
+            (f->codes[g] & 0xFF) - mincol;
+        idx[at] = g;
+    }
+
+    pcf_format(pc);
+    pcf16(pc, mincol);
+    pcf16(pc, maxcol);
+    pcf16(pc, minrow);
+    pcf16(pc, maxrow);
+    pcf16(pc, f->defcode >= 0 && f->defcode <= 0xFFFF ? f->defcode : 0xFFFF);
+    for (size_t i = 0; i < n; i++)
+        pcf16(pc, idx[i]);
+
+    free(idx);
+}
+
+int
+winfont_write_pcf(WinFont *wf, FILE *out)
+{
+    static const int types[PCF_NTABLES] = {
+        PCF_PROPERTIES, PCF_ACCELERATORS, PCF_METRICS, PCF_BITMAPS,
+        PCF_BDF_ENCODINGS, PCF_BDF_ACCELERATORS,
+    };
+    struct pcf pc = { NULL, 0, 0, 0 };
+    size_t toc, start;
+    struct face f;
+    int ret = -1;
+
+    if (!wf || !out) {
+        winfont_set_error(WinFont_ErrArg);
+        return -1;
+    }
+    if (face_init(wf, &f) == -1)
+        return -1;
+
+    pcf_bytes(&pc, "\1fcp", 4);
+    pcf_grow(&pc, 4 + 16 * PCF_NTABLES);
+    toc = 4;
+
+    for (int t = 0; t < PCF_NTABLES && !pc.failed; t++) {
+        start = pc.len;
+        switch (types[t]) {
+        case PCF_PROPERTIES:
+            pcf_properties(&pc, wf, &f);
+            break;
+        case PCF_ACCELERATORS:
+        case PCF_BDF_ACCELERATORS:
+            pcf_accelerators(&pc, wf, &f);
+            break;
+        case PCF_METRICS:
+            pcf_glyph_metrics(&pc, wf, &f);
+            break;
+        case PCF_BITMAPS:
+            pcf_bitmaps(&pc, wf);
+            break;
+        case PCF_BDF_ENCODINGS:
+            pcf_encodings(&pc, wf, &f);
+            break;
+        }
+        pcf_align(&pc);
+        if (pc.failed)
+            break;
+
+        put32le(pc.p + toc + 4 + 16 * t, types[t]);
+        put32le(pc.p + toc + 8 + 16 * t, PCF_FORMAT);
+        put32le(pc.p + toc + 12 + 16 * t, pc.len - start);
+        put32le(pc.p + toc + 16 + 16 * t, start);
+    }
+
+    if (pc.failed) {
+        winfont_set_error(WinFont_ErrNoMem);
+    } else {
+        put32le(pc.p + toc, PCF_NTABLES);
+        if (fwrite(pc.p, 1, pc.len, out) != pc.len)
+            winfont_set_error(WinFont_ErrIO);
+        else
+            ret = 0;
+    }
+
+    free(f.codes);
+    free(pc.p);
+    return ret;
+}
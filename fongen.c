@@ -0,0 +1,212 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 Eddie Hillenbrand
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+/* Synthetic FON files for benchmarks and tests. The image is an MZ
+ * header, an NE header with the resource table right after it, and one
+ * FNT resource per face, each 16 byte aligned:
+ *
+ *     FNT header | char table | face name | column major bits */
+
+#include "fongen.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define FACENAME    "Synthetic"
+#define NE_OFF      64
+#define RT_OFF      128
+#define FNT_START   512
+#define SHIFT       4
+
+static void
+put16(uint8_t *p, unsigned v)
+{
+    p[0] = v & 0xff;
+    p[1] = (v >> 8) & 0xff;
+}
+
+static void
+put32(uint8_t *p, unsigned long v)
+{
+    put16(p, v & 0xffff);
+    put16(p + 2, (v >> 16) & 0xffff);
+}
+
+static int
+glyph_width(const struct fongen_face *face, int g)
+{
+    return face->prop ? 1 + (g * 5) % face->w : face->w;
+}
+
+/* Size of the FNT resource for face, up to the end of its bits. */
+static size_t
+fnt_size(const struct fongen_face *face, size_t *bitsoffp)
+{
+    int v3 = face->version == 0x300, nglyphs = face->nchars + 1;
+    size_t bitsoff, bits = 0;
+
+    bitsoff = (v3 ? 148 : 118) + (v3 ? 6 : 4) * nglyphs +
+        sizeof(FACENAME);
+    for (int g = 0; g < nglyphs; g++)
+        bits += (size_t)(glyph_width(face, g) + 7) / 8 * face->h;
+
+    if (bitsoffp)
+        *bitsoffp = bitsoff;
+    return bitsoff + bits;
+}
+
+size_t
+fongen_size(int nfaces, const struct fongen_face *faces)
+{
+    const struct fongen_face *f;
+    size_t len = FNT_START, sz;
+
+    /* The table's NAMEINFO entries must fit before FNT_START. */
+    if (nfaces < 1 || RT_OFF + 30 + 12 * nfaces + 2 > FNT_START)
+        return 0;
+
+    for (int i = 0; i < nfaces; i++) {
+        f = &faces[i];
+        if ((f->version != 0x200 && f->version != 0x300) ||
+            f->w < 1 || f->w > 255 || f->h < 1 || f->h > 255 ||
+            f->nchars < 1 || f->nchars > 256)
+            return 0;
+        sz = fnt_size(f, NULL);
+        if (f->version == 0x200 && sz > 0xffff)
+            return 0;
+        len = ((len + 15) & ~(size_t)15) + sz;
+        if (len >> SHIFT > 0xffff)
+            return 0;
+    }
+
+    return len;
+}
+
+size_t
+fongen_build(uint8_t *buf, int nfaces, const struct fongen_face *faces)
+{
+    const struct fongen_face *f;
+    size_t len, fnt, hdrlen, cilen, bitsoff, p;
+    uint32_t seed = 0x2545f491;
+    int nglyphs, wbytes, gw, points, weight;
+
+    len = fongen_size(nfaces, faces);
+    if (!len)
+        return 0;
+    memset(buf, 0, len);
+
+    /* MZ */
+    put16(buf, 0x5A4D);
+    put32(buf + 0x3C, NE_OFF);
+
+    /* NE, with the resource table offset from it */
+    put16(buf + NE_OFF, 0x454E);
+    put16(buf + NE_OFF + 36, RT_OFF - NE_OFF);
+
+    put16(buf + RT_OFF, SHIFT);
+    /* RT_FONTDIR, one entry, unused by the parser */
+    put16(buf + RT_OFF + 2, 0x8007);
+    put16(buf + RT_OFF + 4, 1);
+    /* RT_FONT, nfaces entries, terminated by a 0 type */
+    put16(buf + RT_OFF + 22, 0x8008);
+    put16(buf + RT_OFF + 24, nfaces);
+
+    p = FNT_START;
+    for (int i = 0; i < nfaces; i++) {
+        f = &faces[i];
+        nglyphs = f->nchars + 1;
+
+        fnt = p = (p + 15) & ~(size_t)15;
+        put16(buf + RT_OFF + 30 + 12 * i, fnt >> SHIFT);
+
+        hdrlen = f->version == 0x300 ? 148 : 118;
+        cilen = f->version == 0x300 ? 6 : 4;
+        fnt_size(f, &bitsoff);
+        points = f->points ? f->points : f->h * 3 / 4;
+        weight = f->weight ? f->weight : 400;
+
+        put16(buf + p + 0, f->version);
+        put16(buf + p + 68, points);            /* dfPoints */
+        put16(buf + p + 70, 96);                /* dfVertRes */
+        put16(buf + p + 72, 96);                /* dfHorizRes */
+        put16(buf + p + 74, f->h - f->h / 8);   /* dfAscent */
+        put16(buf + p + 83, weight);            /* dfWeight */
+        buf[p + 85] = 255;                      /* dfCharSet, OEM */
+        put16(buf + p + 86, f->prop ? 0 : f->w); /* dfPixWidth */
+        put16(buf + p + 88, f->h);              /* dfPixHeight */
+        buf[p + 90] = f->prop ? 0x31 : 0x30;    /* dfPitchAndFamily */
+        put16(buf + p + 91, f->w);              /* dfAvgWidth */
+        put16(buf + p + 93, f->w);              /* dfMaxWidth */
+        buf[p + 95] = 0;                        /* dfFirstChar */
+        buf[p + 96] = f->nchars - 1;            /* dfLastChar */
+        buf[p + 97] = f->nchars > '?' ? '?' : 0; /* dfDefaultChar */
+        buf[p + 98] = f->nchars > ' ' ? ' ' : 0; /* dfBreakChar */
+        put32(buf + p + 105, bitsoff - sizeof(FACENAME)); /* dfFace */
+        put32(buf + p + 113, bitsoff);          /* dfBitsOffset */
+
+        memcpy(buf + p + bitsoff - sizeof(FACENAME), FACENAME,
+            sizeof(FACENAME));
+
+        p = fnt + bitsoff;
+        for (int g = 0; g < nglyphs; g++) {
+            uint8_t *ci = buf + fnt + hdrlen + cilen * g;
+            gw = glyph_width(f, g);
+            wbytes = (gw + 7) / 8;
+            put16(ci, gw);
+            if (f->version == 0x300)
+                put32(ci + 2, p - fnt);
+            else
+                put16(ci + 2, p - fnt);
+            for (int col = 0; col < wbytes; col++)
+                for (int r = 0; r < f->h; r++) {
+                    if (f->pattern) {
+                        buf[p++] = f->pattern(g, r, col);
+                        continue;
+                    }
+                    seed ^= seed << 13;
+                    seed ^= seed >> 17;
+                    seed ^= seed << 5;
+                    buf[p++] = seed;
+                }
+        }
+
+        put32(buf + fnt + 2, p - fnt);          /* dfSize */
+    }
+
+    return p;
+}
+
+int
+fongen_write(const char *path, int nfaces, const struct fongen_face *faces)
+{
+    uint8_t *buf;
+    size_t len;
+    FILE *f;
+    int ret = -1;
+
+    len = fongen_size(nfaces, faces);
+    if (!len)
+        return -1;
+
+    buf = malloc(len);
+    if (!buf)
+        return -1;
+
+    len = fongen_build(buf, nfaces, faces);
+    f = fopen(path, "wb");
+    if (f) {
+        if (fwrite(buf, 1, len, f) == len)
+            ret = 0;
+        if (fclose(f) == EOF)
+            ret = -1;
+    }
+
+    free(buf);
+    return ret;
+}
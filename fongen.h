@@ -0,0 +1,47 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 Eddie Hillenbrand
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef FONGEN_H
+#define FONGEN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Byte col of row r of glyph g. */
+typedef uint8_t (*fongen_pattern)(int g, int r, int col);
+
+/* A synthetic face. Fixed pitch faces have every glyph w pixels wide,
+ * proportional ones glyphs 1 to w pixels wide. */
+struct fongen_face {
+    int version;                /* 0x200 or 0x300 */
+    int w, h;                   /* glyph size in pixels */
+    int nchars;                 /* characters 0 to nchars - 1, 1 to 256 */
+    int prop;                   /* proportional */
+    int points;                 /* dfPoints, or 0 for three quarters of h */
+    int weight;                 /* dfWeight, or 0 for 400 */
+    fongen_pattern pattern;     /* glyph bits, or NULL for pseudo random */
+};
+
+/* Bytes fongen_build needs for nfaces faces, or 0 if a face can not be
+ * stored: a bad size or character count, or a v2 face whose bits go
+ * past the 64K its 16 bit char table offsets reach. */
+size_t
+fongen_size(int nfaces, const struct fongen_face *faces);
+
+/* Build a FON image with one FNT resource per face into buf, which
+ * must hold fongen_size bytes. Glyph bits come from each face's
+ * pattern, or are pseudo random and the same on every run. Returns the
+ * image size, or 0. */
+size_t
+fongen_build(uint8_t *buf, int nfaces, const struct fongen_face *faces);
+
+/* fongen_build into a file. */
+int
+fongen_write(const char *path, int nfaces, const struct fongen_face *faces);
+
+#endif
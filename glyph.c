@@ -0,0 +1,201 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 Eddie Hillenbrand
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+/* Per glyph access. */
+
+#include <winfont.h>
+#include "winfont_private.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Lazy fonts keep two bit sets of nglyphs bits in _lazy: the glyphs a
+ * thread has claimed for decoding, followed by the glyphs whose
+ * decoded rows are in bitmap. A glyph is decoded into bitmap by the
+ * one thread that claims it and published with a release store.
+ * Threads that find a glyph claimed but not yet published decode it
+ * straight into their own buffer, so nobody waits and nothing is
+ * written twice. */
+
+#define LAZY_WORDS(wf) (((wf)->nglyphs + 31) / 32)
+
+static inline int
+glyph_is_decoded(WinFont *wf, int g)
+{
+    uint32_t *decoded = wf->_lazy + LAZY_WORDS(wf);
+
+    return (__atomic_load_n(&decoded[g / 32], __ATOMIC_ACQUIRE) >>
+        (g % 32)) & 1;
+}
+
+static void
+glyph_decode(WinFont *wf, int g, uint8_t *dst)
+{
+    winfont_transpose_bitmap(dst, wf->_raw + wf->_rawoff[g],
+        (wf->widths[g] + 7) / 8, wf->height, 1);
+}
+
+/* The decoded rows of glyph g, from the store if the font is shared,
+ * decoding them first if the font is lazy. NULL if another thread is
+ * still decoding the glyph, in which case the caller decodes its own
+ * copy. */
+static const uint8_t *
+glyph_rows(WinFont *wf, int g)
+{
+    uint8_t *gb;
+    uint32_t bit, *claimed, *decoded;
+
+    if (wf->_shared)
+        return wf->_shared[g];
+
+    gb = wf->bitmap + wf->offsets[g];
+    if (!wf->_lazy || glyph_is_decoded(wf, g))
+        return gb;
+
+    claimed = wf->_lazy;
+    decoded = wf->_lazy + LAZY_WORDS(wf);
+    bit = (uint32_t)1 << (g % 32);
+
+    if (__atomic_fetch_or(&claimed[g / 32], bit, __ATOMIC_ACQ_REL) & bit)
+        return NULL;
+
+    glyph_decode(wf, g, gb);
+    __atomic_fetch_or(&decoded[g / 32], bit, __ATOMIC_RELEASE);
+
+    return gb;
+}
+
+static uint8_t
+reverse_bits(uint8_t b)
+{
+    b = (b & 0xF0) >> 4 | (b & 0x0F) << 4;
+    b = (b & 0xCC) >> 2 | (b & 0x33) << 2;
+    b = (b & 0xAA) >> 1 | (b & 0x55) << 1;
+    return b;
+}
+
+/* Convert h rows of rowbytes from the stored layout. */
+static void
+glyph_convert(uint8_t *dst, const uint8_t *src, int w, int h,
+    int rowbytes, WinFont_Layout layout)
+{
+    switch (layout) {
+    case WinFont_LayoutRowMSB:
+        memcpy(dst, src, (size_t)rowbytes * h);
+        break;
+    case WinFont_LayoutColumn:
+        for (int col = 0; col < rowbytes; col++)
+            for (int r = 0; r < h; r++)
+                *dst++ = src[r * rowbytes + col];
+        break;
+    case WinFont_LayoutRowLSB:
+        for (int i = 0; i < rowbytes * h; i++)
+            dst[i] = reverse_bits(src[i]);
+        break;
+    case WinFont_Layout8bpp:
+        /* Rows without pad bits are one run of bits. */
+        if (w == rowbytes * 8) {
+            winfont_expand_bits(dst, src, (size_t)w * h);
+            break;
+        }
+        for (int r = 0; r < h; r++)
+            winfont_expand_bits(dst + r * w, src + r * rowbytes, w);
+        break;
+    }
+}
+
+size_t
+winfont_glyph_layout_size(WinFont *wf, int g, WinFont_Layout layout)
+{
+    if (!wf || g < 0 || g >= wf->nglyphs)
+        return 0;
+
+    if (layout == WinFont_Layout8bpp)
+        return (size_t)wf->widths[g] * wf->height;
+
+    return (size_t)(wf->widths[g] + 7) / 8 * wf->height;
+}
+
+size_t
+winfont_glyph_required_size(WinFont *wf, int g)
+{
+    return winfont_glyph_layout_size(wf, g, WinFont_LayoutRowMSB);
+}
+
+const uint8_t *
+winfont_glyph_get(WinFont *wf, int g, WinFont_Layout layout,
+    uint8_t *buf, size_t sz)
+{
+    const uint8_t *rows;
+    uint8_t *tmp;
+    size_t need;
+    int w, rowbytes;
+
+    if (!wf || g < 0 || g >= wf->nglyphs) {
+        winfont_set_error(WinFont_ErrArg);
+        return NULL;
+    }
+
+    w = wf->widths[g];
+    rowbytes = (w + 7) / 8;
+
+    /* Lazy fonts still have the file's own column data. */
+    if (layout == WinFont_LayoutColumn && wf->_raw)
+        return wf->_raw + wf->_rawoff[g];
+
+    rows = glyph_rows(wf, g);
+    if (rows && (layout == WinFont_LayoutRowMSB ||
+            (layout == WinFont_LayoutColumn && rowbytes <= 1)))
+        return rows;
+
+    need = winfont_glyph_layout_size(wf, g, layout);
+    if (!buf || sz < need) {
+        winfont_set_error(WinFont_ErrArg);
+        return NULL;
+    }
+
+    if (!rows) {
+        if (layout == WinFont_LayoutRowMSB) {
+            glyph_decode(wf, g, buf);
+            return buf;
+        }
+        tmp = malloc((size_t)rowbytes * wf->height + 1);
+        if (!tmp) {
+            winfont_set_error(WinFont_ErrNoMem);
+            return NULL;
+        }
+        glyph_decode(wf, g, tmp);
+        glyph_convert(buf, tmp, w, wf->height, rowbytes, layout);
+        free(tmp);
+        return buf;
+    }
+
+    glyph_convert(buf, rows, w, wf->height, rowbytes, layout);
+    return buf;
+}
+
+int
+winfont_glyph_bitmap(WinFont *wf, int g, uint8_t *bm, size_t sz)
+{
+    const uint8_t *gb;
+
+    if (!bm || sz < winfont_glyph_required_size(wf, g)) {
+        winfont_set_error(WinFont_ErrArg);
+        return -1;
+    }
+
+    gb = winfont_glyph_get(wf, g, WinFont_LayoutRowMSB, bm, sz);
+    if (!gb)
+        return -1;
+
+    if (gb != bm)
+        memcpy(bm, gb, winfont_glyph_required_size(wf, g));
+
+    return 0;
+}
@@ -29,13 +29,44 @@
 #ifndef WINFONT_H
 #define WINFONT_H
 
+#include <pthread.h>
 #include <stdio.h>
 #include <stdint.h>
+#include <sys/types.h>
+
+/* Thread safety
+ *
+ * The only global state is the diagnostics callback, which should be
+ * set before other threads use the library, and the last error, which
+ * is kept per thread. Loaders only read their input, so fonts may be
+ * loaded on many threads at once, even from one FILE or descriptor.
+ * Anything that takes a font, collection or atlas as input may be
+ * called on it from many threads at once: glyph access, drawing,
+ * scaling, caching, atlas building and winfont_collection_face. So may
+ * the background loader and its jobs. Lazy glyphs and cached scaled
+ * copies are published with atomic operations. Freeing an object, and
+ * the screen functions, which change their screen, need the caller to
+ * make sure no other thread is using that object. */
 
 typedef enum {
     WinFont_CharSetANSI = 0,
     WinFont_CharSetDefault = 1,
     WinFont_CharSetSymbol = 2,
+    WinFont_CharSetMac = 77,
+    WinFont_CharSetShiftJIS = 128,
+    WinFont_CharSetHangul = 129,
+    WinFont_CharSetJohab = 130,
+    WinFont_CharSetGB2312 = 134,
+    WinFont_CharSetChineseBig5 = 136,
+    WinFont_CharSetGreek = 161,
+    WinFont_CharSetTurkish = 162,
+    WinFont_CharSetVietnamese = 163,
+    WinFont_CharSetHebrew = 177,
+    WinFont_CharSetArabic = 178,
+    WinFont_CharSetBaltic = 186,
+    WinFont_CharSetRussian = 204,
+    WinFont_CharSetThai = 222,
+    WinFont_CharSetEastEurope = 238,
     WinFont_CharSetOEM = 255,
     WinFont_CharSetCP437 = WinFont_CharSetOEM,
     WinFont_CharSetIBM437 = WinFont_CharSetOEM,
@@ -43,33 +74,781 @@ typedef enum {
 
 typedef struct FontDirEntry WinFont_Info;
 
+/* Why the last call that failed on this thread failed, see
+ * winfont_last_error. */
+typedef enum {
+    WinFont_ErrNone = 0,
+    WinFont_ErrIO,              /* the input could not be read */
+    WinFont_ErrNoMem,
+    WinFont_ErrFormat,          /* not an MZ/NE file, or truncated */
+    WinFont_ErrNoFont,          /* no RT_FONT resources */
+    WinFont_ErrVector,          /* a vector font, not a bitmap one */
+    WinFont_ErrVersion,         /* FNT version other than 2.0 or 3.0 */
+    WinFont_ErrCharTable,       /* a glyph lies outside the font */
+    WinFont_ErrArg,             /* a bad argument */
+    WinFont_ErrArchive,         /* a damaged or unsupported archive */
+} WinFont_Error;
+
+/* Diagnostic levels, most severe first. */
+enum {
+    WinFont_LogError = 1,       /* why a call failed */
+    WinFont_LogWarn,
+    WinFont_LogInfo,
+    WinFont_LogDebug,           /* each face loaded */
+};
+
+/* Called with each diagnostic at or above the level it was set with.
+ * msg is only valid during the call. */
+typedef void (*WinFont_LogFunc)(int level, const char *msg, void *ctx);
+
+/* Glyph bitmap layouts. Bitmaps are stored as WinFont_LayoutRowMSB. */
+typedef enum {
+    WinFont_LayoutRowMSB = 0,   /* rows of packed bits, MSB leftmost */
+    WinFont_LayoutColumn,       /* FNT native, byte columns of rows */
+    WinFont_LayoutRowLSB,       /* rows of packed bits, LSB leftmost */
+    WinFont_Layout8bpp,         /* width bytes per row, 0 or 255 */
+} WinFont_Layout;
+
+/* Largest factor accepted by the scaling functions */
+#define WINFONT_MAX_SCALE 16
+
+/* Load flags */
+#define WINFONT_LAZY    0x0001  /* decode each glyph on first access */
+
+/* Style flags for winfont_derive_style */
+#define WINFONT_BOLD        0x0001  /* one pixel wider, doubled right */
+#define WINFONT_ITALIC      0x0002  /* slanted right a pixel per 4 rows */
+#define WINFONT_UNDERLINE   0x0004
+#define WINFONT_STRIKEOUT   0x0008
+
+/* Where a font's memory comes from. alloc returns size bytes aligned
+ * for any type, or NULL, and free releases a block alloc returned.
+ * Each font is one block, plus one for the bitmap of a collection face
+ * loaded after its header. */
 typedef struct {
+    void *(*alloc)(void *ctx, size_t size);
+    void (*free)(void *ctx, void *ptr);
+    void *ctx;
+} WinFont_Allocator;
+
+/* Slabs that many fonts are carved from, see winfont_pool_new. */
+typedef struct WinFontPool WinFontPool;
+
+/* Background loading, see winfont_loader_new. */
+typedef struct WinFontLoader WinFontLoader;
+typedef struct WinFontJob WinFontJob;
+
+typedef enum {
+    WinFont_JobQueued = 0,
+    WinFont_JobRunning,
+    WinFont_JobDone,            /* the font is ready */
+    WinFont_JobFailed,          /* see winfont_job_error */
+    WinFont_JobCanceled,
+} WinFont_JobState;
+
+/* Glyph g is height rows of (widths[g] + 7) / 8 bytes starting at
+ * bitmap + offsets[g]. In a fixed pitch font every glyph is width
+ * pixels wide and offsets[g] is wbytes * height * g. */
+typedef struct WinFont {
     char *facename;             /* null-terminated face name */
     int nglyphs;                /* number of glyphs in font */
-    int width;                  /* glyph width in pixels */
+    int width;                  /* glyph width in pixels, or widest */
     int height;                 /* glyph height in pixels */
-    int wbytes;                 /* glyph byte width */
-    WinFont_CharSet charset;    /* probably CP437 */
+    int wbytes;                 /* byte width of a width pixel row */
+    WinFont_CharSet charset;    /* dfCharSet, usually CP437 */
     WinFont_Info *_fn_info;     /* private */
     uint8_t *bitmap;            /* all glyphs */
+    uint16_t *widths;           /* width of each glyph in pixels */
+    uint32_t *offsets;          /* offset of each glyph in bitmap */
+    size_t _bmbytes;            /* private */
+    int _flags;                 /* private */
+    void *_map;                 /* private */
+    size_t _maplen;             /* private */
+    const uint8_t *_raw;        /* private */
+    uint32_t *_rawoff;          /* private */
+    uint32_t *_lazy;            /* private */
+    struct WinFont **_scaled;   /* private */
+    const uint8_t **_shared;    /* private */
+    struct WinFontGlyphStore *_store; /* private */
+    struct WinFontCMap *_cmap;  /* private */
+    WinFont_Allocator _alloc;   /* private */
 } WinFont;
 
+typedef enum {
+    WinFont_AtlasA8 = 0,        /* one byte per pixel, 0 or 255 */
+    WinFont_AtlasRGBA8888,      /* white, transparent where unset */
+} WinFont_AtlasFormat;
+
+typedef struct {
+    int x, y;                   /* top left corner in the atlas */
+    int w, h;                   /* glyph size in pixels */
+    float u0, v0, u1, v1;       /* texture coordinates of the rect */
+} WinFont_AtlasRect;
+
+/* All glyphs of a font in one texture. */
+typedef struct {
+    WinFont_AtlasFormat format;
+    int width;                  /* in pixels */
+    int height;                 /* in pixels */
+    int stride;                 /* bytes per row */
+    uint8_t *pixels;
+    int nglyphs;
+    WinFont_AtlasRect *rects;   /* where each glyph is */
+    int _flags;                 /* private */
+} WinFont_Atlas;
+
+/* Framebuffer pixel formats, by bytes per pixel. Colors are passed
+ * as values already in the target format, e.g. a palette index or an
+ * RGB565 value. */
+typedef enum {
+    WinFont_Pixel8 = 1,
+    WinFont_Pixel16 = 2,
+    WinFont_Pixel32 = 4,
+} WinFont_PixelFormat;
+
+typedef struct {
+    uint8_t *pixels;
+    int width;                  /* in pixels */
+    int height;                 /* in pixels */
+    int stride;                 /* bytes per row */
+    WinFont_PixelFormat format;
+} WinFont_Framebuffer;
+
+/* Drawing modes */
+#define WinFont_DrawOpaque      0   /* unset pixels are drawn in bg */
+#define WinFont_DrawTransparent 1   /* unset pixels are left alone */
+
+typedef struct {
+    int x, y, w, h;
+} WinFont_Rect;
+
+/* Cell attributes */
+#define WinFont_CellBlink       0x01
+
+typedef struct {
+    uint16_t glyph;             /* glyph index */
+    uint8_t fg;                 /* palette index */
+    uint8_t bg;                 /* palette index */
+    uint8_t attr;               /* WinFont_Cell* flags */
+} WinFont_Cell;
+
+/* A grid of character cells drawn into a framebuffer. Cells are the
+ * font's width by height pixels. Set cells with winfont_screen_put or
+ * winfont_screen_write; winfont_screen_update redraws only the cells
+ * that changed. */
+typedef struct {
+    WinFont *font;
+    int cols, rows;             /* grid size in cells */
+    int cellw, cellh;           /* cell size in pixels */
+    WinFont_Cell *cells;        /* cols * rows, row by row; read only */
+    WinFont_Framebuffer fb;
+    uint32_t palette[256];      /* pixel values, identity by default */
+    int blink_off;              /* blinking cells are hidden */
+    int _owns_pixels;           /* private */
+    uint8_t *_dirty;            /* private */
+    int *_queue;                /* private */
+    int _nqueued;               /* private */
+    int *_rows;                 /* private */
+    int _nrows;                 /* private */
+    int *_rowmin;               /* private */
+    int *_rowmax;               /* private */
+} WinFontScreen;
+
+/* Every face in a FON file. Headers are read up front, bitmaps when a
+ * face is first asked for with winfont_collection_face. The faces are
+ * owned by the collection. */
+typedef struct {
+    int nfaces;                 /* number of RT_FONT resources */
+    WinFont **faces;            /* bitmap is NULL until loaded */
+    int *points;                /* nominal point size of each face */
+    int *weights;               /* weight of each face, 400 is normal */
+    const uint8_t *_base;       /* private */
+    size_t _len;                /* private */
+    size_t *_offsets;           /* private */
+    void *_map;                 /* private */
+    size_t _maplen;             /* private */
+    pthread_mutex_t _lock;      /* private */
+} WinFontCollection;
+
+/* What the FNT header says about a face. Filled in without reading
+ * the char table or the bitmap. */
+typedef struct {
+    char facename[32];          /* null-terminated, may be truncated */
+    int version;                /* 0x200 or 0x300 */
+    int points;                 /* nominal point size */
+    int pixwidth;               /* glyph width, 0 if proportional */
+    int pixheight;              /* glyph height */
+    int maxwidth;               /* widest glyph */
+    int weight;                 /* 400 is normal, 700 bold */
+    int charset;                /* dfCharSet */
+    int italic;                 /* nonzero if italic */
+    int pitchfamily;            /* dfPitchAndFamily */
+    int firstchar;
+    int lastchar;
+} WinFont_FaceInfo;
+
+/* The FNT header of a loaded font, see winfont_get_info. Offsets are
+ * from the start of the FNT resource. */
+typedef struct {
+    int version;                /* dfVersion, 0x200 or 0x300 */
+    uint32_t size;              /* dfSize, bytes in the resource */
+    char copyright[61];         /* dfCopyright, null-terminated */
+    int type;                   /* dfType, bit 0 set for vector fonts */
+    int points;                 /* nominal point size */
+    int vertres, horizres;      /* dots per inch it was designed for */
+    int ascent;                 /* baseline from the top, in pixels */
+    int internal_leading;
+    int external_leading;
+    int italic;
+    int underline;
+    int strikeout;
+    int weight;                 /* 400 is normal, 700 bold */
+    int charset;                /* dfCharSet */
+    int pixwidth;               /* glyph width, 0 if proportional */
+    int pixheight;              /* glyph height */
+    int pitchfamily;            /* dfPitchAndFamily */
+    int avgwidth;
+    int maxwidth;
+    int firstchar;
+    int lastchar;
+    int defaultchar;            /* relative to firstchar */
+    int breakchar;              /* relative to firstchar */
+    int widthbytes;             /* dfWidthBytes */
+    uint32_t device;            /* offset of the device name, or 0 */
+    uint32_t face;              /* offset of the face name */
+    uint32_t bitspointer;       /* dfBitsPointer, unused on disk */
+    uint32_t bitsoffset;        /* offset of the glyph bits */
+    uint32_t flags;             /* dfFlags, v3 only */
+    int aspace;                 /* dfAspace, space before each glyph */
+    int bspace;                 /* dfBspace, the glyph's own width */
+    int cspace;                 /* dfCspace, space after each glyph */
+} WinFont_FontInfo;
+
+/* Faces of every font file found, in path order. nfaces is -1 for a
+ * file that is not a FON. */
+typedef struct {
+    char *path;
+    int nfaces;
+    WinFont_FaceInfo *faces;
+} WinFont_IndexEntry;
+
+typedef struct {
+    int nfiles;
+    WinFont_IndexEntry *files;
+} WinFont_Index;
+
+/* A source of FON bytes for winfont_read_reader. read copies up to n
+ * bytes at offset off into buf and returns how many, 0 at the end of
+ * the input, or -1 on error. base is added to every offset, so a FON
+ * can be read from inside a larger file. read may be called from
+ * several threads at once if the same reader is shared. */
+typedef struct {
+    ssize_t (*read)(void *ctx, void *buf, size_t n, uint64_t off);
+    void *ctx;
+    uint64_t base;
+} WinFont_Reader;
+
+/* A source of FON bytes that can only be read in order, for
+ * winfont_stream_new. Returns up to n bytes, 0 at the end of the
+ * input, or -1 on error. */
+typedef ssize_t (*WinFont_StreamFunc)(void *ctx, void *buf, size_t n);
+
+/* Faces read in one forward pass, see winfont_stream_new. */
+typedef struct WinFontStream WinFontStream;
+
+/* The FON files in a zip archive or a gzip file. */
+typedef struct WinFontArchive WinFontArchive;
+
+/* The size of a run of text. The box is what its glyphs' bitmaps
+ * cover, from the pen position at the top of the glyphs; it is empty
+ * for no text. */
+typedef struct {
+    int advance;                /* how far the pen moves */
+    int x, y, w, h;             /* the box */
+} WinFont_Extent;
+
+/* One line of wrapped text: the bytes up to where it breaks, without
+ * the spaces or newline it breaks at. ext.y is the line's top, from
+ * the top of the first line. */
+typedef struct {
+    size_t start;
+    size_t len;
+    WinFont_Extent ext;
+} WinFont_Line;
+
+/* Distinct glyphs shared between fonts, see winfont_store_new. */
+typedef struct WinFontGlyphStore WinFontGlyphStore;
+
+/* Glyph counts and row bytes of the fonts sharing a store. */
+typedef struct {
+    size_t glyphs;              /* glyphs of all the fonts */
+    size_t unique;              /* distinct glyphs kept */
+    size_t bytes;               /* rows of all the fonts' glyphs */
+    size_t stored;              /* rows of the distinct glyphs */
+    size_t saved;               /* bytes - stored */
+    double ratio;               /* glyphs / unique */
+} WinFont_StoreStats;
+
 const char *
 winfont_version();
 
+/* Read the FON that starts at the current position of f. The
+ * position is not moved; the bytes are read with pread. A pipe or
+ * socket, which can't be read by position, is streamed instead, which
+ * leaves f after the first face. */
 WinFont *
 winfont_read_file(FILE *f);
 
+/* Read faces from input that can't seek, such as a pipe, a socket or
+ * a decompressor, without holding more than budget bytes of it at a
+ * time, or 1 MiB if budget is 0. The bytes of each face are kept only
+ * while it is decoded, so a budget smaller than a face fails with
+ * WinFont_ErrNoMem. */
+WinFontStream *
+winfont_stream_new(WinFont_StreamFunc fn, void *ctx, size_t budget);
+
+/* A stream reading f forward from its current position. */
+WinFontStream *
+winfont_stream_file(FILE *f, size_t budget);
+
+/* The next face, in the order the faces are stored in the file, as
+ * soon as its last byte has been read. Returns NULL after the last
+ * face, with winfont_last_error WinFont_ErrNone, or on error, after
+ * which the stream returns no more faces. Faces never refer to the
+ * stream and outlive it. */
+WinFont *
+winfont_stream_next(WinFontStream *st);
+
+void
+winfont_stream_free(WinFontStream *st);
+
+/* Read the FON that starts at offset base of fd with pread. */
+WinFont *
+winfont_read_fd(int fd, uint64_t base);
+
+WinFont *
+winfont_read_reader(const WinFont_Reader *r);
+
 WinFont *
 winfont_read_path(char *path);
 
+/* Parse a FON image that is already in memory. No stdio is used. For
+ * fonts with glyphs 8 pixels wide or less the bitmap may point
+ * directly into buf, so buf must outlive the returned font. */
+WinFont *
+winfont_read_memory(const void *buf, size_t len);
+
+/* Map the file at path and parse it with winfont_read_memory. The
+ * mapping is owned by the font and released by winfont_free. */
+WinFont *
+winfont_open_mmap(const char *path);
+
+/* With WINFONT_LAZY glyphs are decoded the first time they are read
+ * with winfont_glyph_bitmap, which is safe to call from several
+ * threads at once. Until then a glyph in bitmap is blank, so lazy
+ * fonts should only be read through winfont_glyph_bitmap. */
+WinFont *
+winfont_read_memory_flags(const void *buf, size_t len, int flags);
+
+WinFont *
+winfont_open_mmap_flags(const char *path, int flags);
+
+/* As the _flags functions, with the font's memory from alloc. */
+WinFont *
+winfont_read_memory_alloc(const void *buf, size_t len, int flags,
+    const WinFont_Allocator *alloc);
+
+WinFont *
+winfont_open_mmap_alloc(const char *path, int flags,
+    const WinFont_Allocator *alloc);
+
+/* A pool that hands out memory from slabs of slabsize bytes, or a
+ * default size if 0, so that many small fonts share a few large
+ * allocations. A slab is released when every font in it has been
+ * freed. The pool may be used from several threads at once. */
+WinFontPool *
+winfont_pool_new(size_t slabsize);
+
+/* An allocator for the _alloc functions that uses pool. */
+WinFont_Allocator
+winfont_pool_allocator(WinFontPool *pool);
+
+/* Release the pool. Every font allocated from it must be freed
+ * first. */
+void
+winfont_pool_free(WinFontPool *pool);
+
 void
 winfont_free(WinFont *wf);
 
+/* Copy the FNT header of wf into info. Returns 0, or -1 if wf is
+ * NULL. */
+int
+winfont_get_info(WinFont *wf, WinFont_FontInfo *info);
+
+/* Why the last call that failed on this thread failed. Calls that
+ * succeed leave it alone. */
+WinFont_Error
+winfont_last_error(void);
+
+const char *
+winfont_strerror(WinFont_Error err);
+
+/* Send diagnostics at level and above, WinFont_LogError first, to fn,
+ * or stop sending them if fn is NULL. None are sent by default, and
+ * none exist in a library built with -DWINFONT_NO_LOG. */
+void
+winfont_set_log(WinFont_LogFunc fn, int level, void *ctx);
+
+/* Like winfont_read_memory, buf must outlive the collection. */
+WinFontCollection *
+winfont_collection_read_memory(const void *buf, size_t len);
+
+WinFontCollection *
+winfont_collection_open(const char *path);
+
+/* Returns face i with its bitmap loaded. */
+WinFont *
+winfont_collection_face(WinFontCollection *wc, int i);
+
+/* Index of the first face matching the point size, pixel height and
+ * weight, any of which may be 0 to match anything. -1 if none. */
+int
+winfont_collection_find(WinFontCollection *wc, int points, int height,
+    int weight);
+
+void
+winfont_collection_free(WinFontCollection *wc);
+
+/* Open a zip archive, its .fon entries stored or deflated, or a gzip
+ * file holding one FON. Only the zip's directory is read; entries are
+ * decompressed in memory when first asked for, and loaded with flags
+ * as by winfont_read_memory_flags. Deflate needs the library built
+ * with zlib. */
+WinFontArchive *
+winfont_archive_open(const char *path, int flags);
+
+/* Like winfont_archive_open, buf must outlive the archive. */
+WinFontArchive *
+winfont_archive_read_memory(const void *buf, size_t len, int flags);
+
+/* The number of FON entries. */
+int
+winfont_archive_count(const WinFontArchive *ar);
+
+/* Entry i's name in the archive, or for a gzip file the name in its
+ * header or the file's name without .gz. */
+const char *
+winfont_archive_name(const WinFontArchive *ar, int i);
+
+/* Entry i's font, decompressed and loaded the first time it is asked
+ * for, from any number of threads at once. The font is owned by the
+ * archive. Returns NULL if the entry could not be loaded, every time it
+ * is asked for. */
+WinFont *
+winfont_archive_font(WinFontArchive *ar, int i);
+
+/* Decompress and load every entry not yet loaded on nthreads threads,
+ * or one per CPU if 0. Returns how many entries have a font. */
+int
+winfont_archive_load(WinFontArchive *ar, int nthreads);
+
+void
+winfont_archive_free(WinFontArchive *ar);
+
+/* A store that keeps one copy of each distinct glyph, by width, height
+ * and rows, for the fonts shared through it. */
+WinFontGlyphStore *
+winfont_store_new(void);
+
+/* A copy of wf whose glyphs are in the store, added to it if they are
+ * not there yet. Its bitmap is NULL, so it must be read through
+ * winfont_glyph_get. wf is not changed and may be freed. Freeing the
+ * copy drops its glyphs from the store. Thread safe. */
+WinFont *
+winfont_store_share(WinFontGlyphStore *st, WinFont *wf);
+
+int
+winfont_store_stats(WinFontGlyphStore *st, WinFont_StoreStats *stats);
+
+/* The store is freed once this is called and its last font freed. */
+void
+winfont_store_free(WinFontGlyphStore *st);
+
+/* Read the headers of the faces of a FON, up to max of them, into
+ * faces. Nothing else in the file is looked at. Returns the number of
+ * faces in the file, or -1 if it is not a FON. */
+int
+winfont_scan_memory(const void *buf, size_t len, WinFont_FaceInfo *faces,
+    int max);
+
+/* winfont_scan_memory on a mapped file, so only the pages holding the
+ * headers are read. */
+int
+winfont_scan_path(const char *path, WinFont_FaceInfo *faces, int max);
+
+/* Scan npaths files on nthreads threads, or one per CPU if nthreads is
+ * 0 or less. Only the headers are read, through io_uring on Linux where
+ * the kernel allows it. */
+WinFont_Index *
+winfont_index_paths(char *const *paths, int npaths, int nthreads);
+
+/* Scan every .fon file under dir. */
+WinFont_Index *
+winfont_index_dir(const char *dir, int nthreads);
+
+/* Write one tab separated line per face: path, face name, points,
+ * pixel width and height, weight, charset, italic and pitch and
+ * family. Returns 0 on success, -1 on a write error. */
+int
+winfont_index_write(WinFont_Index *idx, FILE *f);
+
+void
+winfont_index_free(WinFont_Index *idx);
+
+/* A loader that opens fonts with winfont_open_mmap_flags on nthreads
+ * threads, or one per CPU if nthreads is 0. Queued jobs start in
+ * order of priority, highest first, then of submission. */
+WinFontLoader *
+winfont_loader_new(int nthreads);
+
+/* Queue path for loading. The job belongs to the caller, who frees it
+ * with winfont_job_free. */
+WinFontJob *
+winfont_loader_submit(WinFontLoader *ld, const char *path, int flags,
+    int priority);
+
+/* Store up to max finished, failed or canceled jobs in jobs, in the
+ * order they finished, each only once. Never blocks. Returns how many
+ * were stored. */
+int
+winfont_loader_done(WinFontLoader *ld, WinFontJob **jobs, int max);
+
+/* Cancel the queued jobs, wait for the running ones and stop the
+ * threads. Jobs stay valid until freed. */
+void
+winfont_loader_free(WinFontLoader *ld);
+
+WinFont_JobState
+winfont_job_poll(WinFontJob *job);
+
+/* Block until the job has finished, failed or been canceled. */
+WinFont_JobState
+winfont_job_wait(WinFontJob *job);
+
+/* Cancel a job that has not started. Returns 0, or -1 if it has. */
+int
+winfont_job_cancel(WinFontJob *job);
+
+/* Move a job that has not started. Returns 0, or -1 if it has. */
+int
+winfont_job_set_priority(WinFontJob *job, int priority);
+
+/* Wait for the job and take its font, which the caller then frees.
+ * NULL if the job failed or was canceled, or the font was taken. */
+WinFont *
+winfont_job_take(WinFontJob *job);
+
+/* Wait for the job and return why it failed, or WinFont_ErrNone. */
+WinFont_Error
+winfont_job_error(WinFontJob *job);
+
+/* Cancel the job if queued, wait for it if running, and free it along
+ * with any font not taken. */
+void
+winfont_job_free(WinFontJob *job);
+
+/* Load npaths fonts on nthreads threads, or one per CPU if 0, into
+ * fonts, which gets NULL for each that fails. The files are read like
+ * winfont_index_paths reads them. Returns the number loaded, or -1. */
+int
+winfont_load_batch(char *const *paths, int npaths, int flags,
+    WinFont **fonts, int nthreads);
+
+/* Glyph index of character code ch, or of the font's default
+ * character if ch is not in the font. */
+int
+winfont_glyph_index(WinFont *wf, int ch);
+
+/* The Unicode code point of character code ch in charset, or -1 if
+ * it has none the library knows. */
+int32_t
+winfont_charset_unicode(int charset, int ch);
+
+/* Glyph index of Unicode code point cp, or of the font's default
+ * character if the font's charset has no code for it. */
+int
+winfont_glyph_index_unicode(WinFont *wf, uint32_t cp);
+
+/* Glyph indices of len bytes of UTF-8 into glyphs, which must have
+ * room for len of them. Malformed sequences are U+FFFD, one per byte.
+ * Returns the number of glyphs, or -1. */
+ssize_t
+winfont_glyphs_utf8(WinFont *wf, const char *text, size_t len,
+    uint16_t *glyphs);
+
+/* The advance of len bytes of text, as winfont_draw_string would
+ * draw them, and if ext is not NULL their box. Returns -1 on error. */
+int
+winfont_measure(WinFont *wf, const char *text, size_t len,
+    WinFont_Extent *ext);
+
+/* Break len bytes of text into lines at most maxwidth pixels wide,
+ * or only at newlines if maxwidth is 0. Lines break after spaces and
+ * the font's break character, and inside a word only if it does not
+ * fit on a line of its own. The first maxlines lines are stored in
+ * lines. Returns how many lines there are, or -1 on error. */
+int
+winfont_wrap(WinFont *wf, const char *text, size_t len, int maxwidth,
+    WinFont_Line *lines, int maxlines);
+
+/* Draw glyph g with its top left corner at x, y, clipped to the
+ * framebuffer. Returns x advanced by the glyph width. */
+int
+winfont_draw_glyph(WinFont *wf, const WinFont_Framebuffer *fb,
+    int x, int y, int g, uint32_t fg, uint32_t bg, int mode);
+
+/* Draw len bytes of text, each a character code in the font's
+ * charset, with a v3 font's A and C space around every glyph. Returns
+ * the x position after the last glyph. */
+int
+winfont_draw_string(WinFont *wf, const WinFont_Framebuffer *fb,
+    int x, int y, uint32_t fg, uint32_t bg, int mode,
+    const char *text, size_t len);
+
+/* winfont_draw_glyph and winfont_draw_string with every pixel drawn
+ * as a factor by factor block. */
+int
+winfont_draw_glyph_scaled(WinFont *wf, const WinFont_Framebuffer *fb,
+    int x, int y, int g, int factor, uint32_t fg, uint32_t bg, int mode);
+
+int
+winfont_draw_string_scaled(WinFont *wf, const WinFont_Framebuffer *fb,
+    int x, int y, int factor, uint32_t fg, uint32_t bg, int mode,
+    const char *text, size_t len);
+
+/* A screen of cols by rows cells drawn into pixels, or into its own
+ * framebuffer if pixels is NULL. stride may be 0 for a packed
+ * framebuffer. Every cell starts as a space, palette 7 on 0. */
+WinFontScreen *
+winfont_screen_new(WinFont *wf, int cols, int rows,
+    WinFont_PixelFormat format, uint8_t *pixels, int stride);
+
+void
+winfont_screen_free(WinFontScreen *s);
+
+void
+winfont_screen_put(WinFontScreen *s, int col, int row, int glyph,
+    uint8_t fg, uint8_t bg, uint8_t attr);
+
+/* Put len character codes starting at col, row. */
+void
+winfont_screen_write(WinFontScreen *s, int col, int row,
+    const char *text, size_t len, uint8_t fg, uint8_t bg, uint8_t attr);
+
+/* Changing a palette entry redraws the whole screen. */
+void
+winfont_screen_set_palette(WinFontScreen *s, int idx, uint32_t value);
+
+/* Show or hide cells with WinFont_CellBlink. */
+void
+winfont_screen_blink(WinFontScreen *s, int on);
+
+/* Redraw the cells changed since the last update and store up to
+ * maxrects pixel rects covering them in rects. Returns the number of
+ * rects stored. */
+int
+winfont_screen_update(WinFontScreen *s, WinFont_Rect *rects, int maxrects);
+
+/* Bytes of pixels winfont_build_atlas needs for the same arguments. */
+size_t
+winfont_atlas_required_size(WinFont *wf, WinFont_AtlasFormat format,
+    int maxwidth, int padding);
+
+/* Pack every glyph into an atlas at most maxwidth pixels wide, or
+ * about square if maxwidth is 0, with padding pixels around each
+ * glyph. The atlas is drawn into pixels if given, which must hold
+ * winfont_atlas_required_size bytes, otherwise it is allocated. */
+WinFont_Atlas *
+winfont_build_atlas(WinFont *wf, WinFont_AtlasFormat format,
+    int maxwidth, int padding, uint8_t *pixels, size_t sz);
+
+void
+winfont_atlas_free(WinFont_Atlas *atlas);
+
+/* Write wf to cache_path in a form winfont_load_cache can map
+ * without decoding. source_path, if not NULL, is the file wf was loaded
+ * from; its size and modification time are recorded. Returns 0 on
+ * success, -1 on failure. */
+int
+winfont_save_cache(WinFont *wf, const char *source_path,
+    const char *cache_path);
+
+/* Map the font in cache_path. If source_path is not NULL and the cache
+ * is missing, damaged or older than it, the font is loaded from
+ * source_path instead and the cache is rewritten. */
+WinFont *
+winfont_load_cache(const char *cache_path, const char *source_path);
+
+/* A copy of wf with every glyph scaled up by factor, 1 to
+ * WINFONT_MAX_SCALE. Free it with winfont_free. */
+WinFont *
+winfont_scale(WinFont *wf, int factor);
+
+/* Keep a copy of wf scaled by factor for the _scaled draw functions,
+ * so text drawn often at that size is scaled only once. The copy is
+ * freed with wf. Returns 0 on success, -1 on failure. */
+int
+winfont_cache_scale(WinFont *wf, int factor);
+
+/* A copy of wf with its glyphs drawn in style, WINFONT_BOLD and the
+ * other style flags or'ed together, and its header marked to match.
+ * Bold glyphs are a pixel wider and italic ones (height - 1) / 4
+ * pixels. Underline and strikeout fill a row across each glyph. Free
+ * it with winfont_free. */
+WinFont *
+winfont_derive_style(WinFont *wf, int style);
+
+/* Write wf as a PSF2 console font to fd, in one writev, with a
+ * Unicode table if wf's charset maps all of its characters. A font
+ * narrower than its widest glyph is padded out to it. Returns 0 on
+ * success, -1 on failure. */
+int
+winfont_write_psf2(WinFont *wf, int fd);
+
+/* Write wf as an X11 BDF font to out. Glyphs are encoded by Unicode,
+ * ISO10646-1, if wf's charset maps all of its characters, and by their
+ * character codes, FontSpecific-0, if not. Returns 0 or -1. */
+int
+winfont_write_bdf(WinFont *wf, FILE *out);
+
+/* Write wf as an X11 PCF font to out, encoded as for BDF. Returns 0
+ * or -1. */
+int
+winfont_write_pcf(WinFont *wf, FILE *out);
+
+/* Bytes needed to hold glyph g, 0 if there is no such glyph. */
 size_t
 winfont_glyph_required_size(WinFont *wf, int g);
 
+/* Copy glyph g into bm as height rows of (widths[g] + 7) / 8 bytes,
+ * most significant bit leftmost. Returns 0, or -1 if g is out of range or
+ * sz is too small. */
 int
 winfont_glyph_bitmap(WinFont *wf, int g, uint8_t *bm, size_t sz);
 
+/* Bytes needed to hold glyph g in layout, 0 if there is no such
+ * glyph. */
+size_t
+winfont_glyph_layout_size(WinFont *wf, int g, WinFont_Layout layout);
+
+/* Glyph g in layout. If the font already holds the glyph that way a
+ * pointer into the font is returned and buf is not touched, otherwise
+ * the glyph is converted into buf and buf is returned. NULL if g is
+ * out of range or buf is needed and smaller than
+ * winfont_glyph_layout_size. */
+const uint8_t *
+winfont_glyph_get(WinFont *wf, int g, WinFont_Layout layout,
+    uint8_t *buf, size_t sz);
+
 #endif /* WINFONT_H */
@@ -0,0 +1,226 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 Eddie Hillenbrand
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+/* Font directory indexing. The files are read with
+ * winfont_bulk_read, which hands each one's headers to index_file on
+ * whichever thread read it, and index_file scans them into that file's
+ * slot, so the index comes out in path order however the work was
+ * split. */
+
+#include <winfont.h>
+#include "winfont_private.h"
+
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/stat.h>
+
+static void
+index_file(void *ctx, int i, uint8_t *buf, size_t len, WinFont_Error err)
+{
+    WinFont_IndexEntry *e = &((WinFont_Index *)ctx)->files[i];
+    int n;
+
+    (void)err;
+    e->nfaces = -1;
+    if (!buf)
+        return;
+
+    n = winfont_scan_memory(buf, len, NULL, 0);
+    if (n > 0) {
+        e->faces = malloc(n * sizeof(WinFont_FaceInfo));
+        if (e->faces)
+            e->nfaces = winfont_scan_memory(buf, len, e->faces, n);
+    } else {
+        e->nfaces = n;
+    }
+
+    free(buf);
+}
+
+WinFont_Index *
+winfont_index_paths(char *const *paths, int npaths, int nthreads)
+{
+    WinFont_Index *idx;
+    WinFont_Error err;
+
+    if (npaths < 0 || (npaths && !paths)) {
+        winfont_set_error(WinFont_ErrArg);
+        return NULL;
+    }
+
+    idx = calloc(1, sizeof(WinFont_Index));
+    if (!idx) {
+        winfont_set_error(WinFont_ErrNoMem);
+        return NULL;
+    }
+    idx->files = calloc(npaths ? npaths : 1, sizeof(WinFont_IndexEntry));
+    if (!idx->files)
+        goto fail;
+    for (int i = 0; i < npaths; i++) {
+        idx->files[i].path = strdup(paths[i]);
+        if (!idx->files[i].path)
+            goto fail;
+        idx->nfiles++;
+    }
+
+    /* Files that cannot be read are entries, not a failure. */
+    err = winfont_last_error();
+    winfont_bulk_read(paths, npaths, 1, WF_IO_AUTO, nthreads, index_file,
+        idx);
+    winfont_set_error(err);
+
+    return idx;
+
+fail:
+    winfont_index_free(idx);
+    winfont_set_error(WinFont_ErrNoMem);
+    return NULL;
+}
+
+struct path_list {
+    char **paths;
+    int n, cap;
+};
+
+static int
+path_cmp(const void *a, const void *b)
+{
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+static int
+has_fon_suffix(const char *name)
+{
+    size_t n = strlen(name);
+
+    return n > 4 && strcasecmp(name + n - 4, ".fon") == 0;
+}
+
+/* Add every .fon under dir to list. Unreadable directories are
+ * skipped. */
+static int
+collect_fonts(const char *dir, struct path_list *list)
+{
+    struct dirent *de;
+    struct stat st;
+    char *path, **grown;
+    DIR *d;
+    int ret = 0;
+
+    d = opendir(dir);
+    if (!d)
+        return 0;
+
+    while (ret == 0 && (de = readdir(d))) {
+        if (!strcmp(de->d_name, ".") || !strcmp(de->d_name, ".."))
+            continue;
+
+        path = malloc(strlen(dir) + strlen(de->d_name) + 2);
+        if (!path) {
+            ret = -1;
+            break;
+        }
+        sprintf(path, "%s/%s", dir, de->d_name);
+
+        if (stat(path, &st) == -1) {
+            free(path);
+        } else if (S_ISDIR(st.st_mode)) {
+            ret = collect_fonts(path, list);
+            free(path);
+        } else if (S_ISREG(st.st_mode) && has_fon_suffix(de->d_name)) {
+            if (list->n == list->cap) {
+                list->cap = list->cap ? 2 * list->cap : 64;
+                grown = realloc(list->paths, list->cap * sizeof(char *));
+                if (!grown) {
+                    free(path);
+                    ret = -1;
+                    break;
+                }
+                list->paths = grown;
+            }
+            list->paths[list->n++] = path;
+        } else {
+            free(path);
+        }
+    }
+
+    closedir(d);
+    return ret;
+}
+
+WinFont_Index *
+winfont_index_dir(const char *dir, int nthreads)
+{
+    struct path_list list = { NULL, 0, 0 };
+    WinFont_Index *idx = NULL;
+
+    if (!dir) {
+        winfont_set_error(WinFont_ErrArg);
+        return NULL;
+    }
+
+    if (collect_fonts(dir, &list) == 0) {
+        qsort(list.paths, list.n, sizeof(char *), path_cmp);
+        idx = winfont_index_paths(list.paths, list.n, nthreads);
+    } else {
+        winfont_set_error(WinFont_ErrNoMem);
+    }
+
+    for (int i = 0; i < list.n; i++)
+        free(list.paths[i]);
+    free(list.paths);
+
+    return idx;
+}
+
+int
+winfont_index_write(WinFont_Index *idx, FILE *f)
+{
+    WinFont_IndexEntry *e;
+    WinFont_FaceInfo *fi;
+
+    if (!idx || !f) {
+        winfont_set_error(WinFont_ErrArg);
+        return -1;
+    }
+
+    for (int i = 0; i < idx->nfiles; i++) {
+        e = &idx->files[i];
+        for (int j = 0; j < e->nfaces; j++) {
+            fi = &e->faces[j];
+            fprintf(f, "%s\t%s\t%d\t%d\t%d\t%d\t%d\t%d\t0x%02x\n",
+                e->path, fi->facename, fi->points, fi->pixwidth,
+                fi->pixheight, fi->weight, fi->charset,
+                fi->italic != 0, fi->pitchfamily);
+        }
+    }
+
+    if (ferror(f)) {
+        winfont_set_error(WinFont_ErrIO);
+        return -1;
+    }
+
+    return 0;
+}
+
+void
+winfont_index_free(WinFont_Index *idx)
+{
+    if (!idx)
+        return;
+
+    for (int i = 0; i < idx->nfiles; i++) {
+        free(idx->files[i].path);
+        free(idx->files[i].faces);
+    }
+    free(idx->files);
+    free(idx);
+}
@@ -0,0 +1,223 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 Eddie Hillenbrand
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+/* Measuring and wrapping text, bytes in the font's charset as for
+ * winfont_draw_string. A glyph moves the pen by the A space, its width
+ * and the C space. In a fixed pitch font that is one number, so a run
+ * is its length times the pitch and the byte that overflows a line is
+ * found by a division. In a proportional font the widths are gathered
+ * four bytes at a time, and a line is fitted a block at a time. */
+
+#include <winfont.h>
+#include "winfont_private.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#define FIT_BLOCK 64
+
+struct metrics {
+    int a, ac;                  /* A space, and A plus C */
+    int pitch;                  /* advance of every glyph, or 0 */
+    int width;                  /* bitmap width of every glyph */
+    int height, lineh;          /* glyph height, and with the leading */
+    int brk;                    /* dfBreakChar as a character code */
+    unsigned first, count;      /* character codes in the font */
+    int defglyph;
+    const uint16_t *widths;
+};
+
+static int
+metrics_init(WinFont *wf, struct metrics *m)
+{
+    WinFont_FontInfo info;
+    int c;
+
+    if (winfont_get_info(wf, &info) == -1)
+        return -1;
+
+    winfont_spacing(wf, &m->a, &c);
+    m->ac = m->a + c;
+    m->height = wf->height;
+    m->lineh = wf->height + info.external_leading;
+    m->brk = info.firstchar + info.breakchar;
+    m->width = wf->width;
+    m->pitch = info.pixwidth ? m->ac + wf->width : 0;
+    m->first = info.firstchar;
+    m->count = info.lastchar - info.firstchar + 1;
+    m->defglyph = winfont_glyph_index(wf, -1);
+    m->widths = wf->widths;
+
+    return 0;
+}
+
+/* Bitmap width of the glyph for ch, as winfont_glyph_index finds it. */
+static inline int
+ink(const struct metrics *m, uint8_t ch)
+{
+    unsigned k = ch - m->first;
+
+    if (m->pitch)
+        return m->width;
+    return m->widths[k < m->count ? (int)k : m->defglyph];
+}
+
+static inline int
+advance(const struct metrics *m, uint8_t ch)
+{
+    return m->pitch ? m->pitch : ink(m, ch) + m->ac;
+}
+
+static int
+run_advance(const struct metrics *m, const uint8_t *p, size_t n)
+{
+    int s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+    size_t i;
+
+    if (m->pitch)
+        return (int)n * m->pitch;
+
+    for (i = 0; i + 4 <= n; i += 4) {
+        s0 += ink(m, p[i]);
+        s1 += ink(m, p[i + 1]);
+        s2 += ink(m, p[i + 2]);
+        s3 += ink(m, p[i + 3]);
+    }
+    for (; i < n; i++)
+        s0 += ink(m, p[i]);
+
+    return s0 + s1 + s2 + s3 + (int)n * m->ac;
+}
+
+/* How many bytes of p from the start fit in maxwidth. */
+static size_t
+run_fit(const struct metrics *m, const uint8_t *p, size_t n, int maxwidth)
+{
+    size_t i = 0;
+    int w = 0, block;
+
+    if (m->pitch) {
+        i = maxwidth / m->pitch;
+        return i < n ? i : n;
+    }
+
+    for (; i + FIT_BLOCK <= n; i += FIT_BLOCK) {
+        block = run_advance(m, p + i, FIT_BLOCK);
+        if (w + block > maxwidth)
+            break;
+        w += block;
+    }
+    for (; i < n && w + advance(m, p[i]) <= maxwidth; i++)
+        w += advance(m, p[i]);
+
+    return i;
+}
+
+/* The advance of n bytes, and the box their bitmaps cover, which runs
+ * from the first glyph's A space to the last glyph's right edge. */
+static void
+run_extent(const struct metrics *m, const uint8_t *p, size_t n, int y,
+    WinFont_Extent *ext)
+{
+    memset(ext, 0, sizeof(*ext));
+    ext->advance = run_advance(m, p, n);
+    ext->y = y;
+    if (n == 0)
+        return;
+
+    ext->x = m->a;
+    ext->w = ext->advance - advance(m, p[n - 1]) + ink(m, p[n - 1]);
+    ext->h = m->height;
+}
+
+int
+winfont_measure(WinFont *wf, const char *text, size_t len,
+    WinFont_Extent *ext)
+{
+    struct metrics m;
+    WinFont_Extent e;
+
+    if (!wf || (len && !text)) {
+        winfont_set_error(WinFont_ErrArg);
+        return -1;
+    }
+    if (metrics_init(wf, &m) == -1)
+        return -1;
+
+    run_extent(&m, (const uint8_t *)text, len, 0, &e);
+    if (ext)
+        *ext = e;
+
+    return e.advance;
+}
+
+static int
+is_break(const struct metrics *m, uint8_t ch)
+{
+    return ch == ' ' || ch == m->brk;
+}
+
+int
+winfont_wrap(WinFont *wf, const char *text, size_t len, int maxwidth,
+    WinFont_Line *lines, int maxlines)
+{
+    const uint8_t *p = (const uint8_t *)text, *nl = NULL;
+    size_t pos = 0, segend, hard, fit, end, next, j;
+    struct metrics m;
+    int n = 0, searched = 0;
+
+    if (!wf || (len && !text) || (maxlines > 0 && !lines)) {
+        winfont_set_error(WinFont_ErrArg);
+        return -1;
+    }
+    if (metrics_init(wf, &m) == -1)
+        return -1;
+
+    while (pos < len) {
+        /* A newline always ends the line, CR LF as well. The next one
+         * is looked for again only once it is passed. */
+        if (!searched || (nl && nl < p + pos)) {
+            nl = memchr(p + pos, '\n', len - pos);
+            searched = 1;
+        }
+        segend = nl ? (size_t)(nl - p) : len;
+        hard = nl ? segend + 1 : len;
+        if (nl && segend > pos && p[segend - 1] == '\r')
+            segend--;
+
+        fit = maxwidth > 0 ? run_fit(&m, p + pos, segend - pos, maxwidth) :
+            segend - pos;
+        if (pos + fit >= segend) {
+            end = segend;
+            next = hard;
+        } else {
+            /* Back up to the last break the line can end at, or split
+             * the word if there is none; a line is never empty. */
+            for (j = pos + fit; j > pos && !is_break(&m, p[j]); j--)
+                ;
+            end = j > pos ? j : pos + (fit ? fit : 1);
+            for (next = end; next < segend && is_break(&m, p[next]); next++)
+                ;
+            if (next == segend)
+                next = hard;
+        }
+
+        while (end > pos && is_break(&m, p[end - 1]))
+            end--;
+
+        if (n < maxlines) {
+            lines[n].start = pos;
+            lines[n].len = end - pos;
+            run_extent(&m, p + pos, end - pos, n * m.lineh, &lines[n].ext);
+        }
+        n++;
+        pos = next;
+    }
+
+    return n;
+}
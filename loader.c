@@ -0,0 +1,486 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 Eddie Hillenbrand
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+/* Background font loading. Jobs wait in one priority queue, a binary
+ * heap ordered by priority and then by submission order, and the
+ * loader's threads take the top job whenever they are free. A job's
+ * font depends only on its file, so results are the same however the
+ * jobs were scheduled. One mutex guards the queue, every job's state
+ * and the list of finished jobs not yet handed out. */
+
+#include <winfont.h>
+#include "winfont_private.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define MAX_THREADS 64
+
+struct WinFontJob {
+    WinFontLoader *loader;      /* NULL once the loader is freed */
+    char *path;
+    int flags;
+    int priority;
+    unsigned long seq;          /* submission order */
+    WinFont_JobState state;
+    WinFont *font;
+    WinFont_Error error;
+    int slot;                   /* index in the heap while queued */
+    int reported;               /* handed out by winfont_loader_done */
+    struct WinFontJob *next_done;
+    struct WinFontJob *prev, *next; /* every job of the loader */
+};
+
+struct WinFontLoader {
+    pthread_mutex_t lock;
+    pthread_cond_t work;        /* a job was queued, or stop */
+    pthread_cond_t done;        /* a job finished */
+    pthread_t threads[MAX_THREADS];
+    int nthreads;
+    int stop;
+    WinFontJob **heap;
+    int nqueued, cap;
+    unsigned long seq;
+    WinFontJob *jobs;
+    WinFontJob *done_head, *done_tail;
+};
+
+/* Whether a should run before b. */
+static int
+job_before(const WinFontJob *a, const WinFontJob *b)
+{
+    if (a->priority != b->priority)
+        return a->priority > b->priority;
+    return a->seq < b->seq;
+}
+
+static void
+heap_set(WinFontLoader *ld, int i, WinFontJob *job)
+{
+    ld->heap[i] = job;
+    job->slot = i;
+}
+
+static void
+heap_up(WinFontLoader *ld, int i)
+{
+    WinFontJob *job = ld->heap[i];
+
+    while (i > 0 && job_before(job, ld->heap[(i - 1) / 2])) {
+        heap_set(ld, i, ld->heap[(i - 1) / 2]);
+        i = (i - 1) / 2;
+    }
+    heap_set(ld, i, job);
+}
+
+static void
+heap_down(WinFontLoader *ld, int i)
+{
+    WinFontJob *job = ld->heap[i];
+    int c;
+
+    while ((c = 2 * i + 1) < ld->nqueued) {
+        if (c + 1 < ld->nqueued && job_before(ld->heap[c + 1], ld->heap[c]))
+            c++;
+        if (!job_before(ld->heap[c], job))
+            break;
+        heap_set(ld, i, ld->heap[c]);
+        i = c;
+    }
+    heap_set(ld, i, job);
+}
+
+static void
+heap_remove(WinFontLoader *ld, WinFontJob *job)
+{
+    WinFontJob *last;
+    int i = job->slot;
+
+    last = ld->heap[--ld->nqueued];
+    if (last == job)
+        return;
+    /* The last job fills the hole and moves whichever way it must. */
+    heap_set(ld, i, last);
+    heap_down(ld, i);
+    heap_up(ld, last->slot);
+}
+
+/* Called with the lock held. */
+static void
+job_finish(WinFontLoader *ld, WinFontJob *job, WinFont_JobState state)
+{
+    job->state = state;
+    job->next_done = NULL;
+    if (ld->done_tail)
+        ld->done_tail->next_done = job;
+    else
+        ld->done_head = job;
+    ld->done_tail = job;
+    pthread_cond_broadcast(&ld->done);
+}
+
+static void *
+loader_worker(void *arg)
+{
+    WinFontLoader *ld = arg;
+    WinFontJob *job;
+    WinFont *wf;
+    WinFont_Error err;
+
+    pthread_mutex_lock(&ld->lock);
+    for (;;) {
+        while (!ld->stop && ld->nqueued == 0)
+            pthread_cond_wait(&ld->work, &ld->lock);
+        if (ld->stop)
+            break;
+
+        job = ld->heap[0];
+        heap_remove(ld, job);
+        job->state = WinFont_JobRunning;
+        pthread_mutex_unlock(&ld->lock);
+
+        wf = winfont_open_mmap_flags(job->path, job->flags);
+        err = wf ? WinFont_ErrNone : winfont_last_error();
+
+        pthread_mutex_lock(&ld->lock);
+        job->font = wf;
+        job->error = err;
+        job_finish(ld, job, wf ? WinFont_JobDone : WinFont_JobFailed);
+    }
+    pthread_mutex_unlock(&ld->lock);
+
+    return NULL;
+}
+
+WinFontLoader *
+winfont_loader_new(int nthreads)
+{
+    WinFontLoader *ld;
+
+    ld = calloc(1, sizeof(WinFontLoader));
+    if (!ld) {
+        winfont_set_error(WinFont_ErrNoMem);
+        return NULL;
+    }
+
+    if (pthread_mutex_init(&ld->lock, NULL)) {
+        free(ld);
+        return NULL;
+    }
+    pthread_cond_init(&ld->work, NULL);
+    pthread_cond_init(&ld->done, NULL);
+
+    if (nthreads <= 0)
+        nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+    if (nthreads < 1)
+        nthreads = 1;
+    if (nthreads > MAX_THREADS)
+        nthreads = MAX_THREADS;
+
+    for (int i = 0; i < nthreads; i++) {
+        if (pthread_create(&ld->threads[i], NULL, loader_worker, ld))
+            break;
+        ld->nthreads++;
+    }
+    if (ld->nthreads == 0) {
+        winfont_loader_free(ld);
+        return NULL;
+    }
+
+    return ld;
+}
+
+WinFontJob *
+winfont_loader_submit(WinFontLoader *ld, const char *path, int flags,
+    int priority)
+{
+    WinFontJob *job, **grown;
+
+    if (!ld || !path) {
+        winfont_set_error(WinFont_ErrArg);
+        return NULL;
+    }
+
+    job = calloc(1, sizeof(WinFontJob));
+    if (job)
+        job->path = strdup(path);
+    if (!job || !job->path) {
+        free(job);
+        winfont_set_error(WinFont_ErrNoMem);
+        return NULL;
+    }
+    job->loader = ld;
+    job->flags = flags;
+    job->priority = priority;
+    job->state = WinFont_JobQueued;
+
+    pthread_mutex_lock(&ld->lock);
+    if (ld->nqueued == ld->cap) {
+        ld->cap = ld->cap ? 2 * ld->cap : 64;
+        grown = realloc(ld->heap, ld->cap * sizeof(WinFontJob *));
+        if (!grown) {
+            ld->cap /= 2;
+            pthread_mutex_unlock(&ld->lock);
+            free(job->path);
+            free(job);
+            winfont_set_error(WinFont_ErrNoMem);
+            return NULL;
+        }
+        ld->heap = grown;
+    }
+
+    job->seq = ld->seq++;
+    job->next = ld->jobs;
+    if (ld->jobs)
+        ld->jobs->prev = job;
+    ld->jobs = job;
+
+    heap_set(ld, ld->nqueued++, job);
+    heap_up(ld, job->slot);
+    pthread_cond_signal(&ld->work);
+    pthread_mutex_unlock(&ld->lock);
+
+    return job;
+}
+
+int
+winfont_loader_done(WinFontLoader *ld, WinFontJob **jobs, int max)
+{
+    WinFontJob *job;
+    int n = 0;
+
+    if (!ld || (max > 0 && !jobs))
+        return -1;
+
+    pthread_mutex_lock(&ld->lock);
+    while (n < max && (job = ld->done_head)) {
+        ld->done_head = job->next_done;
+        if (!ld->done_head)
+            ld->done_tail = NULL;
+        job->reported = 1;
+        jobs[n++] = job;
+    }
+    pthread_mutex_unlock(&ld->lock);
+
+    return n;
+}
+
+WinFont_JobState
+winfont_job_poll(WinFontJob *job)
+{
+    WinFont_JobState state;
+
+    if (!job->loader)
+        return job->state;
+
+    pthread_mutex_lock(&job->loader->lock);
+    state = job->state;
+    pthread_mutex_unlock(&job->loader->lock);
+
+    return state;
+}
+
+WinFont_JobState
+winfont_job_wait(WinFontJob *job)
+{
+    WinFontLoader *ld = job->loader;
+    WinFont_JobState state;
+
+    if (!ld)
+        return job->state;
+
+    pthread_mutex_lock(&ld->lock);
+    while (job->state == WinFont_JobQueued ||
+            job->state == WinFont_JobRunning)
+        pthread_cond_wait(&ld->done, &ld->lock);
+    state = job->state;
+    pthread_mutex_unlock(&ld->lock);
+
+    return state;
+}
+
+/* Called with the lock held. */
+static int
+job_cancel(WinFontLoader *ld, WinFontJob *job)
+{
+    if (job->state != WinFont_JobQueued)
+        return -1;
+
+    heap_remove(ld, job);
+    job_finish(ld, job, WinFont_JobCanceled);
+    return 0;
+}
+
+int
+winfont_job_cancel(WinFontJob *job)
+{
+    WinFontLoader *ld = job->loader;
+    int ret;
+
+    if (!ld)
+        return -1;
+
+    pthread_mutex_lock(&ld->lock);
+    ret = job_cancel(ld, job);
+    pthread_mutex_unlock(&ld->lock);
+
+    return ret;
+}
+
+int
+winfont_job_set_priority(WinFontJob *job, int priority)
+{
+    WinFontLoader *ld = job->loader;
+    int ret = -1;
+
+    if (!ld)
+        return -1;
+
+    pthread_mutex_lock(&ld->lock);
+    if (job->state == WinFont_JobQueued) {
+        job->priority = priority;
+        heap_down(ld, job->slot);
+        heap_up(ld, job->slot);
+        ret = 0;
+    }
+    pthread_mutex_unlock(&ld->lock);
+
+    return ret;
+}
+
+WinFont *
+winfont_job_take(WinFontJob *job)
+{
+    WinFont *wf;
+
+    if (winfont_job_wait(job) != WinFont_JobDone) {
+        winfont_set_error(job->state == WinFont_JobFailed ? job->error :
+            WinFont_ErrArg);
+        return NULL;
+    }
+
+    wf = job->font;
+    job->font = NULL;
+    return wf;
+}
+
+WinFont_Error
+winfont_job_error(WinFontJob *job)
+{
+    winfont_job_wait(job);
+    return job->error;
+}
+
+void
+winfont_job_free(WinFontJob *job)
+{
+    WinFontLoader *ld;
+    WinFontJob **pp;
+
+    if (!job)
+        return;
+
+    ld = job->loader;
+    if (ld) {
+        pthread_mutex_lock(&ld->lock);
+        job_cancel(ld, job);
+        while (job->state == WinFont_JobRunning)
+            pthread_cond_wait(&ld->done, &ld->lock);
+        if (!job->reported) {
+            for (pp = &ld->done_head; *pp; pp = &(*pp)->next_done) {
+                if (*pp == job) {
+                    *pp = job->next_done;
+                    break;
+                }
+            }
+            ld->done_tail = NULL;
+            for (WinFontJob *j = ld->done_head; j; j = j->next_done)
+                ld->done_tail = j;
+        }
+        if (job->prev)
+            job->prev->next = job->next;
+        else
+            ld->jobs = job->next;
+        if (job->next)
+            job->next->prev = job->prev;
+        pthread_mutex_unlock(&ld->lock);
+    }
+
+    winfont_free(job->font);
+    free(job->path);
+    free(job);
+}
+
+void
+winfont_loader_free(WinFontLoader *ld)
+{
+    if (!ld)
+        return;
+
+    pthread_mutex_lock(&ld->lock);
+    while (ld->nqueued)
+        job_cancel(ld, ld->heap[0]);
+    ld->stop = 1;
+    pthread_cond_broadcast(&ld->work);
+    pthread_mutex_unlock(&ld->lock);
+
+    /* Running jobs finish before their thread sees stop. */
+    for (int i = 0; i < ld->nthreads; i++)
+        pthread_join(ld->threads[i], NULL);
+
+    for (WinFontJob *job = ld->jobs; job; job = job->next)
+        job->loader = NULL;
+
+    pthread_cond_destroy(&ld->work);
+    pthread_cond_destroy(&ld->done);
+    pthread_mutex_destroy(&ld->lock);
+    free(ld->heap);
+    free(ld);
+}
+
+struct batch {
+    WinFont **fonts;
+    int flags;
+};
+
+static void
+batch_load(void *ctx, int i, uint8_t *buf, size_t len, WinFont_Error err)
+{
+    struct batch *bt = ctx;
+
+    (void)err;
+    bt->fonts[i] = buf ? winfont_read_buffer(buf, len, bt->flags) : NULL;
+}
+
+/* A batch has no priorities to keep, so it skips the queue and reads
+ * its files with winfont_bulk_read. */
+int
+winfont_load_batch(char *const *paths, int npaths, int flags,
+    WinFont **fonts, int nthreads)
+{
+    struct batch bt;
+    int loaded = 0;
+
+    if (npaths < 0 || (npaths && (!paths || !fonts))) {
+        winfont_set_error(WinFont_ErrArg);
+        return -1;
+    }
+
+    bt.fonts = fonts;
+    bt.flags = flags;
+    winfont_bulk_read(paths, npaths, 0, WF_IO_AUTO, nthreads, batch_load,
+        &bt);
+
+    for (int i = 0; i < npaths; i++)
+        if (fonts[i])
+            loaded++;
+
+    return loaded;
+}
@@ -0,0 +1,169 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 Eddie Hillenbrand
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+/* Font pools. Allocations are bumped out of the current slab, each
+ * behind a 16 byte prefix that points back at its slab, and a slab
+ * counts its live allocations so it can be released once they are all
+ * freed. Something too big for a slab gets a slab of its own. */
+
+#include <winfont.h>
+#include "winfont_private.h"
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#define DEFAULT_SLAB (256 * 1024)
+#define PREFIX 16
+
+#define ALIGN(n, a) (((n) + (a) - 1) & ~(size_t)((a) - 1))
+
+struct slab {
+    struct slab *next, *prev;
+    size_t size, used;
+    int live;
+};
+
+struct WinFontPool {
+    pthread_mutex_t lock;
+    size_t slabsize;
+    struct slab *cur;
+    struct slab *slabs;
+};
+
+#define SLAB_DATA(s) ((uint8_t *)(s) + ALIGN(sizeof(struct slab), 16))
+
+static void
+slab_unlink(WinFontPool *pool, struct slab *s)
+{
+    if (s->prev)
+        s->prev->next = s->next;
+    else
+        pool->slabs = s->next;
+    if (s->next)
+        s->next->prev = s->prev;
+    free(s);
+}
+
+static struct slab *
+slab_new(WinFontPool *pool, size_t size)
+{
+    struct slab *s;
+
+    s = malloc(ALIGN(sizeof(struct slab), 16) + size);
+    if (!s)
+        return NULL;
+
+    s->size = size;
+    s->used = 0;
+    s->live = 0;
+    s->prev = NULL;
+    s->next = pool->slabs;
+    if (pool->slabs)
+        pool->slabs->prev = s;
+    pool->slabs = s;
+
+    return s;
+}
+
+static void *
+pool_alloc(void *ctx, size_t size)
+{
+    WinFontPool *pool = ctx;
+    struct slab *s;
+    size_t need = PREFIX + ALIGN(size, 16);
+    uint8_t *p = NULL;
+
+    pthread_mutex_lock(&pool->lock);
+    s = pool->cur;
+    if (!s || s->size - s->used < need) {
+        s = slab_new(pool, need > pool->slabsize ? need : pool->slabsize);
+        if (!s)
+            goto out;
+        /* The old slab can never be bumped again, so if it is empty
+         * now it never will be used. */
+        if (pool->cur && pool->cur->live == 0)
+            slab_unlink(pool, pool->cur);
+        pool->cur = s;
+    }
+
+    p = SLAB_DATA(s) + s->used;
+    *(struct slab **)p = s;
+    s->used += need;
+    s->live++;
+    p += PREFIX;
+
+out:
+    pthread_mutex_unlock(&pool->lock);
+    return p;
+}
+
+static void
+pool_release(void *ctx, void *ptr)
+{
+    WinFontPool *pool = ctx;
+    struct slab *s;
+
+    if (!ptr)
+        return;
+
+    s = *(struct slab **)((uint8_t *)ptr - PREFIX);
+    pthread_mutex_lock(&pool->lock);
+    if (--s->live == 0) {
+        if (s == pool->cur)
+            s->used = 0;
+        else
+            slab_unlink(pool, s);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+WinFontPool *
+winfont_pool_new(size_t slabsize)
+{
+    WinFontPool *pool;
+
+    pool = calloc(1, sizeof(WinFontPool));
+    if (!pool) {
+        winfont_set_error(WinFont_ErrNoMem);
+        return NULL;
+    }
+
+    if (pthread_mutex_init(&pool->lock, NULL)) {
+        free(pool);
+        winfont_set_error(WinFont_ErrNoMem);
+        return NULL;
+    }
+    pool->slabsize = slabsize ? ALIGN(slabsize, 16) : DEFAULT_SLAB;
+
+    return pool;
+}
+
+WinFont_Allocator
+winfont_pool_allocator(WinFontPool *pool)
+{
+    WinFont_Allocator a = { pool_alloc, pool_release, pool };
+
+    return a;
+}
+
+void
+winfont_pool_free(WinFontPool *pool)
+{
+    struct slab *s, *next;
+
+    if (!pool)
+        return;
+
+    for (s = pool->slabs; s; s = next) {
+        next = s->next;
+        free(s);
+    }
+    pthread_mutex_destroy(&pool->lock);
+    free(pool);
+}
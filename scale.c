@@ -0,0 +1,144 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 Eddie Hillenbrand
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+/* Integer scaling, nearest neighbour. Rows are widened with
+ * winfont_scale_rows and then copied factor times. A scaled font is an
+ * ordinary WinFont, so it can also serve as a cache: the _scaled draw
+ * functions blit from one when winfont_cache_scale has made it. */
+
+#include <winfont.h>
+#include "winfont_private.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+void
+winfont_scale_glyph(uint8_t *dst, const uint8_t *rows, int w, int h,
+    int s)
+{
+    int srowbytes = (w * s + 7) / 8;
+
+    winfont_scale_rows(dst, s * srowbytes, rows, w, h, s);
+    for (int r = 0; r < h; r++, dst += s * srowbytes)
+        for (int k = 1; k < s; k++)
+            memcpy(dst + k * srowbytes, dst, srowbytes);
+}
+
+WinFont *
+winfont_scale(WinFont *wf, int factor)
+{
+    WinFont *sf;
+    uint8_t *buf = NULL;
+    size_t bufsz = 0, need, total = 0;
+    const uint8_t *rows;
+    WinFont_Error err = WinFont_ErrNoMem;
+
+    if (!wf || factor < 1 || factor > WINFONT_MAX_SCALE) {
+        winfont_set_error(WinFont_ErrArg);
+        return NULL;
+    }
+
+    /* Size the scaled bitmap first, so the font is one block. */
+    for (int g = 0; g < wf->nglyphs; g++) {
+        total += (size_t)(wf->widths[g] * factor + 7) / 8 *
+            wf->height * factor;
+        need = winfont_glyph_required_size(wf, g);
+        if (need > bufsz)
+            bufsz = need;
+    }
+    if (total > UINT32_MAX) {
+        winfont_set_error(WinFont_ErrNoMem);
+        return NULL;
+    }
+
+    sf = winfont_new_like(wf, total);
+    buf = malloc(bufsz ? bufsz : 1);
+    if (!sf || !buf)
+        goto fail;
+
+    sf->width = wf->width * factor;
+    sf->height = wf->height * factor;
+    sf->wbytes = (sf->width + 7) / 8;
+    total = 0;
+    for (int g = 0; g < wf->nglyphs; g++) {
+        sf->widths[g] = wf->widths[g] * factor;
+        sf->offsets[g] = total;
+        total += (sf->widths[g] + 7) / 8 * sf->height;
+    }
+
+    for (int g = 0; g < wf->nglyphs; g++) {
+        rows = winfont_glyph_get(wf, g, WinFont_LayoutRowMSB, buf, bufsz);
+        if (!rows) {
+            err = winfont_last_error();
+            goto fail;
+        }
+        winfont_scale_glyph(sf->bitmap + sf->offsets[g], rows,
+            wf->widths[g], wf->height, factor);
+    }
+
+    winfont_set_scale(sf, factor);
+    free(buf);
+    return sf;
+
+fail:
+    free(buf);
+    winfont_free(sf);
+    winfont_set_error(err);
+    return NULL;
+}
+
+/* Both the table and its slots are published with a compare and swap,
+ * so racing callers build at most one extra copy and throw it away. */
+int
+winfont_cache_scale(WinFont *wf, int factor)
+{
+    WinFont **table, *sf, *none = NULL;
+
+    if (!wf || factor < 1 || factor > WINFONT_MAX_SCALE) {
+        winfont_set_error(WinFont_ErrArg);
+        return -1;
+    }
+
+    table = __atomic_load_n(&wf->_scaled, __ATOMIC_ACQUIRE);
+    if (!table) {
+        WinFont **fresh = calloc(WINFONT_MAX_SCALE + 1, sizeof(WinFont *));
+        if (!fresh) {
+            winfont_set_error(WinFont_ErrNoMem);
+            return -1;
+        }
+        if (__atomic_compare_exchange_n(&wf->_scaled, &table, fresh, 0,
+                __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+            table = fresh;
+        else
+            free(fresh);
+    }
+
+    if (__atomic_load_n(&table[factor], __ATOMIC_ACQUIRE))
+        return 0;
+
+    sf = winfont_scale(wf, factor);
+    if (!sf)
+        return -1;
+    if (!__atomic_compare_exchange_n(&table[factor], &none, sf, 0,
+            __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+        winfont_free(sf);
+
+    return 0;
+}
+
+WinFont *
+winfont_cached_scale(WinFont *wf, int factor)
+{
+    WinFont **table = __atomic_load_n(&wf->_scaled, __ATOMIC_ACQUIRE);
+
+    if (!table || factor < 1 || factor > WINFONT_MAX_SCALE)
+        return NULL;
+
+    return __atomic_load_n(&table[factor], __ATOMIC_ACQUIRE);
+}
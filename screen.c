@@ -0,0 +1,276 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 Eddie Hillenbrand
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+/* Text mode screens. Changed cells are queued as they are written, so
+ * an update only touches what changed since the last one. */
+
+#include <winfont.h>
+#include "winfont_private.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static void
+fill_rect(WinFont_Framebuffer *fb, int x, int y, int w, int h,
+    uint32_t v)
+{
+    uint8_t *row = fb->pixels + (size_t)y * fb->stride +
+        (size_t)x * fb->format;
+
+    for (int r = 0; r < h; r++, row += fb->stride)
+        for (int c = 0; c < w; c++)
+            memcpy(row + c * fb->format, &v, fb->format);
+}
+
+static void
+mark_dirty(WinFontScreen *s, int i)
+{
+    int row = i / s->cols, col = i % s->cols;
+
+    if (s->_dirty[i])
+        return;
+    s->_dirty[i] = 1;
+    s->_queue[s->_nqueued++] = i;
+
+    if (s->_rowmin[row] > s->_rowmax[row]) {
+        s->_rows[s->_nrows++] = row;
+        s->_rowmin[row] = s->_rowmax[row] = col;
+    } else if (col < s->_rowmin[row]) {
+        s->_rowmin[row] = col;
+    } else if (col > s->_rowmax[row]) {
+        s->_rowmax[row] = col;
+    }
+}
+
+static void
+mark_all_dirty(WinFontScreen *s)
+{
+    for (int i = 0; i < s->cols * s->rows; i++)
+        mark_dirty(s, i);
+}
+
+WinFontScreen *
+winfont_screen_new(WinFont *wf, int cols, int rows,
+    WinFont_PixelFormat format, uint8_t *pixels, int stride)
+{
+    WinFontScreen *s;
+    size_t ncells;
+    int space;
+
+    if (!wf || cols <= 0 || rows <= 0 || (format != WinFont_Pixel8 &&
+            format != WinFont_Pixel16 && format != WinFont_Pixel32)) {
+        winfont_set_error(WinFont_ErrArg);
+        return NULL;
+    }
+
+    s = calloc(1, sizeof(WinFontScreen));
+    if (!s) {
+        winfont_set_error(WinFont_ErrNoMem);
+        return NULL;
+    }
+
+    ncells = (size_t)cols * rows;
+    s->font = wf;
+    s->cols = cols;
+    s->rows = rows;
+    s->cellw = wf->width;
+    s->cellh = wf->height;
+    s->fb.width = cols * s->cellw;
+    s->fb.height = rows * s->cellh;
+    s->fb.format = format;
+    s->fb.stride = stride ? stride : s->fb.width * format;
+    s->fb.pixels = pixels;
+    if (!pixels) {
+        s->fb.pixels = malloc((size_t)s->fb.stride * s->fb.height);
+        s->_owns_pixels = 1;
+    }
+
+    s->cells = malloc(ncells * sizeof(WinFont_Cell));
+    s->_dirty = calloc(ncells, 1);
+    s->_queue = malloc(ncells * sizeof(int));
+    s->_rows = malloc(rows * sizeof(int));
+    s->_rowmin = malloc(rows * sizeof(int));
+    s->_rowmax = malloc(rows * sizeof(int));
+    if (!s->fb.pixels || !s->cells || !s->_dirty || !s->_queue ||
+        !s->_rows || !s->_rowmin || !s->_rowmax) {
+        winfont_screen_free(s);
+        winfont_set_error(WinFont_ErrNoMem);
+        return NULL;
+    }
+
+    for (int i = 0; i < 256; i++)
+        s->palette[i] = i;
+
+    for (int r = 0; r < rows; r++) {
+        s->_rowmin[r] = cols;
+        s->_rowmax[r] = -1;
+    }
+
+    space = winfont_glyph_index(wf, ' ');
+    for (size_t i = 0; i < ncells; i++) {
+        s->cells[i].glyph = space;
+        s->cells[i].fg = 7;
+        s->cells[i].bg = 0;
+        s->cells[i].attr = 0;
+    }
+
+    mark_all_dirty(s);
+    return s;
+}
+
+void
+winfont_screen_free(WinFontScreen *s)
+{
+    if (!s)
+        return;
+
+    if (s->_owns_pixels)
+        free(s->fb.pixels);
+    free(s->cells);
+    free(s->_dirty);
+    free(s->_queue);
+    free(s->_rows);
+    free(s->_rowmin);
+    free(s->_rowmax);
+    free(s);
+}
+
+void
+winfont_screen_put(WinFontScreen *s, int col, int row, int glyph,
+    uint8_t fg, uint8_t bg, uint8_t attr)
+{
+    WinFont_Cell *c;
+    int i;
+
+    if (col < 0 || row < 0 || col >= s->cols || row >= s->rows)
+        return;
+    if (glyph < 0 || glyph >= s->font->nglyphs)
+        return;
+
+    i = row * s->cols + col;
+    c = &s->cells[i];
+    if (c->glyph == glyph && c->fg == fg && c->bg == bg && c->attr == attr)
+        return;
+
+    c->glyph = glyph;
+    c->fg = fg;
+    c->bg = bg;
+    c->attr = attr;
+    mark_dirty(s, i);
+}
+
+void
+winfont_screen_write(WinFontScreen *s, int col, int row,
+    const char *text, size_t len, uint8_t fg, uint8_t bg, uint8_t attr)
+{
+    for (size_t i = 0; i < len; i++)
+        winfont_screen_put(s, col + i, row,
+            winfont_glyph_index(s->font, (uint8_t)text[i]), fg, bg, attr);
+}
+
+void
+winfont_screen_set_palette(WinFontScreen *s, int idx, uint32_t value)
+{
+    if (idx < 0 || idx > 255 || s->palette[idx] == value)
+        return;
+
+    s->palette[idx] = value;
+    mark_all_dirty(s);
+}
+
+/* Toggling the blink phase scans for blinking cells, which is cheap
+ * next to redrawing them and only happens a few times a second. */
+void
+winfont_screen_blink(WinFontScreen *s, int on)
+{
+    on = !!on;
+    if (s->blink_off == !on)
+        return;
+
+    s->blink_off = !on;
+    for (int i = 0; i < s->cols * s->rows; i++)
+        if (s->cells[i].attr & WinFont_CellBlink)
+            mark_dirty(s, i);
+}
+
+static void
+draw_cell(WinFontScreen *s, int i)
+{
+    WinFont_Cell *c = &s->cells[i];
+    uint32_t fg, bg;
+    int x, y, gw;
+
+    x = (i % s->cols) * s->cellw;
+    y = (i / s->cols) * s->cellh;
+    fg = s->palette[c->fg];
+    bg = s->palette[c->bg];
+    if (s->blink_off && (c->attr & WinFont_CellBlink))
+        fg = bg;
+
+    winfont_draw_glyph(s->font, &s->fb, x, y, c->glyph, fg, bg,
+        WinFont_DrawOpaque);
+
+    /* Proportional glyphs don't fill the cell. */
+    gw = s->font->widths[c->glyph];
+    if (gw < s->cellw)
+        fill_rect(&s->fb, x + gw, y, s->cellw - gw, s->cellh, bg);
+}
+
+int
+winfont_screen_update(WinFontScreen *s, WinFont_Rect *rects, int maxrects)
+{
+    int nrects = 0, row, x0, x1, j;
+    WinFont_Rect rc, *last;
+
+    for (int q = 0; q < s->_nqueued; q++) {
+        draw_cell(s, s->_queue[q]);
+        s->_dirty[s->_queue[q]] = 0;
+    }
+    s->_nqueued = 0;
+
+    /* One span per dirty row, in order, with rows that span the same
+     * columns as the row above merged into one rect. */
+    for (int i = 1; i < s->_nrows; i++) {
+        row = s->_rows[i];
+        for (j = i; j > 0 && s->_rows[j - 1] > row; j--)
+            s->_rows[j] = s->_rows[j - 1];
+        s->_rows[j] = row;
+    }
+
+    for (int i = 0; i < s->_nrows; i++) {
+        row = s->_rows[i];
+        x0 = s->_rowmin[row] * s->cellw;
+        x1 = (s->_rowmax[row] + 1) * s->cellw;
+        s->_rowmin[row] = s->cols;
+        s->_rowmax[row] = -1;
+
+        rc.x = x0;
+        rc.y = row * s->cellh;
+        rc.w = x1 - x0;
+        rc.h = s->cellh;
+
+        last = nrects ? &rects[nrects - 1] : NULL;
+        if (last && last->x == rc.x && last->w == rc.w &&
+            last->y + last->h == rc.y) {
+            last->h += rc.h;
+        } else if (nrects < maxrects) {
+            rects[nrects++] = rc;
+        } else if (last) {
+            /* Out of rects, grow the last one to cover the rest. */
+            x0 = last->x < rc.x ? last->x : rc.x;
+            x1 = last->x + last->w > rc.x + rc.w ?
+                last->x + last->w : rc.x + rc.w;
+            last->x = x0;
+            last->w = x1 - x0;
+            last->h = rc.y + rc.h - last->y;
+        }
+    }
+    s->_nrows = 0;
+
+    return nrects;
+}
@@ -0,0 +1,318 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 Eddie Hillenbrand
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+/* A content addressed glyph store. Fonts of one family, and the sizes
+ * and weights of a collection, draw many of the same glyphs: box
+ * drawing, blanks, the same digits at the same size. The store hashes
+ * each glyph's width, height and decoded rows and keeps one copy of
+ * each distinct glyph. A shared font holds a table of pointers into
+ * the store in place of a bitmap, and every pointer is a reference:
+ * freeing the font drops them, and a glyph is freed with its last
+ * reference. The store itself lives until it has been freed and the
+ * last of its fonts with it. */
+
+#include <winfont.h>
+#include "winfont_private.h"
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MIN_BUCKETS 256
+
+typedef struct StoreGlyph {
+    struct StoreGlyph *next;    /* in its bucket */
+    uint64_t hash;
+    size_t refs;
+    uint16_t w, h;
+    uint32_t size;
+    uint8_t rows[];
+} StoreGlyph;
+
+struct WinFontGlyphStore {
+    pthread_mutex_t lock;
+    StoreGlyph **buckets;
+    size_t nbuckets;            /* a power of two */
+    size_t unique;
+    size_t glyphs;              /* references, one per font glyph */
+    size_t bytes;               /* rows of every reference */
+    size_t stored;              /* rows of every distinct glyph */
+    int refs;                   /* the owner and each font */
+};
+
+#define GLYPH_OF(rows) \
+    ((StoreGlyph *)((uint8_t *)(rows) - offsetof(StoreGlyph, rows)))
+
+/* FNV-1a over the size and the rows. */
+static uint64_t
+store_hash(int w, int h, const uint8_t *rows, size_t size)
+{
+    uint64_t hv = 0xcbf29ce484222325ULL;
+    uint8_t dim[4] = { w, w >> 8, h, h >> 8 };
+
+    for (int i = 0; i < 4; i++)
+        hv = (hv ^ dim[i]) * 0x100000001b3ULL;
+    for (size_t i = 0; i < size; i++)
+        hv = (hv ^ rows[i]) * 0x100000001b3ULL;
+
+    return hv;
+}
+
+static int
+store_grow(WinFontGlyphStore *st)
+{
+    size_t n = st->nbuckets * 2;
+    StoreGlyph **b, *sg, *next;
+
+    b = calloc(n, sizeof(StoreGlyph *));
+    if (!b)
+        return -1;
+
+    for (size_t i = 0; i < st->nbuckets; i++) {
+        for (sg = st->buckets[i]; sg; sg = next) {
+            next = sg->next;
+            sg->next = b[sg->hash & (n - 1)];
+            b[sg->hash & (n - 1)] = sg;
+        }
+    }
+
+    free(st->buckets);
+    st->buckets = b;
+    st->nbuckets = n;
+    return 0;
+}
+
+/* A reference to the stored copy of rows, which is added if there is
+ * none. Called with the lock held. */
+static const uint8_t *
+store_intern(WinFontGlyphStore *st, int w, int h, const uint8_t *rows)
+{
+    size_t size = (size_t)(w + 7) / 8 * h;
+    uint64_t hv = store_hash(w, h, rows, size);
+    StoreGlyph *sg, **bucket;
+
+    bucket = &st->buckets[hv & (st->nbuckets - 1)];
+    for (sg = *bucket; sg; sg = sg->next) {
+        if (sg->hash == hv && sg->w == w && sg->h == h &&
+                memcmp(sg->rows, rows, size) == 0)
+            break;
+    }
+
+    if (!sg) {
+        /* Grown at one glyph per bucket on average. */
+        if (st->unique >= st->nbuckets && store_grow(st) == 0)
+            bucket = &st->buckets[hv & (st->nbuckets - 1)];
+
+        sg = malloc(sizeof(StoreGlyph) + (size ? size : 1));
+        if (!sg)
+            return NULL;
+        sg->hash = hv;
+        sg->refs = 0;
+        sg->w = w;
+        sg->h = h;
+        sg->size = size;
+        memcpy(sg->rows, rows, size);
+        sg->next = *bucket;
+        *bucket = sg;
+        st->unique++;
+        st->stored += size;
+    }
+
+    sg->refs++;
+    st->glyphs++;
+    st->bytes += size;
+    return sg->rows;
+}
+
+/* Drop one reference. Called with the lock held. */
+static void
+store_unref(WinFontGlyphStore *st, const uint8_t *rows)
+{
+    StoreGlyph *sg = GLYPH_OF(rows), **pp;
+
+    st->glyphs--;
+    st->bytes -= sg->size;
+    if (--sg->refs)
+        return;
+
+    for (pp = &st->buckets[sg->hash & (st->nbuckets - 1)]; *pp;
+            pp = &(*pp)->next) {
+        if (*pp == sg) {
+            *pp = sg->next;
+            break;
+        }
+    }
+    st->unique--;
+    st->stored -= sg->size;
+    free(sg);
+}
+
+static void
+store_destroy(WinFontGlyphStore *st)
+{
+    StoreGlyph *sg, *next;
+
+    for (size_t i = 0; i < st->nbuckets; i++) {
+        for (sg = st->buckets[i]; sg; sg = next) {
+            next = sg->next;
+            free(sg);
+        }
+    }
+    free(st->buckets);
+    pthread_mutex_destroy(&st->lock);
+    free(st);
+}
+
+/* Drop a reference to the store itself, and destroy it with the last.
+ * Called with the lock held, which is released. */
+static void
+store_put(WinFontGlyphStore *st)
+{
+    int last = --st->refs == 0;
+
+    pthread_mutex_unlock(&st->lock);
+    if (last)
+        store_destroy(st);
+}
+
+WinFontGlyphStore *
+winfont_store_new(void)
+{
+    WinFontGlyphStore *st;
+
+    st = calloc(1, sizeof(WinFontGlyphStore));
+    if (!st) {
+        winfont_set_error(WinFont_ErrNoMem);
+        return NULL;
+    }
+
+    st->nbuckets = MIN_BUCKETS;
+    st->buckets = calloc(st->nbuckets, sizeof(StoreGlyph *));
+    if (!st->buckets || pthread_mutex_init(&st->lock, NULL)) {
+        free(st->buckets);
+        free(st);
+        winfont_set_error(WinFont_ErrNoMem);
+        return NULL;
+    }
+    st->refs = 1;
+
+    return st;
+}
+
+WinFont *
+winfont_store_share(WinFontGlyphStore *st, WinFont *wf)
+{
+    const uint8_t **table, *rows;
+    uint8_t *buf = NULL;
+    size_t bufsz = 0, need;
+    WinFont *sf;
+    int g;
+
+    if (!st || !wf) {
+        winfont_set_error(WinFont_ErrArg);
+        return NULL;
+    }
+
+    for (g = 0; g < wf->nglyphs; g++) {
+        need = winfont_glyph_required_size(wf, g);
+        if (need > bufsz)
+            bufsz = need;
+    }
+
+    /* The pointer table takes the place of the bitmap in the block. */
+    sf = winfont_new_like(wf, wf->nglyphs * sizeof(const uint8_t *));
+    buf = malloc(bufsz ? bufsz : 1);
+    if (!sf || !buf) {
+        winfont_free(sf);
+        free(buf);
+        winfont_set_error(WinFont_ErrNoMem);
+        return NULL;
+    }
+
+    table = (const uint8_t **)sf->bitmap;
+    sf->bitmap = NULL;
+    sf->_bmbytes = 0;
+    sf->width = wf->width;
+    sf->height = wf->height;
+    sf->wbytes = wf->wbytes;
+    memcpy(sf->widths, wf->widths, wf->nglyphs * sizeof(uint16_t));
+
+    pthread_mutex_lock(&st->lock);
+    for (g = 0; g < wf->nglyphs; g++) {
+        rows = winfont_glyph_get(wf, g, WinFont_LayoutRowMSB, buf, bufsz);
+        if (!rows)
+            break;
+        table[g] = store_intern(st, wf->widths[g], wf->height, rows);
+        if (!table[g])
+            break;
+    }
+    if (g < wf->nglyphs) {
+        while (g-- > 0)
+            store_unref(st, table[g]);
+        pthread_mutex_unlock(&st->lock);
+        free(buf);
+        winfont_free(sf);
+        winfont_set_error(WinFont_ErrNoMem);
+        return NULL;
+    }
+    st->refs++;
+    pthread_mutex_unlock(&st->lock);
+
+    free(buf);
+    sf->_shared = table;
+    sf->_store = st;
+    return sf;
+}
+
+void
+winfont_store_release(WinFont *wf)
+{
+    WinFontGlyphStore *st = wf->_store;
+
+    pthread_mutex_lock(&st->lock);
+    for (int g = 0; g < wf->nglyphs; g++)
+        store_unref(st, wf->_shared[g]);
+    store_put(st);
+
+    wf->_shared = NULL;
+    wf->_store = NULL;
+}
+
+int
+winfont_store_stats(WinFontGlyphStore *st, WinFont_StoreStats *stats)
+{
+    if (!st || !stats) {
+        winfont_set_error(WinFont_ErrArg);
+        return -1;
+    }
+
+    pthread_mutex_lock(&st->lock);
+    stats->glyphs = st->glyphs;
+    stats->unique = st->unique;
+    stats->bytes = st->bytes;
+    stats->stored = st->stored;
+    pthread_mutex_unlock(&st->lock);
+
+    stats->saved = stats->bytes - stats->stored;
+    stats->ratio = stats->unique ?
+        (double)stats->glyphs / stats->unique : 1.0;
+
+    return 0;
+}
+
+void
+winfont_store_free(WinFontGlyphStore *st)
+{
+    if (!st)
+        return;
+
+    pthread_mutex_lock(&st->lock);
+    store_put(st);
+}
@@ -0,0 +1,343 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 Eddie Hillenbrand
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+/* Forward-only reading, for input that can't seek such as pipes,
+ * sockets and decompressors. The stream keeps a window of the input
+ * that only ever moves forward: asking for bytes at an offset drops
+ * everything before it, and reads, or reads and throws away, up to
+ * it. The MZ and NE headers and the resource table are walked first,
+ * then the RT_FONT resources are visited in file order, the window
+ * grown over each one until winfont_mem_fnt_extent is satisfied and
+ * the face decoded out of it. The window never grows past the budget,
+ * so the largest face sets how much memory a stream needs. */
+
+#include <winfont.h>
+#include "winfont_private.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DEFAULT_BUDGET  (1 << 20)
+#define MIN_WINDOW      4096
+
+#define MZ_SIZE         64      /* the MZ header, through e_lfanew */
+#define NE_SIZE         40      /* the NE header, through ne_restab */
+
+#define FON_MZ_MAGIC    0x5A4D
+#define FON_NE_MAGIC    0x454E
+#define RT_FONT         0x8008
+
+struct WinFontStream {
+    WinFont_StreamFunc read;
+    void *ctx;
+    size_t budget;
+    uint8_t *buf;
+    size_t cap;
+    size_t len;                 /* bytes in buf */
+    uint64_t bufoff;            /* input offset of buf[0] */
+    int eof;
+    int failed;
+    uint64_t *fnt;              /* RT_FONT offsets, ascending */
+    int nfnt;
+    int next;                   /* -1 until the table is read */
+};
+
+static unsigned
+get16(const uint8_t *p)
+{
+    return p[0] | p[1] << 8;
+}
+
+static uint32_t
+get32(const uint8_t *p)
+{
+    return get16(p) | (uint32_t)get16(p + 2) << 16;
+}
+
+/* Make the window start at off and hold n bytes, or as many as are
+ * left of the input. */
+static int
+stream_fill(WinFontStream *st, uint64_t off, size_t n)
+{
+    uint8_t *grown;
+    size_t cap, skip;
+    ssize_t k;
+
+    if (off < st->bufoff) {
+        WF_FAIL(WinFont_ErrFormat,
+            "offset %llu is behind the stream, at %llu",
+            (unsigned long long)off, (unsigned long long)st->bufoff);
+        return -1;
+    }
+    if (n > st->budget) {
+        WF_FAIL(WinFont_ErrNoMem,
+            "%zu bytes at %llu are over the stream's budget", n,
+            (unsigned long long)off);
+        return -1;
+    }
+
+    if (off - st->bufoff < st->len) {
+        skip = off - st->bufoff;
+        memmove(st->buf, st->buf + skip, st->len - skip);
+        st->len -= skip;
+    } else {
+        /* Past the window, so read up to off into it and drop that. */
+        st->bufoff += st->len;
+        st->len = 0;
+        while (st->bufoff < off && !st->eof) {
+            skip = off - st->bufoff < st->cap ? off - st->bufoff : st->cap;
+            k = st->read(st->ctx, st->buf, skip);
+            if (k < 0) {
+                WF_FAIL(WinFont_ErrIO, "stream read failed");
+                return -1;
+            }
+            if (k == 0)
+                st->eof = 1;
+            st->bufoff += k;
+        }
+    }
+    st->bufoff = off;
+
+    if (n > st->cap) {
+        cap = st->cap;
+        while (cap < n)
+            cap *= 2;
+        if (cap > st->budget)
+            cap = st->budget;
+        grown = realloc(st->buf, cap);
+        if (!grown) {
+            WF_FAIL(WinFont_ErrNoMem, "out of memory for the stream");
+            return -1;
+        }
+        st->buf = grown;
+        st->cap = cap;
+    }
+
+    /* No more than asked for, so a face is returned as soon as its
+     * last byte arrives. */
+    while (st->len < n && !st->eof) {
+        k = st->read(st->ctx, st->buf + st->len, n - st->len);
+        if (k < 0) {
+            WF_FAIL(WinFont_ErrIO, "stream read failed");
+            return -1;
+        }
+        if (k == 0)
+            st->eof = 1;
+        st->len += k;
+    }
+
+    return 0;
+}
+
+/* stream_fill that fails if the input ends first. */
+static int
+stream_need(WinFontStream *st, uint64_t off, size_t n, const char *what)
+{
+    if (stream_fill(st, off, n) == -1)
+        return -1;
+    if (st->len < n) {
+        WF_FAIL(WinFont_ErrFormat, "%s runs past the end", what);
+        return -1;
+    }
+    return 0;
+}
+
+static int
+cmp_offset(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+/* Walk the headers and resource table for the RT_FONT offsets. */
+static int
+stream_read_table(WinFontStream *st)
+{
+    uint64_t off, *grown;
+    unsigned shift, type, count;
+    int cap = 0;
+
+    if (stream_need(st, 0, MZ_SIZE, "MZ header") == -1)
+        return -1;
+    if (get16(st->buf) != FON_MZ_MAGIC) {
+        WF_FAIL(WinFont_ErrFormat, "bad MZ magic 0x%X", get16(st->buf));
+        return -1;
+    }
+
+    off = get32(st->buf + 0x3C);
+    if (stream_need(st, off, NE_SIZE, "NE header") == -1)
+        return -1;
+    if (get16(st->buf) != FON_NE_MAGIC) {
+        WF_FAIL(WinFont_ErrFormat, "bad NE magic 0x%X", get16(st->buf));
+        return -1;
+    }
+
+    off += get16(st->buf + 36);
+    if (stream_need(st, off, 2, "resource table") == -1)
+        return -1;
+    shift = get16(st->buf);
+    off += 2;
+
+    for (;;) {
+        if (stream_need(st, off, 2, "resource table") == -1)
+            return -1;
+        type = get16(st->buf);
+        if (type == 0)
+            break;
+        if (stream_need(st, off, 8, "resource table") == -1)
+            return -1;
+        count = get16(st->buf + 2);
+        off += 8;
+        if (type != RT_FONT) {
+            off += 12 * count;
+            continue;
+        }
+
+        if (stream_need(st, off, 12 * count, "resource table") == -1)
+            return -1;
+        if (st->nfnt + (int)count > cap) {
+            cap = st->nfnt + count;
+            grown = realloc(st->fnt, cap * sizeof(uint64_t));
+            if (!grown) {
+                WF_FAIL(WinFont_ErrNoMem, "out of memory for the table");
+                return -1;
+            }
+            st->fnt = grown;
+        }
+        for (unsigned i = 0; i < count; i++)
+            st->fnt[st->nfnt++] = (uint64_t)get16(st->buf + 12 * i) <<
+                shift;
+        off += 12 * count;
+    }
+
+    if (st->nfnt == 0) {
+        WF_FAIL(WinFont_ErrNoFont, "no FNT resources");
+        return -1;
+    }
+
+    qsort(st->fnt, st->nfnt, sizeof(uint64_t), cmp_offset);
+    return 0;
+}
+
+WinFontStream *
+winfont_stream_new(WinFont_StreamFunc fn, void *ctx, size_t budget)
+{
+    WinFontStream *st;
+
+    if (!fn) {
+        winfont_set_error(WinFont_ErrArg);
+        return NULL;
+    }
+
+    st = calloc(1, sizeof(WinFontStream));
+    if (!st) {
+        winfont_set_error(WinFont_ErrNoMem);
+        return NULL;
+    }
+
+    st->read = fn;
+    st->ctx = ctx;
+    st->budget = budget ? budget : DEFAULT_BUDGET;
+    if (st->budget < MIN_WINDOW)
+        st->budget = MIN_WINDOW;
+    st->cap = MIN_WINDOW;
+    st->buf = malloc(st->cap);
+    st->next = -1;
+    if (!st->buf) {
+        free(st);
+        winfont_set_error(WinFont_ErrNoMem);
+        return NULL;
+    }
+
+    return st;
+}
+
+static ssize_t
+stream_fread(void *ctx, void *buf, size_t n)
+{
+    FILE *f = ctx;
+    size_t k;
+
+    k = fread(buf, 1, n, f);
+    if (k == 0 && ferror(f))
+        return -1;
+
+    return k;
+}
+
+WinFontStream *
+winfont_stream_file(FILE *f, size_t budget)
+{
+    if (!f) {
+        winfont_set_error(WinFont_ErrArg);
+        return NULL;
+    }
+
+    return winfont_stream_new(stream_fread, f, budget);
+}
+
+WinFont *
+winfont_stream_next(WinFontStream *st)
+{
+    uint64_t off;
+    size_t end;
+    WinFont *wf;
+
+    if (!st) {
+        winfont_set_error(WinFont_ErrArg);
+        return NULL;
+    }
+    if (st->failed)
+        return NULL;
+
+    if (st->next == -1) {
+        if (stream_read_table(st) == -1) {
+            st->failed = 1;
+            return NULL;
+        }
+        st->next = 0;
+    }
+
+    if (st->next == st->nfnt) {
+        winfont_set_error(WinFont_ErrNone);
+        return NULL;
+    }
+    off = st->fnt[st->next++];
+
+    /* Each look at what is in the window may show more is needed:
+     * the header gives the char table, which gives the bits. */
+    end = 0;
+    for (;;) {
+        if (stream_fill(st, off, end) == -1) {
+            st->failed = 1;
+            return NULL;
+        }
+        end = winfont_mem_fnt_extent(st->buf, st->len, 0, 0);
+        if (end <= st->len || st->eof)
+            break;
+    }
+
+    wf = winfont_mem_load_fnt(st->buf, st->len, 0, WF_LOAD_COPY, NULL);
+    if (!wf)
+        st->failed = 1;
+
+    return wf;
+}
+
+void
+winfont_stream_free(WinFontStream *st)
+{
+    if (!st)
+        return;
+
+    free(st->fnt);
+    free(st->buf);
+    free(st);
+}
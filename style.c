@@ -0,0 +1,271 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 Eddie Hillenbrand
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+/* Synthesized styles. A styled font is made once, like a scaled one,
+ * and then drawn like any other, so bold or italic text costs nothing
+ * more to draw than regular text.
+ *
+ * Bold ORs each row with itself shifted a pixel right. The glyphs are
+ * packed one after another, so consecutive glyphs whose rows keep
+ * their byte width, or grow from one byte to two, are emboldened by
+ * one call of a bulk kernel. Italic shifts row r right by
+ * (height - 1 - r) / 4 pixels, leaning about 14 degrees about the
+ * bottom row. Underline fills the row below the baseline and strikeout
+ * one a third of the way up from it. */
+
+#include <winfont.h>
+#include "winfont_private.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ROWBYTES(w) (((w) + 7) / 8)
+
+#define STYLE_ALL \
+    (WINFONT_BOLD | WINFONT_ITALIC | WINFONT_UNDERLINE | WINFONT_STRIKEOUT)
+
+enum { BOLD_BITS, BOLD_BYTES, BOLD_ROWS };
+
+/* How glyphs of width w are emboldened: a last pixel to spare, eight
+ * pixel rows, or wider rows that grow a byte. */
+static int
+bold_kind(int w)
+{
+    if (w % 8)
+        return BOLD_BITS;
+    return w == 8 ? BOLD_BYTES : BOLD_ROWS;
+}
+
+/* A row of sbytes into sbytes + 1, from the right so that each byte
+ * still sees the unshifted one before it. */
+static void
+bold_row(uint8_t *dst, const uint8_t *src, int sbytes)
+{
+    memcpy(dst, src, sbytes);
+    dst[sbytes] = 0;
+    for (int j = sbytes; j >= 0; j--)
+        dst[j] |= dst[j] >> 1 | (j ? (uint8_t)(dst[j - 1] << 7) : 0);
+}
+
+/* Embolden the packed glyphs in src into dst, a run of glyphs of the
+ * same kind at a time. */
+static void
+bold_glyphs(WinFont *wf, uint8_t *dst, const uint8_t *src)
+{
+    size_t n;
+    int g, e, k, sbytes;
+
+    for (g = 0; g < wf->nglyphs; g = e) {
+        k = bold_kind(wf->widths[g]);
+        n = 0;
+        for (e = g; e < wf->nglyphs && bold_kind(wf->widths[e]) == k; e++)
+            n += (size_t)ROWBYTES(wf->widths[e]) * wf->height;
+
+        if (k == BOLD_BITS) {
+            winfont_bold_bits(dst, src, n);
+            dst += n;
+        } else if (k == BOLD_BYTES) {
+            winfont_bold_bytes(dst, src, n);
+            dst += 2 * n;
+        } else {
+            for (; g < e; g++) {
+                sbytes = ROWBYTES(wf->widths[g]);
+                for (int r = 0; r < wf->height; r++) {
+                    bold_row(dst, src, sbytes);
+                    dst += sbytes + 1;
+                    src += sbytes;
+                }
+            }
+            continue;
+        }
+        src += n;
+    }
+}
+
+/* Row src of sbytes shifted right s pixels into the zeroed row dst of
+ * dbytes, which has room for every set pixel. */
+static void
+shift_row(uint8_t *dst, int dbytes, const uint8_t *src, int sbytes, int s)
+{
+    int q = s / 8, r = s % 8;
+
+    for (int i = 0; i < sbytes && i + q < dbytes; i++) {
+        dst[i + q] |= src[i] >> r;
+        if (r && i + q + 1 < dbytes)
+            dst[i + q + 1] |= (uint8_t)(src[i] << (8 - r));
+    }
+}
+
+/* Pixels 0..w of a row. */
+static void
+fill_row(uint8_t *row, int w)
+{
+    memset(row, 0xFF, w / 8);
+    if (w % 8)
+        row[w / 8] = (uint8_t)(0xFF00 >> (w % 8));
+}
+
+/* The glyph rows of wf one after another in a new buffer, with the
+ * pad bits after each row's last pixel cleared: fonts keep whatever
+ * the file had there, and a shift would move it into the glyph. */
+static uint8_t *
+packed_rows(WinFont *wf, size_t total)
+{
+    const uint8_t *rows;
+    uint8_t *buf, *p, mask;
+    size_t pos = 0, n;
+    int g, w, rb;
+
+    buf = malloc(total ? total : 1);
+    if (!buf)
+        return NULL;
+
+    if (wf->bitmap && !wf->_lazy && !wf->_shared) {
+        for (g = 0; g < wf->nglyphs && wf->offsets[g] == pos; g++)
+            pos += (size_t)ROWBYTES(wf->widths[g]) * wf->height;
+    } else {
+        g = 0;
+    }
+
+    if (g == wf->nglyphs) {
+        memcpy(buf, wf->bitmap, total);
+    } else {
+        for (g = 0, pos = 0; g < wf->nglyphs; g++, pos += n) {
+            n = (size_t)ROWBYTES(wf->widths[g]) * wf->height;
+            rows = winfont_glyph_get(wf, g, WinFont_LayoutRowMSB, buf + pos,
+                n);
+            if (!rows) {
+                free(buf);
+                return NULL;
+            }
+            if (rows != buf + pos)
+                memcpy(buf + pos, rows, n);
+        }
+    }
+
+    for (g = 0, p = buf; g < wf->nglyphs; g++) {
+        w = wf->widths[g];
+        rb = ROWBYTES(w);
+        if (w % 8 == 0) {
+            p += (size_t)rb * wf->height;
+            continue;
+        }
+        mask = (uint8_t)(0xFF00 >> (w % 8));
+        for (int r = 0; r < wf->height; r++, p += rb)
+            p[rb - 1] &= mask;
+    }
+
+    return buf;
+}
+
+WinFont *
+winfont_derive_style(WinFont *wf, int style)
+{
+    WinFont_FontInfo info;
+    WinFont *sf = NULL;
+    const uint8_t *b;
+    uint8_t *src = NULL, *bbuf = NULL, *dst;
+    size_t srcbytes = 0, boldbytes = 0, total = 0;
+    int h, bold, slant, uline = -1, strike = -1, w, bw, dbytes;
+
+    if (!wf || (style & ~STYLE_ALL)) {
+        winfont_set_error(WinFont_ErrArg);
+        return NULL;
+    }
+    if (winfont_get_info(wf, &info) == -1)
+        return NULL;
+
+    h = wf->height;
+    bold = style & WINFONT_BOLD ? 1 : 0;
+    slant = style & WINFONT_ITALIC && h > 0 ? (h - 1) / 4 : 0;
+    if (style & WINFONT_UNDERLINE)
+        uline = info.ascent + 1 < h ? info.ascent + 1 : h - 1;
+    if (style & WINFONT_STRIKEOUT) {
+        strike = info.ascent - info.ascent / 3;
+        if (strike >= h)
+            strike = h - 1;
+    }
+
+    for (int g = 0; g < wf->nglyphs; g++) {
+        w = wf->widths[g];
+        srcbytes += (size_t)ROWBYTES(w) * h;
+        boldbytes += (size_t)ROWBYTES(w + bold) * h;
+        total += (size_t)ROWBYTES(w + bold + slant) * h;
+    }
+    if (total > UINT32_MAX) {
+        winfont_set_error(WinFont_ErrNoMem);
+        return NULL;
+    }
+
+    sf = winfont_new_like(wf, total);
+    if (!sf)
+        goto nomem;
+
+    sf->width = wf->width + bold + slant;
+    sf->height = h;
+    sf->wbytes = ROWBYTES(sf->width);
+    total = 0;
+    for (int g = 0; g < wf->nglyphs; g++) {
+        sf->widths[g] = wf->widths[g] + bold + slant;
+        sf->offsets[g] = total;
+        total += (size_t)ROWBYTES(sf->widths[g]) * h;
+    }
+
+    src = packed_rows(wf, srcbytes);
+    if (!src)
+        goto nomem;
+
+    /* Bold goes straight to the bitmap unless it is then slanted. */
+    b = src;
+    if (bold) {
+        if (slant) {
+            bbuf = malloc(boldbytes ? boldbytes : 1);
+            if (!bbuf)
+                goto nomem;
+        }
+        bold_glyphs(wf, slant ? bbuf : sf->bitmap, src);
+        b = slant ? bbuf : sf->bitmap;
+    }
+
+    if (slant) {
+        memset(sf->bitmap, 0, total);
+        dst = sf->bitmap;
+        for (int g = 0; g < wf->nglyphs; g++) {
+            bw = ROWBYTES(wf->widths[g] + bold);
+            dbytes = ROWBYTES(sf->widths[g]);
+            for (int r = 0; r < h; r++, b += bw, dst += dbytes)
+                shift_row(dst, dbytes, b, bw, (h - 1 - r) / 4);
+        }
+    } else if (!bold) {
+        memcpy(sf->bitmap, src, total);
+    }
+
+    if (uline >= 0 || strike >= 0) {
+        for (int g = 0; g < wf->nglyphs; g++) {
+            dst = sf->bitmap + sf->offsets[g];
+            dbytes = ROWBYTES(sf->widths[g]);
+            if (uline >= 0)
+                fill_row(dst + uline * dbytes, sf->widths[g]);
+            if (strike >= 0)
+                fill_row(dst + strike * dbytes, sf->widths[g]);
+        }
+    }
+
+    winfont_set_style(sf, style, bold + slant);
+    free(src);
+    free(bbuf);
+    return sf;
+
+nomem:
+    free(src);
+    free(bbuf);
+    winfont_free(sf);
+    winfont_set_error(WinFont_ErrNoMem);
+    return NULL;
+}
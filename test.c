@@ -1,6 +1,17 @@
 #include <winfont.h>
+#include "winfont_private.h"
+#include "fongen.h"
+#include <pthread.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef WINFONT_HAVE_ZLIB
+#include <zlib.h>
+#endif
 
 static struct {
     const char *name;
@@ -11,11 +22,2591 @@ static struct {
       .input = "one 1", .expect = "one 1", },
 };
 
+/* Synthetic FON images. Every font is built in memory with a known
+ * bit pattern so the decoded bitmap can be checked exactly. */
+
+#define FON_MAX (1 << 20)
+
+static uint8_t fon_buf[FON_MAX];
+
+static void
+put16(uint8_t *p, unsigned v)
+{
+    p[0] = v & 0xff;
+    p[1] = (v >> 8) & 0xff;
+}
+
+static void
+put32(uint8_t *p, unsigned long v)
+{
+    put16(p, v & 0xffff);
+    put16(p + 2, (v >> 16) & 0xffff);
+}
+
+static uint8_t
+pattern(int g, int r, int col)
+{
+    return (uint8_t)(g * 31 + r * 7 + col * 13 + 1);
+}
+
+struct face {
+    int version, w, h, points, weight, prop;
+};
+
+/* Proportional faces get glyphs 1 to w pixels wide. */
+static int
+glyph_width(const struct face *face, int g)
+{
+    return face->prop ? 1 + (g * 5) % face->w : face->w;
+}
+
+/* fongen faces of 255 characters, with pattern for their bits.
+ * Returns the image size. */
+static size_t
+build_fon_faces(uint8_t *buf, int nfaces, const struct face *faces)
+{
+    struct fongen_face ff[8];
+
+    if (nfaces > 8)
+        return 0;
+    for (int i = 0; i < nfaces; i++) {
+        ff[i] = (struct fongen_face){
+            faces[i].version, faces[i].w, faces[i].h, 255, faces[i].prop,
+            faces[i].points, faces[i].weight, pattern,
+        };
+    }
+
+    return fongen_build(buf, nfaces, ff);
+}
+
+static size_t
+build_fon(uint8_t *buf, int version, int w, int h)
+{
+    struct face face = { version, w, h, 12, 400, 0 };
+
+    return build_fon_faces(buf, 1, &face);
+}
+
+static int
+check_face(WinFont *wf, const struct face *face)
+{
+    int w = face->w, h = face->h, wbytes;
+    uint8_t *gb;
+
+    if (!wf)
+        return 1;
+    if (wf->width != w || wf->height != h || wf->wbytes != (w + 7) / 8)
+        return 1;
+    if (wf->nglyphs != 256)
+        return 1;
+    if (!wf->facename || strcmp(wf->facename, "Synthetic"))
+        return 1;
+
+    for (int g = 0; g < wf->nglyphs; g++) {
+        if (wf->widths[g] != glyph_width(face, g))
+            return 1;
+        wbytes = (wf->widths[g] + 7) / 8;
+        gb = wf->bitmap + wf->offsets[g];
+        for (int r = 0; r < h; r++)
+            for (int col = 0; col < wbytes; col++)
+                if (gb[r * wbytes + col] != pattern(g, r, col))
+                    return 1;
+    }
+
+    return 0;
+}
+
+static int
+check_font(WinFont *wf, int w, int h)
+{
+    struct face face = { 0, w, h, 0, 0, 0 };
+
+    return check_face(wf, &face);
+}
+
+static int
+test_read_memory(int version, int w, int h)
+{
+    size_t len;
+    WinFont *wf;
+    int failed;
+
+    len = build_fon(fon_buf, version, w, h);
+    wf = winfont_read_memory(fon_buf, len);
+    failed = check_font(wf, w, h);
+    winfont_free(wf);
+
+    /* Truncated images must be rejected, not read past. */
+    if (winfont_read_memory(fon_buf, len - 1) != NULL)
+        failed = 1;
+
+    return failed;
+}
+
+static int
+test_read_file(int version, int w, int h)
+{
+    char path[] = "/tmp/winfont-test-XXXXXX";
+    size_t len;
+    FILE *f;
+    WinFont *wf;
+    int fd, failed;
+
+    len = build_fon(fon_buf, version, w, h);
+    if ((fd = mkstemp(path)) == -1)
+        return 1;
+    f = fdopen(fd, "w+b");
+    if (!f || fwrite(fon_buf, 1, len, f) != len)
+        return 1;
+    rewind(f);
+
+    wf = winfont_read_file(f);
+    failed = check_font(wf, w, h);
+    winfont_free(wf);
+    fclose(f);
+
+    wf = winfont_read_path(path);
+    failed |= check_font(wf, w, h);
+    winfont_free(wf);
+
+    remove(path);
+    return failed;
+}
+
+static int
+write_file(const char *path, const void *buf, size_t len)
+{
+    FILE *f = fopen(path, "wb");
+    int ret = -1;
+
+    if (f && fwrite(buf, 1, len, f) == len)
+        ret = 0;
+    if (f)
+        fclose(f);
+    return ret;
+}
+
+static int
+test_scan(int version, int w, int h)
+{
+    static const struct face faces[] = {
+        { 0x200, 8, 8, 6, 400, 0 },
+        { 0x300, 8, 16, 12, 700, 0 },
+        { 0x300, 20, 16, 10, 400, 1 },
+    };
+    char dir[] = "/tmp/winfont-test-XXXXXX", path[64];
+    WinFont_FaceInfo fi[4];
+    WinFont_Index *idx[2];
+    WinFontCollection *wc;
+    size_t len;
+    FILE *f;
+    int n, failed = 0, lines = 0;
+
+    len = build_fon_faces(fon_buf, 3, faces);
+    wc = winfont_collection_read_memory(fon_buf, len);
+    if (!wc || winfont_scan_memory(fon_buf, len, fi, 4) != 3)
+        return 1;
+    for (int i = 0; i < 3; i++) {
+        WinFont *wf = wc->faces[i];
+        if (strcmp(fi[i].facename, wf->facename) ||
+            fi[i].points != faces[i].points ||
+            fi[i].weight != faces[i].weight ||
+            fi[i].pixheight != faces[i].h ||
+            fi[i].pixwidth != (faces[i].prop ? 0 : faces[i].w) ||
+            fi[i].version != faces[i].version ||
+            fi[i].lastchar - fi[i].firstchar + 2 != wf->nglyphs)
+            failed = 1;
+    }
+    winfont_collection_free(wc);
+
+    memset(fi, 0x5A, sizeof(fi));
+    if (winfont_scan_memory(fon_buf, len, fi, 1) != 3 ||
+        fi[0].points != 6 || fi[1].points != 0x5A5A5A5A)
+        failed = 1;
+    if (winfont_scan_memory(fon_buf, 40, fi, 4) != -1)
+        failed = 1;
+
+    /* A tree of fonts, a stray file and a broken font. */
+    if (!mkdtemp(dir))
+        return 1;
+    snprintf(path, sizeof(path), "%s/a.fon", dir);
+    failed |= write_file(path, fon_buf, len);
+    snprintf(path, sizeof(path), "%s/notes.txt", dir);
+    failed |= write_file(path, fon_buf, len);
+    snprintf(path, sizeof(path), "%s/c.fon", dir);
+    failed |= write_file(path, "MZ", 2);
+    snprintf(path, sizeof(path), "%s/sub", dir);
+    mkdir(path, 0755);
+    snprintf(path, sizeof(path), "%s/sub/b.FON", dir);
+    len = build_fon(fon_buf, version, w, h);
+    failed |= write_file(path, fon_buf, len);
+
+    idx[0] = winfont_index_dir(dir, 1);
+    idx[1] = winfont_index_dir(dir, 4);
+    for (int k = 0; k < 2; k++) {
+        if (!idx[k] || idx[k]->nfiles != 3)
+            return 1;
+        n = strlen(dir);
+        if (strcmp(idx[k]->files[0].path + n, "/a.fon") ||
+            strcmp(idx[k]->files[1].path + n, "/c.fon") ||
+            strcmp(idx[k]->files[2].path + n, "/sub/b.FON") ||
+            idx[k]->files[0].nfaces != 3 ||
+            idx[k]->files[1].nfaces != -1 ||
+            idx[k]->files[2].nfaces != 1 ||
+            idx[k]->files[2].faces[0].pixheight != h)
+            failed = 1;
+    }
+    for (int i = 0; i < 3; i++)
+        if (idx[0]->files[i].nfaces > 0 &&
+            memcmp(idx[0]->files[i].faces, idx[1]->files[i].faces,
+                idx[0]->files[i].nfaces * sizeof(WinFont_FaceInfo)))
+            failed = 1;
+
+    f = tmpfile();
+    if (!f || winfont_index_write(idx[1], f))
+        return 1;
+    rewind(f);
+    while (fgets(path, sizeof(path), f))
+        if (strchr(path, '\n'))
+            lines++;
+    fclose(f);
+    if (lines != 4)
+        failed = 1;
+
+    for (int i = 0; i < idx[1]->nfiles; i++)
+        remove(idx[1]->files[i].path);
+    winfont_index_free(idx[0]);
+    winfont_index_free(idx[1]);
+    snprintf(path, sizeof(path), "%s/notes.txt", dir);
+    remove(path);
+    snprintf(path, sizeof(path), "%s/sub", dir);
+    if (remove(path) || remove(dir))
+        failed = 1;
+    return failed;
+}
+
+/* Every glyph, the metrics and the face name of a match b. */
+static int
+check_same_font(WinFont *a, WinFont *b)
+{
+    uint8_t ga[64 * 64], gb[64 * 64];
+    size_t sz;
+
+    if (!a || !b || a->nglyphs != b->nglyphs || a->width != b->width ||
+        a->height != b->height || a->charset != b->charset ||
+        strcmp(a->facename, b->facename))
+        return 1;
+
+    for (int g = 0; g < a->nglyphs; g++) {
+        sz = winfont_glyph_required_size(a, g);
+        if (a->widths[g] != b->widths[g] ||
+            winfont_glyph_bitmap(a, g, ga, sizeof(ga)) == -1 ||
+            winfont_glyph_bitmap(b, g, gb, sizeof(gb)) == -1 ||
+            memcmp(ga, gb, sz) ||
+            winfont_glyph_index(a, g) != winfont_glyph_index(b, g))
+            return 1;
+    }
+
+    return 0;
+}
+
+static int
+test_cache(int version, int w, int h)
+{
+    char path[] = "/tmp/winfont-test-XXXXXX";
+    char cache[64];
+    struct face face = { version, w, h, 10, 400, 1 };
+    WinFont *src, *wf;
+    size_t len;
+    FILE *f;
+    int fd, failed = 0;
+
+    len = build_fon_faces(fon_buf, 1, &face);
+    if ((fd = mkstemp(path)) == -1)
+        return 1;
+    if (write(fd, fon_buf, len) != (ssize_t)len)
+        return 1;
+    close(fd);
+    snprintf(cache, sizeof(cache), "%s.cache", path);
+
+    /* Save from a lazy font, load it back without the source. */
+    src = winfont_open_mmap_flags(path, WINFONT_LAZY);
+    if (winfont_save_cache(src, path, cache))
+        failed = 1;
+    wf = winfont_load_cache(cache, NULL);
+    failed |= check_same_font(src, wf);
+    failed |= check_face(wf, &face);
+    winfont_free(wf);
+
+    /* Up to date, so it is mapped rather than rebuilt. */
+    wf = winfont_load_cache(cache, path);
+    if (!wf || !wf->_map)
+        failed = 1;
+    failed |= check_same_font(src, wf);
+    winfont_free(wf);
+
+    /* A damaged cache is rebuilt from the source. */
+    f = fopen(cache, "r+b");
+    if (!f || fseek(f, -1, SEEK_END) || fputc(0x5A, f) == EOF)
+        return 1;
+    fclose(f);
+    if (winfont_load_cache(cache, NULL))
+        failed = 1;
+    wf = winfont_load_cache(cache, path);
+    failed |= check_same_font(src, wf);
+    winfont_free(wf);
+    wf = winfont_load_cache(cache, NULL);
+    failed |= check_same_font(src, wf);
+    winfont_free(wf);
+    winfont_free(src);
+
+    /* So is one whose source has changed. The size changes too, as
+     * the mtime may not have moved on yet. */
+    face.prop = 0;
+    len = build_fon_faces(fon_buf, 1, &face);
+    f = fopen(path, "wb");
+    if (!f || fwrite(fon_buf, 1, len + 16, f) != len + 16)
+        return 1;
+    fclose(f);
+    src = winfont_read_memory(fon_buf, len);
+    wf = winfont_load_cache(cache, path);
+    failed |= check_same_font(src, wf);
+    winfont_free(wf);
+    winfont_free(src);
+
+    remove(cache);
+    remove(path);
+    return failed;
+}
+
+static int
+test_collection(int version, int w, int h)
+{
+    static const struct face faces[] = {
+        { 0x200, 8, 8, 6, 400, 0 },
+        { 0x300, 8, 16, 12, 400, 0 },
+        { 0x300, 16, 32, 24, 400, 0 },
+        { 0x300, 16, 32, 24, 700, 0 },
+    };
+    WinFontCollection *wc;
+    WinFont *wf;
+    size_t len;
+    int i, failed = 0;
+
+    len = build_fon_faces(fon_buf, 4, faces);
+    wc = winfont_collection_read_memory(fon_buf, len);
+    if (!wc || wc->nfaces != 4)
+        return 1;
+
+    for (i = 0; i < wc->nfaces; i++)
+        if (wc->faces[i]->bitmap != NULL)
+            failed = 1;
+
+    i = winfont_collection_find(wc, 24, 0, 700);
+    if (i != 3 || winfont_collection_find(wc, 0, 16, 0) != 1)
+        failed = 1;
+    if (winfont_collection_find(wc, 10, 0, 0) != -1)
+        failed = 1;
+
+    /* Only the face asked for is decoded. */
+    failed |= check_font(winfont_collection_face(wc, i), 16, 32);
+    if (wc->faces[0]->bitmap || wc->faces[1]->bitmap ||
+        wc->faces[2]->bitmap)
+        failed = 1;
+    failed |= check_font(winfont_collection_face(wc, 0), 8, 8);
+
+    winfont_collection_free(wc);
+
+    /* Single face loaders still return the first face. */
+    wf = winfont_read_memory(fon_buf, len);
+    failed |= check_font(wf, 8, 8);
+    winfont_free(wf);
+
+    return failed;
+}
+
+static int
+test_proportional(int version, int w, int h)
+{
+    struct face face = { version, w, h, 10, 400, 1 };
+    uint8_t gb[4 * 64];
+    size_t len, sz;
+    WinFont *wf;
+    FILE *f;
+    int failed = 0;
+
+    len = build_fon_faces(fon_buf, 1, &face);
+
+    wf = winfont_read_memory(fon_buf, len);
+    failed |= check_face(wf, &face);
+    for (int g = 0; wf && g < wf->nglyphs; g++) {
+        sz = winfont_glyph_required_size(wf, g);
+        if (sz != (size_t)(glyph_width(&face, g) + 7) / 8 * h ||
+            winfont_glyph_bitmap(wf, g, gb, sz) == -1 ||
+            memcmp(gb, wf->bitmap + wf->offsets[g], sz))
+            failed = 1;
+    }
+    winfont_free(wf);
+
+    wf = winfont_read_memory_flags(fon_buf, len, WINFONT_LAZY);
+    for (int g = 0; wf && g < wf->nglyphs; g++)
+        winfont_glyph_bitmap(wf, g, gb, sizeof(gb));
+    failed |= check_face(wf, &face);
+    winfont_free(wf);
+
+    f = tmpfile();
+    if (!f || fwrite(fon_buf, 1, len, f) != len)
+        return 1;
+    rewind(f);
+    wf = winfont_read_file(f);
+    failed |= check_face(wf, &face);
+    winfont_free(wf);
+    fclose(f);
+
+    return failed;
+}
+
+/* Wrap text and check every line: it fits unless it is one word cut
+ * to a glyph, it is what the text holds between breaks, and it
+ * measures what drawing it advances. */
+static int
+check_wrap(WinFont *wf, const char *text, int maxwidth, int lineh)
+{
+    static uint8_t pix[4096];
+    WinFont_Framebuffer fb = { pix, 4096, 1, 4096, WinFont_Pixel8 };
+    static WinFont_Line lines[256];
+    size_t covered = 0, len = strlen(text);
+    int n;
+
+    n = winfont_wrap(wf, text, len, maxwidth, lines, 256);
+    if (n < 1 || n > 256 || winfont_wrap(wf, text, len, maxwidth, NULL,
+            0) != n)
+        return 1;
+
+    for (int i = 0; i < n; i++) {
+        const char *line = text + lines[i].start;
+        size_t llen = lines[i].len;
+
+        if (lines[i].start < covered || lines[i].ext.y != i * lineh ||
+                memchr(line, '\n', llen) ||
+                (llen && (line[0] == ' ' && i && text[lines[i].start - 1]
+                    != '\n')) || (llen && line[llen - 1] == ' '))
+            return 1;
+        if (lines[i].ext.advance > maxwidth && llen > 1)
+            return 1;
+        if (winfont_measure(wf, line, llen, NULL) !=
+                lines[i].ext.advance ||
+                winfont_draw_string(wf, &fb, 0, 0, 1, 0,
+                    WinFont_DrawOpaque, line, llen) != lines[i].ext.advance)
+            return 1;
+        /* Only breaks are left out between lines. */
+        for (size_t k = covered; k < lines[i].start; k++)
+            if (text[k] != ' ' && text[k] != '\n' && text[k] != '\r')
+                return 1;
+        covered = lines[i].start + llen;
+    }
+
+    return 0;
+}
+
+static int
+test_layout(int version, int w, int h)
+{
+    static const char *para =
+        "The quick brown fox jumps over the lazy dog.  Pack my box "
+        "with five dozen liquor jugs.\nSphinx of black quartz,\r\n\n"
+        "judge my vow. Antidisestablishmentarianism!";
+    struct face prop = { version, w, h, 10, 400, 1 };
+    WinFont_Line lines[8];
+    WinFont_Extent ext;
+    size_t len;
+    WinFont *wf;
+    int failed = 0, sum;
+
+    len = build_fon(fon_buf, version, w, h);
+    wf = winfont_read_memory(fon_buf, len);
+    if (!wf)
+        return 1;
+
+    /* Fixed pitch */
+    if (winfont_measure(wf, "hello", 5, &ext) != 5 * w ||
+            ext.x != 0 || ext.y != 0 || ext.w != 5 * w || ext.h != h ||
+            winfont_measure(wf, "", 0, &ext) != 0 || ext.w || ext.h)
+        failed = 1;
+    if (winfont_wrap(wf, "the quick brown fox", 19, 10 * w, lines, 8)
+            != 2 || lines[0].start != 0 || lines[0].len != 9 ||
+            lines[1].start != 10 || lines[1].len != 9 ||
+            lines[1].ext.advance != 9 * w || lines[1].ext.y != h)
+        failed = 1;
+    if (winfont_wrap(wf, "ab\r\n\ncd\n", 8, 0, lines, 8) != 3 ||
+            lines[0].len != 2 || lines[1].len != 0 ||
+            lines[2].start != 5 || lines[2].len != 2)
+        failed = 1;
+    if (winfont_wrap(wf, "abcdefghijkl", 12, 5 * w, lines, 8) != 3 ||
+            lines[1].start != 5 || lines[2].len != 2)
+        failed = 1;
+    for (int mw = w / 2; mw < 40 * w; mw += 7)
+        failed |= check_wrap(wf, para, mw, h);
+    winfont_free(wf);
+
+    /* Proportional */
+    len = build_fon_faces(fon_buf, 1, &prop);
+    wf = winfont_read_memory(fon_buf, len);
+    if (!wf)
+        return 1;
+    sum = 0;
+    for (const char *c = para; *c; c++)
+        sum += glyph_width(&prop, (uint8_t)*c);
+    if (winfont_measure(wf, para, strlen(para), &ext) != sum ||
+            ext.w != sum)
+        failed = 1;
+    for (int mw = 1; mw < 80 * w; mw += 5)
+        failed |= check_wrap(wf, para, mw, h);
+    winfont_free(wf);
+
+    /* v3 A and C space around every glyph, also when drawing */
+    if (version == 0x300) {
+        len = build_fon(fon_buf, version, w, h);
+        put16(fon_buf + 512 + 118 + 4, 1);      /* dfAspace */
+        put16(fon_buf + 512 + 118 + 8, 2);      /* dfCspace */
+        wf = winfont_read_memory(fon_buf, len);
+        if (!wf || winfont_measure(wf, "ab", 2, &ext) != 2 * (w + 3) ||
+                ext.x != 1 || ext.w != 2 * w + 3)
+            failed = 1;
+        for (int mw = w / 2; wf && mw < 40 * w; mw += 7)
+            failed |= check_wrap(wf, para, mw, h);
+        winfont_free(wf);
+    }
+
+    return failed;
+}
+
+static int
+test_layouts(int version, int w, int h)
+{
+    struct face face = { version, w, h, 10, 400, 1 };
+    uint8_t buf[64 * 64];
+    const uint8_t *gb, *rows;
+    size_t len;
+    WinFont *wf;
+    int gw, rowbytes, bit, failed = 0;
+
+    len = build_fon_faces(fon_buf, 1, &face);
+    wf = winfont_read_memory(fon_buf, len);
+    if (!wf)
+        return 1;
+
+    for (int g = 0; g < wf->nglyphs; g++) {
+        gw = wf->widths[g];
+        rowbytes = (gw + 7) / 8;
+        rows = wf->bitmap + wf->offsets[g];
+
+        /* The stored layout is borrowed, not copied. */
+        if (winfont_glyph_get(wf, g, WinFont_LayoutRowMSB, NULL, 0) != rows)
+            failed = 1;
+
+        gb = winfont_glyph_get(wf, g, WinFont_Layout8bpp, buf, sizeof(buf));
+        if (!gb || winfont_glyph_layout_size(wf, g,
+                WinFont_Layout8bpp) != (size_t)gw * h)
+            return 1;
+        for (int r = 0; r < h; r++)
+            for (int x = 0; x < gw; x++) {
+                bit = rows[r * rowbytes + x / 8] >> (7 - x % 8) & 1;
+                if (gb[r * gw + x] != (bit ? 255 : 0))
+                    failed = 1;
+            }
+
+        gb = winfont_glyph_get(wf, g, WinFont_LayoutRowLSB, buf, sizeof(buf));
+        for (int r = 0; gb && r < h; r++)
+            for (int x = 0; x < gw; x++)
+                if ((gb[r * rowbytes + x / 8] >> (x % 8) & 1) !=
+                    (rows[r * rowbytes + x / 8] >> (7 - x % 8) & 1))
+                    failed = 1;
+
+        gb = winfont_glyph_get(wf, g, WinFont_LayoutColumn, buf, sizeof(buf));
+        for (int col = 0; gb && col < rowbytes; col++)
+            for (int r = 0; r < h; r++)
+                if (gb[col * h + r] != pattern(g, r, col))
+                    failed = 1;
+    }
+
+    /* Too small a buffer when a conversion is needed. */
+    if (winfont_glyph_get(wf, 1, WinFont_Layout8bpp, buf, 1) != NULL)
+        failed = 1;
+
+    winfont_free(wf);
+    return failed;
+}
+
+static int
+test_expand_kernels(int version, int w, int h)
+{
+    uint8_t src[64], ref[512], out[512];
+
+    for (size_t i = 0; i < sizeof(src); i++)
+        src[i] = pattern(i, i, 3);
+
+    for (size_t n = 0; n <= sizeof(ref); n += 7) {
+        winfont_expand_bits_isa(WF_ISA_SCALAR, ref, src, n);
+        for (int isa = WF_ISA_SSE2; isa <= winfont_cpu_isa(); isa++) {
+            memset(out, 0x55, sizeof(out));
+            winfont_expand_bits_isa(isa, out, src, n);
+            if (memcmp(ref, out, n) || (n < sizeof(out) && out[n] != 0x55))
+                return 1;
+        }
+    }
+
+    for (size_t n = 0; n <= sizeof(ref) / 4; n += 3) {
+        winfont_expand_bits32_isa(WF_ISA_SCALAR, ref, src, n,
+            0x11223344, 0xAABBCCDD);
+        for (int isa = WF_ISA_SSE2; isa <= winfont_cpu_isa(); isa++) {
+            memset(out, 0x55, sizeof(out));
+            winfont_expand_bits32_isa(isa, out, src, n,
+                0x11223344, 0xAABBCCDD);
+            if (memcmp(ref, out, 4 * n) ||
+                (4 * n < sizeof(out) && out[4 * n] != 0x55))
+                return 1;
+        }
+    }
+
+    return 0;
+}
+
+/* Glyphs of UTF-8 text against charset tables, with ASCII runs of
+ * every length ending at every byte that stops the kernels. */
+static int
+test_unicode(int version, int w, int h)
+{
+    /* '?' is the default glyph. */
+    static const struct {
+        int charset;
+        const char *text;
+        int glyphs[4];
+    } cases[] = {
+        { 255, "\xE2\x98\xBA\xC3\xA9\xE2\x94\x80~",
+          { 0x01, 0x82, 0xC4, '~' } },
+        { 0, "\xE2\x82\xAC\xC3\xA9\xF0\x9F\x98\x80\x7F",
+          { 0x80, 0xE9, '?', 0x7F } },
+        { 204, "\xD0\x96\xD1\x8E\xC0\x80",
+          { 0xC6, 0xFE, '?', '?' } },
+    };
+    uint16_t ref[300], out[300];
+    char text[300];
+    WinFont *wf;
+    size_t len;
+    ssize_t n;
+    int failed = 0;
+
+    if (winfont_charset_unicode(255, 0xB0) != 0x2591 ||
+            winfont_charset_unicode(2, 'A') != 0xF041 ||
+            winfont_charset_unicode(128, 0xB1) != 0xFF71 ||
+            winfont_charset_unicode(134, 0xB1) != -1)
+        return 1;
+
+    for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+        len = build_fon(fon_buf, version, w, h);
+        fon_buf[512 + 85] = cases[c].charset;
+        wf = winfont_read_memory(fon_buf, len);
+        if (!wf || wf->charset != cases[c].charset)
+            return 1;
+        n = winfont_glyphs_utf8(wf, cases[c].text, strlen(cases[c].text),
+            out);
+        if (n != 4)
+            failed = 1;
+        for (int i = 0; i < 4 && i < n; i++)
+            if (out[i] != cases[c].glyphs[i])
+                failed = 1;
+        winfont_free(wf);
+    }
+
+    len = build_fon(fon_buf, version, w, h);
+    wf = winfont_read_memory(fon_buf, len);
+    if (!wf)
+        return 1;
+    for (size_t k = 0; k < 260; k += 3) {
+        for (size_t i = 0; i < k; i++)
+            text[i] = ' ' + (i * 7) % 95;
+        text[k] = "\n\x7F\xC3"[k % 3];
+        for (size_t i = k + 1; i < k + 8; i++)
+            text[i] = 'a' + i % 26;
+        for (size_t i = 0; i < k + 8; i++)
+            ref[i] = winfont_glyph_index(wf, (uint8_t)text[i]);
+        /* A lone lead byte is U+FFFD, the default glyph. */
+        if (k % 3 == 2)
+            ref[k] = '?';
+        n = winfont_glyphs_utf8(wf, text, k + 8, out);
+        if (n != (ssize_t)k + 8 || memcmp(ref, out, n * sizeof(uint16_t)))
+            failed = 1;
+
+        for (int isa = WF_ISA_SCALAR; isa <= winfont_cpu_isa(); isa++) {
+            memset(out, 0, sizeof(out));
+            if (winfont_ascii_glyphs_isa(isa, out, (uint8_t *)text, k + 8,
+                    0x20, 0x7E, 0) != k ||
+                    memcmp(ref, out, k * sizeof(uint16_t)))
+                failed = 1;
+        }
+    }
+    winfont_free(wf);
+
+    return failed;
+}
+
+static int
+check_atlas(WinFont *wf, WinFont_Atlas *atlas, int padding)
+{
+    uint8_t gb[64 * 64], *cover;
+    int bpp = atlas->format == WinFont_AtlasRGBA8888 ? 4 : 1;
+    int failed = 0;
+
+    cover = calloc((size_t)atlas->width * atlas->height, 1);
+    if (!cover)
+        return 1;
+
+    for (int g = 0; g < wf->nglyphs; g++) {
+        WinFont_AtlasRect *rc = &atlas->rects[g];
+
+        if (rc->w != wf->widths[g] || rc->h != wf->height)
+            failed = 1;
+        if (rc->w && (rc->x < padding || rc->y < padding ||
+                rc->x + rc->w + padding > atlas->width ||
+                rc->y + rc->h + padding > atlas->height))
+            return 1;
+
+        winfont_glyph_get(wf, g, WinFont_Layout8bpp, gb, sizeof(gb));
+        for (int r = 0; r < rc->h; r++)
+            for (int x = 0; x < rc->w; x++) {
+                uint8_t *px = atlas->pixels +
+                    (size_t)(rc->y + r) * atlas->stride + (rc->x + x) * bpp;
+                for (int c = 0; c < bpp; c++)
+                    if (px[c] != gb[r * rc->w + x])
+                        failed = 1;
+                /* No two glyphs share a pixel. */
+                if (cover[(rc->y + r) * atlas->width + rc->x + x]++)
+                    failed = 1;
+            }
+    }
+
+    free(cover);
+    return failed;
+}
+
+static int
+test_atlas(int version, int w, int h)
+{
+    struct face fixed = { version, w, h, 10, 400, 0 };
+    struct face prop = { version, w, h, 10, 400, 1 };
+    WinFont_Atlas *atlas;
+    uint8_t *pixels;
+    size_t len, sz;
+    WinFont *wf;
+    int failed = 0;
+
+    len = build_fon_faces(fon_buf, 1, &fixed);
+    wf = winfont_read_memory(fon_buf, len);
+    atlas = winfont_build_atlas(wf, WinFont_AtlasA8, 16 * w, 0, NULL, 0);
+    if (!atlas || atlas->width != 16 * w || atlas->height != 16 * h)
+        failed = 1;
+    else
+        failed |= check_atlas(wf, atlas, 0);
+    winfont_atlas_free(atlas);
+    winfont_free(wf);
+
+    len = build_fon_faces(fon_buf, 1, &prop);
+    wf = winfont_read_memory_flags(fon_buf, len, WINFONT_LAZY);
+    sz = winfont_atlas_required_size(wf, WinFont_AtlasRGBA8888, 0, 1);
+    pixels = malloc(sz);
+    if (winfont_build_atlas(wf, WinFont_AtlasRGBA8888, 0, 1,
+            pixels, sz - 1) != NULL)
+        failed = 1;
+    atlas = winfont_build_atlas(wf, WinFont_AtlasRGBA8888, 0, 1,
+        pixels, sz);
+    if (!atlas || atlas->pixels != pixels)
+        failed = 1;
+    else
+        failed |= check_atlas(wf, atlas, 1);
+    winfont_atlas_free(atlas);
+    free(pixels);
+    winfont_free(wf);
+
+    return failed;
+}
+
+static uint32_t
+fb_get(const WinFont_Framebuffer *fb, int x, int y)
+{
+    uint8_t *p = fb->pixels + y * fb->stride + x * fb->format;
+    uint32_t v = 0;
+
+    memcpy(&v, p, fb->format);
+    return v;
+}
+
+/* Draw text pixel by pixel into ref, the obvious way. */
+static void
+ref_draw_string(WinFont *wf, WinFont_Framebuffer *ref, int x, int y,
+    uint32_t fg, uint32_t bg, int mode, const char *text)
+{
+    uint8_t gb[64 * 64];
+    int g, bit;
+
+    for (; *text; text++) {
+        g = winfont_glyph_index(wf, (uint8_t)*text);
+        winfont_glyph_get(wf, g, WinFont_Layout8bpp, gb, sizeof(gb));
+        for (int r = 0; r < wf->height; r++)
+            for (int c = 0; c < wf->widths[g]; c++) {
+                int px = x + c, py = y + r;
+                if (px < 0 || py < 0 || px >= ref->width ||
+                    py >= ref->height)
+                    continue;
+                bit = gb[r * wf->widths[g] + c];
+                if (bit || mode == WinFont_DrawOpaque) {
+                    uint32_t v = bit ? fg : bg;
+                    memcpy(ref->pixels + py * ref->stride +
+                        px * ref->format, &v, ref->format);
+                }
+            }
+        x += wf->widths[g];
+    }
+}
+
+static int
+test_draw(int version, int w, int h)
+{
+    static const int formats[] = {
+        WinFont_Pixel8, WinFont_Pixel16, WinFont_Pixel32,
+    };
+    static const int pos[][2] = {
+        { 3, 2 }, { -5, -3 }, { 100, 40 }, { -1000, 0 }, { 0, 0 },
+    };
+    const char *text = "Hello, \x01 World!\xDB";
+    struct face prop = { version, w, h, 10, 400, 1 };
+    WinFont_Framebuffer fb, ref;
+    uint8_t *pix, *refpix;
+    size_t len;
+    WinFont *wf;
+    int failed = 0, x, end;
+
+    len = build_fon(fon_buf, version, w, h);
+    wf = winfont_read_memory(fon_buf, len);
+    if (!wf)
+        return 1;
+
+    for (int round = 0; round < 2; round++) {
+        for (int f = 0; f < 3; f++) {
+            fb.width = ref.width = 123;
+            fb.height = ref.height = 57;
+            fb.format = ref.format = formats[f];
+            fb.stride = ref.stride = fb.width * fb.format + 5;
+            pix = malloc(fb.stride * fb.height);
+            refpix = malloc(fb.stride * fb.height);
+            for (int i = 0; i < fb.stride * fb.height; i++)
+                pix[i] = refpix[i] = (uint8_t)(i * 13);
+            fb.pixels = pix;
+            ref.pixels = refpix;
+
+            for (int p = 0; p < 5; p++) {
+                int mode = p % 2 ? WinFont_DrawTransparent :
+                    WinFont_DrawOpaque;
+                end = winfont_draw_string(wf, &fb, pos[p][0], pos[p][1],
+                    0xA1B2C3D4, 0x5E6F7081, mode, text, strlen(text));
+                ref_draw_string(wf, &ref, pos[p][0], pos[p][1],
+                    0xA1B2C3D4, 0x5E6F7081, mode, text);
+                x = pos[p][0];
+                for (const char *c = text; *c && x < fb.width; c++)
+                    x += wf->widths[winfont_glyph_index(wf, (uint8_t)*c)];
+                if (end != x)
+                    failed = 1;
+            }
+
+            for (int y = 0; y < fb.height; y++)
+                for (int x = 0; x < fb.width; x++)
+                    if (fb_get(&fb, x, y) != fb_get(&ref, x, y))
+                        failed = 1;
+            /* Stride padding is never written. */
+            if (memcmp(pix, refpix, fb.stride * fb.height))
+                failed = 1;
+
+            free(pix);
+            free(refpix);
+        }
+
+        winfont_free(wf);
+        len = build_fon_faces(fon_buf, 1, &prop);
+        wf = winfont_read_memory_flags(fon_buf, len, WINFONT_LAZY);
+        if (!wf)
+            return 1;
+    }
+
+    winfont_free(wf);
+    return failed;
+}
+
+/* Every pixel of each glyph of sf is the pixel of wf it came from. */
+static int
+check_scaled(WinFont *wf, WinFont *sf, int s)
+{
+    uint8_t *gb, *sb;
+    int w, failed = 0;
+
+    if (!sf || sf->nglyphs != wf->nglyphs || sf->height != wf->height * s)
+        return 1;
+
+    gb = malloc((size_t)wf->width * wf->height);
+    sb = malloc((size_t)sf->width * sf->height);
+    for (int g = 0; g < wf->nglyphs && !failed; g++) {
+        w = wf->widths[g];
+        if (sf->widths[g] != w * s) {
+            failed = 1;
+            break;
+        }
+        winfont_glyph_get(wf, g, WinFont_Layout8bpp, gb,
+            (size_t)wf->width * wf->height);
+        winfont_glyph_get(sf, g, WinFont_Layout8bpp, sb,
+            (size_t)sf->width * sf->height);
+        for (int y = 0; y < sf->height; y++)
+            for (int x = 0; x < w * s; x++)
+                if (sb[y * w * s + x] != gb[y / s * w + x / s])
+                    failed = 1;
+    }
+
+    free(gb);
+    free(sb);
+    return failed;
+}
+
+/* Compare every pixel of the styled copy sf with wf drawn in style by
+ * hand, and check the pad bits of its rows are clear. */
+static int
+check_styled(WinFont *wf, WinFont *sf, int style)
+{
+    WinFont_FontInfo info, sinfo;
+    int bold = style & WINFONT_BOLD ? 1 : 0, h = wf->height, slant = 0;
+    int uline = -1, strike = -1, w, sw, bx, on, failed = 0;
+    const uint8_t *row;
+    uint8_t *gb, *sb;
+
+    if (!sf || sf->nglyphs != wf->nglyphs || sf->height != h ||
+            winfont_get_info(wf, &info) || winfont_get_info(sf, &sinfo))
+        return 1;
+
+    if (style & WINFONT_ITALIC)
+        slant = (h - 1) / 4;
+    if (style & WINFONT_UNDERLINE)
+        uline = info.ascent + 1 < h ? info.ascent + 1 : h - 1;
+    if (style & WINFONT_STRIKEOUT)
+        strike = info.ascent - info.ascent / 3;
+    if (sinfo.italic != (info.italic || (style & WINFONT_ITALIC)) ||
+        sinfo.underline != (info.underline || uline >= 0) ||
+        sinfo.strikeout != (info.strikeout || strike >= 0) ||
+        sinfo.weight != (bold && info.weight < 700 ? 700 : info.weight) ||
+        sinfo.maxwidth != info.maxwidth + bold + slant)
+        return 1;
+
+    gb = malloc((size_t)wf->width * h);
+    sb = malloc((size_t)sf->width * h);
+    for (int g = 0; g < wf->nglyphs && !failed; g++) {
+        w = wf->widths[g];
+        sw = sf->widths[g];
+        if (sw != w + bold + slant) {
+            failed = 1;
+            break;
+        }
+        winfont_glyph_get(wf, g, WinFont_Layout8bpp, gb,
+            (size_t)wf->width * h);
+        winfont_glyph_get(sf, g, WinFont_Layout8bpp, sb,
+            (size_t)sf->width * h);
+        for (int y = 0; y < h; y++) {
+            for (int x = 0; x < sw; x++) {
+                bx = x - (h - 1 - y) * !!slant / 4;
+                on = (bx >= 0 && bx < w && gb[y * w + bx]) ||
+                    (bold && bx >= 1 && bx <= w && gb[y * w + bx - 1]) ||
+                    y == uline || y == strike;
+                if (!!sb[y * sw + x] != on)
+                    failed = 1;
+            }
+            row = sf->bitmap + sf->offsets[g] + (size_t)y * ((sw + 7) / 8);
+            if (sw % 8 && row[sw / 8] & (0xFF >> sw % 8))
+                failed = 1;
+        }
+    }
+
+    free(gb);
+    free(sb);
+    return failed;
+}
+
+static int
+test_scale(int version, int w, int h)
+{
+    struct face face = { version, w, h, 10, 400, 1 };
+    const char *text = "Scale \x02 me!";
+    uint8_t src[3 * 16], ref[3 * 16 * 8 + 1], out[3 * 16 * 8 + 1];
+    uint8_t pix[3][160 * 100];
+    WinFont_Framebuffer fb = { NULL, 160, 100, 160, WinFont_Pixel8 };
+    WinFont_FontInfo info, sinfo;
+    WinFont *wf, *sf, *uf;
+    size_t len, n;
+    int failed = 0, end[3];
+
+    for (size_t i = 0; i < sizeof(src); i++)
+        src[i] = pattern(i, 7 * i, 1);
+
+    /* Three rows of n pixels, written to rows 16 * s bytes apart. */
+    for (int s = 1; s <= 8; s++)
+        for (int n = 0; n <= 8 * 16; n += 5) {
+            int rb = (n + 7) / 8, srb = (n * s + 7) / 8;
+            winfont_scale_rows_isa(WF_ISA_SCALAR, ref, 16 * s, src,
+                n, 3, s);
+            for (int r = 0; r < 3; r++)
+                for (int x = 0; x < n * s; x++)
+                    if (((ref[r * 16 * s + x / 8] >> (7 - x % 8)) ^
+                        (src[r * rb + x / s / 8] >> (7 - x / s % 8))) & 1)
+                        failed = 1;
+            for (int isa = WF_ISA_SSE2; isa <= winfont_cpu_isa(); isa++) {
+                memset(out, 0x55, sizeof(out));
+                winfont_scale_rows_isa(isa, out, 16 * s, src, n, 3, s);
+                for (int r = 0; r < 3; r++)
+                    if (memcmp(ref + r * 16 * s, out + r * 16 * s, srb) ||
+                        (srb < 16 * s && out[r * 16 * s + srb] != 0x55))
+                        failed = 1;
+            }
+        }
+
+    for (int prop = 0; prop < 2; prop++) {
+        face.prop = prop;
+        len = build_fon_faces(fon_buf, 1, &face);
+        wf = winfont_read_memory_flags(fon_buf, len,
+            prop ? WINFONT_LAZY : 0);
+        if (!wf)
+            return 1;
+
+        for (int s = 1; s <= 4; s++) {
+            sf = winfont_scale(wf, s);
+            failed |= check_scaled(wf, sf, s);
+
+            /* The header describes the scaled font, so an underline
+             * goes below its baseline. */
+            if (!sf || winfont_get_info(wf, &info) ||
+                    winfont_get_info(sf, &sinfo) ||
+                    sinfo.pixheight != info.pixheight * s ||
+                    sinfo.ascent != info.ascent * s ||
+                    sinfo.external_leading != info.external_leading * s ||
+                    sinfo.avgwidth != info.avgwidth * s ||
+                    sinfo.maxwidth != info.maxwidth * s ||
+                    sinfo.aspace != info.aspace * s ||
+                    sinfo.cspace != info.cspace * s) {
+                failed = 1;
+            } else {
+                uf = winfont_derive_style(sf, WINFONT_UNDERLINE);
+                failed |= check_styled(sf, uf, WINFONT_UNDERLINE);
+                winfont_free(uf);
+            }
+
+            /* Scaling on the fly, from the cache and from the scaled
+             * font all draw the same pixels. */
+            n = strlen(text);
+            memset(pix, 0x33, sizeof(pix));
+            fb.pixels = pix[0];
+            end[0] = winfont_draw_string_scaled(wf, &fb, -3, 5, s,
+                0xEE, 0x11, WinFont_DrawOpaque, text, n);
+            fb.pixels = pix[1];
+            end[1] = winfont_draw_string(sf, &fb, -3, 5,
+                0xEE, 0x11, WinFont_DrawOpaque, text, n);
+            if (winfont_cache_scale(wf, s) || winfont_cache_scale(wf, s))
+                failed = 1;
+            fb.pixels = pix[2];
+            end[2] = winfont_draw_string_scaled(wf, &fb, -3, 5, s,
+                0xEE, 0x11, WinFont_DrawOpaque, text, n);
+            if (end[0] != end[1] || end[1] != end[2] ||
+                memcmp(pix[0], pix[1], sizeof(pix[0])) ||
+                memcmp(pix[1], pix[2], sizeof(pix[0])))
+                failed = 1;
+
+            winfont_free(sf);
+        }
+
+        if (winfont_scale(wf, 0) || winfont_scale(wf, WINFONT_MAX_SCALE + 1))
+            failed = 1;
+        winfont_free(wf);
+    }
+
+    return failed;
+}
+
+static int
+test_style(int version, int w, int h)
+{
+    struct face face = { version, w, h, 10, 400, 1 };
+    const char *text = "Sty \x02!";
+    uint8_t src[200], ref[2 * 200], out[2 * 200 + 1];
+    uint8_t pix[160 * 100];
+    WinFont_Framebuffer fb = { NULL, 160, 100, 160, WinFont_Pixel8 };
+    WinFont_Extent ext;
+    WinFont *wf, *sf;
+    size_t len;
+    int failed = 0, end;
+
+    for (size_t i = 0; i < sizeof(src); i++)
+        src[i] = pattern(i, 3 * i, 0) & 0xFE;
+
+    for (size_t n = 0; n <= sizeof(src); n += 7) {
+        winfont_bold_bits_isa(WF_ISA_SCALAR, ref, src, n);
+        for (size_t i = 0; i < n; i++)
+            if (ref[i] != (uint8_t)(src[i] | src[i] >> 1 |
+                    (i ? src[i - 1] << 7 : 0)))
+                failed = 1;
+        for (int isa = WF_ISA_SSE2; isa <= winfont_cpu_isa(); isa++) {
+            memset(out, 0x55, sizeof(out));
+            winfont_bold_bits_isa(isa, out, src, n);
+            if (memcmp(ref, out, n) || out[n] != 0x55)
+                failed = 1;
+        }
+
+        winfont_bold_bytes_isa(WF_ISA_SCALAR, ref, src, n);
+        for (size_t i = 0; i < n; i++)
+            if (ref[2 * i] != (src[i] | src[i] >> 1) ||
+                    ref[2 * i + 1] != (uint8_t)(src[i] << 7))
+                failed = 1;
+        for (int isa = WF_ISA_SSE2; isa <= winfont_cpu_isa(); isa++) {
+            memset(out, 0x55, sizeof(out));
+            winfont_bold_bytes_isa(isa, out, src, n);
+            if (memcmp(ref, out, 2 * n) || out[2 * n] != 0x55)
+                failed = 1;
+        }
+    }
+
+    for (int prop = 0; prop < 2; prop++) {
+        face.prop = prop;
+        len = build_fon_faces(fon_buf, 1, &face);
+        wf = winfont_read_memory_flags(fon_buf, len,
+            prop ? WINFONT_LAZY : 0);
+        if (!wf)
+            return 1;
+
+        for (int style = 0; style <= 0xF; style++) {
+            sf = winfont_derive_style(wf, style);
+            failed |= check_styled(wf, sf, style);
+
+            /* A styled font measures and draws like any other. */
+            memset(pix, 0, sizeof(pix));
+            fb.pixels = pix;
+            end = winfont_draw_string(sf, &fb, 2, 3, 0xEE, 0x11,
+                WinFont_DrawOpaque, text, strlen(text));
+            if (winfont_measure(sf, text, strlen(text), &ext) != end - 2)
+                failed = 1;
+            winfont_free(sf);
+        }
+
+        /* Unknown style bits are refused. */
+        if (winfont_derive_style(wf, 0x10) || winfont_derive_style(NULL, 0))
+            failed = 1;
+        winfont_free(wf);
+    }
+
+    return failed;
+}
+
+/* All of f, from the start. */
+static uint8_t *
+read_back(FILE *f, size_t *len)
+{
+    uint8_t *buf;
+    long n;
+
+    fflush(f);
+    if (fseek(f, 0, SEEK_END) || (n = ftell(f)) < 0 || fseek(f, 0, SEEK_SET))
+        return NULL;
+    buf = malloc(n + 1);
+    if (buf && fread(buf, 1, n, f) != (size_t)n) {
+        free(buf);
+        return NULL;
+    }
+    buf[n] = 0;
+    *len = n;
+    return buf;
+}
+
+static uint32_t
+get32le(const uint8_t *p)
+{
+    return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static uint32_t
+get32be(const uint8_t *p)
+{
+    return (uint32_t)p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3];
+}
+
+/* Whether the rows of glyph g, rowbytes apart, hold its pixels and
+ * nothing after them. */
+static int
+rows_match(WinFont *wf, int g, const uint8_t *rows, int rowbytes)
+{
+    uint8_t gb[64 * 64];
+    int w = wf->widths[g], on;
+
+    winfont_glyph_get(wf, g, WinFont_Layout8bpp, gb, sizeof(gb));
+    for (int y = 0; y < wf->height; y++)
+        for (int x = 0; x < 8 * rowbytes; x++) {
+            on = (rows[y * rowbytes + x / 8] >> (7 - x % 8)) & 1;
+            if (on != (x < w && gb[y * w + x] != 0))
+                return 0;
+        }
+
+    return 1;
+}
+
+static int
+test_export(int version, int w, int h)
+{
+    struct face face = { version, w, h, 10, 400, 0 };
+    uint8_t *buf, *p, *bits = NULL, *enc = NULL;
+    const uint8_t *table;
+    uint32_t type, off, n, cs, *offsets = NULL;
+    char want[64], *at;
+    size_t len;
+    WinFont *wf;
+    FILE *f;
+    int failed = 0, ga;
+
+    /* Fixed, proportional, and proportional with glyphs wider than
+     * dfMaxWidth. */
+    for (int prop = 0; prop < 3; prop++) {
+        face.prop = prop != 0;
+        len = build_fon_faces(fon_buf, 1, &face);
+        if (prop == 2)
+            put16(fon_buf + 512 + 93, w / 2);   /* dfMaxWidth */
+        wf = winfont_read_memory_flags(fon_buf, len,
+            prop ? WINFONT_LAZY : 0);
+        if (!wf)
+            return 1;
+        ga = winfont_glyph_index(wf, 'A');
+
+        /* PSF2: header, glyphs padded to the widest, and the table. */
+        f = tmpfile();
+        if (!f || winfont_write_psf2(wf, fileno(f)) ||
+                !(buf = read_back(f, &len))) {
+            winfont_free(wf);
+            return 1;
+        }
+        cs = (w + 7) / 8 * h;
+        if (len < 32 || get32le(buf) != 0x864AB572 || get32le(buf + 12) != 1 ||
+                get32le(buf + 16) != (uint32_t)wf->nglyphs ||
+                get32le(buf + 20) != cs || get32le(buf + 24) != (uint32_t)h ||
+                get32le(buf + 28) != (uint32_t)w ||
+                len < 32 + cs * wf->nglyphs) {
+            failed = 1;
+        } else {
+            for (int g = 0; g < wf->nglyphs; g++)
+                if (!rows_match(wf, g, buf + 32 + cs * g, (w + 7) / 8))
+                    failed = 1;
+            table = buf + 32 + cs * wf->nglyphs;
+            for (int g = 0; g < ga && table < buf + len; table++)
+                g += *table == 0xFF;
+            if (table + 2 > buf + len || memcmp(table, "A\xFF", 2))
+                failed = 1;
+        }
+        free(buf);
+        fclose(f);
+
+        /* BDF: every glyph, and A's first row in hex. */
+        f = tmpfile();
+        if (!f || winfont_write_bdf(wf, f) || !(buf = read_back(f, &len))) {
+            winfont_free(wf);
+            return 1;
+        }
+        n = 0;
+        for (at = (char *)buf; (at = strstr(at, "STARTCHAR")); at++)
+            n++;
+        p = (uint8_t *)winfont_glyph_get(wf, ga, WinFont_LayoutRowMSB, NULL,
+            0);
+        snprintf(want, sizeof(want), "FONTBOUNDINGBOX %d %d ", w, h);
+        if (!strstr((char *)buf, want))
+            failed = 1;
+        at = strstr((char *)buf, "ENCODING 65\n");
+        at = at ? strstr(at, "BITMAP\n") : NULL;
+        if (n != (uint32_t)wf->nglyphs || !at || !p ||
+                strncmp(at + 7, "ENDCHAR", 7) == 0)
+            failed = 1;
+        else if (wf->widths[ga] <= 8) {
+            snprintf(want, sizeof(want), "%02X\n",
+                p[0] & (0xFF00 >> wf->widths[ga]));
+            if (strncmp(at + 7, want, 3))
+                failed = 1;
+        }
+        free(buf);
+        fclose(f);
+
+        /* PCF: the bitmaps and the encoding of A. */
+        f = tmpfile();
+        if (!f || winfont_write_pcf(wf, f) || !(buf = read_back(f, &len))) {
+            winfont_free(wf);
+            return 1;
+        }
+        n = len >= 8 ? get32le(buf + 4) : 0;
+        if (len < 8 || memcmp(buf, "\1fcp", 4) || len < 8 + 16 * n)
+            failed = 1;
+        for (uint32_t t = 0; !failed && t < n; t++) {
+            type = get32le(buf + 8 + 16 * t);
+            off = get32le(buf + 20 + 16 * t);
+            if (off + 8 > len)
+                failed = 1;
+            else if (type == 1 << 3)
+                bits = buf + off + 4;
+            else if (type == 1 << 5)
+                enc = buf + off + 4;
+        }
+        if (!failed && (!bits || !enc ||
+                get32be(bits) != (uint32_t)wf->nglyphs))
+            failed = 1;
+        if (!failed) {
+            offsets = malloc(wf->nglyphs * sizeof(uint32_t));
+            for (int g = 0; g < wf->nglyphs; g++)
+                offsets[g] = get32be(bits + 4 + 4 * g);
+            p = bits + 4 + 4 * wf->nglyphs + 16;
+            for (int g = 0; g < wf->nglyphs; g++)
+                if (!rows_match(wf, g, p + offsets[g],
+                        (wf->widths[g] + 7) / 8))
+                    failed = 1;
+            /* One row of columns for byte 0, so A is at 'A' - mincol. */
+            off = 10 + 2 * ('A' - (enc[0] << 8 | enc[1]));
+            if ((enc[off] << 8 | enc[off + 1]) != ga)
+                failed = 1;
+            free(offsets);
+        }
+        bits = enc = NULL;
+        free(buf);
+        fclose(f);
+        winfont_free(wf);
+    }
+
+    if (winfont_write_psf2(NULL, 1) != -1 || winfont_write_bdf(NULL, stdout)
+            != -1 || winfont_write_pcf(NULL, stdout) != -1)
+        failed = 1;
+
+    /* The widest A and C space a v3 file can hold. */
+    if (version == 0x300) {
+        face.prop = 0;
+        len = build_fon_faces(fon_buf, 1, &face);
+        put16(fon_buf + 512 + 122, 0xFFFF);     /* dfAspace */
+        put16(fon_buf + 512 + 126, 0xFFFF);     /* dfCspace */
+        wf = winfont_read_memory(fon_buf, len);
+        f = tmpfile();
+        if (!wf || !f || winfont_write_bdf(wf, f) ||
+                !(buf = read_back(f, &len))) {
+            failed = 1;
+        } else {
+            snprintf(want, sizeof(want), "SWIDTH %d 0\n",
+                (int)((2 * 0xFFFFLL + w) * 72000 / (10 * 96)));
+            if (!strstr((char *)buf, want))
+                failed = 1;
+            free(buf);
+        }
+        if (f)
+            fclose(f);
+        winfont_free(wf);
+    }
+
+    return failed;
+}
+
+/* Draw every cell of s from scratch into its own framebuffer and
+ * compare with s->fb. */
+static int
+check_screen(WinFontScreen *s)
+{
+    WinFont_Framebuffer ref = s->fb;
+    size_t sz = (size_t)s->fb.stride * s->fb.height;
+    WinFont_Cell *c;
+    uint32_t fg, bg;
+    int failed;
+
+    ref.pixels = malloc(sz);
+    if (!ref.pixels)
+        return 1;
+    memset(ref.pixels, 0, sz);
+
+    for (int i = 0; i < s->cols * s->rows; i++) {
+        c = &s->cells[i];
+        fg = s->palette[c->fg];
+        bg = s->palette[c->bg];
+        if (s->blink_off && (c->attr & WinFont_CellBlink))
+            fg = bg;
+        winfont_draw_glyph(s->font, &ref, (i % s->cols) * s->cellw,
+            (i / s->cols) * s->cellh, c->glyph, fg, bg, WinFont_DrawOpaque);
+    }
+
+    failed = memcmp(ref.pixels, s->fb.pixels, sz) != 0;
+    free(ref.pixels);
+    return failed;
+}
+
+static int
+test_screen(int version, int w, int h)
+{
+    WinFont_Rect rects[4];
+    WinFontScreen *s;
+    size_t len;
+    WinFont *wf;
+    int n, failed = 0;
+
+    len = build_fon(fon_buf, version, w, h);
+    wf = winfont_read_memory(fon_buf, len);
+    s = winfont_screen_new(wf, 20, 6, WinFont_Pixel32, NULL, 0);
+    if (!s)
+        return 1;
+    memset(s->fb.pixels, 0, (size_t)s->fb.stride * s->fb.height);
+
+    n = winfont_screen_update(s, rects, 4);
+    if (n != 1 || rects[0].x != 0 || rects[0].y != 0 ||
+        rects[0].w != 20 * w || rects[0].h != 6 * h)
+        failed = 1;
+    failed |= check_screen(s);
+
+    /* Writing what is already there changes nothing. */
+    winfont_screen_write(s, 0, 0, "   ", 3, 7, 0, 0);
+    if (winfont_screen_update(s, rects, 4) != 0)
+        failed = 1;
+
+    winfont_screen_write(s, 3, 2, "Hi", 2, 14, 1, 0);
+    winfont_screen_write(s, 3, 3, "yo", 2, 10, 4, WinFont_CellBlink);
+    winfont_screen_write(s, 10, 5, "x", 1, 12, 0, 0);
+    n = winfont_screen_update(s, rects, 4);
+    if (n != 2 || rects[0].x != 3 * w || rects[0].y != 2 * h ||
+        rects[0].w != 2 * w || rects[0].h != 2 * h ||
+        rects[1].x != 10 * w || rects[1].y != 5 * h)
+        failed = 1;
+    failed |= check_screen(s);
+
+    winfont_screen_blink(s, 0);
+    n = winfont_screen_update(s, rects, 4);
+    if (n != 1 || rects[0].y != 3 * h || rects[0].h != h)
+        failed = 1;
+    failed |= check_screen(s);
+
+    /* More dirty rows than rects are folded into the last one. */
+    for (int r = 0; r < 6; r++)
+        winfont_screen_put(s, r, r, 1, 2, 3, 0);
+    n = winfont_screen_update(s, rects, 2);
+    if (n != 2 || rects[1].y != h || rects[1].h != 5 * h ||
+        rects[1].x != w || rects[1].w != 5 * w)
+        failed = 1;
+    failed |= check_screen(s);
+
+    winfont_screen_set_palette(s, 7, 0x00FFFFFF);
+    if (winfont_screen_update(s, rects, 4) != 1)
+        failed = 1;
+    failed |= check_screen(s);
+
+    winfont_screen_free(s);
+    winfont_free(wf);
+    return failed;
+}
+
+static int
+check_glyph(const uint8_t *gb, int g, int wbytes, int h)
+{
+    for (int r = 0; r < h; r++)
+        for (int col = 0; col < wbytes; col++)
+            if (gb[r * wbytes + col] != pattern(g, r, col))
+                return 1;
+    return 0;
+}
+
+static void *
+lazy_reader(void *arg)
+{
+    WinFont *wf = arg;
+    uint8_t gb[4 * 64];
+    intptr_t failed = 0;
+
+    for (int i = 0; i < wf->nglyphs; i++) {
+        int g = (i * 7) % wf->nglyphs;
+        if (winfont_glyph_bitmap(wf, g, gb, sizeof(gb)) == -1 ||
+            check_glyph(gb, g, wf->wbytes, wf->height))
+            failed = 1;
+    }
+
+    return (void *)failed;
+}
+
+/* Draw glyph g of the lazy font wf as if another thread had claimed
+ * it and not yet decoded it, and compare with the same glyph of ref.
+ * It is drawn from a copy of its own, and that is not an error. */
+static int
+draw_claimed(WinFont *wf, WinFont *ref, int g)
+{
+    uint8_t pix[2][64 * 32];
+    WinFont_Framebuffer fb = { NULL, 64, 32, 64, WinFont_Pixel8 };
+    int failed = 0;
+
+    memset(pix, 0, sizeof(pix));
+    fb.pixels = pix[1];
+    winfont_draw_glyph(ref, &fb, 0, 0, g, 1, 0, WinFont_DrawOpaque);
+
+    wf->_lazy[g / 32] |= 1u << (g % 32);
+    winfont_set_error(WinFont_ErrNone);
+    fb.pixels = pix[0];
+    winfont_draw_glyph(wf, &fb, 0, 0, g, 1, 0, WinFont_DrawOpaque);
+    if (winfont_last_error() != WinFont_ErrNone ||
+        memcmp(pix[0], pix[1], sizeof(pix[0])))
+        failed = 1;
+    wf->_lazy[g / 32] &= ~(1u << (g % 32));
+
+    return failed;
+}
+
+static int
+test_lazy(int version, int w, int h)
+{
+    int wbytes = (w + 7) / 8;
+    pthread_t threads[4];
+    uint8_t gb[4 * 64];
+    size_t len;
+    WinFont *wf, *ref;
+    void *ret;
+    int failed = 0;
+
+    len = build_fon(fon_buf, version, w, h);
+    wf = winfont_read_memory_flags(fon_buf, len, WINFONT_LAZY);
+    if (!wf)
+        return 1;
+
+    if (winfont_glyph_required_size(wf, 65) != (size_t)wbytes * h)
+        failed = 1;
+    if (winfont_glyph_bitmap(wf, 65, gb, wbytes * h - 1) != -1)
+        failed = 1;
+    if (winfont_glyph_bitmap(wf, wf->nglyphs, gb, sizeof(gb)) != -1)
+        failed = 1;
+
+    /* Only glyph 65 is decoded after the first access. */
+    if (winfont_glyph_bitmap(wf, 65, gb, sizeof(gb)) == -1 ||
+        check_glyph(gb, 65, wbytes, h))
+        failed = 1;
+    if (check_glyph(wf->bitmap + wbytes * h * 65, 65, wbytes, h))
+        failed = 1;
+    if (!check_glyph(wf->bitmap + wbytes * h * 66, 66, wbytes, h))
+        failed = 1;
+
+    ref = winfont_read_memory(fon_buf, len);
+    if (!ref || draw_claimed(wf, ref, 67))
+        failed = 1;
+    winfont_free(ref);
+
+    for (int i = 0; i < 4; i++)
+        pthread_create(&threads[i], NULL, lazy_reader, wf);
+    for (int i = 0; i < 4; i++) {
+        pthread_join(threads[i], &ret);
+        if (ret)
+            failed = 1;
+    }
+
+    failed |= check_font(wf, w, h);
+
+    winfont_free(wf);
+
+    return failed;
+}
+
+#define CONTAINER_OFF 1000
+
+static const struct face stress_faces[] = {
+    { 0x200, 8, 16, 12, 400, 0 },
+    { 0x300, 12, 20, 14, 700, 0 },
+    { 0x300, 16, 24, 18, 400, 1 },
+};
+
+struct stress {
+    FILE *f;                    /* FON at CONTAINER_OFF */
+    int fd;                     /* the same file */
+    WinFontCollection *wc;
+    WinFont *lazy;              /* face 2, decoded on demand */
+    WinFont *ref;               /* face 2, decoded up front */
+    int tid;
+};
+
+static void *
+stress_worker(void *arg)
+{
+    struct stress *st = arg;
+    uint8_t gb[2][3 * 24], pix[2][100 * 60];
+    WinFont_Framebuffer fb = { NULL, 100, 60, 100, WinFont_Pixel8 };
+    intptr_t failed = 0;
+    WinFont *wf;
+    int i = st->tid % 3;
+
+    wf = winfont_read_file(st->f);
+    failed |= check_font(wf, 8, 16);
+    winfont_free(wf);
+    wf = winfont_read_fd(st->fd, CONTAINER_OFF);
+    failed |= check_font(wf, 8, 16);
+    winfont_free(wf);
+
+    failed |= check_face(winfont_collection_face(st->wc, i),
+        &stress_faces[i]);
+
+    for (int k = 0; k < st->ref->nglyphs; k++) {
+        int g = (k * 11 + st->tid) % st->ref->nglyphs;
+        size_t sz = winfont_glyph_required_size(st->ref, g);
+        if (winfont_glyph_bitmap(st->lazy, g, gb[0], sizeof(gb[0])) == -1 ||
+            winfont_glyph_bitmap(st->ref, g, gb[1], sizeof(gb[1])) == -1 ||
+            memcmp(gb[0], gb[1], sz))
+            failed = 1;
+    }
+
+    if (winfont_cache_scale(st->lazy, 2))
+        failed = 1;
+    memset(pix, 0x77, sizeof(pix));
+    fb.pixels = pix[0];
+    winfont_draw_string_scaled(st->lazy, &fb, -2, 3, 2, 1, 0,
+        WinFont_DrawOpaque, "Threads!", 8);
+    fb.pixels = pix[1];
+    winfont_draw_string_scaled(st->ref, &fb, -2, 3, 2, 1, 0,
+        WinFont_DrawOpaque, "Threads!", 8);
+    if (memcmp(pix[0], pix[1], sizeof(pix[0])))
+        failed = 1;
+
+    return (void *)failed;
+}
+
+/* Everything that may share an object across threads does so at once.
+ * Run under -fsanitize=thread to check for races. */
+static int
+test_concurrent(int version, int w, int h)
+{
+    static uint8_t prop_buf[FON_MAX];
+    struct stress st[8];
+    pthread_t threads[8];
+    WinFont *wf;
+    size_t len;
+    void *ret;
+    FILE *f, *mf;
+    int failed = 0;
+
+    len = build_fon(fon_buf, 0x200, 8, 16);
+    f = tmpfile();
+    if (!f || fwrite(fon_buf, 1, CONTAINER_OFF, f) != CONTAINER_OFF ||
+        fwrite(fon_buf, 1, len, f) != len ||
+        fseek(f, CONTAINER_OFF, SEEK_SET))
+        return 1;
+
+    /* No descriptor behind it, so read through stdio. */
+    mf = fmemopen(fon_buf, len, "rb");
+    wf = winfont_read_file(mf);
+    failed |= check_font(wf, 8, 16);
+    winfont_free(wf);
+    if (mf)
+        fclose(mf);
+
+    len = build_fon_faces(fon_buf, 3, stress_faces);
+    st[0].wc = winfont_collection_read_memory(fon_buf, len);
+    st[0].ref = winfont_collection_face(st[0].wc, 2);
+    len = build_fon_faces(prop_buf, 1, &stress_faces[2]);
+    st[0].lazy = winfont_read_memory_flags(prop_buf, len, WINFONT_LAZY);
+    if (!st[0].wc || !st[0].ref || !st[0].lazy)
+        return 1;
+    st[0].f = f;
+    st[0].fd = fileno(f);
+
+    for (int i = 0; i < 8; i++) {
+        st[i] = st[0];
+        st[i].tid = i;
+        pthread_create(&threads[i], NULL, stress_worker, &st[i]);
+    }
+    for (int i = 0; i < 8; i++) {
+        pthread_join(threads[i], &ret);
+        if (ret)
+            failed = 1;
+    }
+
+    /* Nobody moved the file position. */
+    if (ftell(f) != CONTAINER_OFF)
+        failed = 1;
+
+    winfont_free(st[0].lazy);
+    winfont_collection_free(st[0].wc);
+    fclose(f);
+    return failed;
+}
+
+struct log {
+    int n, level;
+    char msg[256];
+};
+
+static void
+log_capture(int level, const char *msg, void *ctx)
+{
+    struct log *lg = ctx;
+
+    lg->n++;
+    lg->level = level;
+    snprintf(lg->msg, sizeof(lg->msg), "%s", msg);
+}
+
+/* Both loaders fail the same way on the same damage. */
+static int
+expect_error(const uint8_t *buf, size_t len, WinFont_Error err)
+{
+    WinFont *wf;
+    FILE *f;
+    int failed = 0;
+
+    wf = winfont_read_memory(buf, len);
+    if (wf || winfont_last_error() != err)
+        failed = 1;
+    winfont_free(wf);
+
+    f = fmemopen((void *)buf, len, "rb");
+    if (!f)
+        return 1;
+    wf = winfont_read_file(f);
+    if (wf || winfont_last_error() != err)
+        failed = 1;
+    winfont_free(wf);
+    fclose(f);
+
+    return failed;
+}
+
+static int
+test_errors(int version, int w, int h)
+{
+    static uint8_t bad[FON_MAX];
+    struct log lg = { 0, 0, "" };
+    WinFont_FontInfo fi;
+    size_t len, fnt = 512;
+    WinFont *wf;
+    FILE *f;
+    int failed = 0;
+
+    len = build_fon(fon_buf, version, w, h);
+
+    winfont_set_log(log_capture, WinFont_LogError, &lg);
+    memcpy(bad, fon_buf, len);
+    bad[0] = 'X';
+    failed |= expect_error(bad, len, WinFont_ErrFormat);
+#ifndef WINFONT_NO_LOG
+    if (lg.n != 2 || lg.level != WinFont_LogError || !lg.msg[0])
+        failed = 1;
+#endif
+    winfont_set_log(NULL, 0, NULL);
+
+    failed |= expect_error(fon_buf, 40, WinFont_ErrFormat);
+
+    memcpy(bad, fon_buf, len);
+    bad[fnt + 66] |= 1;                         /* dfType */
+    failed |= expect_error(bad, len, WinFont_ErrVector);
+
+    memcpy(bad, fon_buf, len);
+    bad[fnt + 1] = 1;                           /* dfVersion */
+    failed |= expect_error(bad, len, WinFont_ErrVersion);
+
+    /* A header narrower than its glyphs is widened to hold them. */
+    memcpy(bad, fon_buf, len);
+    put16(bad + fnt + 86, w / 2);               /* dfPixWidth */
+    put16(bad + fnt + 93, w / 2);               /* dfMaxWidth */
+    wf = winfont_read_memory(bad, len);
+    if (!wf || wf->width != w || wf->wbytes != (w + 7) / 8)
+        failed = 1;
+    winfont_free(wf);
+    f = fmemopen(bad, len, "rb");
+    wf = f ? winfont_read_file(f) : NULL;
+    if (!wf || wf->width != w || wf->wbytes != (w + 7) / 8)
+        failed = 1;
+    winfont_free(wf);
+    if (f)
+        fclose(f);
+
+    memcpy(bad, fon_buf, len);
+    bad[fnt + 95] = 2;                          /* dfFirstChar */
+    bad[fnt + 96] = 0;                          /* dfLastChar */
+    failed |= expect_error(bad, len, WinFont_ErrFormat);
+
+    memcpy(bad, fon_buf, len);
+    put16(bad + 128 + 24, 0);                   /* RT_FONT count */
+    failed |= expect_error(bad, len, WinFont_ErrNoFont);
+
+    /* The last glyph points past the end of the file. */
+    memcpy(bad, fon_buf, len);
+    if (version == 0x300)
+        put32(bad + fnt + 148 + 6 * 255 + 2, len);
+    else
+        put16(bad + fnt + 118 + 4 * 255 + 2, len - fnt);
+    wf = winfont_read_memory(bad, len);
+    if (wf || winfont_last_error() != WinFont_ErrCharTable)
+        failed = 1;
+
+    if (winfont_read_memory(NULL, 0) ||
+        winfont_last_error() != WinFont_ErrArg)
+        failed = 1;
+    winfont_set_error(WinFont_ErrNone);
+    if (winfont_scan_memory(NULL, 0, NULL, 0) != -1 ||
+        winfont_last_error() != WinFont_ErrArg)
+        failed = 1;
+    if (winfont_open_mmap("/nonexistent/font.fon") ||
+        winfont_last_error() != WinFont_ErrIO)
+        failed = 1;
+    if (strcmp(winfont_strerror(WinFont_ErrNoMem), "out of memory"))
+        failed = 1;
+
+    /* Debug messages only when asked for. */
+    lg.n = 0;
+    winfont_set_log(log_capture, WinFont_LogInfo, &lg);
+    winfont_free(winfont_read_memory(fon_buf, len));
+    if (lg.n != 0)
+        failed = 1;
+    winfont_set_log(log_capture, WinFont_LogDebug, &lg);
+    wf = winfont_read_memory(fon_buf, len);
+#ifndef WINFONT_NO_LOG
+    if (lg.n != 1 || lg.level != WinFont_LogDebug ||
+        !strstr(lg.msg, "Synthetic"))
+        failed = 1;
+#endif
+    winfont_set_log(NULL, 0, NULL);
+
+    if (winfont_get_info(wf, &fi) == -1 || fi.version != version ||
+        fi.points != 12 || fi.weight != 400 || fi.charset != 255 ||
+        fi.pixwidth != w || fi.pixheight != h || fi.ascent != h - h / 8 ||
+        fi.firstchar != 0 || fi.lastchar != 254 || fi.breakchar != 32 ||
+        fi.pitchfamily != 0x30)
+        failed = 1;
+
+    /* Every call that can fail says why. */
+    winfont_set_error(WinFont_ErrNone);
+    if (winfont_glyph_get(wf, -1, WinFont_LayoutRowMSB, NULL, 0) ||
+        winfont_last_error() != WinFont_ErrArg)
+        failed = 1;
+    winfont_set_error(WinFont_ErrNone);
+    if (winfont_scale(wf, 0) || winfont_last_error() != WinFont_ErrArg)
+        failed = 1;
+    winfont_set_error(WinFont_ErrNone);
+    if (winfont_build_atlas(wf, WinFont_AtlasA8, 64, 0, bad, 1) ||
+        winfont_last_error() != WinFont_ErrArg)
+        failed = 1;
+    winfont_set_error(WinFont_ErrNone);
+    if (winfont_screen_new(wf, 0, 25, WinFont_Pixel8, NULL, 0) ||
+        winfont_last_error() != WinFont_ErrArg)
+        failed = 1;
+    winfont_set_error(WinFont_ErrNone);
+    if (winfont_load_cache("/nonexistent/font.cache", NULL) ||
+        winfont_last_error() != WinFont_ErrIO)
+        failed = 1;
+    winfont_set_error(WinFont_ErrNone);
+    if (winfont_save_cache(wf, NULL, "/nonexistent/font.cache") != -1 ||
+        winfont_last_error() != WinFont_ErrIO)
+        failed = 1;
+    winfont_set_error(WinFont_ErrNone);
+    if (winfont_index_paths(NULL, 1, 1) ||
+        winfont_last_error() != WinFont_ErrArg)
+        failed = 1;
+    winfont_free(wf);
+
+    return failed;
+}
+
+static const struct face loader_faces[] = {
+    { 0x200, 8, 16, 12, 400, 0 },
+    { 0x300, 16, 32, 24, 400, 0 },
+    { 0x300, 12, 20, 14, 700, 0 },
+    { 0x200, 8, 8, 6, 400, 0 },
+};
+
+#define NLOADER 4
+
+static int
+test_loader(int version, int w, int h)
+{
+    char dir[] = "/tmp/winfont-test-XXXXXX", paths[NLOADER + 2][64];
+    char *argv[NLOADER + 1];
+    WinFontJob *jobs[5], *done[8];
+    WinFont *fonts[NLOADER + 1];
+    WinFontLoader *ld;
+    size_t len;
+    int fd, n, failed = 0;
+
+    if (!mkdtemp(dir))
+        return 1;
+    for (int i = 0; i < NLOADER; i++) {
+        snprintf(paths[i], sizeof(paths[i]), "%s/%d.fon", dir, i);
+        len = build_fon_faces(fon_buf, 1, &loader_faces[i]);
+        if (write_file(paths[i], fon_buf, len) == -1)
+            failed = 1;
+        argv[i] = paths[i];
+    }
+    snprintf(paths[NLOADER], sizeof(paths[0]), "%s/missing.fon", dir);
+    argv[NLOADER] = paths[NLOADER];
+
+    /* Results land in path order whatever thread loaded them. */
+    if (winfont_load_batch(argv, NLOADER + 1, 0, fonts, 3) != NLOADER ||
+        fonts[NLOADER] != NULL)
+        failed = 1;
+    for (int i = 0; i < NLOADER; i++) {
+        failed |= check_face(fonts[i], &loader_faces[i]);
+        winfont_free(fonts[i]);
+    }
+
+    /* The one thread blocks opening a FIFO until it is written, so
+     * the rest queue up behind it. */
+    snprintf(paths[NLOADER + 1], sizeof(paths[0]), "%s/fifo", dir);
+    if (mkfifo(paths[NLOADER + 1], 0600) == -1)
+        return 1;
+    ld = winfont_loader_new(1);
+    if (!ld)
+        return 1;
+    jobs[0] = winfont_loader_submit(ld, paths[NLOADER + 1], 0, 10);
+    jobs[1] = winfont_loader_submit(ld, paths[0], 0, 0);
+    jobs[2] = winfont_loader_submit(ld, paths[1], 0, 5);
+    jobs[3] = winfont_loader_submit(ld, paths[2], WINFONT_LAZY, 5);
+    jobs[4] = winfont_loader_submit(ld, paths[3], 0, 1);
+    while (winfont_job_poll(jobs[0]) != WinFont_JobRunning)
+        usleep(1000);
+    if (winfont_job_cancel(jobs[4]) != 0 ||
+        winfont_job_cancel(jobs[0]) != -1 ||
+        winfont_job_set_priority(jobs[1], 7) != 0 ||
+        winfont_loader_done(ld, done, 8) != 1 || done[0] != jobs[4])
+        failed = 1;
+
+    fd = open(paths[NLOADER + 1], O_WRONLY);
+    if (fd != -1)
+        close(fd);
+
+    /* Canceled, then the empty FIFO failed, then by priority. */
+    if (winfont_job_wait(jobs[3]) != WinFont_JobDone ||
+        winfont_job_error(jobs[0]) != WinFont_ErrIO ||
+        winfont_job_take(jobs[4]) != NULL)
+        failed = 1;
+    n = winfont_loader_done(ld, done, 8);
+    if (n != 4 || done[0] != jobs[0] || done[1] != jobs[1] ||
+        done[2] != jobs[2] || done[3] != jobs[3])
+        failed = 1;
+
+    winfont_loader_free(ld);
+    for (int i = 1; i < 4; i++) {
+        fonts[0] = winfont_job_take(jobs[i]);
+        if (i == 3)
+            failed |= lazy_reader(fonts[0]) != NULL;
+        else
+            failed |= check_face(fonts[0], &loader_faces[i - 1]);
+        winfont_free(fonts[0]);
+    }
+    for (int i = 0; i < 5; i++)
+        winfont_job_free(jobs[i]);
+
+    for (int i = 0; i < NLOADER + 2; i++)
+        unlink(paths[i]);
+    rmdir(dir);
+
+    return failed;
+}
+
+struct bulk_result {
+    uint8_t *buf;
+    size_t len;
+    WinFont_Error err;
+};
+
+static void
+bulk_keep(void *ctx, int i, uint8_t *buf, size_t len, WinFont_Error err)
+{
+    struct bulk_result *res = ctx;
+
+    res[i].buf = buf;
+    res[i].len = len;
+    res[i].err = err;
+}
+
+/* Both backends read the same bytes: all of the headers, which for the
+ * later faces are well past the first read, or the first face. */
+static int
+test_bulk(int version, int w, int h)
+{
+    static const struct face faces[] = {
+        { 0x300, 16, 32, 24, 400, 0 },
+        { 0x200, 8, 16, 12, 700, 0 },
+        { 0x300, 20, 16, 10, 400, 1 },
+    };
+    char dir[] = "/tmp/winfont-test-XXXXXX", paths[5][64];
+    char *argv[5];
+    struct bulk_result res[5];
+    WinFont_FaceInfo fi[3], want[3];
+    WinFont *fonts[5];
+    size_t multi, first, full;
+    int failed = 0;
+
+    if (!mkdtemp(dir))
+        return 1;
+    for (int i = 0; i < 5; i++) {
+        snprintf(paths[i], sizeof(paths[i]), "%s/%d.fon", dir, i);
+        argv[i] = paths[i];
+    }
+    first = build_fon_faces(fon_buf, 1, faces);
+    multi = build_fon_faces(fon_buf, 3, faces);
+    if (winfont_scan_memory(fon_buf, multi, want, 3) != 3)
+        return 1;
+    failed |= write_file(paths[0], fon_buf, multi);
+    full = build_fon(fon_buf, version, w, h);
+    failed |= write_file(paths[1], fon_buf, full);
+    failed |= write_file(paths[2], "MZ", 2);
+    full = build_fon(fon_buf, 0x200, 8, 16);
+    failed |= write_file(paths[3], fon_buf, full);
+
+    for (int backend = WF_IO_PREAD; backend <= WF_IO_URING; backend++) {
+        memset(res, 0, sizeof(res));
+        winfont_bulk_read(argv, 5, 1, backend, 2, bulk_keep, res);
+        if (!res[0].buf || res[0].len >= multi ||
+            winfont_scan_memory(res[0].buf, res[0].len, fi, 3) != 3 ||
+            memcmp(fi, want, sizeof(fi)))
+            failed = 1;
+        if (winfont_scan_memory(res[2].buf, res[2].len, fi, 3) != -1 ||
+            res[4].buf || res[4].err != WinFont_ErrIO)
+            failed = 1;
+        for (int i = 0; i < 5; i++)
+            free(res[i].buf);
+
+        winfont_bulk_read(argv, 5, 0, backend, 1, bulk_keep, res);
+        if (res[0].len != first)
+            failed = 1;
+        for (int i = 0; i < 5; i++)
+            free(res[i].buf);
+    }
+
+    /* Borrowed and lazy fonts keep the buffer, eager ones free it. */
+    for (int lazy = 0; lazy <= 1; lazy++) {
+        if (winfont_load_batch(argv, 5, lazy ? WINFONT_LAZY : 0, fonts,
+                3) != 3 || fonts[2] || fonts[4])
+            failed = 1;
+        if (lazy) {
+            failed |= !fonts[1] || lazy_reader(fonts[1]) != NULL;
+        } else {
+            failed |= check_face(fonts[0], &faces[0]);
+            failed |= check_font(fonts[1], w, h);
+            failed |= check_font(fonts[3], 8, 16);
+        }
+        for (int i = 0; i < 5; i++)
+            winfont_free(fonts[i]);
+    }
+
+    for (int i = 0; i < 4; i++)
+        unlink(paths[i]);
+    rmdir(dir);
+
+    return failed;
+}
+
+/* A stream that hands out at most 7 bytes a read, and counts them. */
+struct trickle {
+    const uint8_t *buf;
+    size_t len, pos;
+};
+
+static ssize_t
+trickle_read(void *ctx, void *buf, size_t n)
+{
+    struct trickle *t = ctx;
+
+    if (n > 7)
+        n = 7;
+    if (n > t->len - t->pos)
+        n = t->len - t->pos;
+    memcpy(buf, t->buf + t->pos, n);
+    t->pos += n;
+    return n;
+}
+
+static void *
+pipe_writer(void *arg)
+{
+    struct trickle *t = arg;
+    int fd = t->pos;
+
+    if (write(fd, t->buf, t->len) != (ssize_t)t->len)
+        t->pos = -1;
+    close(fd);
+    return NULL;
+}
+
+static int
+test_stream(int version, int w, int h)
+{
+    struct face faces[] = {
+        { 0x200, 8, 16, 12, 400, 0 },
+        { version, w, h, 12, 700, 0 },
+        { 0x300, 20, 16, 10, 400, 1 },
+    };
+    struct trickle t = { fon_buf, 0, 0 };
+    WinFontStream *st;
+    pthread_t writer;
+    size_t first;
+    WinFont *wf;
+    FILE *f;
+    int fds[2], failed = 0;
+
+    first = build_fon_faces(fon_buf, 1, faces);
+    t.len = build_fon_faces(fon_buf, 3, faces);
+
+    /* Each face as soon as it is in, then a clean end. */
+    st = winfont_stream_new(trickle_read, &t, 64 * 1024);
+    for (int i = 0; i < 3; i++) {
+        wf = winfont_stream_next(st);
+        failed |= check_face(wf, &faces[i]);
+        if (i == 0 && t.pos >= first + 64)
+            failed = 1;
+        winfont_free(wf);
+    }
+    if (winfont_stream_next(st) || winfont_last_error() != WinFont_ErrNone)
+        failed = 1;
+    winfont_stream_free(st);
+
+    /* A face bigger than the budget, and input that stops short. */
+    t.pos = 0;
+    st = winfont_stream_new(trickle_read, &t, 4096);
+    if (winfont_stream_next(st) != NULL ||
+        winfont_last_error() != WinFont_ErrNoMem ||
+        winfont_stream_next(st) != NULL)
+        failed = 1;
+    winfont_stream_free(st);
+    t.pos = 0;
+    t.len = first - 100;
+    st = winfont_stream_new(trickle_read, &t, 0);
+    if (winfont_stream_next(st) != NULL ||
+        winfont_last_error() != WinFont_ErrCharTable)
+        failed = 1;
+    winfont_stream_free(st);
+
+    /* winfont_read_file streams a pipe. */
+    t.len = build_fon(fon_buf, version, w, h);
+    if (pipe(fds) == -1)
+        return 1;
+    t.pos = fds[1];
+    if (pthread_create(&writer, NULL, pipe_writer, &t))
+        return 1;
+    f = fdopen(fds[0], "rb");
+    wf = f ? winfont_read_file(f) : NULL;
+    failed |= check_font(wf, w, h);
+    winfont_free(wf);
+    pthread_join(writer, NULL);
+    if (f)
+        fclose(f);
+
+    return failed;
+}
+
+struct zip_member {
+    const char *name;
+    const uint8_t *data;
+    size_t len;
+    int deflate;
+};
+
+static uint32_t
+zip_crc(const uint8_t *data, size_t len)
+{
+#ifdef WINFONT_HAVE_ZLIB
+    return crc32(0, data, len);
+#else
+    (void)data;
+    (void)len;
+    return 0;
+#endif
+}
+
+/* Raw deflate data, as zip and gzip hold it, or 0 without zlib. */
+static size_t
+deflate_raw(uint8_t *dst, size_t cap, const uint8_t *src, size_t len)
+{
+#ifdef WINFONT_HAVE_ZLIB
+    z_stream zs;
+    size_t n;
+
+    memset(&zs, 0, sizeof(zs));
+    if (deflateInit2(&zs, 9, Z_DEFLATED, -MAX_WBITS, 8,
+            Z_DEFAULT_STRATEGY) != Z_OK)
+        return 0;
+    zs.next_in = (Bytef *)src;
+    zs.avail_in = len;
+    zs.next_out = dst;
+    zs.avail_out = cap;
+    n = deflate(&zs, Z_FINISH) == Z_STREAM_END ? zs.total_out : 0;
+    deflateEnd(&zs);
+    return n;
+#else
+    (void)dst;
+    (void)cap;
+    (void)src;
+    (void)len;
+    return 0;
+#endif
+}
+
+/* Local headers and data, then the central directory and its end
+ * record. Returns the archive size. */
+static size_t
+build_zip(uint8_t *buf, const struct zip_member *m, int n)
+{
+    size_t p = 0, cd, csize[8], loff[8];
+    int method[8];
+
+    for (int i = 0; i < n; i++) {
+        size_t nlen = strlen(m[i].name);
+        loff[i] = p;
+        put32(buf + p, 0x04034b50);
+        put16(buf + p + 26, nlen);
+        put16(buf + p + 28, 4);         /* an extra field to skip */
+        memcpy(buf + p + 30, m[i].name, nlen);
+        p += 30 + nlen + 4;
+        csize[i] = m[i].deflate ?
+            deflate_raw(buf + p, FON_MAX - p, m[i].data, m[i].len) : 0;
+        method[i] = csize[i] ? 8 : 0;
+        if (!csize[i]) {
+            memcpy(buf + p, m[i].data, m[i].len);
+            csize[i] = m[i].len;
+        }
+        p += csize[i];
+    }
+
+    cd = p;
+    for (int i = 0; i < n; i++) {
+        size_t nlen = strlen(m[i].name);
+        memset(buf + p, 0, 46);
+        put32(buf + p, 0x02014b50);
+        put16(buf + p + 10, method[i]);
+        put32(buf + p + 16, zip_crc(m[i].data, m[i].len));
+        put32(buf + p + 20, csize[i]);
+        put32(buf + p + 24, m[i].len);
+        put16(buf + p + 28, nlen);
+        put32(buf + p + 42, loff[i]);
+        memcpy(buf + p + 46, m[i].name, nlen);
+        p += 46 + nlen;
+    }
+
+    memset(buf + p, 0, 22);
+    put32(buf + p, 0x06054b50);
+    put16(buf + p + 8, n);
+    put16(buf + p + 10, n);
+    put32(buf + p + 12, p - cd);
+    put32(buf + p + 16, cd);
+    return p + 22;
+}
+
+static uint8_t zip_buf[FON_MAX];
+
+static int
+test_archive(int version, int w, int h)
+{
+    char dir[] = "/tmp/winfont-test-XXXXXX", path[64];
+    struct zip_member m[4];
+    uint8_t *a, *b;
+    size_t alen, blen, zlen, n;
+    WinFontArchive *ar;
+    WinFont *wf;
+    int failed = 0, have_zlib = deflate_raw(zip_buf, 64, zip_buf, 1) > 0;
+
+    alen = build_fon(fon_buf, version, w, h);
+    a = malloc(alen);
+    memcpy(a, fon_buf, alen);
+    blen = build_fon(fon_buf, 0x200, 8, 16);
+    b = malloc(blen);
+    memcpy(b, fon_buf, blen);
+
+    m[0] = (struct zip_member){ "fonts/a.fon", a, alen, 1 };
+    m[1] = (struct zip_member){ "README.txt", b, 16, 0 };
+    m[2] = (struct zip_member){ "B.FON", b, blen, 0 };
+    m[3] = (struct zip_member){ "bad.fon", (const uint8_t *)"MZ", 2, 0 };
+    zlen = build_zip(zip_buf, m, 4);
+
+    /* Entries load in parallel, and again on their own. */
+    ar = winfont_archive_read_memory(zip_buf, zlen, 0);
+    if (!ar || winfont_archive_count(ar) != 3 ||
+        strcmp(winfont_archive_name(ar, 0), "fonts/a.fon") ||
+        strcmp(winfont_archive_name(ar, 1), "B.FON") ||
+        winfont_archive_load(ar, 3) != 2)
+        return 1;
+    failed |= check_font(winfont_archive_font(ar, 0), w, h);
+    failed |= check_font(winfont_archive_font(ar, 1), 8, 16);
+    if (winfont_archive_font(ar, 2) != NULL ||
+        winfont_last_error() != WinFont_ErrFormat)
+        failed = 1;
+    winfont_archive_free(ar);
+
+    /* Lazy, and nothing loaded until asked for. */
+    ar = winfont_archive_read_memory(zip_buf, zlen, WINFONT_LAZY);
+    wf = ar ? winfont_archive_font(ar, 0) : NULL;
+    failed |= !wf || lazy_reader(wf) != NULL;
+    winfont_archive_free(ar);
+
+    if (have_zlib) {
+        /* A damaged deflate stream is caught by its CRC at the latest. */
+        zip_buf[30 + strlen(m[0].name) + 4 + 20] ^= 0x55;
+        ar = winfont_archive_read_memory(zip_buf, zlen, 0);
+        if (!ar || winfont_archive_font(ar, 0) != NULL ||
+            winfont_last_error() != WinFont_ErrArchive ||
+            !winfont_archive_font(ar, 1))
+            failed = 1;
+        winfont_archive_free(ar);
+
+        /* gzip, named by its header. */
+        memset(zip_buf, 0, 16);
+        zip_buf[0] = 0x1f;
+        zip_buf[1] = 0x8b;
+        zip_buf[2] = 8;
+        zip_buf[3] = 8;
+        strcpy((char *)zip_buf + 10, "x.fon");
+        n = deflate_raw(zip_buf + 16, FON_MAX - 24, a, alen);
+        put32(zip_buf + 16 + n, zip_crc(a, alen));
+        put32(zip_buf + 20 + n, alen);
+        if (!mkdtemp(dir))
+            return 1;
+        snprintf(path, sizeof(path), "%s/a.fon.gz", dir);
+        failed |= write_file(path, zip_buf, n + 24);
+        ar = winfont_archive_open(path, 0);
+        if (!ar || winfont_archive_count(ar) != 1 ||
+            strcmp(winfont_archive_name(ar, 0), "x.fon"))
+            failed = 1;
+        else
+            failed |= check_font(winfont_archive_font(ar, 0), w, h);
+        winfont_archive_free(ar);
+        unlink(path);
+        rmdir(dir);
+    }
+
+    if (winfont_archive_read_memory(b, blen, 0) != NULL ||
+        winfont_last_error() != WinFont_ErrArchive)
+        failed = 1;
+
+    free(a);
+    free(b);
+    return failed;
+}
+
+struct counts {
+    int allocs, frees;
+};
+
+static void *
+count_alloc(void *ctx, size_t size)
+{
+    ((struct counts *)ctx)->allocs++;
+    return malloc(size);
+}
+
+static void
+count_free(void *ctx, void *ptr)
+{
+    ((struct counts *)ctx)->frees++;
+    free(ptr);
+}
+
+/* Eager, lazy, borrowed and scaled fonts are each one allocation. */
+static int
+test_alloc(int version, int w, int h)
+{
+    struct counts n = { 0, 0 };
+    WinFont_Allocator a = { count_alloc, count_free, &n };
+    static const int flags[] = { 0, WINFONT_LAZY };
+    size_t len;
+    WinFont *wf, *sf;
+    int failed = 0;
+
+    len = build_fon(fon_buf, version, w, h);
+    for (int i = 0; i < 2; i++) {
+        wf = winfont_read_memory_alloc(fon_buf, len, flags[i], &a);
+        if (!wf || n.allocs != 1)
+            return 1;
+        /* Scaling decodes every glyph of a lazy font. */
+        sf = winfont_scale(wf, 2);
+        if (!sf || n.allocs != 2)
+            failed = 1;
+        failed |= check_font(wf, w, h);
+        winfont_free(sf);
+        winfont_free(wf);
+        if (n.frees != n.allocs)
+            failed = 1;
+        n.allocs = n.frees = 0;
+    }
+
+    return failed;
+}
+
+static int
+test_pool(int version, int w, int h)
+{
+    WinFont *fonts[64];
+    WinFontPool *pool;
+    WinFont_Allocator a;
+    size_t len;
+    int failed = 0;
+
+    pool = winfont_pool_new(4096);
+    if (!pool)
+        return 1;
+    a = winfont_pool_allocator(pool);
+
+    len = build_fon(fon_buf, version, w, h);
+    for (int i = 0; i < 64; i++) {
+        fonts[i] = winfont_read_memory_alloc(fon_buf, len,
+            i % 2 ? WINFONT_LAZY : 0, &a);
+        if (!fonts[i] || (i % 2 ? lazy_reader(fonts[i]) != NULL :
+                check_font(fonts[i], w, h)))
+            failed = 1;
+    }
+    /* Free out of order, so slabs empty in the middle of the list. */
+    for (int i = 0; i < 64; i += 2)
+        winfont_free(fonts[i]);
+    for (int i = 1; i < 64; i += 2)
+        winfont_free(fonts[i]);
+
+    winfont_pool_free(pool);
+    return failed;
+}
+
+struct share {
+    WinFontGlyphStore *st;
+    WinFont *wf;
+    WinFont *shared;
+};
+
+static void *
+share_font(void *arg)
+{
+    struct share *sh = arg;
+
+    sh->shared = winfont_store_share(sh->st, sh->wf);
+    return NULL;
+}
+
+static int
+test_store(int version, int w, int h)
+{
+    size_t gbytes = (size_t)(w + 7) / 8 * h;
+    struct share sh[4];
+    pthread_t threads[4];
+    WinFont_StoreStats stats;
+    WinFontGlyphStore *st;
+    WinFont *wf, *lf, *tall, *tf;
+    size_t len;
+    int failed = 0;
+
+    len = build_fon(fon_buf, version, w, h);
+    wf = winfont_read_memory(fon_buf, len);
+    lf = winfont_read_memory_flags(fon_buf, len, WINFONT_LAZY);
+    st = winfont_store_new();
+    if (!wf || !lf || !st)
+        return 1;
+
+    /* The same glyphs shared from four threads, two of them from a
+     * lazy font, are stored once. */
+    for (int i = 0; i < 4; i++) {
+        sh[i] = (struct share){ st, i % 2 ? lf : wf, NULL };
+        pthread_create(&threads[i], NULL, share_font, &sh[i]);
+    }
+    for (int i = 0; i < 4; i++) {
+        pthread_join(threads[i], NULL);
+        if (!sh[i].shared || sh[i].shared->bitmap ||
+                lazy_reader(sh[i].shared))
+            failed = 1;
+    }
+    winfont_free(wf);
+    winfont_free(lf);
+
+    if (winfont_store_stats(st, &stats) == -1 ||
+            stats.glyphs != 4 * 256 || stats.unique != 256 ||
+            stats.bytes != 4 * 256 * gbytes ||
+            stats.stored != 256 * gbytes ||
+            stats.saved != 3 * 256 * gbytes || stats.ratio != 4.0)
+        failed = 1;
+
+    /* A taller face has glyphs of its own. */
+    len = build_fon(fon_buf, version, w, h + 1);
+    tall = winfont_read_memory(fon_buf, len);
+    tf = tall ? winfont_store_share(st, tall) : NULL;
+    winfont_free(tall);
+    if (!tf || winfont_store_stats(st, &stats) == -1 ||
+            stats.glyphs != 5 * 256 || stats.unique != 2 * 256)
+        failed = 1;
+
+    /* A glyph goes with its last font, the store with the last of
+     * them all. */
+    winfont_free(tf);
+    winfont_free(sh[0].shared);
+    winfont_free(sh[1].shared);
+    winfont_store_stats(st, &stats);
+    if (stats.glyphs != 2 * 256 || stats.unique != 256)
+        failed = 1;
+    winfont_store_free(st);
+    if (lazy_reader(sh[2].shared))
+        failed = 1;
+    winfont_free(sh[2].shared);
+    winfont_free(sh[3].shared);
+
+    return failed;
+}
+
+static struct {
+    const char *name;
+    int (*fn)(int version, int w, int h);
+    int version, w, h;
+} font_cases[] = {
+    { "Memory v2 8x8", test_read_memory, 0x200, 8, 8, },
+    { "Memory v3 8x16", test_read_memory, 0x300, 8, 16, },
+    { "Memory v2 12x20", test_read_memory, 0x200, 12, 20, },
+    { "Memory v3 16x32", test_read_memory, 0x300, 16, 32, },
+    { "Memory v3 20x24", test_read_memory, 0x300, 20, 24, },
+    { "Memory v2 16x40", test_read_memory, 0x200, 16, 40, },
+    { "Memory v3 32x20", test_read_memory, 0x300, 32, 20, },
+    { "File v2 8x16", test_read_file, 0x200, 8, 16, },
+    { "File v3 16x32", test_read_file, 0x300, 16, 32, },
+    { "Collection", test_collection, 0, 0, 0, },
+    { "Scan v3 8x16", test_scan, 0x300, 8, 16, },
+    { "Cache v2 8x16", test_cache, 0x200, 8, 16, },
+    { "Cache v3 20x24", test_cache, 0x300, 20, 24, },
+    { "Lazy v2 16x16", test_lazy, 0x200, 16, 16, },
+    { "Lazy v3 24x32", test_lazy, 0x300, 24, 32, },
+    { "Concurrent", test_concurrent, 0, 0, 0, },
+    { "Alloc v3 16x32", test_alloc, 0x300, 16, 32, },
+    { "Alloc v2 8x16", test_alloc, 0x200, 8, 16, },
+    { "Pool v3 12x20", test_pool, 0x300, 12, 20, },
+    { "Store v3 16x32", test_store, 0x300, 16, 32, },
+    { "Store v2 8x16", test_store, 0x200, 8, 16, },
+    { "Errors v2 8x16", test_errors, 0x200, 8, 16, },
+    { "Errors v3 16x32", test_errors, 0x300, 16, 32, },
+    { "Loader", test_loader, 0, 0, 0, },
+    { "Bulk v3 16x32", test_bulk, 0x300, 16, 32, },
+    { "Bulk v2 12x20", test_bulk, 0x200, 12, 20, },
+    { "Stream v3 16x32", test_stream, 0x300, 16, 32, },
+    { "Stream v2 12x20", test_stream, 0x200, 12, 20, },
+    { "Archive v3 16x32", test_archive, 0x300, 16, 32, },
+    { "Archive v2 12x20", test_archive, 0x200, 12, 20, },
+    { "Proportional v2 8x12", test_proportional, 0x200, 8, 12, },
+    { "Proportional v3 20x16", test_proportional, 0x300, 20, 16, },
+    { "Layouts v3 20x16", test_layouts, 0x300, 20, 16, },
+    { "Layout v2 8x16", test_layout, 0x200, 8, 16, },
+    { "Layout v3 12x20", test_layout, 0x300, 12, 20, },
+    { "Layouts v2 8x8", test_layouts, 0x200, 8, 8, },
+    { "Expand kernels", test_expand_kernels, 0, 0, 0, },
+    { "Unicode v2 8x16", test_unicode, 0x200, 8, 16, },
+    { "Unicode v3 12x20", test_unicode, 0x300, 12, 20, },
+    { "Atlas v3 12x20", test_atlas, 0x300, 12, 20, },
+    { "Atlas v2 8x8", test_atlas, 0x200, 8, 8, },
+    { "Draw v2 8x16", test_draw, 0x200, 8, 16, },
+    { "Draw v3 16x32", test_draw, 0x300, 16, 32, },
+    { "Draw v3 12x20", test_draw, 0x300, 12, 20, },
+    { "Screen v2 8x16", test_screen, 0x200, 8, 16, },
+    { "Scale v2 8x16", test_scale, 0x200, 8, 16, },
+    { "Scale v3 20x12", test_scale, 0x300, 20, 12, },
+    { "Style v2 8x16", test_style, 0x200, 8, 16, },
+    { "Style v3 16x32", test_style, 0x300, 16, 32, },
+    { "Style v3 12x20", test_style, 0x300, 12, 20, },
+    { "Export v2 8x16", test_export, 0x200, 8, 16, },
+    { "Export v3 12x20", test_export, 0x300, 12, 20, },
+};
+
 int
 main(int argc, char **argv)
 {
     const char *name, *input, *expect;
-    int test_count, failed, fail_count = 0;
+    int test_count, font_count, failed, fail_count = 0;
 
     test_count = sizeof(test_cases) / sizeof(test_cases[0]);
 
@@ -36,7 +2627,19 @@ main(int argc, char **argv)
             fprintf(stderr, "[%s] %s\n", "pass", test_cases[i].name);
     }
 
+    font_count = sizeof(font_cases) / sizeof(font_cases[0]);
+
+    for (int i = 0; i < font_count; i++) {
+        failed = font_cases[i].fn(font_cases[i].version,
+            font_cases[i].w, font_cases[i].h);
+        fprintf(stderr, "[%s] %s\n", failed ? "fail" : "pass",
+            font_cases[i].name);
+        if (failed)
+            fail_count++;
+    }
+    test_count += font_count;
+
     fprintf(stderr, "\nRan %d tests, %d failures\n", test_count, fail_count);
 
-    return 0;
+    return fail_count != 0;
 }
@@ -0,0 +1 @@
+#define WINFONT_VERSION "0.0.1"
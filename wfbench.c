@@ -0,0 +1,861 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 Eddie Hillenbrand
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+/* Benchmarks for the library's hot paths, run on synthetic fonts from
+ * fongen. Every benchmark is timed over SAMPLES samples, each a batch
+ * of calls long enough to time well, and reported as the min, median
+ * and 99th percentile time per call. */
+
+#include <winfont.h>
+#include "winfont_private.h"
+#include "fongen.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define SAMPLES     101
+#define MIN_SAMPLE  100e-6      /* seconds a sample takes at least */
+#define MAX_RESULTS 256
+#define IO_FILES    512         /* files in the I/O benchmarks */
+
+static const char *isa_names[] = {
+    [WF_ISA_SCALAR] = "scalar",
+    [WF_ISA_SSE2] = "sse2",
+    [WF_ISA_AVX2] = "avx2",
+};
+
+/* The fonts benchmarked when none is given on the command line. */
+static const struct fongen_face default_faces[] = {
+    { 0x200, 8, 16, 256, 0 },
+    { 0x300, 16, 32, 256, 0 },
+    { 0x300, 16, 24, 256, 1 },
+};
+
+struct result {
+    char name[64];
+    double min, median, p99;    /* seconds per call */
+    double bytes;               /* per call, 0 if not a throughput */
+};
+
+static struct result results[MAX_RESULTS];
+static int nresults;
+
+static const char *sample_text =
+    "The quick brown fox jumps over the lazy dog. 0123456789 !@#$%^&*()";
+
+static void
+usage()
+{
+    (void)fprintf(stderr,
+        "usage: %s [-j] [-v version] [-w width] [-h height] [-n chars]\n"
+        "       [-f faces] [-p] [-g fontpath] [-d iodir]\n",
+        getprogname());
+}
+
+static double
+now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int
+cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+/* Time fn(arg) and record it as name. The batch size is doubled until
+ * a batch takes MIN_SAMPLE, which also warms up caches. With prep,
+ * every sample is one call after an untimed prep(arg) instead. */
+static void
+bench_prep(const char *name, double bytes, void (*fn)(void *),
+    void (*prep)(void *), void *arg)
+{
+    double t[SAMPLES], start, elapsed;
+    struct result *res;
+    long batch = 1;
+
+    for (; !prep;) {
+        start = now();
+        for (long i = 0; i < batch; i++)
+            fn(arg);
+        elapsed = now() - start;
+        if (elapsed >= MIN_SAMPLE || batch >= 1L << 24)
+            break;
+        batch *= 2;
+    }
+
+    for (int s = 0; s < SAMPLES; s++) {
+        if (prep)
+            prep(arg);
+        start = now();
+        for (long i = 0; i < batch; i++)
+            fn(arg);
+        t[s] = (now() - start) / batch;
+    }
+    qsort(t, SAMPLES, sizeof(double), cmp_double);
+
+    if (nresults == MAX_RESULTS)
+        return;
+    res = &results[nresults++];
+    snprintf(res->name, sizeof(res->name), "%s", name);
+    res->min = t[0];
+    res->median = t[SAMPLES / 2];
+    res->p99 = t[(SAMPLES - 1) * 99 / 100];
+    res->bytes = bytes;
+}
+
+static void
+bench(const char *name, double bytes, void (*fn)(void *), void *arg)
+{
+    bench_prep(name, bytes, fn, NULL, arg);
+}
+
+static void *
+xmalloc(size_t n)
+{
+    void *p = malloc(n ? n : 1);
+
+    if (!p) {
+        fprintf(stderr, "OOM\n");
+        exit(1);
+    }
+    return p;
+}
+
+static void
+face_name(char *buf, size_t sz, const struct fongen_face *f)
+{
+    snprintf(buf, sz, "v%d-%dx%d%s", f->version >> 8, f->w, f->h,
+        f->prop ? "p" : "");
+}
+
+/* Loading */
+
+struct load_arg {
+    const uint8_t *buf;
+    size_t len;
+    const char *path;
+    int flags;
+};
+
+static void
+run_load(void *arg)
+{
+    struct load_arg *a = arg;
+    WinFont *wf;
+
+    wf = a->path ? winfont_open_mmap_flags(a->path, a->flags) :
+        winfont_read_memory_flags(a->buf, a->len, a->flags);
+    if (!wf) {
+        fprintf(stderr, "Unable to load font\n");
+        exit(1);
+    }
+    winfont_free(wf);
+}
+
+/* Open a collection and load every face. */
+static void
+run_collection(void *arg)
+{
+    struct load_arg *a = arg;
+    WinFontCollection *wc;
+
+    wc = winfont_collection_read_memory(a->buf, a->len);
+    if (!wc) {
+        fprintf(stderr, "Unable to load collection\n");
+        exit(1);
+    }
+    for (int i = 0; i < wc->nfaces; i++)
+        winfont_collection_face(wc, i);
+    winfont_collection_free(wc);
+}
+
+/* Glyph access */
+
+struct glyph_arg {
+    WinFont *wf;
+    uint8_t *buf;
+    size_t sz;
+    WinFont_Layout layout;
+};
+
+/* Get every glyph of the font once. */
+static void
+run_glyphs(void *arg)
+{
+    struct glyph_arg *a = arg;
+
+    for (int g = 0; g < a->wf->nglyphs; g++)
+        if (!winfont_glyph_get(a->wf, g, a->layout, a->buf, a->sz))
+            exit(1);
+}
+
+/* Drawing */
+
+struct draw_arg {
+    WinFont *wf;
+    WinFont_Framebuffer fb;
+    WinFont_AtlasFormat format;
+    size_t sz;
+};
+
+static void
+run_string(void *arg)
+{
+    struct draw_arg *a = arg;
+
+    winfont_draw_string(a->wf, &a->fb, 0, 0, 1, 0, WinFont_DrawOpaque,
+        sample_text, strlen(sample_text));
+}
+
+static void
+run_atlas(void *arg)
+{
+    struct draw_arg *a = arg;
+
+    winfont_atlas_free(winfont_build_atlas(a->wf, a->format, 0, 1,
+        a->fb.pixels, a->sz));
+}
+
+/* Styles: deriving a styled copy, once per font. */
+
+struct style_arg {
+    WinFont *wf;
+    int style;
+};
+
+static void
+run_style(void *arg)
+{
+    struct style_arg *a = arg;
+
+    winfont_free(winfont_derive_style(a->wf, a->style));
+}
+
+/* Text: UTF-8 to glyphs against copying it, measuring and wrapping. */
+
+#define UTF8_LEN 4096
+
+struct text_arg {
+    WinFont *wf;
+    char *text;
+    uint16_t *glyphs;
+};
+
+static void
+run_utf8(void *arg)
+{
+    struct text_arg *a = arg;
+
+    winfont_glyphs_utf8(a->wf, a->text, UTF8_LEN, a->glyphs);
+}
+
+static void
+run_memcpy(void *arg)
+{
+    struct text_arg *a = arg;
+
+    memcpy(a->glyphs, a->text, UTF8_LEN);
+}
+
+static void
+run_measure(void *arg)
+{
+    struct text_arg *a = arg;
+
+    winfont_measure(a->wf, a->text, UTF8_LEN, NULL);
+}
+
+/* Into 80 column lines. */
+static void
+run_wrap(void *arg)
+{
+    struct text_arg *a = arg;
+
+    winfont_wrap(a->wf, a->text, UTF8_LEN, 80 * a->wf->width, NULL, 0);
+}
+
+/* Kernels */
+
+struct kernel_arg {
+    int isa, wbytes, w, h, n, s;
+    uint8_t *src, *dst;
+};
+
+static void
+run_transpose(void *arg)
+{
+    struct kernel_arg *a = arg;
+
+    winfont_transpose_bitmap_isa(a->isa, a->dst, a->src, a->wbytes, a->h,
+        a->n);
+}
+
+static void
+run_bold(void *arg)
+{
+    struct kernel_arg *a = arg;
+    size_t n = (size_t)a->wbytes * a->h * a->n;
+
+    if (a->w == 8)
+        winfont_bold_bytes_isa(a->isa, a->dst, a->src, n);
+    else
+        winfont_bold_bits_isa(a->isa, a->dst, a->src, n);
+}
+
+/* Scale the rows of every glyph of a 16 pixel wide font by s. */
+static void
+run_scale(void *arg)
+{
+    struct kernel_arg *a = arg;
+    int srcbytes = a->wbytes * a->h;
+
+    for (int g = 0; g < a->n; g++)
+        winfont_scale_rows_isa(a->isa, a->dst, (a->w * a->s + 7) / 8,
+            a->src + srcbytes * g, a->w, a->h, a->s);
+}
+
+static void
+bench_face(const struct fongen_face *face, int nfaces)
+{
+    struct fongen_face *faces;
+    struct load_arg la = { NULL, 0, NULL, 0 };
+    struct glyph_arg ga;
+    struct draw_arg da;
+    struct text_arg ua;
+    struct style_arg sa;
+    char fname[32], name[64], path[] = "/tmp/wfbench-XXXXXX";
+    size_t bmbytes, maxglyph = 0;
+    uint8_t *buf;
+    WinFont *wf;
+    int fd;
+
+    face_name(fname, sizeof(fname), face);
+    faces = xmalloc(nfaces * sizeof(*faces));
+    for (int i = 0; i < nfaces; i++)
+        faces[i] = *face;
+
+    la.len = fongen_size(1, face);
+    if (!la.len) {
+        fprintf(stderr, "Can not generate %s\n", fname);
+        exit(1);
+    }
+    buf = xmalloc(la.len);
+    la.buf = buf;
+    fongen_build(buf, 1, face);
+
+    wf = winfont_read_memory(la.buf, la.len);
+    if (!wf) {
+        fprintf(stderr, "Unable to load %s\n", fname);
+        exit(1);
+    }
+    bmbytes = wf->_bmbytes;
+
+    snprintf(name, sizeof(name), "load/%s", fname);
+    bench(name, bmbytes, run_load, &la);
+    la.flags = WINFONT_LAZY;
+    snprintf(name, sizeof(name), "load-lazy/%s", fname);
+    bench(name, 0, run_load, &la);
+    la.flags = 0;
+
+    fd = mkstemp(path);
+    if (fd != -1) {
+        close(fd);
+        if (fongen_write(path, 1, face) == 0) {
+            la.path = path;
+            snprintf(name, sizeof(name), "open/%s", fname);
+            bench(name, bmbytes, run_load, &la);
+            la.path = NULL;
+        }
+        unlink(path);
+    }
+
+    if (nfaces > 1) {
+        struct load_arg ca = { NULL, 0, NULL, 0 };
+        uint8_t *cbuf;
+
+        ca.len = fongen_size(nfaces, faces);
+        if (ca.len) {
+            cbuf = xmalloc(ca.len);
+            fongen_build(cbuf, nfaces, faces);
+            ca.buf = cbuf;
+            snprintf(name, sizeof(name), "collection/%s/%d", fname, nfaces);
+            bench(name, bmbytes * nfaces, run_collection, &ca);
+            free(cbuf);
+        }
+    }
+
+    for (int g = 0; g < wf->nglyphs; g++) {
+        size_t sz = winfont_glyph_layout_size(wf, g, WinFont_Layout8bpp);
+        if (sz > maxglyph)
+            maxglyph = sz;
+    }
+    ga.wf = wf;
+    ga.buf = xmalloc(maxglyph);
+    ga.sz = maxglyph;
+    ga.layout = WinFont_LayoutRowMSB;
+    snprintf(name, sizeof(name), "glyph/%s", fname);
+    bench(name, 0, run_glyphs, &ga);
+    ga.layout = WinFont_Layout8bpp;
+    snprintf(name, sizeof(name), "glyph-8bpp/%s", fname);
+    bench(name, 0, run_glyphs, &ga);
+    ga.layout = WinFont_LayoutRowMSB;
+    ga.wf = winfont_read_memory_flags(la.buf, la.len, WINFONT_LAZY);
+    if (ga.wf) {
+        snprintf(name, sizeof(name), "glyph-lazy/%s", fname);
+        bench(name, 0, run_glyphs, &ga);
+        winfont_free(ga.wf);
+    }
+    free(ga.buf);
+
+    da.wf = wf;
+    da.fb.width = wf->width * strlen(sample_text);
+    da.fb.height = wf->height;
+    for (int bpp = 1; bpp <= 4; bpp *= 4) {
+        da.fb.format = bpp;
+        da.fb.stride = da.fb.width * bpp;
+        da.fb.pixels = xmalloc((size_t)da.fb.stride * da.fb.height);
+        snprintf(name, sizeof(name), "string/%s/%dbpp", fname, 8 * bpp);
+        bench(name, (double)da.fb.stride * da.fb.height, run_string, &da);
+        free(da.fb.pixels);
+    }
+
+    sa.wf = wf;
+    sa.style = WINFONT_BOLD;
+    snprintf(name, sizeof(name), "style/%s/bold", fname);
+    bench(name, bmbytes, run_style, &sa);
+    sa.style = WINFONT_BOLD | WINFONT_ITALIC | WINFONT_UNDERLINE;
+    snprintf(name, sizeof(name), "style/%s/all", fname);
+    bench(name, bmbytes, run_style, &sa);
+
+    /* Drawn from a bold copy, against the regular string above. */
+    da.wf = winfont_derive_style(wf, WINFONT_BOLD);
+    if (da.wf) {
+        da.fb.format = WinFont_Pixel8;
+        da.fb.width = da.wf->width * strlen(sample_text);
+        da.fb.stride = da.fb.width;
+        da.fb.pixels = xmalloc((size_t)da.fb.stride * da.fb.height);
+        snprintf(name, sizeof(name), "string/%s/8bpp-bold", fname);
+        bench(name, (double)da.fb.stride * da.fb.height, run_string, &da);
+        free(da.fb.pixels);
+        winfont_free(da.wf);
+    }
+    da.wf = wf;
+
+    /* Plain ASCII, then with an e acute in every 16 bytes. */
+    ua.wf = wf;
+    ua.text = xmalloc(UTF8_LEN);
+    ua.glyphs = xmalloc(UTF8_LEN * sizeof(uint16_t));
+    for (size_t i = 0; i < UTF8_LEN; i++)
+        ua.text[i] = sample_text[i % strlen(sample_text)];
+    snprintf(name, sizeof(name), "utf8/%s/memcpy", fname);
+    bench(name, UTF8_LEN, run_memcpy, &ua);
+    snprintf(name, sizeof(name), "utf8/%s/ascii", fname);
+    bench(name, UTF8_LEN, run_utf8, &ua);
+    snprintf(name, sizeof(name), "measure/%s", fname);
+    bench(name, UTF8_LEN, run_measure, &ua);
+    snprintf(name, sizeof(name), "wrap/%s", fname);
+    bench(name, UTF8_LEN, run_wrap, &ua);
+    for (size_t i = 14; i < UTF8_LEN; i += 16)
+        memcpy(ua.text + i, "\xC3\xA9", 2);
+    snprintf(name, sizeof(name), "utf8/%s/mixed", fname);
+    bench(name, UTF8_LEN, run_utf8, &ua);
+    free(ua.text);
+    free(ua.glyphs);
+
+    for (int f = WinFont_AtlasA8; f <= WinFont_AtlasRGBA8888; f++) {
+        da.format = f;
+        da.sz = winfont_atlas_required_size(wf, f, 0, 1);
+        da.fb.pixels = xmalloc(da.sz);
+        snprintf(name, sizeof(name), "atlas/%s/%s", fname,
+            f == WinFont_AtlasA8 ? "a8" : "rgba");
+        bench(name, da.sz, run_atlas, &da);
+        free(da.fb.pixels);
+    }
+
+    winfont_free(wf);
+    free(buf);
+    free(faces);
+}
+
+/* The decoding and scaling kernels, on every ISA this CPU has. */
+static void
+bench_kernels(void)
+{
+    static const struct { int w, h; } sizes[] = {
+        { 8, 8 },
+        { 8, 16 },
+        { 16, 32 },
+    };
+    int best = winfont_cpu_isa();
+    struct kernel_arg ka;
+    size_t bytes;
+    char name[64];
+
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        ka.wbytes = (sizes[i].w + 7) / 8;
+        ka.h = sizes[i].h;
+        ka.n = 256;
+        bytes = (size_t)ka.wbytes * ka.h * ka.n;
+        ka.src = xmalloc(bytes);
+        ka.dst = xmalloc(bytes);
+        for (size_t k = 0; k < bytes; k++)
+            ka.src[k] = (uint8_t)(k * 7 + 1);
+        for (ka.isa = WF_ISA_SCALAR; ka.isa <= best; ka.isa++) {
+            snprintf(name, sizeof(name), "decode/%dx%d/%s",
+                sizes[i].w, sizes[i].h, isa_names[ka.isa]);
+            bench(name, bytes, run_transpose, &ka);
+        }
+        free(ka.src);
+        free(ka.dst);
+    }
+
+    /* Emboldening 256 glyphs: eight pixel rows grow a byte, twelve
+     * pixel rows keep theirs. */
+    for (ka.w = 8; ka.w <= 12; ka.w += 4) {
+        ka.wbytes = (ka.w + 7) / 8;
+        ka.h = ka.w == 8 ? 16 : 20;
+        ka.n = 256;
+        bytes = (size_t)ka.wbytes * ka.h * ka.n;
+        ka.src = xmalloc(bytes);
+        ka.dst = xmalloc(2 * bytes);
+        for (size_t k = 0; k < bytes; k++)
+            ka.src[k] = (uint8_t)(k * 7 + 1) & (ka.w == 8 ? 0xFF : 0xF0);
+        for (ka.isa = WF_ISA_SCALAR; ka.isa <= best; ka.isa++) {
+            snprintf(name, sizeof(name), "bold/%dx%d/%s", ka.w, ka.h,
+                isa_names[ka.isa]);
+            bench(name, bytes, run_bold, &ka);
+        }
+        free(ka.src);
+        free(ka.dst);
+    }
+
+    ka.w = 16;
+    ka.wbytes = 2;
+    ka.h = 32;
+    ka.n = 256;
+    ka.src = xmalloc((size_t)ka.wbytes * ka.h * ka.n);
+    ka.dst = xmalloc((16 * 4 + 7) / 8 * 32);
+    for (size_t k = 0; k < (size_t)ka.wbytes * ka.h * ka.n; k++)
+        ka.src[k] = (uint8_t)(k * 7 + 1);
+    for (ka.s = 2; ka.s <= 4; ka.s++) {
+        for (ka.isa = WF_ISA_SCALAR; ka.isa <= best; ka.isa++) {
+            snprintf(name, sizeof(name), "scale/16x32/%dx/%s", ka.s,
+                isa_names[ka.isa]);
+            bench(name, (double)(16 * ka.s + 7) / 8 * 32 * ka.n,
+                run_scale, &ka);
+        }
+    }
+    free(ka.src);
+    free(ka.dst);
+}
+
+/* File I/O: IO_FILES fonts read one after another with stdio, the way
+ * winfont_read_file does, against winfont_bulk_read with each backend,
+ * from the page cache and from disk. */
+
+struct io_arg {
+    char **paths;
+    int npaths;
+    int backend;
+    int header_only;
+};
+
+static void
+run_stdio(void *arg)
+{
+    struct io_arg *a = arg;
+    WinFont *wf;
+    FILE *f;
+
+    for (int i = 0; i < a->npaths; i++) {
+        f = fopen(a->paths[i], "rb");
+        if (!f || !(wf = winfont_read_file(f))) {
+            fprintf(stderr, "Unable to load %s\n", a->paths[i]);
+            exit(1);
+        }
+        winfont_free(wf);
+        fclose(f);
+    }
+}
+
+static void
+run_scan(void *arg)
+{
+    struct io_arg *a = arg;
+    WinFont_FaceInfo fi;
+
+    for (int i = 0; i < a->npaths; i++)
+        if (winfont_scan_path(a->paths[i], &fi, 1) < 1)
+            exit(1);
+}
+
+static void
+bulk_done(void *ctx, int i, uint8_t *buf, size_t len, WinFont_Error err)
+{
+    struct io_arg *a = ctx;
+    WinFont_FaceInfo fi;
+
+    if (!buf) {
+        fprintf(stderr, "%s: %s\n", a->paths[i], winfont_strerror(err));
+        exit(1);
+    }
+    if (a->header_only) {
+        if (winfont_scan_memory(buf, len, &fi, 1) < 1)
+            exit(1);
+        free(buf);
+    } else {
+        winfont_free(winfont_read_buffer(buf, len, 0));
+    }
+}
+
+static void
+run_bulk(void *arg)
+{
+    struct io_arg *a = arg;
+
+    winfont_bulk_read(a->paths, a->npaths, a->header_only, a->backend, 1,
+        bulk_done, a);
+}
+
+/* Evict the files from the page cache, which works for clean pages of
+ * files on a disk but not on tmpfs. */
+static void
+drop_cache(void *arg)
+{
+    struct io_arg *a = arg;
+    int fd;
+
+    for (int i = 0; i < a->npaths; i++) {
+        fd = open(a->paths[i], O_RDONLY);
+        if (fd != -1) {
+            posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+            close(fd);
+        }
+    }
+}
+
+static void
+bench_io(const char *dir)
+{
+    static const char *backends[] = {
+        [WF_IO_PREAD] = "pread",
+        [WF_IO_URING] = "uring",
+    };
+    struct io_arg a = { NULL, 0, 0, 0 };
+    double bytes = 0;
+    char name[64];
+    int fd, nb;
+
+    a.paths = xmalloc(IO_FILES * sizeof(char *));
+    for (int i = 0; i < IO_FILES; i++) {
+        a.paths[i] = xmalloc(strlen(dir) + 32);
+        sprintf(a.paths[i], "%s/wfbench-%d-%d.fon", dir, (int)getpid(), i);
+        if (fongen_write(a.paths[i], 1, &default_faces[i % 3]) == -1) {
+            fprintf(stderr, "Unable to write: %s\n", a.paths[i]);
+            free(a.paths[i]);
+            goto out;
+        }
+        a.npaths++;
+        bytes += fongen_size(1, &default_faces[i % 3]);
+    }
+    /* Written back, so that their pages are clean and can be dropped. */
+    for (int i = 0; i < a.npaths; i++) {
+        fd = open(a.paths[i], O_RDONLY);
+        if (fd != -1) {
+            fsync(fd);
+            close(fd);
+        }
+    }
+
+    for (int cold = 0; cold <= 1; cold++) {
+        const char *cache = cold ? "cold" : "warm";
+        void (*prep)(void *) = cold ? drop_cache : NULL;
+
+        a.header_only = 0;
+        snprintf(name, sizeof(name), "io/load/stdio/%s", cache);
+        bench_prep(name, bytes, run_stdio, prep, &a);
+        for (a.backend = WF_IO_PREAD; a.backend <= WF_IO_URING;
+                a.backend++) {
+            nb = winfont_bulk_read(NULL, 0, 0, a.backend, 1, NULL, NULL);
+            if (nb != a.backend)
+                continue;
+            snprintf(name, sizeof(name), "io/load/%s/%s",
+                backends[a.backend], cache);
+            bench_prep(name, bytes, run_bulk, prep, &a);
+        }
+
+        a.header_only = 1;
+        snprintf(name, sizeof(name), "io/scan/mmap/%s", cache);
+        bench_prep(name, 0, run_scan, prep, &a);
+        for (a.backend = WF_IO_PREAD; a.backend <= WF_IO_URING;
+                a.backend++) {
+            nb = winfont_bulk_read(NULL, 0, 0, a.backend, 1, NULL, NULL);
+            if (nb != a.backend)
+                continue;
+            snprintf(name, sizeof(name), "io/scan/%s/%s",
+                backends[a.backend], cache);
+            bench_prep(name, 0, run_bulk, prep, &a);
+        }
+    }
+
+out:
+    for (int i = 0; i < a.npaths; i++) {
+        unlink(a.paths[i]);
+        free(a.paths[i]);
+    }
+    free(a.paths);
+}
+
+static void
+print_text(void)
+{
+    struct result *r;
+
+    printf("%-32s %12s %12s %12s %10s\n", "benchmark", "min ns",
+        "median ns", "p99 ns", "MB/s");
+    for (int i = 0; i < nresults; i++) {
+        r = &results[i];
+        printf("%-32s %12.0f %12.0f %12.0f", r->name, r->min * 1e9,
+            r->median * 1e9, r->p99 * 1e9);
+        if (r->bytes)
+            printf(" %10.1f", r->bytes / r->median / 1e6);
+        printf("\n");
+    }
+}
+
+/* One object per benchmark, times in nanoseconds per call. Names are
+ * plain ASCII, so need no escaping. */
+static void
+print_json(void)
+{
+    struct result *r;
+
+    printf("{\n  \"version\": \"%s\",\n  \"samples\": %d,\n"
+        "  \"unit\": \"ns\",\n  \"results\": [\n", winfont_version(),
+        SAMPLES);
+    for (int i = 0; i < nresults; i++) {
+        r = &results[i];
+        printf("    { \"name\": \"%s\", \"min\": %.1f, \"median\": %.1f, "
+            "\"p99\": %.1f", r->name, r->min * 1e9, r->median * 1e9,
+            r->p99 * 1e9);
+        if (r->bytes)
+            printf(", \"mb_per_s\": %.1f", r->bytes / r->median / 1e6);
+        printf(" }%s\n", i + 1 < nresults ? "," : "");
+    }
+    printf("  ]\n}\n");
+}
+
+static int
+number(const char *arg, int *n)
+{
+    if (sscanf(arg, "%d", n) != 1) {
+        fprintf(stderr, "expected number got %s\n", arg);
+        exit(1);
+    }
+    return 1;
+}
+
+int
+main(int argc, char **argv)
+{
+    struct fongen_face face = { 0x300, 8, 16, 256, 0 }, *faces;
+    int ch, jflag = 0, custom = 0, nfaces = 0, version;
+    const char *genpath = NULL, *iodir = "/tmp";
+
+    const char *opts = "d:f:g:h:jn:pv:w:";
+    while ((ch = getopt(argc, argv, opts)) != -1) {
+        switch (ch) {
+        case 'd':
+            /* Where the I/O benchmarks write their files, which should
+               be on a disk for the cold cache runs to mean anything. */
+            iodir = optarg;
+            break;
+        case 'f':
+            /* Faces in the generated file, 1 by default, and in the
+               collection benchmark, 4 by default. */
+            number(optarg, &nfaces);
+            break;
+        case 'g':
+            /* Write a synthetic font instead of benchmarking. */
+            genpath = optarg;
+            break;
+        case 'h':
+            custom = number(optarg, &face.h);
+            break;
+        case 'j':
+            /* JSON output. */
+            jflag = 1;
+            break;
+        case 'n':
+            custom = number(optarg, &face.nchars);
+            break;
+        case 'p':
+            custom = face.prop = 1;
+            break;
+        case 'v':
+            custom = number(optarg, &version);
+            face.version = version << 8;
+            break;
+        case 'w':
+            custom = number(optarg, &face.w);
+            break;
+        default:
+            usage();
+            exit(1);
+        }
+    }
+
+    if (nfaces < 0 || optind != argc) {
+        usage();
+        exit(1);
+    }
+
+    if (genpath) {
+        if (!nfaces)
+            nfaces = 1;
+        faces = xmalloc(nfaces * sizeof(*faces));
+        for (int i = 0; i < nfaces; i++)
+            faces[i] = face;
+        if (fongen_write(genpath, nfaces, faces) == -1) {
+            fprintf(stderr, "Unable to write: %s\n", genpath);
+            exit(1);
+        }
+        free(faces);
+        return 0;
+    }
+
+    if (!nfaces)
+        nfaces = 4;
+    if (custom) {
+        bench_face(&face, nfaces);
+    } else {
+        for (size_t i = 0; i < sizeof(default_faces) /
+                sizeof(default_faces[0]); i++)
+            bench_face(&default_faces[i], nfaces);
+    }
+    bench_kernels();
+    bench_io(iodir);
+
+    if (jflag)
+        print_json();
+    else
+        print_text();
+
+    return 0;
+}
@@ -30,40 +30,35 @@ static void
 winfont_render_all(WinFont *wf, SDL_Renderer *renderer)
 {
     int x = 0, y = 0;
-    int px = 0, py = 0;
-    uint8_t *gb;
+    const uint8_t *gb;
+    uint8_t *buf;
+    int w, h = wf->height;
 
     SDL_SetRenderDrawColor(renderer, 255, 255, 255, SDL_ALPHA_OPAQUE);
-    if (sflag)
-        (void)scale;
 
-    gb = wf->bitmap;
-    for (int g = 0; g < wf->nglyphs; g++) {
-        gb = wf->bitmap + (wf->wbytes * wf->height) * g;
+    /* Big enough for the widest glyph at one byte per pixel. */
+    buf = malloc((size_t)wf->width * h + 1);
+    if (!buf)
+        return;
 
+    for (int g = 0; g < wf->nglyphs; g++) {
         if ((g != 0) && ((g % ccol) == 0)) {
-            y += wf->height;
+            y += h;
             x = 0;
         }
 
-        px = x;
-        py = y;
-
-        for (int i = 0; i < wf->wbytes * wf->height; i ++) {
-            if (i != 0 && i % wf->wbytes == 0) {
-                py++;
-                px = x;
-            }
-            for (int b = 7; b >= 0; b--) {
-                if ((1 << b) & *gb)
-                    SDL_RenderDrawPoint(renderer, px, py);
-                px++;
-            }
-            gb++;
-        }
+        w = wf->widths[g];
+        gb = winfont_glyph_get(wf, g, WinFont_Layout8bpp, buf,
+            (size_t)wf->width * h + 1);
+        for (int py = 0; gb && py < h; py++)
+            for (int px = 0; px < w; px++)
+                if (gb[py * w + px])
+                    SDL_RenderDrawPoint(renderer, x + px, y + py);
 
-        x += wf->width;
+        x += w;
     }
+
+    free(buf);
 }
 
 int
@@ -116,6 +111,18 @@ main(int argc, char **argv)
 
     /* TODO: sanity checks */
 
+    if (sflag) {
+        WinFont *sf = winfont_scale(wf, scale);
+        if (sf == NULL) {
+            fprintf(stderr, "Unable to scale by %d\n", scale);
+            exit(1);
+        }
+        winfont_free(wf);
+        wf = sf;
+        winw *= scale;
+        winh *= scale;
+    }
+
     if (SDL_Init(SDL_INIT_VIDEO) < 0) {
         printf("Couldn't initialize SDL: %s\n", SDL_GetError());
         exit(1);
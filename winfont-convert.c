@@ -0,0 +1,267 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 Eddie Hillenbrand
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+/* Convert FON files to PSF2, BDF and PCF, on one thread per CPU. Each
+ * face of a file is written to its own file, named after the input
+ * and, in a file of several faces, the face's number. */
+
+#include <winfont.h>
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define FMT_PSF 0x1
+#define FMT_BDF 0x2
+#define FMT_PCF 0x4
+
+struct job {
+    char **paths;
+    int npaths;
+    int next;                   /* the next path to take */
+    int formats;
+    const char *outdir;
+    int failed;
+};
+
+static void
+usage(void)
+{
+    (void)fprintf(stderr,
+        "usage: %s [-f psf|bdf|pcf] [-j threads] [-o dir] fontpath ...\n",
+        getprogname());
+}
+
+/* path's file name without its extension, len bytes at *base. */
+static int
+path_stem(const char *path, const char **base)
+{
+    const char *dot;
+
+    *base = strrchr(path, '/');
+    *base = *base ? *base + 1 : path;
+    dot = strrchr(*base, '.');
+
+    return dot && dot != *base ? (int)(dot - *base) : (int)strlen(*base);
+}
+
+static int
+stem_cmp(const void *a, const void *b)
+{
+    const char *pa = *(char *const *)a, *pb = *(char *const *)b, *sa, *sb;
+    int la = path_stem(pa, &sa), lb = path_stem(pb, &sb);
+    int c = memcmp(sa, sb, la < lb ? la : lb);
+
+    return c ? c : la - lb;
+}
+
+/* Inputs with the same file name stem would be written to the same
+ * files by two threads at once, so refuse them before converting
+ * anything. */
+static int
+check_stems(char **paths, int n)
+{
+    const char *sa, *sb;
+    char **sorted;
+    int la, ret = 0;
+
+    sorted = malloc((n ? n : 1) * sizeof(char *));
+    if (!sorted) {
+        fprintf(stderr, "OOM\n");
+        return -1;
+    }
+    memcpy(sorted, paths, n * sizeof(char *));
+    qsort(sorted, n, sizeof(char *), stem_cmp);
+
+    for (int i = 1; i < n; i++) {
+        la = path_stem(sorted[i - 1], &sa);
+        if (la == path_stem(sorted[i], &sb) && !memcmp(sa, sb, la)) {
+            fprintf(stderr, "Same output name: %s and %s\n",
+                sorted[i - 1], sorted[i]);
+            ret = -1;
+        }
+    }
+
+    free(sorted);
+    return ret;
+}
+
+/* outdir/name-face.ext, where name is path's file name without its
+ * extension. */
+static void
+out_path(char *buf, size_t sz, const char *outdir, const char *path,
+    int face, int nfaces, const char *ext)
+{
+    const char *base;
+    int len = path_stem(path, &base);
+
+    if (nfaces > 1)
+        snprintf(buf, sz, "%s/%.*s-%d.%s", outdir, len, base, face, ext);
+    else
+        snprintf(buf, sz, "%s/%.*s.%s", outdir, len, base, ext);
+}
+
+static int
+write_face(struct job *jb, const char *path, WinFont *wf, int face,
+    int nfaces)
+{
+    char out[4096];
+    FILE *f;
+    int fd, err, ret = 0;
+
+    if (jb->formats & FMT_PSF) {
+        out_path(out, sizeof(out), jb->outdir, path, face, nfaces, "psf");
+        fd = open(out, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        err = fd == -1 || winfont_write_psf2(wf, fd) == -1;
+        if ((fd != -1 && close(fd)) || err) {
+            fprintf(stderr, "Unable to write: %s\n", out);
+            ret = -1;
+        }
+    }
+
+    for (int fmt = FMT_BDF; fmt <= FMT_PCF; fmt <<= 1) {
+        if (!(jb->formats & fmt))
+            continue;
+        out_path(out, sizeof(out), jb->outdir, path, face, nfaces,
+            fmt == FMT_BDF ? "bdf" : "pcf");
+        f = fopen(out, "wb");
+        err = !f || (fmt == FMT_BDF ? winfont_write_bdf(wf, f) :
+            winfont_write_pcf(wf, f)) == -1;
+        if ((f && fclose(f)) || err) {
+            fprintf(stderr, "Unable to write: %s\n", out);
+            ret = -1;
+        }
+    }
+
+    return ret;
+}
+
+static int
+convert(struct job *jb, const char *path)
+{
+    WinFontCollection *wc;
+    WinFont *wf;
+    int ret = 0;
+
+    wc = winfont_collection_open(path);
+    if (!wc) {
+        fprintf(stderr, "Unable to read: %s: %s\n", path,
+            winfont_strerror(winfont_last_error()));
+        return -1;
+    }
+
+    for (int i = 0; i < wc->nfaces; i++) {
+        wf = winfont_collection_face(wc, i);
+        if (!wf) {
+            fprintf(stderr, "Unable to read face %d: %s: %s\n", i, path,
+                winfont_strerror(winfont_last_error()));
+            ret = -1;
+            continue;
+        }
+        if (write_face(jb, path, wf, i, wc->nfaces) == -1)
+            ret = -1;
+    }
+
+    winfont_collection_free(wc);
+    return ret;
+}
+
+static void *
+worker(void *arg)
+{
+    struct job *jb = arg;
+    int i;
+
+    while ((i = __atomic_fetch_add(&jb->next, 1, __ATOMIC_RELAXED)) <
+            jb->npaths) {
+        if (convert(jb, jb->paths[i]) == -1)
+            __atomic_store_n(&jb->failed, 1, __ATOMIC_RELAXED);
+    }
+
+    return NULL;
+}
+
+int
+main(int argc, char **argv)
+{
+    struct job jb = { NULL, 0, 0, 0, ".", 0 };
+    pthread_t *threads;
+    int ch, nthreads = 0, started;
+
+    while ((ch = getopt(argc, argv, "f:j:o:")) != -1) {
+        switch (ch) {
+        case 'f':
+            /* Output formats, given once each. PSF2 by default. */
+            if (strcmp(optarg, "psf") == 0)
+                jb.formats |= FMT_PSF;
+            else if (strcmp(optarg, "bdf") == 0)
+                jb.formats |= FMT_BDF;
+            else if (strcmp(optarg, "pcf") == 0)
+                jb.formats |= FMT_PCF;
+            else {
+                usage();
+                exit(1);
+            }
+            break;
+        case 'j':
+            /* Threads to convert with, one per CPU if 0. */
+            if (sscanf(optarg, "%d", &nthreads) != 1 || nthreads < 0) {
+                fprintf(stderr, "expected number got %s\n", optarg);
+                exit(1);
+            }
+            break;
+        case 'o':
+            jb.outdir = optarg;
+            break;
+        default:
+            usage();
+            exit(1);
+        }
+    }
+
+    argc -= optind;
+    argv += optind;
+
+    if (argc == 0) {
+        usage();
+        exit(1);
+    }
+
+    if (check_stems(argv, argc) == -1)
+        exit(1);
+
+    jb.paths = argv;
+    jb.npaths = argc;
+    if (!jb.formats)
+        jb.formats = FMT_PSF;
+    if (nthreads == 0)
+        nthreads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (nthreads < 1)
+        nthreads = 1;
+    if (nthreads > argc)
+        nthreads = argc;
+
+    threads = malloc(nthreads * sizeof(pthread_t));
+    if (!threads) {
+        fprintf(stderr, "OOM\n");
+        exit(1);
+    }
+    for (started = 0; started < nthreads; started++)
+        if (pthread_create(&threads[started], NULL, worker, &jb))
+            break;
+    if (started == 0)
+        worker(&jb);
+    for (int i = 0; i < started; i++)
+        pthread_join(threads[i], NULL);
+
+    free(threads);
+    return jb.failed ? 1 : 0;
+}
@@ -2,13 +2,18 @@
  * independent implemtation. */
 
 #include <winfont.h>
+#include "winfont_private.h"
 
-#include <math.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #define PACKED __attribute__((__packed__))
 
@@ -55,6 +60,24 @@ typedef struct PACKED {
     BYTE  _pad2[10];
 } ResEntry;
 
+/* ResEntry above is really a TYPEINFO followed by its first NAMEINFO.
+ * A type with reCount > 1 is followed by reCount NAMEINFO entries, so
+ * walking the table properly needs the two halves separately. */
+typedef struct PACKED {
+    WORD  reType;
+    WORD  reCount;
+    DWORD _pad;
+} ResTypeInfo;
+
+typedef struct PACKED {
+    WORD  reOffset;             /* shifted by the alignment shift */
+    WORD  reLength;
+    WORD  reFlags;
+    WORD  reID;
+    WORD  reHandle;
+    WORD  reUsage;
+} ResNameInfo;
+
 /* Unused. Included as informal documentation. This struct proceeds
  * the FontDirEntry structure of type RT_FONTDIR. It is at the
  * location that the ResEntry offset points to. */
@@ -85,7 +108,7 @@ typedef struct PACKED {
    stucture and the CharTable follows.
 
    This struct is called FONTINFO in some contexts. */
-typedef struct PACKED {
+typedef struct PACKED FontDirEntry {
     WORD   dfVersion;
     DWORD  dfSize; /* ATTN: Struct must be packed, otherwise offset of
                       field is 4 instead of 2 */
@@ -146,6 +169,15 @@ typedef struct PACKED {
     BYTE   dfReserved1[16];
 } FontDirEntry_v3_Fields;
 
+/* What _fn_info points to: the header, and the Win 3.x fields, which
+ * are zero in a v2 font. */
+typedef struct PACKED {
+    FontDirEntry fd;
+    FontDirEntry_v3_Fields v3;
+} FontInfo;
+
+#define FONT_V3(wf) (&((FontInfo *)(wf)->_fn_info)->v3)
+
 typedef struct PACKED {
     WORD  width;
     WORD  offset;
@@ -242,330 +274,1499 @@ typedef struct PACKED {
 
 /* end wingdi.h */
 
-char *
-winfont_read_string(long stroff, FILE *fnt)
+/* WinFont _flags */
+
+/* Font memory
+ *
+ * A font is one block from its allocator, sized from the FNT header
+ * and char table before anything is read into it:
+ *
+ *     WinFont | FNT header | widths | offsets | rawoff | lazy bits |
+ *     facename | bitmap
+ *
+ * rawoff and the lazy bits are only there for lazy fonts. The bitmap
+ * is left out when it is a view of the file, and for a collection face
+ * whose bitmap gets a block of its own when it is first asked for. */
+
+#define ALIGN(n, a) (((n) + (a) - 1) & ~(size_t)((a) - 1))
+
+static void *
+winfont_default_alloc(void *ctx, size_t size)
 {
-    long saveoff;
-    int ch, len = 0;
-    char *str = NULL;
+    (void)ctx;
+    return malloc(size);
+}
 
-    saveoff = ftell(fnt);
-    if (fseek(fnt, stroff, SEEK_SET) == -1) {
-        return NULL;
+static void
+winfont_default_free(void *ctx, void *ptr)
+{
+    (void)ctx;
+    free(ptr);
+}
+
+static const WinFont_Allocator winfont_default_allocator = {
+    winfont_default_alloc, winfont_default_free, NULL,
+};
+
+WinFont *
+winfont_arena_new(const WinFont_Allocator *a, int nglyphs, size_t namelen,
+    size_t bmbytes, int lazy)
+{
+    size_t info, widths, offsets, rawoff = 0, bits = 0, name, bitmap;
+    size_t off, nwords = (nglyphs + 31) / 32;
+    uint8_t *p;
+    WinFont *wf;
+
+    if (!a)
+        a = &winfont_default_allocator;
+
+    off = ALIGN(sizeof(WinFont), 16);
+    info = off;
+    off = ALIGN(off + sizeof(FontInfo), 8);
+    widths = off;
+    off = ALIGN(off + nglyphs * sizeof(uint16_t), 4);
+    offsets = off;
+    off += nglyphs * sizeof(uint32_t);
+    if (lazy) {
+        rawoff = off;
+        off += nglyphs * sizeof(uint32_t);
+        bits = off;
+        off += 2 * nwords * sizeof(uint32_t);
     }
+    name = off;
+    off = ALIGN(off + namelen, 16);
+    bitmap = off;
 
-    while ((ch = getc(fnt)))
-        len++;
+    p = a->alloc(a->ctx, bitmap + bmbytes);
+    if (!p)
+        return NULL;
 
-    if (fseek(fnt, stroff, SEEK_SET) == -1) {
-        goto restoreoffset;
+    /* Decoding fills every byte of an eager bitmap, a lazy one starts
+     * out blank. */
+    memset(p, 0, lazy ? bitmap + bmbytes : bitmap);
+
+    wf = (WinFont *)p;
+    wf->_alloc = *a;
+    wf->_fn_info = (WinFont_Info *)(p + info);
+    wf->widths = (uint16_t *)(p + widths);
+    wf->offsets = (uint32_t *)(p + offsets);
+    if (lazy) {
+        wf->_rawoff = (uint32_t *)(p + rawoff);
+        wf->_lazy = (uint32_t *)(p + bits);
     }
+    if (namelen)
+        wf->facename = (char *)(p + name);
+    if (bmbytes)
+        wf->bitmap = p + bitmap;
+    wf->nglyphs = nglyphs;
 
-    str = malloc(len + 1);
-    if (!str) {
-        fprintf(stderr, "OOM\n");
-        goto restoreoffset;
+    return wf;
+}
+
+/* Positional reads. Parsing never moves a file offset, so any number
+ * of threads can parse from the same descriptor at once. */
+
+static ssize_t
+winfont_fd_read(void *ctx, void *buf, size_t n, uint64_t off)
+{
+    ssize_t k;
+
+    do
+        k = pread(*(int *)ctx, buf, n, off);
+    while (k == -1 && errno == EINTR);
+
+    return k;
+}
+
+/* For a FILE with no descriptor behind it, such as one from fmemopen.
+ * The lock makes the seek, read and restore one step. */
+static ssize_t
+winfont_stdio_read(void *ctx, void *buf, size_t n, uint64_t off)
+{
+    FILE *f = ctx;
+    off_t saveoff;
+    ssize_t k = -1;
+
+    flockfile(f);
+    saveoff = ftello(f);
+    if (saveoff != -1 && fseeko(f, off, SEEK_SET) == 0) {
+        k = fread(buf, 1, n, f);
+        fseeko(f, saveoff, SEEK_SET);
     }
+    funlockfile(f);
 
-    if (fread(str, sizeof(char), len, fnt) < len) {
-        free(str);
-        str = NULL;
-        goto restoreoffset;
+    return k;
+}
+
+/* Read exactly n bytes at off from the start of the FON, or set the
+ * error and return -1. */
+static int
+winfont_reader_read(const WinFont_Reader *r, uint64_t off, void *buf,
+    size_t n)
+{
+    uint8_t *p = buf;
+    ssize_t k;
+
+    while (n > 0) {
+        k = r->read(r->ctx, p, n, r->base + off);
+        if (k <= 0) {
+            /* Running out of file means the font is damaged. */
+            winfont_set_error(k ? WinFont_ErrIO : WinFont_ErrFormat);
+            return -1;
+        }
+        p += k;
+        off += k;
+        n -= k;
     }
 
-    str[len] = 0;
+    return 0;
+}
+
+static char *
+winfont_read_string(const WinFont_Reader *r, uint64_t stroff)
+{
+    char *str = NULL, *grown, *nul;
+    size_t len = 0, cap = 0;
+    ssize_t k;
 
-restoreoffset:
-    fseek(fnt, saveoff, SEEK_SET);
-    return str;
+    for (;;) {
+        if (cap - len < 64) {
+            cap = cap ? 2 * cap : 64;
+            grown = realloc(str, cap);
+            if (!grown) {
+                free(str);
+                return NULL;
+            }
+            str = grown;
+        }
+        k = r->read(r->ctx, str + len, cap - len - 1,
+            r->base + stroff + len);
+        if (k <= 0) {
+            free(str);
+            return NULL;
+        }
+        nul = memchr(str + len, 0, k);
+        if (nul)
+            return str;
+        len += k;
+    }
 }
 
-uint8_t *
-winfont_read_bitmap(int w, int h, int wbytes,
-    int nglyphs, FILE *fnt)
+int
+winfont_cell_width(const uint16_t *widths, int nglyphs, int w)
 {
-    int bmbytes;
-    uint8_t *bm = NULL, *gb,
-        *dest, *colb;
+    for (int g = 0; g < nglyphs; g++)
+        if (widths[g] > w)
+            w = widths[g];
 
-    bmbytes = wbytes * h * nglyphs;
-    bm = calloc(bmbytes, sizeof(uint8_t));
-    if (!bm) {
-        fprintf(stderr, "OOM\n");
-        return NULL;
+    return w;
+}
+
+/* Read the widths and bitmap offsets out of a v2 or v3 char table.
+ * rawoff gets the offset of each glyph's column data from the start
+ * of the FNT resource, offsets the offset of the decoded glyph in a
+ * bitmap where glyphs are packed back to back, each row only as many
+ * bytes as its own width needs. Returns the size of that bitmap. */
+static size_t
+winfont_glyph_layout(const void *ct, int version, int nglyphs, int h,
+    uint16_t *widths, uint32_t *rawoff, uint32_t *offsets)
+{
+    const uint8_t *p = ct;
+    CharInfo_v2 ci2;
+    CharInfo_v3 ci3;
+    size_t bmbytes = 0;
+
+    for (int g = 0; g < nglyphs; g++) {
+        if (version == DF_VER2) {
+            memcpy(&ci2, p + g * sizeof(ci2), sizeof(ci2));
+            widths[g] = ci2.width;
+            rawoff[g] = ci2.offset;
+        } else {
+            memcpy(&ci3, p + g * sizeof(ci3), sizeof(ci3));
+            widths[g] = ci3.width;
+            rawoff[g] = ci3.offset;
+        }
+        offsets[g] = bmbytes;
+        bmbytes += (size_t)(widths[g] + 7) / 8 * h;
     }
 
-    gb = bm;
-    for (int c = 0; c < nglyphs; c++) {
-        dest = colb = gb;
-        for (int i = 0; i < wbytes * h; i++) {
-            if (i != 0 && i % h == 0)
-                dest = ++colb;
-            *dest = getc(fnt);
-            dest += wbytes;
+    return bmbytes;
+}
+
+/* The size of the bitmap winfont_glyph_layout would lay out, found
+ * before there is anywhere to put the layout. isview is set if the
+ * glyphs in the file can be used as the bitmap as they are: a glyph
+ * one byte wide is the same in column and row major order, so glyphs
+ * that narrow stored back to back from bitsoff need no decoding. */
+static size_t
+winfont_ct_measure(const void *ct, int version, int nglyphs, int h,
+    DWORD bitsoff, int *isview)
+{
+    const uint8_t *p = ct;
+    CharInfo_v2 ci2;
+    CharInfo_v3 ci3;
+    size_t bmbytes = 0;
+    uint32_t width, rawoff;
+
+    *isview = 1;
+    for (int g = 0; g < nglyphs; g++) {
+        if (version == DF_VER2) {
+            memcpy(&ci2, p + g * sizeof(ci2), sizeof(ci2));
+            width = ci2.width;
+            rawoff = ci2.offset;
+        } else {
+            memcpy(&ci3, p + g * sizeof(ci3), sizeof(ci3));
+            width = ci3.width;
+            rawoff = ci3.offset;
         }
-        gb += wbytes * h;
+        if (width > 8 || rawoff != bitsoff + bmbytes)
+            *isview = 0;
+        bmbytes += (size_t)(width + 7) / 8 * h;
     }
 
-    return bm;
+    return bmbytes;
 }
 
-WinFont *
-winfont_load_fnt_resource(WinFont *wf, FILE *fnt)
+/* Decode glyphs whose column data is at raw + rawoff[g]. When the
+ * glyphs are all the same width and stored back to back, as in any
+ * fixed pitch font, the whole block goes through the transposition
+ * kernel at once. */
+static void
+winfont_decode_glyphs(uint8_t *bitmap, const uint8_t *raw, int nglyphs,
+    int h, const uint16_t *widths, const uint32_t *rawoff,
+    const uint32_t *offsets)
+{
+    int g, wbytes = (widths[0] + 7) / 8;
+
+    for (g = 1; g < nglyphs; g++)
+        if (widths[g] != widths[0] ||
+            rawoff[g] - rawoff[0] != offsets[g])
+            break;
+
+    if (g == nglyphs) {
+        winfont_transpose_bitmap(bitmap, raw + rawoff[0],
+            wbytes, h, nglyphs);
+        return;
+    }
+
+    for (g = 0; g < nglyphs; g++)
+        winfont_transpose_bitmap(bitmap + offsets[g], raw + rawoff[g],
+            (widths[g] + 7) / 8, h, 1);
+}
+
+/* Read the whole bits block, which starts at bitsoff and which rawoff
+ * is relative to, with one read and reorder it in bulk into bm. */
+static int
+winfont_read_bitmap(uint8_t *bm, int nglyphs, int h, const uint16_t *widths,
+    const uint32_t *rawoff, const uint32_t *offsets,
+    const WinFont_Reader *r, uint64_t bitsoff)
+{
+    size_t rawbytes = 0, end;
+    uint8_t *raw;
+
+    for (int g = 0; g < nglyphs; g++) {
+        end = rawoff[g] + (size_t)(widths[g] + 7) / 8 * h;
+        if (end > rawbytes)
+            rawbytes = end;
+    }
+
+    raw = malloc(rawbytes ? rawbytes : 1);
+    if (!raw) {
+        WF_FAIL(WinFont_ErrNoMem, "out of memory for %zu bytes of bits",
+            rawbytes);
+        return -1;
+    }
+
+    if (winfont_reader_read(r, bitsoff, raw, rawbytes) == -1) {
+        WF_LOG(WinFont_LogError, "glyph bits run past the file");
+        free(raw);
+        return -1;
+    }
+
+    winfont_decode_glyphs(bm, raw, nglyphs, h, widths, rawoff, offsets);
+    free(raw);
+
+    return 0;
+}
+
+static WinFont *
+winfont_load_fnt_resource(const WinFont_Reader *r, uint64_t fnt_base)
 {
     FontDirEntry fd;
     FontDirEntry_v3_Fields extras;
-    size_t nglyphs, ctsize;
-    WORD fnt_base;
+    size_t nglyphs, ctsize, bmbytes;
+    uint64_t ctoff;
     CharInfo_v2 *ct2 = NULL;
     CharInfo_v3 *ct3 = NULL;
     char *facestr = NULL;
-    uint8_t *bitmap = NULL;
-    int w, h, wbytes, offset;
+    uint32_t *rawoff = NULL;
+    WinFont *wf = NULL;
+    const void *ct;
+    int w, h, wbytes, isview;
 
-    fnt_base = ftell(fnt);
-    if (fread(&fd, sizeof(FontDirEntry), 1, fnt) == 0) {
-        fprintf(stderr, "Error reading font\n");
+    if (winfont_reader_read(r, fnt_base, &fd, sizeof(fd)) == -1) {
+        WF_LOG(WinFont_LogError, "FNT header at %llu runs past the file",
+            (unsigned long long)fnt_base);
         goto cleanup;
     }
 
     if (fd.dfType & 1) {
-        fprintf(stderr, "Not a bitmap font\n");
+        WF_FAIL(WinFont_ErrVector, "not a bitmap font");
         goto cleanup;
     }
 
-    fprintf(stderr, "Version: 0x%X\n", fd.dfVersion);
-    fprintf(stderr, "Size: %u\n", fd.dfSize);
+    if (fd.dfVersion != DF_VER2 && fd.dfVersion != DF_VER3) {
+        WF_FAIL(WinFont_ErrVersion, "FNT version 0x%X", fd.dfVersion);
+        goto cleanup;
+    }
 
-    /* fprintf(stderr, "f0(%lu), f1(%lu)\n",
-           offsetof(FontDirEntry, dfVersion),
-           offsetof(FontDirEntry, dfSize));
-    */
+    if (fd.dfLastChar < fd.dfFirstChar) {
+        WF_FAIL(WinFont_ErrFormat, "last char %d before first char %d",
+            fd.dfLastChar, fd.dfFirstChar);
+        goto cleanup;
+    }
 
-    fprintf(stderr, "Copyright: %s\n", fd.dfCopyright);
-    fprintf(stderr, "Type: 0x%X\n", fd.dfType);
-    fprintf(stderr, "Pts: %d\n", fd.dfPoints);
-    fprintf(stderr, "VRes: %d\n", fd.dfVertRes);
-    fprintf(stderr, "HRes: %d\n", fd.dfHorizRes);
-    fprintf(stderr, "Asc: %d\n", fd.dfAscent);
-    fprintf(stderr, "IntL: %d\n", fd.dfInternalLeading);
-    fprintf(stderr, "ExtL: %d\n", fd.dfExternalLeading);
-    fprintf(stderr, "Itl: %d\n", fd.dfItalic);
-    fprintf(stderr, "Und: %d\n", fd.dfUnderline);
-    fprintf(stderr, "StO: %d\n", fd.dfStrikeOut);
-    fprintf(stderr, "Lbs: %d\n", fd.dfWeight);
-    fprintf(stderr, "ChS: %d\n", fd.dfCharSet);
-    fprintf(stderr, "PixW: %d\n", fd.dfPixWidth);
-    fprintf(stderr, "PixH: %d\n", fd.dfPixHeight);
-    fprintf(stderr, "AvgW: %d\n", fd.dfAvgWidth);
-    fprintf(stderr, "MaxW: %d\n", fd.dfMaxWidth);
-    fprintf(stderr, "PnF: %d\n", fd.dfPitchAndFamily);
-    fprintf(stderr, "FC: %d\n", fd.dfFirstChar);
-    fprintf(stderr, "LC: %d\n", fd.dfLastChar);
-    fprintf(stderr, "DC: %d\n", fd.dfDefaultChar);
-    fprintf(stderr, "BC: %d\n", fd.dfBreakChar);
-    fprintf(stderr, "WidthInBytes: %d\n", fd.dfWidthBytes);
-    fprintf(stderr, "Device: %d\n", fd.dfDevice);
-    fprintf(stderr, "FO: %d\n", fd.dfFace);
-    fprintf(stderr, "BP: %d\n", fd.dfBitsPointer);
-    fprintf(stderr, "BO: %d\n", fd.dfBitsOffset);
-
-    facestr = winfont_read_string(fnt_base + fd.dfFace, fnt);
-    if (facestr)
-        fprintf(stderr, "Face: %s\n", facestr);
+    /* A font without a readable name still loads. */
+    facestr = winfont_read_string(r, fnt_base + fd.dfFace);
+    if (!facestr)
+        WF_LOG(WinFont_LogWarn, "no face name at %u", (unsigned)fd.dfFace);
 
-    if (fd.dfVersion == DF_VER3)
-        if (fread(&extras, sizeof(extras), 1, fnt) == 0) {
-            fprintf(stderr, "Expected v3 FNT fields\n");
+    ctoff = fnt_base + sizeof(fd);
+    if (fd.dfVersion == DF_VER3) {
+        if (winfont_reader_read(r, ctoff, &extras, sizeof(extras)) == -1) {
+            WF_LOG(WinFont_LogError, "v3 FNT header runs past the file");
             goto cleanup;
         }
+        ctoff += sizeof(extras);
+    }
 
     nglyphs = fd.dfLastChar - fd.dfFirstChar + 2;
     if (fd.dfVersion == DF_VER2) {
         ctsize = nglyphs * sizeof(CharInfo_v2);
         ct2 = malloc(ctsize);
         if (!ct2) {
-            fprintf(stderr, "OOM\n");
+            WF_FAIL(WinFont_ErrNoMem, "out of memory for the char table");
             goto cleanup;
         }
-        if (fread(ct2, ctsize, 1, fnt) == 0) {
-            fprintf(stderr, "Error reading: %s\n", ".fon");
+        if (winfont_reader_read(r, ctoff, ct2, ctsize) == -1) {
+            WF_LOG(WinFont_LogError, "char table runs past the file");
             goto cleanup;
         }
     } else {
         ctsize = nglyphs * sizeof(CharInfo_v3);
         ct3 = malloc(ctsize);
         if (!ct3) {
-            fprintf(stderr, "OOM\n");
+            WF_FAIL(WinFont_ErrNoMem, "out of memory for the char table");
             goto cleanup;
         }
-        if (fread(ct3, ctsize, 1, fnt) == 0) {
-            fprintf(stderr, "Error reading: %s\n", ".fon");
+        if (winfont_reader_read(r, ctoff, ct3, ctsize) == -1) {
+            WF_LOG(WinFont_LogError, "char table runs past the file");
             goto cleanup;
         }
     }
 
-    offset = fnt_base + fd.dfBitsOffset;
-    if (fseek(fnt, offset, SEEK_SET) == -1) {
-        fprintf(stderr, "Error reading font\n");
-        goto cleanup;
-    }
-
-    w = fd.dfPixWidth;
+    w = fd.dfPixWidth ? fd.dfPixWidth : fd.dfMaxWidth;
     h = fd.dfPixHeight;
 
-    wbytes = (int)ceilf((float)w / 8.0f);
-    bitmap = winfont_read_bitmap(w, h, wbytes, nglyphs, fnt);
+    ct = ct2 ? (void *)ct2 : (void *)ct3;
+    bmbytes = winfont_ct_measure(ct, fd.dfVersion, nglyphs, h, 0, &isview);
+    wf = winfont_arena_new(NULL, nglyphs,
+        strlen(facestr ? facestr : "") + 1, bmbytes, 0);
+    rawoff = malloc(nglyphs * sizeof(uint32_t));
+    if (!wf || !rawoff) {
+        WF_FAIL(WinFont_ErrNoMem, "out of memory for a %zu byte bitmap",
+            bmbytes);
+        goto cleanup;
+    }
 
-    if (!wf) {
-        wf = calloc(1, sizeof(WinFont));
-        if (!wf) {
-            fprintf(stderr, "OOM\n");
+    winfont_glyph_layout(ct, fd.dfVersion, nglyphs, h, wf->widths,
+        rawoff, wf->offsets);
+    w = winfont_cell_width(wf->widths, nglyphs, w);
+    wbytes = (w + 7) / 8;
+    for (int g = 0; g < nglyphs; g++) {
+        if (rawoff[g] < fd.dfBitsOffset) {
+            WF_FAIL(WinFont_ErrCharTable, "glyph %d is before the bits", g);
             goto cleanup;
         }
+        rawoff[g] -= fd.dfBitsOffset;
     }
 
-    wf->facename = facestr;
-    wf->nglyphs = nglyphs;
+    if (winfont_read_bitmap(wf->bitmap, nglyphs, h, wf->widths, rawoff,
+            wf->offsets, r, fnt_base + fd.dfBitsOffset) == -1)
+        goto cleanup;
+
+    strcpy(wf->facename, facestr ? facestr : "");
     wf->width = w;
     wf->height = h;
     wf->wbytes = wbytes;
-    wf->charset = WinFont_CharSetCP437;
-    wf->_fn_info = calloc(1, sizeof(FontDirEntry));
-    if (!wf->_fn_info) {
-        fprintf(stderr, "OOM\n");
-        goto cleanup;
-    }
+    wf->charset = fd.dfCharSet;
     memmove(wf->_fn_info, &fd, sizeof(FontDirEntry));
-    /* TODO: zero out fields that don't apply outside of the file
-     * context */
-    wf->bitmap = bitmap;
+    if (fd.dfVersion == DF_VER3)
+        memcpy(FONT_V3(wf), &extras, sizeof(extras));
+    wf->_bmbytes = bmbytes;
+    WF_LOG(WinFont_LogDebug, "loaded %s, v%d %dx%d, %d glyphs",
+        wf->facename, fd.dfVersion >> 8, w, h, wf->nglyphs);
+    free(rawoff);
+    free(facestr);
+    free(ct2);
+    free(ct3);
 
     return wf;
 
 cleanup:
-    if (facestr)
-        free(facestr);
-    if (ct2)
-        free(ct2);
-    if (ct3)
-        free(ct3);
+    winfont_free(wf);
+    free(rawoff);
+    free(facestr);
+    free(ct2);
+    free(ct3);
 
-    return wf;
+    return NULL;
 }
 
 WinFont *
-winfont_read_file(FILE *f)
+winfont_read_reader(const WinFont_Reader *r)
 {
     MZ_Header mz;
     NE_Header ne;
     ResEntry re;
-    long foff, rtoff, fntoff;
-    int rcount, fntcount;
+    uint64_t off, fntoff;
     uint16_t shift;
-    WinFont *wf = NULL;
 
-    if ((foff = ftell(f)) == -1)
-        return NULL;
-
-    if (foff != 0)
+    if (!r || !r->read) {
+        winfont_set_error(WinFont_ErrArg);
         return NULL;
+    }
 
-    if (fread(&mz, sizeof(MZ_Header), 1, f) == 0) {
-        fprintf(stderr, "Error reading font\n");
+    if (winfont_reader_read(r, 0, &mz, sizeof(MZ_Header)) == -1) {
+        WF_LOG(WinFont_LogError, "can not read the MZ header");
         return NULL;
     }
 
     if (mz.e_magic != FON_MZ_MAGIC) {
-        fprintf(stderr, "Invalid font\n");
+        WF_FAIL(WinFont_ErrFormat, "bad MZ magic 0x%X", mz.e_magic);
         return NULL;
     }
 
-    /* fprintf(stderr, "MZ magic=0x%X\n", mz.e_magic); */
-    /* fprintf(stderr, "NE offset=%d\n", mz.e_lfanew); */
-
-    if (fseek(f, mz.e_lfanew, SEEK_SET) == -1) {
-        fprintf(stderr, "Error reading font\n");
+    if (winfont_reader_read(r, mz.e_lfanew, &ne, sizeof(NE_Header)) == -1) {
+        WF_LOG(WinFont_LogError, "NE header at %u runs past the file",
+            (unsigned)mz.e_lfanew);
         return NULL;
     }
 
-    if (fread(&ne, sizeof(NE_Header), 1, f) == 0) {
-        fprintf(stderr, "Error reading font\n");
+    if (ne.ne_magic != FON_NE_MAGIC) {
+        WF_FAIL(WinFont_ErrFormat, "bad NE magic 0x%X", ne.ne_magic);
         return NULL;
     }
 
-    if (ne.ne_magic != FON_NE_MAGIC) {
-        fprintf(stderr, "Invalid font\n");
+    /* The resource table. */
+    off = (uint64_t)mz.e_lfanew + ne.ne_rsrctab;
+    if (winfont_reader_read(r, off, &shift, sizeof(shift)) == -1) {
+        WF_LOG(WinFont_LogError, "resource table runs past the file");
         return NULL;
     }
+    off += sizeof(shift);
 
-    /* fprintf(stderr, "NE magic=0x%X\n", ne.ne_magic); */
-    /* fprintf(stderr, "NE rsrctab=%d\n", ne.ne_rsrctab); */
+    for (;;) {
+        if (winfont_reader_read(r, off, &re, sizeof(ResEntry)) == -1) {
+            WF_LOG(WinFont_LogError, "resource table runs past the file");
+            return NULL;
+        }
+        if (re.reType == 0)
+            break;
+        if (re.reType == RT_FONT && re.reCount > 0) {
+            fntoff = (uint64_t)re.reOffset << shift;
+            /* Only the first face is loaded, see WinFontCollection. */
+            return winfont_load_fnt_resource(r, fntoff);
+        }
+        /* The next type follows all reCount NAMEINFO entries. */
+        off += sizeof(ResTypeInfo) + re.reCount * sizeof(ResNameInfo);
+    }
 
-    /* Move to the resource table. */
-    rtoff = mz.e_lfanew + ne.ne_rsrctab;
-    /* fprintf(stderr, "rtoff=%ld\n", rtoff); */
-    if (fseek(f, rtoff, SEEK_SET) == -1) {
-        fprintf(stderr, "Error reading font\n");
+    WF_FAIL(WinFont_ErrNoFont, "no FNT resources");
+    return NULL;
+}
+
+WinFont *
+winfont_read_fd(int fd, uint64_t base)
+{
+    WinFont_Reader r = { winfont_fd_read, &fd, base };
+
+    return winfont_read_reader(&r);
+}
+
+/* The font is read from the current position of f, which is left
+ * where it was, unless f is a pipe and has to be streamed. */
+WinFont *
+winfont_read_file(FILE *f)
+{
+    WinFontStream *st;
+    WinFont_Reader r;
+    WinFont *wf;
+    off_t base;
+    int fd;
+
+    if (!f) {
+        winfont_set_error(WinFont_ErrArg);
         return NULL;
     }
 
-    if (fread(&shift, sizeof(shift), 1, f) == 0) {
-        fprintf(stderr, "Error reading font\n");
+    if ((base = ftello(f)) == -1) {
+        if (errno != ESPIPE) {
+            WF_FAIL(WinFont_ErrIO, "ftell: %s", strerror(errno));
+            return NULL;
+        }
+        st = winfont_stream_file(f, 0);
+        wf = winfont_stream_next(st);
+        winfont_stream_free(st);
+        return wf;
+    }
+
+    fd = fileno(f);
+    if (fd != -1) {
+        r.read = winfont_fd_read;
+        r.ctx = &fd;
+    } else {
+        r.read = winfont_stdio_read;
+        r.ctx = f;
+    }
+    r.base = base;
+
+    return winfont_read_reader(&r);
+}
+
+/* Bounds checked copy out of an in-memory font image. */
+static int
+winfont_mem_read(const uint8_t *base, size_t len, size_t off,
+    void *dst, size_t n)
+{
+    if (off > len || n > len - off)
+        return -1;
+    memcpy(dst, base + off, n);
+    return 0;
+}
+
+/* Length of the string at off, or -1 if it runs off the end. */
+static ssize_t
+winfont_mem_strlen(const uint8_t *base, size_t len, size_t off)
+{
+    const uint8_t *nul;
+
+    if (off >= len)
+        return -1;
+
+    nul = memchr(base + off, 0, len - off);
+    if (!nul)
+        return -1;
+
+    return nul - (base + off);
+}
+
+/* Validate the FNT header at fntoff and find its char table. */
+static int
+winfont_mem_fnt_check(const uint8_t *base, size_t len, size_t fntoff,
+    FontDirEntry *fd, size_t *ctoffp)
+{
+    size_t nglyphs, ctoff, ctsize;
+
+    if (winfont_mem_read(base, len, fntoff, fd, sizeof(*fd)) == -1) {
+        WF_FAIL(WinFont_ErrFormat, "FNT header at %zu runs past the end",
+            fntoff);
+        return -1;
+    }
+
+    if (fd->dfType & 1) {
+        WF_FAIL(WinFont_ErrVector, "not a bitmap font");
+        return -1;
+    }
+
+    if (fd->dfVersion != DF_VER2 && fd->dfVersion != DF_VER3) {
+        WF_FAIL(WinFont_ErrVersion, "FNT version 0x%X", fd->dfVersion);
+        return -1;
+    }
+
+    if (fd->dfLastChar < fd->dfFirstChar) {
+        WF_FAIL(WinFont_ErrFormat, "last char %d before first char %d",
+            fd->dfLastChar, fd->dfFirstChar);
+        return -1;
+    }
+
+    ctoff = fntoff + sizeof(FontDirEntry);
+    if (fd->dfVersion == DF_VER3)
+        ctoff += sizeof(FontDirEntry_v3_Fields);
+
+    nglyphs = fd->dfLastChar - fd->dfFirstChar + 2;
+    ctsize = nglyphs * (fd->dfVersion == DF_VER2 ?
+        sizeof(CharInfo_v2) : sizeof(CharInfo_v3));
+    if (ctoff > len || ctsize > len - ctoff) {
+        WF_FAIL(WinFont_ErrFormat, "char table runs past the end");
+        return -1;
+    }
+
+    *ctoffp = ctoff;
+    return 0;
+}
+
+/* Where each glyph's column data is, and check it is all in the
+ * image. */
+static int
+winfont_mem_rawoff(WinFont *wf, const uint8_t *base, size_t len,
+    size_t fntoff, uint32_t *rawoff)
+{
+    FontDirEntry *fd = wf->_fn_info;
+    size_t ctoff, off;
+    uint16_t width;
+
+    if (winfont_mem_fnt_check(base, len, fntoff, fd, &ctoff) == -1)
+        return -1;
+
+    for (int g = 0; g < wf->nglyphs; g++) {
+        if (fd->dfVersion == DF_VER2) {
+            CharInfo_v2 ci;
+            memcpy(&ci, base + ctoff + g * sizeof(ci), sizeof(ci));
+            width = ci.width;
+            rawoff[g] = ci.offset;
+        } else {
+            CharInfo_v3 ci;
+            memcpy(&ci, base + ctoff + g * sizeof(ci), sizeof(ci));
+            width = ci.width;
+            rawoff[g] = ci.offset;
+        }
+        off = fntoff + rawoff[g];
+        if (off > len || (size_t)(width + 7) / 8 * wf->height > len - off) {
+            WF_FAIL(WinFont_ErrCharTable, "glyph %d runs past the end", g);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+#define WF_HEADER_ONLY 0x8000  /* load flag for collection faces */
+
+/* Load the FNT resource at fntoff into one block from a. The bitmap
+ * is a view of the image when it can be, otherwise decoded now,
+ * decoded a glyph at a time for WINFONT_LAZY, or not loaded at all
+ * for WF_HEADER_ONLY, see winfont_mem_load_fnt_bitmap. WF_LOAD_COPY
+ * always decodes. */
+WinFont *
+winfont_mem_load_fnt(const uint8_t *base, size_t len, size_t fntoff,
+    int flags, const WinFont_Allocator *a)
+{
+    FontDirEntry fd;
+    size_t ctoff, bmbytes;
+    ssize_t namelen;
+    uint32_t *rawoff = NULL;
+    WinFont *wf;
+    int w, h, isview, lazy, header_only = flags & WF_HEADER_ONLY;
+
+    if (winfont_mem_fnt_check(base, len, fntoff, &fd, &ctoff) == -1)
+        return NULL;
+
+    /* Proportional fonts have no fixed width; the widest glyph is the
+     * cell size. The char table may hold wider glyphs than the header
+     * says, so it has the last word once it has been read. */
+    w = fd.dfPixWidth ? fd.dfPixWidth : fd.dfMaxWidth;
+    h = fd.dfPixHeight;
+
+    bmbytes = winfont_ct_measure(base + ctoff, fd.dfVersion,
+        fd.dfLastChar - fd.dfFirstChar + 2, h, fd.dfBitsOffset, &isview);
+    if (flags & WF_LOAD_COPY)
+        isview = 0;
+    lazy = (flags & WINFONT_LAZY) && !isview && !header_only &&
+        !(flags & WF_LOAD_COPY);
+    namelen = winfont_mem_strlen(base, len, fntoff + fd.dfFace);
+
+    wf = winfont_arena_new(a, fd.dfLastChar - fd.dfFirstChar + 2,
+        namelen > 0 ? namelen + 1 : 1,
+        isview || header_only ? 0 : bmbytes, lazy);
+    if (!wf) {
+        WF_FAIL(WinFont_ErrNoMem, "out of memory for a %zu byte bitmap",
+            bmbytes);
         return NULL;
     }
-    /* fprintf(stderr, "shift=%d\n", shift); */
 
-    fntoff = 0;
-    rcount = 0;
-    fntcount = 0;
+    memmove(wf->_fn_info, &fd, sizeof(FontDirEntry));
+    /* Checked to be in the image with the char table that follows. */
+    if (fd.dfVersion == DF_VER3)
+        memcpy(FONT_V3(wf), base + fntoff + sizeof(FontDirEntry),
+            sizeof(FontDirEntry_v3_Fields));
+    if (namelen > 0)
+        memcpy(wf->facename, base + fntoff + fd.dfFace, namelen);
+    wf->height = h;
+    wf->charset = fd.dfCharSet;
+    wf->_bmbytes = bmbytes;
+
+    /* Lazy fonts keep the char table offsets to decode each glyph the
+     * first time glyph.c is asked for it. */
+    rawoff = lazy ? wf->_rawoff : malloc(wf->nglyphs * sizeof(uint32_t));
+    if (!rawoff) {
+        WF_FAIL(WinFont_ErrNoMem, "out of memory for the char table");
+        goto fail;
+    }
+    winfont_glyph_layout(base + ctoff, fd.dfVersion, wf->nglyphs, h,
+        wf->widths, rawoff, wf->offsets);
+    w = winfont_cell_width(wf->widths, wf->nglyphs, w);
+    wf->width = w;
+    wf->wbytes = (w + 7) / 8;
+    if (winfont_mem_rawoff(wf, base, len, fntoff, rawoff) == -1)
+        goto fail;
+
+    if (isview && !header_only) {
+        wf->bitmap = (uint8_t *)(base + fntoff + fd.dfBitsOffset);
+        wf->_flags |= WF_BORROWED_BITMAP;
+    } else if (lazy) {
+        wf->_raw = base + fntoff;
+        wf->_flags |= WF_LAZY;
+    } else if (!header_only) {
+        winfont_decode_glyphs(wf->bitmap, base + fntoff, wf->nglyphs, h,
+            wf->widths, rawoff, wf->offsets);
+    }
+
+    if (!header_only)
+        WF_LOG(WinFont_LogDebug, "loaded %s, v%d %dx%d, %d glyphs%s",
+            wf->facename, fd.dfVersion >> 8, w, h, wf->nglyphs,
+            isview ? ", borrowed" : lazy ? ", lazy" : "");
+    if (!lazy)
+        free(rawoff);
+    return wf;
+
+fail:
+    if (!lazy)
+        free(rawoff);
+    winfont_free(wf);
+    return NULL;
+}
+
+/* Decode, or point at, the bitmap of a collection face loaded with
+ * WF_HEADER_ONLY. The bitmap gets a block of its own. */
+static int
+winfont_mem_load_fnt_bitmap(WinFont *wf, const uint8_t *base,
+    size_t len, size_t fntoff)
+{
+    FontDirEntry *fd = wf->_fn_info;
+    uint32_t *rawoff;
+    uint8_t *bitmap;
+    int isview;
+
+    winfont_ct_measure(base + fntoff + sizeof(FontDirEntry) +
+        (fd->dfVersion == DF_VER3 ? sizeof(FontDirEntry_v3_Fields) : 0),
+        fd->dfVersion, wf->nglyphs, wf->height, fd->dfBitsOffset, &isview);
+    if (isview) {
+        wf->bitmap = (uint8_t *)(base + fntoff + fd->dfBitsOffset);
+        wf->_flags |= WF_BORROWED_BITMAP;
+        return 0;
+    }
+
+    rawoff = malloc(wf->nglyphs * sizeof(uint32_t));
+    if (!rawoff) {
+        WF_FAIL(WinFont_ErrNoMem, "out of memory for the char table");
+        return -1;
+    }
+    if (winfont_mem_rawoff(wf, base, len, fntoff, rawoff) == -1) {
+        free(rawoff);
+        return -1;
+    }
+
+    bitmap = wf->_alloc.alloc(wf->_alloc.ctx,
+        wf->_bmbytes ? wf->_bmbytes : 1);
+    if (!bitmap) {
+        WF_FAIL(WinFont_ErrNoMem, "out of memory for a %zu byte bitmap",
+            wf->_bmbytes);
+    } else {
+        winfont_decode_glyphs(bitmap, base + fntoff, wf->nglyphs,
+            wf->height, wf->widths, rawoff, wf->offsets);
+        wf->bitmap = bitmap;
+        wf->_flags |= WF_OWNS_BITMAP;
+    }
+
+    free(rawoff);
+    return bitmap ? 0 : -1;
+}
+
+/* How far winfont_mem_res_walk got when it fails. */
+enum {
+    WF_WALK_NO_MZ = -1,
+    WF_WALK_NO_NE = -2,
+    WF_WALK_TRUNCATED = -3,
+};
+
+/* Walk the resource table and store the file offset of up to max
+ * RT_FONT resources in offs. Returns the total number of RT_FONT
+ * resources, or one of the WF_WALK codes. Sets no error, so a file can
+ * be walked before all of it has been read. */
+static int
+winfont_mem_res_walk(const uint8_t *base, size_t len, size_t *offs,
+    int max)
+{
+    MZ_Header mz;
+    NE_Header ne;
+    ResTypeInfo ti;
+    ResNameInfo ni;
+    size_t off;
+    uint16_t shift;
+    int count = 0;
+
+    if (winfont_mem_read(base, len, 0, &mz, sizeof(mz)) == -1)
+        return len < sizeof(mz) ? WF_WALK_TRUNCATED : WF_WALK_NO_MZ;
+    if (mz.e_magic != FON_MZ_MAGIC)
+        return WF_WALK_NO_MZ;
+
+    if (winfont_mem_read(base, len, mz.e_lfanew, &ne, sizeof(ne)) == -1)
+        return WF_WALK_TRUNCATED;
+    if (ne.ne_magic != FON_NE_MAGIC)
+        return WF_WALK_NO_NE;
+
+    off = (size_t)mz.e_lfanew + ne.ne_rsrctab;
+    if (winfont_mem_read(base, len, off, &shift, sizeof(shift)) == -1)
+        return WF_WALK_TRUNCATED;
+    off += sizeof(shift);
 
     for (;;) {
-        if (fread(&re, sizeof(ResEntry), 1, f) == 0) {
-            fprintf(stderr, "Error reading font\n");
-            return NULL;
-        }
-        if (re.reType == 0)
+        if (winfont_mem_read(base, len, off, &ti.reType,
+                sizeof(ti.reType)) == -1)
+            return WF_WALK_TRUNCATED;
+        if (ti.reType == 0)
             break;
-        foff = ftell(f);
-        if (re.reType == RT_FONT) {
-            fntcount = re.reCount;
-            fntoff = re.reOffset << shift;
-            /* fprintf(stderr, "fntoff=%ld\n", fntoff); */
-            if (fseek(f, fntoff, SEEK_SET) == -1) {
-                fprintf(stderr, "Error reading resource table\n");
-                return NULL;
-            }
-            wf = winfont_load_fnt_resource(wf, f);
-            if (fntcount == ++rcount)
-                break;
+        if (winfont_mem_read(base, len, off, &ti, sizeof(ti)) == -1)
+            return WF_WALK_TRUNCATED;
+        off += sizeof(ti);
+
+        for (int i = 0; ti.reType == RT_FONT && i < ti.reCount; i++) {
+            if (winfont_mem_read(base, len, off + i * sizeof(ni),
+                    &ni, sizeof(ni)) == -1)
+                return WF_WALK_TRUNCATED;
+            if (count < max)
+                offs[count] = (size_t)ni.reOffset << shift;
+            count++;
         }
-        if (fseek(f, foff, SEEK_SET) == -1) {
-            fprintf(stderr, "Error reading resource table\n");
-            return NULL;
+
+        off += (size_t)ti.reCount * sizeof(ResNameInfo);
+    }
+
+    return count;
+}
+
+/* winfont_mem_res_walk, failing with the reason. Returns the number of
+ * RT_FONT resources or -1. */
+static int
+winfont_mem_fnt_offsets(const uint8_t *base, size_t len,
+    size_t *offs, int max)
+{
+    MZ_Header mz;
+    int n;
+
+    n = winfont_mem_res_walk(base, len, offs, max);
+    switch (n) {
+    case WF_WALK_NO_MZ:
+        WF_FAIL(WinFont_ErrFormat, "no MZ header");
+        return -1;
+    case WF_WALK_NO_NE:
+        memcpy(&mz, base, sizeof(mz));
+        WF_FAIL(WinFont_ErrFormat, "no NE header at %u",
+            (unsigned)mz.e_lfanew);
+        return -1;
+    case WF_WALK_TRUNCATED:
+        WF_FAIL(WinFont_ErrFormat, "resource table runs past the end");
+        return -1;
+    }
+
+    return n;
+}
+
+size_t
+winfont_mem_fnt_extent(const uint8_t *base, size_t len, size_t off,
+    int header_only)
+{
+    FontDirEntry fd;
+    size_t ctoff, end, gend;
+    int nglyphs;
+
+    if (winfont_mem_read(base, len, off, &fd, sizeof(fd)) == -1)
+        return off + sizeof(fd);
+
+    end = off + fd.dfFace + sizeof(((WinFont_FaceInfo *)0)->facename);
+    /* A header the loader rejects needs nothing after it. */
+    if (header_only || fd.dfLastChar < fd.dfFirstChar)
+        return end > off + sizeof(fd) ? end : off + sizeof(fd);
+
+    ctoff = off + sizeof(fd);
+    if (fd.dfVersion == DF_VER3)
+        ctoff += sizeof(FontDirEntry_v3_Fields);
+    nglyphs = fd.dfLastChar - fd.dfFirstChar + 2;
+    gend = ctoff + nglyphs * (fd.dfVersion == DF_VER3 ?
+        sizeof(CharInfo_v3) : sizeof(CharInfo_v2));
+    if (gend > len) {
+        gend = gend > off + fd.dfSize ? gend : off + fd.dfSize;
+        return end > gend ? end : gend;
+    }
+
+    /* Every glyph's columns, wherever the char table puts them. */
+    for (int g = 0; g < nglyphs; g++) {
+        size_t goff, gw;
+        if (fd.dfVersion == DF_VER2) {
+            CharInfo_v2 ci;
+            memcpy(&ci, base + ctoff + g * sizeof(ci), sizeof(ci));
+            goff = ci.offset;
+            gw = ci.width;
+        } else {
+            CharInfo_v3 ci;
+            memcpy(&ci, base + ctoff + g * sizeof(ci), sizeof(ci));
+            goff = ci.offset;
+            gw = ci.width;
         }
+        goff = off + goff + (gw + 7) / 8 * fd.dfPixHeight;
+        if (goff > gend)
+            gend = goff;
+    }
+
+    return end > gend ? end : gend;
+}
+
+size_t
+winfont_mem_extent(const uint8_t *base, size_t len, int header_only)
+{
+    size_t offs[WF_EXTENT_MAX_FACES], end = 0, e;
+    int n;
+
+    n = winfont_mem_res_walk(base, len, offs, WF_EXTENT_MAX_FACES);
+    if (n == WF_WALK_TRUNCATED)
+        return 0;
+    if (n < 0)
+        return len;
+
+    /* Loading reads only the first face. */
+    if (!header_only && n > 1)
+        n = 1;
+    if (n > WF_EXTENT_MAX_FACES)
+        return SIZE_MAX;
+    for (int i = 0; i < n; i++) {
+        e = winfont_mem_fnt_extent(base, len, offs[i], header_only);
+        if (e > end)
+            end = e;
+    }
+
+    return end > len ? end : len;
+}
+
+int
+winfont_scan_memory(const void *buf, size_t len, WinFont_FaceInfo *faces,
+    int max)
+{
+    const uint8_t *base = buf, *name;
+    size_t *offs;
+    FontDirEntry fd;
+    WinFont_FaceInfo *fi;
+    int n;
+
+    if (!buf || (max > 0 && !faces)) {
+        winfont_set_error(WinFont_ErrArg);
+        return -1;
+    }
+
+    n = winfont_mem_fnt_offsets(base, len, NULL, 0);
+    if (n < 0 || max <= 0)
+        return n;
+
+    if (max > n)
+        max = n;
+    offs = malloc(max * sizeof(size_t));
+    if (!offs) {
+        winfont_set_error(WinFont_ErrNoMem);
+        return -1;
+    }
+    winfont_mem_fnt_offsets(base, len, offs, max);
+
+    for (int i = 0; i < max; i++) {
+        fi = &faces[i];
+        memset(fi, 0, sizeof(*fi));
+        if (winfont_mem_read(base, len, offs[i], &fd, sizeof(fd)) == -1)
+            continue;
+        fi->version = fd.dfVersion;
+        fi->points = fd.dfPoints;
+        fi->pixwidth = fd.dfPixWidth;
+        fi->pixheight = fd.dfPixHeight;
+        fi->maxwidth = fd.dfMaxWidth;
+        fi->weight = fd.dfWeight;
+        fi->charset = fd.dfCharSet;
+        fi->italic = fd.dfItalic;
+        fi->pitchfamily = fd.dfPitchAndFamily;
+        fi->firstchar = fd.dfFirstChar;
+        fi->lastchar = fd.dfLastChar;
+        if (offs[i] + fd.dfFace < len) {
+            name = base + offs[i] + fd.dfFace;
+            for (size_t j = 0; j < sizeof(fi->facename) - 1 &&
+                    name + j < base + len && name[j]; j++)
+                fi->facename[j] = name[j];
+        }
+    }
+
+    free(offs);
+    return n;
+}
+
+WinFont *
+winfont_read_memory(const void *buf, size_t len)
+{
+    return winfont_read_memory_flags(buf, len, 0);
+}
+
+WinFont *
+winfont_read_memory_flags(const void *buf, size_t len, int flags)
+{
+    return winfont_read_memory_alloc(buf, len, flags, NULL);
+}
+
+WinFont *
+winfont_read_memory_alloc(const void *buf, size_t len, int flags,
+    const WinFont_Allocator *alloc)
+{
+    size_t fntoff;
+
+    if (!buf) {
+        winfont_set_error(WinFont_ErrArg);
+        return NULL;
+    }
+
+    /* Only the first face is loaded, see WinFontCollection. */
+    switch (winfont_mem_fnt_offsets(buf, len, &fntoff, 1)) {
+    case -1:
+        return NULL;
+    case 0:
+        WF_FAIL(WinFont_ErrNoFont, "no FNT resources");
+        return NULL;
+    }
+
+    return winfont_mem_load_fnt(buf, len, fntoff, flags & WINFONT_LAZY,
+        alloc);
+}
+
+void *
+winfont_map_path(const char *path, size_t *lenp)
+{
+    struct stat st;
+    void *map;
+    int fd;
+
+    if (!path) {
+        winfont_set_error(WinFont_ErrArg);
+        return NULL;
+    }
+
+    fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        WF_FAIL(WinFont_ErrIO, "%s: %s", path, strerror(errno));
+        return NULL;
     }
 
-    if (fntcount == 0) {
-        fprintf(stderr, "No FNT resources found\n");
+    if (fstat(fd, &st) == -1 || st.st_size <= 0) {
+        WF_FAIL(WinFont_ErrIO, "%s: empty or unreadable", path);
+        close(fd);
         return NULL;
     }
 
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        WF_FAIL(WinFont_ErrIO, "%s: %s", path, strerror(errno));
+        return NULL;
+    }
+
+    *lenp = st.st_size;
+    return map;
+}
+
+WinFont *
+winfont_open_mmap(const char *path)
+{
+    return winfont_open_mmap_flags(path, 0);
+}
+
+WinFont *
+winfont_open_mmap_flags(const char *path, int flags)
+{
+    return winfont_open_mmap_alloc(path, flags, NULL);
+}
+
+WinFont *
+winfont_open_mmap_alloc(const char *path, int flags,
+    const WinFont_Allocator *alloc)
+{
+    void *map;
+    size_t len;
+    WinFont *wf;
+
+    map = winfont_map_path(path, &len);
+    if (!map)
+        return NULL;
+
+    wf = winfont_read_memory_alloc(map, len, flags, alloc);
+    if (!wf || !(wf->_flags & (WF_BORROWED_BITMAP | WF_LAZY))) {
+        /* Nothing refers to the mapping. */
+        munmap(map, len);
+        return wf;
+    }
+
+    wf->_map = map;
+    wf->_maplen = len;
+
     return wf;
 }
 
 WinFont *
-winfont_read_path(char *path)
+winfont_read_buffer(uint8_t *buf, size_t len, int flags)
 {
-    FILE *f;
-    WinFont *wf = NULL;
-    (void)f;
+    WinFont *wf;
+
+    wf = winfont_read_memory_flags(buf, len, flags);
+    if (!wf || !(wf->_flags & (WF_BORROWED_BITMAP | WF_LAZY))) {
+        free(buf);
+        return wf;
+    }
+
+    wf->_map = buf;
+    wf->_maplen = len;
+    wf->_flags |= WF_OWNS_FILE;
 
     return wf;
 }
 
+int
+winfont_scan_path(const char *path, WinFont_FaceInfo *faces, int max)
+{
+    void *map;
+    size_t len;
+    int n;
+
+    map = winfont_map_path(path, &len);
+    if (!map)
+        return -1;
+
+    n = winfont_scan_memory(map, len, faces, max);
+    munmap(map, len);
+
+    return n;
+}
+
+WinFont *
+winfont_read_path(char *path)
+{
+    return winfont_open_mmap(path);
+}
+
+/* Everything but a separately loaded bitmap is in the one block that
+ * starts with wf. */
 void
 winfont_free(WinFont *wf)
 {
+    if (!wf)
+        return;
+
+    if (wf->_scaled) {
+        for (int s = 0; s <= WINFONT_MAX_SCALE; s++)
+            winfont_free(wf->_scaled[s]);
+        free(wf->_scaled);
+    }
+    if (wf->_store)
+        winfont_store_release(wf);
+    free(wf->_cmap);
+    if (wf->_flags & WF_OWNS_BITMAP)
+        wf->_alloc.free(wf->_alloc.ctx, wf->bitmap);
+    if (wf->_flags & WF_OWNS_FILE)
+        free(wf->_map);
+    else if (wf->_map)
+        munmap(wf->_map, wf->_maplen);
+
+    wf->_alloc.free(wf->_alloc.ctx, wf);
+}
+
+int
+winfont_get_info(WinFont *wf, WinFont_FontInfo *info)
+{
+    FontDirEntry *fd;
+
+    if (!wf || !info) {
+        winfont_set_error(WinFont_ErrArg);
+        return -1;
+    }
+
+    fd = wf->_fn_info;
+    memset(info, 0, sizeof(*info));
+    info->version = fd->dfVersion;
+    info->size = fd->dfSize;
+    memcpy(info->copyright, fd->dfCopyright, sizeof(fd->dfCopyright));
+    info->type = fd->dfType;
+    info->points = fd->dfPoints;
+    info->vertres = fd->dfVertRes;
+    info->horizres = fd->dfHorizRes;
+    info->ascent = fd->dfAscent;
+    info->internal_leading = fd->dfInternalLeading;
+    info->external_leading = fd->dfExternalLeading;
+    info->italic = fd->dfItalic;
+    info->underline = fd->dfUnderline;
+    info->strikeout = fd->dfStrikeOut;
+    info->weight = fd->dfWeight;
+    info->charset = fd->dfCharSet;
+    info->pixwidth = fd->dfPixWidth;
+    info->pixheight = fd->dfPixHeight;
+    info->pitchfamily = fd->dfPitchAndFamily;
+    info->avgwidth = fd->dfAvgWidth;
+    info->maxwidth = fd->dfMaxWidth;
+    info->firstchar = fd->dfFirstChar;
+    info->lastchar = fd->dfLastChar;
+    info->defaultchar = fd->dfDefaultChar;
+    info->breakchar = fd->dfBreakChar;
+    info->widthbytes = fd->dfWidthBytes;
+    info->device = fd->dfDevice;
+    info->face = fd->dfFace;
+    info->bitspointer = fd->dfBitsPointer;
+    info->bitsoffset = fd->dfBitsOffset;
+    info->flags = FONT_V3(wf)->dfFlags;
+    info->aspace = FONT_V3(wf)->dfAspace;
+    info->bspace = FONT_V3(wf)->dfBspace;
+    info->cspace = FONT_V3(wf)->dfCspace;
+
+    return 0;
+}
+
+/* The v3 header's A and C space, which winfont_set_scale has already
+ * scaled in a scaled copy. */
+void
+winfont_spacing(WinFont *wf, int *aspace, int *cspace)
+{
+    *aspace = FONT_V3(wf)->dfAspace;
+    *cspace = FONT_V3(wf)->dfCspace;
+}
+
+/* v times s, held to what a WORD can hold. */
+static WORD
+scale_word(WORD v, int s)
+{
+    return (uint32_t)v * s > 0xFFFF ? 0xFFFF : (WORD)(v * s);
+}
+
+void
+winfont_set_scale(WinFont *wf, int factor)
+{
+    FontDirEntry *fd = wf->_fn_info;
+    FontDirEntry_v3_Fields *v3 = FONT_V3(wf);
+
+    fd->dfPoints = scale_word(fd->dfPoints, factor);
+    fd->dfAscent = scale_word(fd->dfAscent, factor);
+    fd->dfInternalLeading = scale_word(fd->dfInternalLeading, factor);
+    fd->dfExternalLeading = scale_word(fd->dfExternalLeading, factor);
+    fd->dfPixWidth = scale_word(fd->dfPixWidth, factor);
+    fd->dfPixHeight = scale_word(fd->dfPixHeight, factor);
+    fd->dfAvgWidth = scale_word(fd->dfAvgWidth, factor);
+    fd->dfMaxWidth = scale_word(fd->dfMaxWidth, factor);
+    v3->dfAspace = scale_word(v3->dfAspace, factor);
+    v3->dfBspace = scale_word(v3->dfBspace, factor);
+    v3->dfCspace = scale_word(v3->dfCspace, factor);
+}
+
+void
+winfont_set_style(WinFont *wf, int style, int extra)
+{
+    FontDirEntry *fd = wf->_fn_info;
+
+    if ((style & WINFONT_BOLD) && fd->dfWeight < FW_BOLD)
+        fd->dfWeight = FW_BOLD;
+    if (style & WINFONT_ITALIC)
+        fd->dfItalic = 1;
+    if (style & WINFONT_UNDERLINE)
+        fd->dfUnderline = 1;
+    if (style & WINFONT_STRIKEOUT)
+        fd->dfStrikeOut = 1;
+    if (fd->dfPixWidth)
+        fd->dfPixWidth += extra;
+    fd->dfAvgWidth += extra;
+    fd->dfMaxWidth += extra;
+}
+
+size_t
+winfont_info_size(void)
+{
+    return sizeof(FontInfo);
+}
+
+WinFont *
+winfont_new_like(WinFont *wf, size_t bmbytes)
+{
+    const char *name = wf->facename ? wf->facename : "";
+    WinFont *nf;
+
+    nf = winfont_arena_new(&wf->_alloc, wf->nglyphs, strlen(name) + 1,
+        bmbytes, 0);
+    if (!nf)
+        return NULL;
+
+    strcpy(nf->facename, name);
+    memcpy(nf->_fn_info, wf->_fn_info, sizeof(FontInfo));
+    nf->charset = wf->charset;
+    nf->_bmbytes = bmbytes;
+
+    return nf;
+}
+
+/* dfDefaultChar is relative to dfFirstChar, like the glyph index. */
+int
+winfont_glyph_index(WinFont *wf, int ch)
+{
+    FontDirEntry *fd = wf->_fn_info;
+    int g;
+
+    if (ch < fd->dfFirstChar || ch > fd->dfLastChar)
+        g = fd->dfDefaultChar;
+    else
+        g = ch - fd->dfFirstChar;
+
+    return g < wf->nglyphs ? g : 0;
+}
+
+static WinFontCollection *
+winfont_collection_build(const uint8_t *base, size_t len)
+{
+    WinFontCollection *wc;
+    FontDirEntry *fd;
+    int n;
+
+    n = winfont_mem_fnt_offsets(base, len, NULL, 0);
+    if (n == 0)
+        WF_FAIL(WinFont_ErrNoFont, "no FNT resources");
+    if (n < 1)
+        return NULL;
+
+    wc = calloc(1, sizeof(WinFontCollection));
+    if (!wc) {
+        winfont_set_error(WinFont_ErrNoMem);
+        return NULL;
+    }
+    if (pthread_mutex_init(&wc->_lock, NULL)) {
+        free(wc);
+        return NULL;
+    }
+
+    wc->faces = calloc(n, sizeof(WinFont *));
+    wc->points = calloc(n, sizeof(int));
+    wc->weights = calloc(n, sizeof(int));
+    wc->_offsets = calloc(n, sizeof(size_t));
+    if (!wc->faces || !wc->points || !wc->weights || !wc->_offsets) {
+        winfont_set_error(WinFont_ErrNoMem);
+        goto fail;
+    }
+
+    winfont_mem_fnt_offsets(base, len, wc->_offsets, n);
+    wc->_base = base;
+    wc->_len = len;
+
+    for (int i = 0; i < n; i++) {
+        wc->faces[i] = winfont_mem_load_fnt(base, len, wc->_offsets[i],
+            WF_HEADER_ONLY, NULL);
+        if (!wc->faces[i])
+            goto fail;
+        wc->nfaces++;
+        fd = wc->faces[i]->_fn_info;
+        wc->points[i] = fd->dfPoints;
+        wc->weights[i] = fd->dfWeight;
+    }
+
+    return wc;
+
+fail:
+    winfont_collection_free(wc);
+    return NULL;
+}
+
+WinFontCollection *
+winfont_collection_read_memory(const void *buf, size_t len)
+{
+    if (!buf) {
+        winfont_set_error(WinFont_ErrArg);
+        return NULL;
+    }
+
+    return winfont_collection_build(buf, len);
+}
+
+WinFontCollection *
+winfont_collection_open(const char *path)
+{
+    WinFontCollection *wc;
+    void *map;
+    size_t len;
 
+    map = winfont_map_path(path, &len);
+    if (!map)
+        return NULL;
+
+    wc = winfont_collection_build(map, len);
+    if (!wc) {
+        munmap(map, len);
+        return NULL;
+    }
+
+    wc->_map = map;
+    wc->_maplen = len;
+
+    return wc;
+}
+
+WinFont *
+winfont_collection_face(WinFontCollection *wc, int i)
+{
+    WinFont *wf;
+
+    if (!wc || i < 0 || i >= wc->nfaces) {
+        winfont_set_error(WinFont_ErrArg);
+        return NULL;
+    }
+
+    /* Faces are loaded under the lock, so a face asked for by several
+     * threads at once is loaded once. */
+    wf = wc->faces[i];
+    pthread_mutex_lock(&wc->_lock);
+    if (!wf->bitmap && winfont_mem_load_fnt_bitmap(wf, wc->_base,
+            wc->_len, wc->_offsets[i]) == -1)
+        wf = NULL;
+    pthread_mutex_unlock(&wc->_lock);
+
+    return wf;
+}
+
+int
+winfont_collection_find(WinFontCollection *wc, int points, int height,
+    int weight)
+{
+    if (!wc)
+        return -1;
+
+    for (int i = 0; i < wc->nfaces; i++) {
+        if (points && wc->points[i] != points)
+            continue;
+        if (height && wc->faces[i]->height != height)
+            continue;
+        if (weight && wc->weights[i] != weight)
+            continue;
+        return i;
+    }
+
+    return -1;
+}
+
+void
+winfont_collection_free(WinFontCollection *wc)
+{
+    if (!wc)
+        return;
+
+    for (int i = 0; i < wc->nfaces; i++)
+        winfont_free(wc->faces[i]);
+    free(wc->faces);
+    free(wc->points);
+    free(wc->weights);
+    free(wc->_offsets);
+    if (wc->_map)
+        munmap(wc->_map, wc->_maplen);
+    pthread_mutex_destroy(&wc->_lock);
+
+    free(wc);
 }
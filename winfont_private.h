@@ -0,0 +1,228 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 Eddie Hillenbrand
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+/* Library internals shared between the translation units. Not
+ * installed. */
+
+#ifndef WINFONT_PRIVATE_H
+#define WINFONT_PRIVATE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* WinFont _flags */
+#define WF_BORROWED_BITMAP  0x0001 /* bitmap is a view, not malloc'd */
+#define WF_LAZY             0x0002 /* glyphs decoded on first access */
+#define WF_OWNS_BITMAP      0x0004 /* bitmap is a block of its own */
+#define WF_OWNS_FILE        0x0008 /* _map is malloc'd, not mapped */
+
+/* Load flag: decode the bitmap, never refer to the image. */
+#define WF_LOAD_COPY        0x4000
+
+/* Instruction sets the bit kernels in bits.c are specialized for,
+ * in increasing order. */
+enum {
+    WF_ISA_SCALAR = 0,
+    WF_ISA_SSE2,
+    WF_ISA_AVX2,
+};
+
+int
+winfont_cpu_isa(void);
+
+void
+winfont_transpose_bitmap_isa(int isa, uint8_t *dst, const uint8_t *src,
+    int wbytes, int h, int nglyphs);
+
+void
+winfont_transpose_bitmap(uint8_t *dst, const uint8_t *src,
+    int wbytes, int h, int nglyphs);
+
+void
+winfont_expand_bits_isa(int isa, uint8_t *dst, const uint8_t *src,
+    size_t npixels);
+
+/* Expand npixels MSB first bits into one byte per pixel, 0 or 255. */
+void
+winfont_expand_bits(uint8_t *dst, const uint8_t *src, size_t npixels);
+
+void
+winfont_expand_bits32_isa(int isa, uint8_t *dst, const uint8_t *src,
+    size_t npixels, uint32_t fg, uint32_t bg);
+
+/* Expand npixels MSB first bits into native endian 32-bit pixels, fg
+ * for set bits and bg for clear ones. dst need not be aligned. */
+void
+winfont_expand_bits32(uint8_t *dst, const uint8_t *src, size_t npixels,
+    uint32_t fg, uint32_t bg);
+
+void
+winfont_scale_rows_isa(int isa, uint8_t *dst, int dststride,
+    const uint8_t *src, int w, int h, int s);
+
+/* Repeat each pixel of h packed rows of w MSB first bits s times. Row
+ * r of (w * s + 7) / 8 bytes goes to dst + r * dststride. */
+void
+winfont_scale_rows(uint8_t *dst, int dststride, const uint8_t *src,
+    int w, int h, int s);
+
+/* Scale h rows of a w pixel glyph by s into dst, which must hold
+ * (w * s + 7) / 8 * h * s bytes. */
+void
+winfont_scale_glyph(uint8_t *dst, const uint8_t *rows, int w, int h,
+    int s);
+
+size_t
+winfont_ascii_glyphs_isa(int isa, uint16_t *dst, const uint8_t *src,
+    size_t n, int lo, int hi, int first);
+
+/* Store src[i] - first in dst[i] for the leading bytes of src that are
+ * in lo..hi, where 0 <= lo and hi <= 0x7E. Returns how many there are,
+ * at most n. */
+size_t
+winfont_ascii_glyphs(uint16_t *dst, const uint8_t *src, size_t n,
+    int lo, int hi, int first);
+
+void
+winfont_bold_bits_isa(int isa, uint8_t *dst, const uint8_t *src, size_t n);
+
+/* Embolden n bytes of rows that each end in a clear pixel: every set
+ * pixel also sets the one to its right. dst and src must not overlap. */
+void
+winfont_bold_bits(uint8_t *dst, const uint8_t *src, size_t n);
+
+void
+winfont_bold_bytes_isa(int isa, uint8_t *dst, const uint8_t *src, size_t n);
+
+/* Embolden n one byte rows of eight pixels into 2n bytes of nine. */
+void
+winfont_bold_bytes(uint8_t *dst, const uint8_t *src, size_t n);
+
+/* The v3 A and C space, in pixels of wf, which every glyph of a
+ * string has before and after it. Zero for v2 fonts. */
+void
+winfont_spacing(WinFont *wf, int *aspace, int *cspace);
+
+/* Scale the metrics in the header of a copy made by winfont_scale,
+ * so that winfont_get_info describes the copy. */
+void
+winfont_set_scale(WinFont *wf, int factor);
+
+/* Mark the header of a copy made by winfont_derive_style with style,
+ * its widths extra pixels wider. */
+void
+winfont_set_style(WinFont *wf, int style, int extra);
+
+/* w, or the widest of widths if that is wider: the width of a cell
+ * that holds every glyph. */
+int
+winfont_cell_width(const uint16_t *widths, int nglyphs, int w);
+
+/* sizeof the FNT header and v3 fields that _fn_info points to. */
+size_t
+winfont_info_size(void);
+
+/* Allocate a font, with room for nglyphs widths and offsets, a
+ * namelen byte face name, a bmbytes byte bitmap and, if lazy, lazy
+ * glyph state, all in one block from a, or malloc if a is NULL. */
+WinFont *
+winfont_arena_new(const WinFont_Allocator *a, int nglyphs, size_t namelen,
+    size_t bmbytes, int lazy);
+
+/* A font from the same allocator as wf with a copy of its face name
+ * and header and room for a bmbytes byte bitmap. */
+WinFont *
+winfont_new_like(WinFont *wf, size_t bmbytes);
+
+/* Map a whole file read only, or set the error and return NULL. */
+void *
+winfont_map_path(const char *path, size_t *lenp);
+
+/* winfont_read_memory_flags on a malloc'd file image, which the font
+ * takes. It is freed now if the font does not refer to it. */
+WinFont *
+winfont_read_buffer(uint8_t *buf, size_t len, int flags);
+
+/* Load the FNT resource at fntoff of the len byte image at base.
+ * flags are WINFONT_LAZY and WF_LOAD_COPY, a NULL a is malloc. */
+WinFont *
+winfont_mem_load_fnt(const uint8_t *base, size_t len, size_t fntoff,
+    int flags, const WinFont_Allocator *a);
+
+/* The end of the FNT resource at off that loading it reads, or of the
+ * part winfont_scan_memory reads if header_only. Returns at least
+ * off + the header size while the header is not in base, and uses
+ * dfSize while the char table is not. */
+size_t
+winfont_mem_fnt_extent(const uint8_t *base, size_t len, size_t off,
+    int header_only);
+
+/* How many bytes from the start of a FON image loading its first face
+ * reads, or scanning all its headers if header_only, judged from the
+ * len bytes of it in base. More of the file may show it needs more.
+ * Returns 0 until the resource table is all in base, and SIZE_MAX if
+ * the whole file is wanted. */
+#define WF_EXTENT_MAX_FACES 16
+
+size_t
+winfont_mem_extent(const uint8_t *base, size_t len, int header_only);
+
+/* Bulk file reads, see bulk.c. fn gets each file's malloc'd image, or
+ * NULL and why not, on whichever thread read it. */
+enum {
+    WF_IO_AUTO = 0,
+    WF_IO_PREAD,
+    WF_IO_URING,
+};
+
+typedef void (*winfont_bulk_fn)(void *ctx, int i, uint8_t *buf,
+    size_t len, WinFont_Error err);
+
+/* Read what winfont_mem_extent asks for of each of npaths files on
+ * nthreads threads, or one per CPU, with backend. Returns the backend
+ * used, WF_IO_PREAD if io_uring was asked for but is not available. */
+int
+winfont_bulk_read(char *const *paths, int npaths, int header_only,
+    int backend, int nthreads, winfont_bulk_fn fn, void *ctx);
+
+/* Drop a shared font's references to its store, see store.c. */
+void
+winfont_store_release(WinFont *wf);
+
+/* The copy of wf made by winfont_cache_scale for factor, or NULL. */
+WinFont *
+winfont_cached_scale(WinFont *wf, int factor);
+
+/* Diagnostics, see error.c. WF_LOG costs one load when the level is
+ * not wanted, and nothing when built with -DWINFONT_NO_LOG. WF_FAIL
+ * also sets the thread's last error. */
+extern int winfont_log_level;
+
+void
+winfont_log(int level, const char *fmt, ...)
+    __attribute__((format(printf, 2, 3)));
+
+void
+winfont_set_error(WinFont_Error err);
+
+#ifdef WINFONT_NO_LOG
+#define WF_LOG(level, ...) ((void)0)
+#else
+#define WF_LOG(level, ...) do { \
+        if ((level) <= __atomic_load_n(&winfont_log_level, \
+                __ATOMIC_ACQUIRE)) \
+            winfont_log((level), __VA_ARGS__); \
+    } while (0)
+#endif
+
+#define WF_FAIL(err, ...) do { \
+        winfont_set_error(err); \
+        WF_LOG(WinFont_LogError, __VA_ARGS__); \
+    } while (0)
+
+#endif /* WINFONT_PRIVATE_H */
@@ -31,6 +31,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
 #define UTF8_BIT_OFF " "
@@ -45,50 +46,140 @@ char char_on[5]  = UTF8_BIT_ON;
 static void
 usage()
 {
-    (void)fprintf(stderr, "usage: %s [-c char] [-s] fontpath ...\n",
+    (void)fprintf(stderr,
+        "usage: %s [-c char] [-s] [-j threads] fontpath ...\n",
         getprogname());
 }
 
 void
 print_ascii_art_glyph(WinFont *wf, int glyph)
 {
-    int w, h, wbytes;
-    uint8_t *bitmap, *gb;
+    const uint8_t *gb;
+    uint8_t *buf;
+    size_t sz;
+    int w, h;
 
-    w = wf->width;
-    h = wf->height;
-    wbytes = wf->wbytes;
-    bitmap = wf->bitmap;
+    sz = winfont_glyph_layout_size(wf, glyph, WinFont_Layout8bpp);
+    if (sz == 0) {
+        fprintf(stderr, "No glyph %d\n", glyph);
+        return;
+    }
+
+    buf = malloc(sz);
+    if (!buf) {
+        fprintf(stderr, "OOM\n");
+        return;
+    }
 
-    /* should use 'w' since there's no reason to print the pad
-     * bits */
-    (void)w;
+    w = wf->widths[glyph];
+    h = wf->height;
 
-    gb = bitmap + (wbytes * h) * glyph;
-    for (int i = 0; i < wbytes * h; i++) {
-        if (i != 0 && i % wbytes == 0)
+    /* One byte per pixel, so no pad bits get printed. */
+    gb = winfont_glyph_get(wf, glyph, WinFont_Layout8bpp, buf, sz);
+    for (int i = 0; gb && i < w * h; i++) {
+        if (i != 0 && i % w == 0)
             fprintf(stderr, "\n");
-        /* TODO: calculate bits to examine based on wBytes and w to
-         * avoid printing pad */
-        for (int b = 7; b >= 0; b--)
-            fprintf(stderr, "%s", ((1 << b) & *gb) ?
-                char_on : char_off);
-        gb++;
+        fprintf(stderr, "%s", gb[i] ? char_on : char_off);
     }
     fprintf(stderr, "\n");
+
+    free(buf);
+}
+
+/* Print the FNT header of wf, one field per line. */
+static void
+print_info(WinFont *wf)
+{
+    WinFont_FontInfo fi;
+
+    if (winfont_get_info(wf, &fi) == -1)
+        return;
+
+    printf("Face: %s\n", wf->facename);
+    printf("Version: 0x%X\n", fi.version);
+    printf("Size: %u\n", fi.size);
+    printf("Copyright: %s\n", fi.copyright);
+    printf("Type: 0x%X\n", fi.type);
+    printf("Points: %d\n", fi.points);
+    printf("VertRes: %d\n", fi.vertres);
+    printf("HorizRes: %d\n", fi.horizres);
+    printf("Ascent: %d\n", fi.ascent);
+    printf("InternalLeading: %d\n", fi.internal_leading);
+    printf("ExternalLeading: %d\n", fi.external_leading);
+    printf("Italic: %d\n", fi.italic);
+    printf("Underline: %d\n", fi.underline);
+    printf("StrikeOut: %d\n", fi.strikeout);
+    printf("Weight: %d\n", fi.weight);
+    printf("CharSet: %d\n", fi.charset);
+    printf("PixWidth: %d\n", fi.pixwidth);
+    printf("PixHeight: %d\n", fi.pixheight);
+    printf("PitchAndFamily: 0x%02X\n", fi.pitchfamily);
+    printf("AvgWidth: %d\n", fi.avgwidth);
+    printf("MaxWidth: %d\n", fi.maxwidth);
+    printf("FirstChar: %d\n", fi.firstchar);
+    printf("LastChar: %d\n", fi.lastchar);
+    printf("DefaultChar: %d\n", fi.defaultchar);
+    printf("BreakChar: %d\n", fi.breakchar);
+    printf("WidthBytes: %d\n", fi.widthbytes);
+    printf("Device: %u\n", fi.device);
+    printf("FaceOffset: %u\n", fi.face);
+    printf("BitsPointer: %u\n", fi.bitspointer);
+    printf("BitsOffset: %u\n", fi.bitsoffset);
+}
+
+/* Print the header of every face of the font files in paths, scanning
+ * directories for .fon files. Nothing is decoded. */
+static int
+print_short_info(char **paths, int npaths, int nthreads)
+{
+    WinFont_Index *idx;
+    struct stat st;
+    char **files;
+    int nfiles = 0, ret = 0;
+
+    files = malloc(npaths * sizeof(char *));
+    if (!files) {
+        fprintf(stderr, "OOM\n");
+        return 1;
+    }
+
+    for (int i = 0; i < npaths; i++) {
+        if (stat(paths[i], &st) == 0 && S_ISDIR(st.st_mode)) {
+            idx = winfont_index_dir(paths[i], nthreads);
+            if (!idx || winfont_index_write(idx, stdout) == -1)
+                ret = 1;
+            winfont_index_free(idx);
+        } else {
+            files[nfiles++] = paths[i];
+        }
+    }
+
+    if (nfiles) {
+        idx = winfont_index_paths(files, nfiles, nthreads);
+        if (!idx || winfont_index_write(idx, stdout) == -1)
+            ret = 1;
+        for (int i = 0; idx && i < idx->nfiles; i++)
+            if (idx->files[i].nfaces < 0)
+                fprintf(stderr, "Unable to read: %s\n",
+                    idx->files[i].path);
+        winfont_index_free(idx);
+    }
+
+    free(files);
+    return ret;
 }
 
 int
 main(int argc, char **argv)
 {
     int ch, cflag = 0, dflag = 0,
-        sflag = 0;
+        sflag = 0, nthreads = 0;
     FILE *font;
     char *path;
     WinFont *wf = NULL;
     int glyph = 0;
 
-    const char *opts = "c:d:s";
+    const char *opts = "c:d:j:s";
     while ((ch = getopt(argc, argv, opts)) != -1) {
         switch (ch) {
         case 'd':
@@ -106,9 +197,15 @@ main(int argc, char **argv)
             break;
         case 's':
             /* Print short information. */
-            /* fprintf(stderr, "-%c not implemented yet\n", ch); */
             sflag = 1;
             break;
+        case 'j':
+            /* Threads to scan with for -s. */
+            if (sscanf(optarg, "%d", &nthreads) == 0) {
+                fprintf(stderr, "expected number got %s\n", optarg);
+                exit(1);
+            }
+            break;
         default:
             usage();
             exit(1);
@@ -123,6 +220,11 @@ main(int argc, char **argv)
         exit(1);
     }
 
+    if (sflag && print_short_info(argv, argc, nthreads))
+        exit(1);
+    if (sflag && !cflag)
+        return 0;
+
     /* the rest of argv are paths */
     for (; *argv != NULL; argv++) {
         path = *argv;
@@ -134,12 +236,13 @@ main(int argc, char **argv)
 
         wf = winfont_read_file(font);
         if (wf == NULL) {
-            fprintf(stderr, "Unable to read: %s\n", path);
+            fprintf(stderr, "Unable to read: %s: %s\n", path,
+                winfont_strerror(winfont_last_error()));
             fclose(font);
             continue;
         }
 
-        /* fprintf(stderr, "WinFont[%s] ptr=%p\n", wf->facename, wf); */
+        print_info(wf);
 
         if (cflag) {
             if (dflag) {
@@ -149,9 +252,6 @@ main(int argc, char **argv)
             print_ascii_art_glyph(wf, glyph);
         }
 
-        if (sflag)
-            (void)sflag;
-
         fclose(font);
         winfont_free(wf);
         wf = NULL;